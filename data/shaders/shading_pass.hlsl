@@ -79,7 +79,9 @@ float3 eval_ibl(float3 cube_dir_ms, float dot_nv, float linear_roughness, float3
 
 ps_output ps_main(vs_output pixel)
 {
-	const float3 n_ts = normalize(g_tex_normal_map.Sample(g_sampler, pixel.uv).xyz * 2.0f - 1.0f); // sample normal from a normal map.
+	// sample normal from a normal map. Only xy are used so that bc5 normal maps work as well.
+	const float2 n_xy = g_tex_normal_map.Sample(g_sampler, pixel.uv).xy * 2.0f - 1.0f;
+	const float3 n_ts = normalize(float3(n_xy, sqrt(saturate(1.0f - dot(n_xy, n_xy)))));
 	const float3 v_ts	= normalize(pixel.v_ts);
 	const float	dot_nv	= saturate(dot(n_ts, v_ts));
 
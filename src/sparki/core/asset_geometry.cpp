@@ -2,7 +2,16 @@
 
 #include <cassert>
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <exception>
 #include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "sparki/core/asset_geometry_tool.h"
+#include "sparki/core/mesh_streams.h"
+#include "sparki/core/parallel.h"
 #include "sparki/core/utility.h"
 #include "fbxsdk.h"
 
@@ -14,6 +23,473 @@ namespace {
 
 using namespace sparki::core;
 
+// .geo v2 layout:
+// - geo_file_header_v2;
+// - vertex_count vertices (vertex_byte_count bytes each);
+// - index_count indices (byte_count(index_fmt) bytes each);
+// - optional chunks till the end of the file. Each chunk starts at c_chunk_alignment boundary
+//   with geo_chunk_header followed by byte_count bytes of data. Unknown chunks are skipped.
+// Compressed files (version c_compressed_version) differ only in the arrays:
+// - geo_file_header_v2, vertex_byte_count is the size of a decoded vertex;
+// - geo_stream_header followed by vertex_chunk_count + index_chunk_count geo_stream_chunk items
+//   and the encoded chunks;
+// - optional chunks till the end of the file.
+// v1 files have no magic. They start with uint64_t vertex count & uint64_t index count followed by
+// the vertices and 32-bit indices. 'SGEO' as a v1 vertex count would require a file larger than 40 GB.
+struct geo_file_header_v2 final {
+	static constexpr char		c_magic[4] = { 'S', 'G', 'E', 'O' };
+	static constexpr uint32_t	c_version = 2;
+	static constexpr uint32_t	c_compressed_version = 3;
+	static constexpr uint64_t	c_chunk_alignment = 4;
+
+	char			magic[4];
+	uint32_t		version;
+	uint64_t		vertex_count;
+	uint64_t		index_count;
+	index_format	index_fmt;
+	uint8_t			reserved[3];
+	uint32_t		vertex_byte_count;
+};
+
+static_assert(sizeof(geo_file_header_v2) == 32, "geo_file_header_v2 layout must not change.");
+
+constexpr char geo_file_header_v2::c_magic[4];
+
+struct geo_chunk_header final {
+	// meshlets chunk, an array of meshlet items.
+	static constexpr char c_meshlets_id[4] = { 'M', 'S', 'H', 'L' };
+	// lods chunk, an array of mesh_lod items.
+	static constexpr char c_lods_id[4] = { 'L', 'O', 'D', 'S' };
+	// mesh_geometry::submeshes
+	static constexpr char c_submeshes_id[4] = { 'S', 'U', 'B', 'M' };
+	// mesh_bounds of the whole mesh followed by mesh_bounds of each submesh.
+	static constexpr char c_bounds_id[4] = { 'B', 'N', 'D', 'S' };
+
+	char		id[4];
+	uint32_t	byte_count;
+};
+
+static_assert(sizeof(geo_chunk_header) == 8, "geo_chunk_header layout must not change.");
+
+constexpr char geo_chunk_header::c_meshlets_id[4];
+constexpr char geo_chunk_header::c_lods_id[4];
+constexpr char geo_chunk_header::c_submeshes_id[4];
+constexpr char geo_chunk_header::c_bounds_id[4];
+
+struct geo_stream_header final {
+	// The byte count of this header, the chunk table & the encoded chunks.
+	uint64_t	byte_count;
+	// position = position_offset + q * position_scale, uv = uv_offset + q * uv_scale,
+	// q is the 16-bit unorm value [0, 65535].
+	float		position_offset[3];
+	float		position_scale[3];
+	float		uv_offset[2];
+	float		uv_scale[2];
+	uint32_t	vertex_chunk_count;
+	uint32_t	index_chunk_count;
+};
+
+static_assert(sizeof(geo_stream_header) == 56, "geo_stream_header layout must not change.");
+
+// A vertex chunk stores c_vertex_stream_count streams of count values one after another, an index chunk one stream.
+// Each value is the zigzag varint of its delta from the previous value of the stream (the first one from 0).
+struct geo_stream_chunk final {
+	// From the beginning of the file.
+	uint64_t	offset;
+	uint32_t	byte_count;
+	// The first vertex/index & the number of vertices/indices.
+	uint32_t	first;
+	uint32_t	count;
+	uint32_t	reserved;
+};
+
+static_assert(sizeof(geo_stream_chunk) == 24, "geo_stream_chunk layout must not change.");
+
+using geo_vertex_t = vertex<vertex_attribs::p_n_uv_ts>;
+
+constexpr uint32_t c_vertex_chunk_size = 16384;
+constexpr uint32_t c_index_chunk_size = 3 * 16384;
+// position xyz, octahedral normal xy, uv, the 4 fields of the packed tangent space.
+constexpr size_t c_vertex_stream_count = 11;
+
+
+inline uint64_t align_up(uint64_t value, uint64_t alignment) noexcept
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// Writes the padding, the chunk header & the data. offset is the current file position.
+// Returns the file position after the chunk.
+uint64_t write_geo_chunk(FILE* p_file, uint64_t offset, const char (&id)[4], const void* p_data, size_t byte_count)
+{
+	assert(p_file);
+
+	const uint8_t padding[geo_file_header_v2::c_chunk_alignment] = {};
+	const uint64_t chunk_offset = align_up(offset, geo_file_header_v2::c_chunk_alignment);
+	std::fwrite(padding, size_t(chunk_offset - offset), 1, p_file);
+
+	geo_chunk_header chunk;
+	std::memcpy(chunk.id, id, sizeof(chunk.id));
+	chunk.byte_count = uint32_t(byte_count);
+	std::fwrite(&chunk, sizeof(geo_chunk_header), 1, p_file);
+	std::fwrite(p_data, byte_count, 1, p_file);
+
+	return chunk_offset + sizeof(geo_chunk_header) + byte_count;
+}
+
+// ----- .geo compression -----
+
+inline uint32_t zigzag(int32_t v) noexcept
+{
+	return (uint32_t(v) << 1) ^ uint32_t(v >> 31);
+}
+
+inline int32_t unzigzag(uint32_t v) noexcept
+{
+	return int32_t(v >> 1) ^ -int32_t(v & 1);
+}
+
+void encode_delta_stream(const uint32_t* p_values, size_t count, std::vector<uint8_t>& out)
+{
+	uint32_t prev = 0;
+	for (size_t i = 0; i < count; ++i) {
+		uint32_t v = zigzag(int32_t(p_values[i] - prev));
+		prev = p_values[i];
+
+		for (; v >= 0x80; v >>= 7)
+			out.push_back(uint8_t(v | 0x80));
+		out.push_back(uint8_t(v));
+	}
+}
+
+// Decodes count values, returns the position after the stream.
+const uint8_t* decode_delta_stream(const uint8_t* p, const uint8_t* p_end, uint32_t* p_values, size_t count)
+{
+	uint32_t prev = 0;
+	for (size_t i = 0; i < count; ++i) {
+		uint32_t v = 0;
+		for (uint32_t shift = 0; ; shift += 7) {
+			ENFORCE(p < p_end && shift < 32, "The stream is truncated or corrupted.");
+			const uint8_t b = *p++;
+			v |= uint32_t(b & 0x7f) << shift;
+			if (b < 0x80) break;
+		}
+
+		prev += uint32_t(unzigzag(v));
+		p_values[i] = prev;
+	}
+
+	return p;
+}
+
+// The quantization parameters of the mesh. inv_scale is 0 for degenerate axes.
+struct geo_quantizer final {
+	float offset[5];
+	float scale[5];
+	float inv_scale[5];
+};
+
+geo_quantizer make_geo_quantizer(span<const geo_vertex_t> vertices) noexcept
+{
+	assert(vertices.size() > 0);
+
+	const geo_vertex_t& v0 = vertices[0];
+	float min_v[5] = { v0.position.x, v0.position.y, v0.position.z, v0.uv.x, v0.uv.y };
+	float max_v[5] = { min_v[0], min_v[1], min_v[2], min_v[3], min_v[4] };
+	for (const geo_vertex_t& v : vertices) {
+		const float a[5] = { v.position.x, v.position.y, v.position.z, v.uv.x, v.uv.y };
+		for (size_t c = 0; c < 5; ++c) {
+			min_v[c] = std::min(min_v[c], a[c]);
+			max_v[c] = std::max(max_v[c], a[c]);
+		}
+	}
+
+	geo_quantizer q;
+	for (size_t c = 0; c < 5; ++c) {
+		const float extent = max_v[c] - min_v[c];
+		q.offset[c] = min_v[c];
+		q.scale[c] = extent / 65535.0f;
+		q.inv_scale[c] = (extent > 0.0f) ? (65535.0f / extent) : 0.0f;
+	}
+
+	return q;
+}
+
+inline uint32_t quantize_unorm16(float v, float offset, float inv_scale) noexcept
+{
+	const float q = (v - offset) * inv_scale + 0.5f;
+	return uint32_t(std::min(65535.0f, std::max(0.0f, q)));
+}
+
+// The quantized value of a position or uv coordinate which is restored by decode_vertex_chunk.
+inline float dequantize_unorm16(uint32_t q, float offset, float scale) noexcept
+{
+	return offset + float(q & 0xffff) * scale;
+}
+
+// Returns a copy of the vertices whose positions are replaced with the ones which are restored
+// from the compressed file. The bounds of compressed files are computed from them.
+aligned_buffer<geo_vertex_t> make_decoded_positions(span<const geo_vertex_t> vertices)
+{
+	const geo_quantizer q = make_geo_quantizer(vertices);
+
+	aligned_buffer<geo_vertex_t> out(vertices.size());
+	parallel_for(vertices.size(), 4096, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			const math::float3& p = vertices[i].position;
+			out[i] = vertices[i];
+			out[i].position = math::float3(
+				dequantize_unorm16(quantize_unorm16(p.x, q.offset[0], q.inv_scale[0]), q.offset[0], q.scale[0]),
+				dequantize_unorm16(quantize_unorm16(p.y, q.offset[1], q.inv_scale[1]), q.offset[1], q.scale[1]),
+				dequantize_unorm16(quantize_unorm16(p.z, q.offset[2], q.inv_scale[2]), q.offset[2], q.scale[2]));
+		}
+	});
+
+	return out;
+}
+
+// p_streams[s * count + i] is the value of stream s of vertex i.
+void encode_vertex_chunk(const geo_vertex_t* p_vertices, size_t count, const geo_quantizer& q,
+	std::vector<uint8_t>& out)
+{
+	std::vector<uint32_t> streams(c_vertex_stream_count * count);
+	for (size_t i = 0; i < count; ++i) {
+		const geo_vertex_t& v = p_vertices[i];
+		int16_t n[2];
+		encode_octahedral(v.normal, n);
+
+		const uint32_t values[c_vertex_stream_count] = {
+			quantize_unorm16(v.position.x, q.offset[0], q.inv_scale[0]),
+			quantize_unorm16(v.position.y, q.offset[1], q.inv_scale[1]),
+			quantize_unorm16(v.position.z, q.offset[2], q.inv_scale[2]),
+			uint32_t(int32_t(n[0])),
+			uint32_t(int32_t(n[1])),
+			quantize_unorm16(v.uv.x, q.offset[3], q.inv_scale[3]),
+			quantize_unorm16(v.uv.y, q.offset[4], q.inv_scale[4]),
+			v.tangent_h & 0x3ff,
+			(v.tangent_h >> 10) & 0x3ff,
+			(v.tangent_h >> 20) & 0x3ff,
+			v.tangent_h >> 30
+		};
+
+		for (size_t s = 0; s < c_vertex_stream_count; ++s)
+			streams[s * count + i] = values[s];
+	}
+
+	for (size_t s = 0; s < c_vertex_stream_count; ++s)
+		encode_delta_stream(streams.data() + s * count, count, out);
+}
+
+void decode_vertex_chunk(const uint8_t* p, const uint8_t* p_end, const geo_stream_header& header,
+	geo_vertex_t* p_vertices, size_t count)
+{
+	std::vector<uint32_t> streams(c_vertex_stream_count * count);
+	for (size_t s = 0; s < c_vertex_stream_count; ++s)
+		p = decode_delta_stream(p, p_end, streams.data() + s * count, count);
+
+	const uint32_t* px = streams.data();
+	const uint32_t* py = px + count;
+	const uint32_t* pz = py + count;
+	const uint32_t* nx = pz + count;
+	const uint32_t* ny = nx + count;
+	const uint32_t* u = ny + count;
+	const uint32_t* v = u + count;
+	const uint32_t* tx = v + count;
+	const uint32_t* ty = tx + count;
+	const uint32_t* tz = ty + count;
+	const uint32_t* tw = tz + count;
+
+	for (size_t i = 0; i < count; ++i) {
+		geo_vertex_t& out = p_vertices[i];
+		out.position = math::float3(
+			dequantize_unorm16(px[i], header.position_offset[0], header.position_scale[0]),
+			dequantize_unorm16(py[i], header.position_offset[1], header.position_scale[1]),
+			dequantize_unorm16(pz[i], header.position_offset[2], header.position_scale[2]));
+		out.normal = decode_octahedral(int16_t(nx[i]), int16_t(ny[i]));
+		out.uv = math::float2(
+			dequantize_unorm16(u[i], header.uv_offset[0], header.uv_scale[0]),
+			dequantize_unorm16(v[i], header.uv_offset[1], header.uv_scale[1]));
+		out.tangent_h = (tx[i] & 0x3ff) | ((ty[i] & 0x3ff) << 10) | ((tz[i] & 0x3ff) << 20) | ((tw[i] & 0x3) << 30);
+	}
+}
+
+// Encodes the vertices & the indices into the compressed block (see geo_stream_header).
+// offset is the file position of the block. The chunks are encoded on the task system's worker threads.
+std::vector<uint8_t> encode_geo_streams(const mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh, uint64_t offset)
+{
+	const size_t vertex_count = mesh.vertices.size();
+	const size_t index_count = mesh.indices.size();
+	const size_t vertex_chunk_count = (vertex_count + c_vertex_chunk_size - 1) / c_vertex_chunk_size;
+	const size_t index_chunk_count = (index_count + c_index_chunk_size - 1) / c_index_chunk_size;
+	const size_t chunk_count = vertex_chunk_count + index_chunk_count;
+
+	const geo_quantizer q = make_geo_quantizer(span<const geo_vertex_t>(mesh.vertices.data(), vertex_count));
+
+	std::vector<std::vector<uint8_t>> chunk_data(chunk_count);
+	std::vector<std::exception_ptr> errors(chunk_count);
+	parallel_for(chunk_count, 1, [&](size_t begin, size_t end) {
+		for (size_t c = begin; c < end; ++c) {
+			try {
+				if (c < vertex_chunk_count) {
+					const size_t first = c * c_vertex_chunk_size;
+					const size_t count = std::min<size_t>(c_vertex_chunk_size, vertex_count - first);
+					encode_vertex_chunk(mesh.vertices.data() + first, count, q, chunk_data[c]);
+				}
+				else {
+					const size_t first = (c - vertex_chunk_count) * c_index_chunk_size;
+					const size_t count = std::min<size_t>(c_index_chunk_size, index_count - first);
+					encode_delta_stream(mesh.indices.data() + first, count, chunk_data[c]);
+				}
+			}
+			catch (...) {
+				errors[c] = std::current_exception();
+			}
+		}
+	});
+
+	for (const std::exception_ptr& e : errors) {
+		if (e) std::rethrow_exception(e);
+	}
+
+	geo_stream_header header = {};
+	header.vertex_chunk_count = uint32_t(vertex_chunk_count);
+	header.index_chunk_count = uint32_t(index_chunk_count);
+	for (size_t c = 0; c < 3; ++c) {
+		header.position_offset[c] = q.offset[c];
+		header.position_scale[c] = q.scale[c];
+	}
+	for (size_t c = 0; c < 2; ++c) {
+		header.uv_offset[c] = q.offset[3 + c];
+		header.uv_scale[c] = q.scale[3 + c];
+	}
+
+	std::vector<geo_stream_chunk> chunks(chunk_count);
+	uint64_t data_offset = offset + sizeof(geo_stream_header) + chunk_count * sizeof(geo_stream_chunk);
+	for (size_t c = 0; c < chunk_count; ++c) {
+		const bool is_vertex_chunk = (c < vertex_chunk_count);
+		const size_t first = is_vertex_chunk ? (c * c_vertex_chunk_size)
+			: ((c - vertex_chunk_count) * c_index_chunk_size);
+		const size_t total = is_vertex_chunk ? vertex_count : index_count;
+		const size_t chunk_size = is_vertex_chunk ? c_vertex_chunk_size : c_index_chunk_size;
+		ENFORCE(chunk_data[c].size() <= std::numeric_limits<uint32_t>::max(), "The chunk ", c, " is too large.");
+
+		chunks[c] = {};
+		chunks[c].offset = data_offset;
+		chunks[c].byte_count = uint32_t(chunk_data[c].size());
+		chunks[c].first = uint32_t(first);
+		chunks[c].count = uint32_t(std::min(chunk_size, total - first));
+		data_offset += chunk_data[c].size();
+	}
+	header.byte_count = data_offset - offset;
+
+	std::vector<uint8_t> out(size_t(header.byte_count));
+	uint8_t* p = out.data();
+	std::memcpy(p, &header, sizeof(geo_stream_header));
+	p += sizeof(geo_stream_header);
+	std::memcpy(p, chunks.data(), chunk_count * sizeof(geo_stream_chunk));
+	p += chunk_count * sizeof(geo_stream_chunk);
+	for (const std::vector<uint8_t>& data : chunk_data) {
+		std::memcpy(p, data.data(), data.size());
+		p += data.size();
+	}
+
+	return out;
+}
+
+// Decodes the compressed block at offset into out_vertices & out_index_data (narrowed to index_fmt).
+// The chunks are decoded on the task system's worker threads. Returns the byte count of the block.
+uint64_t decode_geo_streams(const uint8_t* p_file, uint64_t file_size, uint64_t offset,
+	uint64_t vertex_count, uint64_t index_count, index_format index_fmt,
+	aligned_buffer<geo_vertex_t>& out_vertices, aligned_buffer<uint8_t>& out_index_data)
+{
+	ENFORCE(sizeof(geo_stream_header) <= file_size - offset, "The stream header is truncated.");
+	geo_stream_header header;
+	std::memcpy(&header, p_file + offset, sizeof(geo_stream_header));
+	ENFORCE(header.byte_count <= file_size - offset, "The compressed block size ", header.byte_count,
+		" exceeds the file size.");
+	ENFORCE(header.byte_count >= sizeof(geo_stream_header), "The compressed block size ", header.byte_count,
+		" is smaller than its header.");
+	ENFORCE(index_fmt == index_format::uint32 || vertex_count <= c_max_uint16_vertex_count,
+		"16-bit indices can not address ", vertex_count, " vertices.");
+
+	const uint64_t chunk_count = uint64_t(header.vertex_chunk_count) + header.index_chunk_count;
+	ENFORCE(chunk_count <= (header.byte_count - sizeof(geo_stream_header)) / sizeof(geo_stream_chunk),
+		"The chunk table is truncated.");
+
+	std::vector<geo_stream_chunk> chunks(static_cast<size_t>(chunk_count));
+	std::memcpy(chunks.data(), p_file + offset + sizeof(geo_stream_header), chunks.size() * sizeof(geo_stream_chunk));
+
+	// The chunks have to cover the vertices & the indices in order. Each value takes at least one byte,
+	// so the counts are limited by the file size before anything is allocated.
+	const uint64_t block_end = offset + header.byte_count;
+	uint64_t next_vertex = 0;
+	uint64_t next_index = 0;
+	for (size_t c = 0; c < chunks.size(); ++c) {
+		const geo_stream_chunk& chunk = chunks[c];
+		const bool is_vertex_chunk = (c < header.vertex_chunk_count);
+		uint64_t& next = is_vertex_chunk ? next_vertex : next_index;
+		const uint64_t min_byte_count = uint64_t(chunk.count) * (is_vertex_chunk ? c_vertex_stream_count : 1);
+
+		ENFORCE(chunk.offset >= offset && chunk.offset <= block_end && chunk.byte_count <= block_end - chunk.offset,
+			"The chunk ", c, " is out of the compressed block.");
+		ENFORCE(chunk.first == next && chunk.count > 0 && min_byte_count <= chunk.byte_count,
+			"The chunk ", c, " has invalid range [", chunk.first, ", ", uint64_t(chunk.first) + chunk.count, ").");
+		next += chunk.count;
+	}
+	ENFORCE(next_vertex == vertex_count && next_index == index_count, "The chunks contain ", next_vertex,
+		" vertices & ", next_index, " indices, expected ", vertex_count, " & ", index_count, ".");
+
+	out_vertices.resize(size_t(vertex_count));
+	out_index_data.resize(size_t(index_count * byte_count(index_fmt)));
+
+	std::vector<std::exception_ptr> errors(chunks.size());
+	parallel_for(chunks.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t c = begin; c < end; ++c) {
+			try {
+				const geo_stream_chunk& chunk = chunks[c];
+				const uint8_t* p = p_file + chunk.offset;
+				const uint8_t* p_end = p + chunk.byte_count;
+
+				if (c < header.vertex_chunk_count) {
+					decode_vertex_chunk(p, p_end, header, out_vertices.data() + chunk.first, chunk.count);
+					continue;
+				}
+
+				std::vector<uint32_t> indices(chunk.count);
+				decode_delta_stream(p, p_end, indices.data(), indices.size());
+				for (uint32_t i : indices)
+					ENFORCE(i < vertex_count, "Index ", i, " is out of the vertices.");
+
+				if (index_fmt == index_format::uint32) {
+					std::memcpy(out_index_data.data() + chunk.first * sizeof(uint32_t), indices.data(),
+						byte_count(indices));
+				}
+				else {
+					uint16_t* p_out = reinterpret_cast<uint16_t*>(out_index_data.data()) + chunk.first;
+					std::transform(indices.cbegin(), indices.cend(), p_out, [](uint32_t i) { return uint16_t(i); });
+				}
+			}
+			catch (...) {
+				errors[c] = std::current_exception();
+			}
+		}
+	});
+
+	for (const std::exception_ptr& e : errors) {
+		if (e) std::rethrow_exception(e);
+	}
+
+	return header.byte_count;
+}
+
+// The determinant of the upper 3x3 part, negative for mirroring transforms.
+float determinant_3x3(const math::float4x4& m) noexcept
+{
+	return m.m00 * (m.m11 * m.m22 - m.m12 * m.m21)
+		- m.m01 * (m.m10 * m.m22 - m.m12 * m.m20)
+		+ m.m02 * (m.m10 * m.m21 - m.m11 * m.m20);
+}
+
 template<typename T>
 struct fbx_deleter final {
 	void operator()(T* obj) const
@@ -36,17 +512,6 @@ inline math::float3 make_float3(const FbxVector4& v) noexcept
 	return math::float3(float(v[0]), float(v[1]), float(v[2]));
 }
 
-inline math::float4 make_float4(const FbxVector4& v) noexcept
-{
-	return math::float4(float(v[0]), float(v[1]), float(v[2]), float(v[3]));
-}
-
-inline uint32_t pack_tangent_space_unorm_10_10_10_2(const FbxVector4& v)
-{
-	const math::float4 v_unorm = make_float4(v) * 0.5f + 0.5f;
-	return math::pack_unorm_10_10_10_2(v_unorm);
-}
-
 fbx_ptr<FbxScene> read_fbx_scene(FbxManager* manager, const char* filename)
 {
 	assert(manager);
@@ -65,8 +530,7 @@ fbx_ptr<FbxScene> read_fbx_scene(FbxManager* manager, const char* filename)
 	return scene;
 }
 
-void setup_triangle(FbxMesh* fbx_mesh, int polygon_index, int first_vertex_index,
-	const char* fbx_uv_set_name, FbxLayerElementArrayTemplate<FbxVector4>& ts_direct_array,
+void setup_triangle(FbxMesh* fbx_mesh, int polygon_index, const char* fbx_uv_set_name,
 	vertex<vertex_attribs::p_n_uv_ts>& v0,
 	vertex<vertex_attribs::p_n_uv_ts>& v1,
 	vertex<vertex_attribs::p_n_uv_ts>& v2) noexcept
@@ -96,117 +560,558 @@ void setup_triangle(FbxMesh* fbx_mesh, int polygon_index, int first_vertex_index
 	v1.uv = make_float2(uv1);
 	v2.uv = make_float2(uv2);
 
-	// tangent space
-	v0.tangent_h = pack_tangent_space_unorm_10_10_10_2(ts_direct_array[first_vertex_index]);
-	v1.tangent_h = pack_tangent_space_unorm_10_10_10_2(ts_direct_array[first_vertex_index + 1]);
-	v2.tangent_h = pack_tangent_space_unorm_10_10_10_2(ts_direct_array[first_vertex_index + 2]);
+	// the tangent space is computed by generate_tangents after the extraction.
+	v0.tangent_h = 0;
+	v1.tangent_h = 0;
+	v2.tangent_h = 0;
 }
 
-} // namespace
-
+// An fbx mesh node which is extracted into a scene_mesh. The uv set is looked up before the extraction.
+struct fbx_mesh_source final {
+	FbxNode*				p_node = nullptr;
+	FbxMesh*				p_mesh = nullptr;
+	const char*				p_uv_set_name = nullptr;
+	// The node's material slots -> scene_geometry::materials.
+	std::vector<uint32_t>	material_indices;
+};
 
-namespace sparki {
-namespace core {
+math::float4x4 make_float4x4(const FbxAMatrix& m) noexcept
+{
+	// FbxAMatrix keeps the translation in its 4th row, float4x4 transforms column vectors.
+	math::float4x4 r;
+	r.m00 = float(m.Get(0, 0));	r.m01 = float(m.Get(1, 0));	r.m02 = float(m.Get(2, 0));	r.m03 = float(m.Get(3, 0));
+	r.m10 = float(m.Get(0, 1));	r.m11 = float(m.Get(1, 1));	r.m12 = float(m.Get(2, 1));	r.m13 = float(m.Get(3, 1));
+	r.m20 = float(m.Get(0, 2));	r.m21 = float(m.Get(1, 2));	r.m22 = float(m.Get(2, 2));	r.m23 = float(m.Get(3, 2));
+	r.m30 = float(m.Get(0, 3));	r.m31 = float(m.Get(1, 3));	r.m32 = float(m.Get(2, 3));	r.m33 = float(m.Get(3, 3));
+	return r;
+}
 
-void convert_fbx_to_geo(const char* p_fbx_filename, const char* p_desc_filename)
+// Appends the node & its subtree to scene.nodes in depth-first order, so that parents precede their children.
+void add_fbx_node(FbxNode* p_node, uint32_t parent_index, scene_geometry& scene, std::vector<fbx_mesh_source>& sources)
 {
-	assert(p_fbx_filename);
-	assert(p_desc_filename);
+	assert(p_node);
 
-	try {
-		auto mesh_geometry = load_from_fbx_file(p_fbx_filename);
-		save_to_geo_file(p_desc_filename, mesh_geometry);
+	const uint32_t node_index = uint32_t(scene.nodes.size());
+	scene.nodes.emplace_back();
+	scene.nodes.back().name = p_node->GetName();
+	scene.nodes.back().local_matrix = make_float4x4(p_node->EvaluateLocalTransform());
+	scene.nodes.back().parent_index = parent_index;
+
+	FbxMesh* p_mesh = p_node->GetMesh();
+	if (p_mesh && p_mesh->GetPolygonCount() > 0) {
+		// The geometric transform applies to the node's mesh only, the children do not inherit it.
+		// The mesh is moved into a child node which has the geometric transform as its local one.
+		const FbxAMatrix geometric_matrix(p_node->GetGeometricTranslation(FbxNode::eSourcePivot),
+			p_node->GetGeometricRotation(FbxNode::eSourcePivot), p_node->GetGeometricScaling(FbxNode::eSourcePivot));
+
+		uint32_t mesh_node_index = node_index;
+		if (!geometric_matrix.IsIdentity()) {
+			mesh_node_index = uint32_t(scene.nodes.size());
+			scene.nodes.emplace_back();
+			scene.nodes.back().name = p_node->GetName();
+			scene.nodes.back().local_matrix = make_float4x4(geometric_matrix);
+			scene.nodes.back().parent_index = node_index;
+		}
+
+		scene.nodes[mesh_node_index].mesh_index = uint32_t(sources.size());
+		sources.emplace_back();
+		sources.back().p_node = p_node;
+		sources.back().p_mesh = p_mesh;
 	}
-	catch (...) {
-		std::throw_with_nested(std::runtime_error("Convert .fbx to .geo error."));
+
+	for (int i = 0; i < p_node->GetChildCount(); ++i)
+		add_fbx_node(p_node->GetChild(i), node_index, scene, sources);
+}
+
+// Looks up the uv set & maps the node's materials. Modifies the scene's materials, must not run in parallel.
+void prepare_fbx_mesh(fbx_mesh_source& src, scene_geometry& scene,
+	std::unordered_map<const FbxSurfaceMaterial*, uint32_t>& material_indices)
+{
+	FbxMesh* fbx_mesh = src.p_mesh;
+	ENFORCE(fbx_mesh->IsTriangleMesh(), "Fbx mesh ", src.p_node->GetName(), " must be triangulated.");
+
+	// fbx_uv_set_name
+	FbxLayer* uv_layer_obj = fbx_mesh->GetLayer(0, FbxLayerElement::EType::eUV);
+	ENFORCE(uv_layer_obj, "Mesh ", src.p_node->GetName(), " does not contain uv vertex attribute.");
+	FbxLayerElementUV* uv_layer = uv_layer_obj->GetUVs();
+	assert(uv_layer);
+	src.p_uv_set_name = uv_layer->GetName();
+
+	// a node without materials gets an unnamed one.
+	const int material_count = std::max(1, src.p_node->GetMaterialCount());
+	for (int i = 0; i < material_count; ++i) {
+		const FbxSurfaceMaterial* p_material = (src.p_node->GetMaterialCount() > 0) ? src.p_node->GetMaterial(i) : nullptr;
+		auto res = material_indices.emplace(p_material, uint32_t(scene.materials.size()));
+		if (res.second) scene.materials.push_back(p_material ? p_material->GetName() : "");
+
+		src.material_indices.push_back(res.first->second);
 	}
 }
 
-mesh_geometry<vertex_attribs::p_n_uv_ts> load_from_fbx_file(const char* filename)
+// Unrolls the triangles into 3 vertices each, the triangles are grouped into submeshes by material.
+mesh_geometry<vertex_attribs::p_n_uv_ts> extract_fbx_mesh(const fbx_mesh_source& src)
 {
 	using mesh_geometry_t = mesh_geometry<vertex_attribs::p_n_uv_ts>;
 
-	assert(filename);
-
 	try {
-		fbx_ptr<FbxManager> fbx_manager(FbxManager::Create());
-		fbx_ptr<FbxScene> scene = read_fbx_scene(fbx_manager.get(), filename);
-		assert(scene);
+		FbxMesh* fbx_mesh = src.p_mesh;
+		const int polygon_count = fbx_mesh->GetPolygonCount();
 
-		FbxNode* root = scene->GetRootNode();
-		ENFORCE(root && root->GetChildCount() == 1, "Fbx scene must contain only one object.");
-		FbxMesh* fbx_mesh = root->GetChild(0)->GetMesh();
-		ENFORCE(fbx_mesh && fbx_mesh->IsTriangleMesh(), "Fbx mesh must be triangulated.");
+		// per polygon material slot
+		std::vector<uint32_t> materials(polygon_count, src.material_indices[0]);
+		const FbxGeometryElementMaterial* p_material_element = fbx_mesh->GetElementMaterial();
+		if (p_material_element) {
+			const FbxLayerElement::EMappingMode mode = p_material_element->GetMappingMode();
+			ENFORCE(mode == FbxLayerElement::eAllSame || mode == FbxLayerElement::eByPolygon,
+				"Unsupported material mapping mode ", int(mode));
+
+			const auto& slots = p_material_element->GetIndexArray();
+			for (int pi = 0; pi < polygon_count; ++pi) {
+				const int slot = slots.GetAt((mode == FbxLayerElement::eAllSame) ? 0 : pi);
+				ENFORCE(0 <= slot && size_t(slot) < src.material_indices.size(), "Invalid material slot ", slot);
+				materials[pi] = src.material_indices[slot];
+			}
+		}
 
 		// position stuff
 		FbxVector4* positions = fbx_mesh->GetControlPoints();
 		int* position_indices = fbx_mesh->GetPolygonVertices();
-		// fbx_uv_set_name
-		FbxLayer* uv_layer_obj = fbx_mesh->GetLayer(0, FbxLayerElement::EType::eUV);
-		ENFORCE(uv_layer_obj, "Mesh does not contain uv vertex attribute.");
-		FbxLayerElementUV* uv_layer = uv_layer_obj->GetUVs();
-		assert(uv_layer);
-		const char* fbx_uv_set_name = uv_layer->GetName();
-		// tangent space direct array
-		const bool res_gen_ts = fbx_mesh->GenerateTangentsData(fbx_uv_set_name);
-		assert(res_gen_ts);
-		FbxLayer* ts_layer_obj = fbx_mesh->GetLayer(0, FbxLayerElement::EType::eTangent);
-		assert(ts_layer_obj);
-		FbxLayerElementTangent* ts_layer = uv_layer_obj->GetTangents();
-		assert(ts_layer);
-		assert(ts_layer->GetReferenceMode() == FbxLayerElement::EReferenceMode::eDirect);
-		FbxLayerElementArrayTemplate<FbxVector4>& ts_direct_array = ts_layer->GetDirectArray();
-
-		mesh_geometry_t mesh;
-		mesh.vertices.reserve(fbx_mesh->GetPolygonCount() * 3);
-		mesh.indices.reserve(fbx_mesh->GetPolygonCount() * 3);
-		for (int pi = 0; pi < fbx_mesh->GetPolygonCount(); ++pi) {
+
+		mesh_geometry_t mesh(size_t(polygon_count) * 3, size_t(polygon_count) * 3);
+		for (int pi = 0; pi < polygon_count; ++pi) {
 			assert(fbx_mesh->GetPolygonSize(pi) == 3);
 
 			const int first_vertex_index = pi * 3;
-			mesh_geometry_t::vertex_t v0;
-			mesh_geometry_t::vertex_t v1;
-			mesh_geometry_t::vertex_t v2;
+			mesh_geometry_t::vertex_t& v0 = mesh.vertices[first_vertex_index];
+			mesh_geometry_t::vertex_t& v1 = mesh.vertices[first_vertex_index + 1];
+			mesh_geometry_t::vertex_t& v2 = mesh.vertices[first_vertex_index + 2];
 
 			const int poly_start_index = fbx_mesh->GetPolygonVertexIndex(pi);
 			v0.position = make_float3(positions[position_indices[poly_start_index]]);
 			v1.position = make_float3(positions[position_indices[poly_start_index + 1]]);
 			v2.position = make_float3(positions[position_indices[poly_start_index + 2]]);
 
-			setup_triangle(fbx_mesh, pi, first_vertex_index, fbx_uv_set_name, ts_direct_array, v0, v1, v2);
-			mesh.vertices.push_back(v0);
-			mesh.vertices.push_back(v1);
-			mesh.vertices.push_back(v2);
-			mesh.indices.push_back(first_vertex_index + 0);
-			mesh.indices.push_back(first_vertex_index + 1);
-			mesh.indices.push_back(first_vertex_index + 2);
+			setup_triangle(fbx_mesh, pi, src.p_uv_set_name, v0, v1, v2);
+		}
+
+		// group the triangles by material (counting sort, the order within a group is kept).
+		std::vector<submesh> submeshes;
+		std::vector<uint32_t> offsets;
+		for (uint32_t m : materials) {
+			if (m >= offsets.size()) offsets.resize(m + 1, 0);
+			offsets[m] += 3;
+		}
+		uint32_t first_index = 0;
+		for (uint32_t m = 0; m < uint32_t(offsets.size()); ++m) {
+			if (offsets[m] == 0) continue;
+
+			submeshes.push_back({ first_index, offsets[m], m });
+			offsets[m] = first_index;
+			first_index += submeshes.back().index_count;
+		}
+
+		for (int pi = 0; pi < polygon_count; ++pi) {
+			uint32_t* p_tri = mesh.indices.data() + offsets[materials[pi]];
+			p_tri[0] = uint32_t(pi * 3);
+			p_tri[1] = uint32_t(pi * 3 + 1);
+			p_tri[2] = uint32_t(pi * 3 + 2);
+			offsets[materials[pi]] += 3;
 		}
 
+		mesh.submeshes.resize(submeshes.size());
+		std::copy(submeshes.cbegin(), submeshes.cend(), mesh.submeshes.data());
+		mesh.index_fmt = pick_index_format(mesh.vertices.size());
 		return mesh;
 	}
 	catch (...) {
-		std::string exc_msg = EXCEPTION_MSG("Fbx reading error. ", filename);
+		std::string exc_msg = EXCEPTION_MSG("Mesh extraction error. Node: ", src.p_node->GetName());
 		std::throw_with_nested(std::runtime_error(exc_msg));
 	}
 }
 
+} // namespace
+
+
+namespace sparki {
+namespace core {
+
+// ----- mapped_geo_file -----
+
+mapped_geo_file::mapped_geo_file(const char* p_filename)
+{
+	using fmt_t = vertex_interleaved_format<vertex_attribs::p_n_uv_ts>;
+	static_assert(sizeof(vertex_t) == fmt_t::vertex_byte_count, "vertex_t must be tightly packed.");
+
+	assert(p_filename);
+
+	try {
+		file_ = mapped_file(p_filename);
+
+		const bool is_v2 = (file_.size() >= sizeof(geo_file_header_v2))
+			&& (std::memcmp(file_.data(), geo_file_header_v2::c_magic, sizeof(geo_file_header_v2::c_magic)) == 0);
+		encoding_ = geo_encoding::raw;
+
+		size_t header_bc;
+		uint64_t vertex_count;
+		uint64_t index_count;
+		if (is_v2) {
+			geo_file_header_v2 header;
+			std::memcpy(&header, file_.data(), sizeof(geo_file_header_v2));
+			ENFORCE(header.version == geo_file_header_v2::c_version
+				|| header.version == geo_file_header_v2::c_compressed_version,
+				"Unsupported .geo version ", header.version);
+			ENFORCE(header.vertex_byte_count == sizeof(vertex_t), "Unsupported vertex size ", header.vertex_byte_count);
+			ENFORCE(header.index_fmt == index_format::uint16 || header.index_fmt == index_format::uint32,
+				"Unknown index format ", int(header.index_fmt));
+
+			header_bc = sizeof(geo_file_header_v2);
+			vertex_count = header.vertex_count;
+			index_count = header.index_count;
+			index_fmt_ = header.index_fmt;
+			if (header.version == geo_file_header_v2::c_compressed_version) encoding_ = geo_encoding::compressed;
+		}
+		else {
+			// v1 header: vertex count & index count, the indices are 32-bit.
+			header_bc = 2 * sizeof(uint64_t);
+			ENFORCE(file_.size() >= header_bc, "The file is too small to contain the header.");
+
+			uint64_t counts[2];
+			std::memcpy(counts, file_.data(), header_bc);
+			vertex_count = counts[0];
+			index_count = counts[1];
+			index_fmt_ = index_format::uint32;
+		}
+
+		ENFORCE(vertex_count > 0 && index_count > 0, "The mesh is empty.");
+		ENFORCE(index_count % 3 == 0, "Index count ", index_count, " is not a multiple of 3.");
+
+		const uint64_t index_bc = byte_count(index_fmt_);
+		uint64_t offset = header_bc;
+
+		if (encoding_ == geo_encoding::compressed) {
+			offset += decode_geo_streams(file_.data(), file_.size(), header_bc, vertex_count, index_count, index_fmt_,
+				decoded_vertices_, decoded_index_data_);
+			vertices_ = span<const vertex_t>(decoded_vertices_.data(), decoded_vertices_.size());
+			index_data_ = span<const uint8_t>(decoded_index_data_.data(), decoded_index_data_.size());
+		}
+		else {
+			// compare the counts against the file size before multiplying them, so that they can not overflow.
+			const uint64_t data_bc = uint64_t(file_.size() - header_bc);
+			ENFORCE(vertex_count <= data_bc / sizeof(vertex_t)
+				&& index_count <= data_bc / index_bc
+				&& vertex_count * sizeof(vertex_t) + index_count * index_bc <= data_bc,
+				"The file size ", file_.size(), " is too small for vertex count ", vertex_count,
+				" & index count ", index_count, ".");
+
+			// vertex_t consists of 4-byte fields, both headers are multiples of 8 bytes and the mapping is page-aligned,
+			// so both arrays are properly aligned.
+			const uint8_t* p_vertices = file_.data() + header_bc;
+			const uint8_t* p_indices = p_vertices + size_t(vertex_count) * sizeof(vertex_t);
+			vertices_ = span<const vertex_t>(reinterpret_cast<const vertex_t*>(p_vertices), size_t(vertex_count));
+			index_data_ = span<const uint8_t>(p_indices, size_t(index_count * index_bc));
+
+			offset += vertex_count * sizeof(vertex_t) + index_count * index_bc;
+			ENFORCE(is_v2 || offset == file_.size(), "The file size ", file_.size(), " does not match vertex count ",
+				vertex_count, " & index count ", index_count, ".");
+		}
+
+		bool has_bounds = false;
+		while (offset < file_.size()) {
+			offset = align_up(offset, geo_file_header_v2::c_chunk_alignment);
+			ENFORCE(offset + sizeof(geo_chunk_header) <= file_.size(), "The chunk header at ", offset, " is truncated.");
+
+			geo_chunk_header chunk;
+			std::memcpy(&chunk, file_.data() + offset, sizeof(geo_chunk_header));
+			offset += sizeof(geo_chunk_header);
+			ENFORCE(chunk.byte_count <= file_.size() - offset, "The chunk at ", offset, " is truncated.");
+
+			if (std::memcmp(chunk.id, geo_chunk_header::c_meshlets_id, sizeof(chunk.id)) == 0) {
+				ENFORCE(chunk.byte_count % sizeof(meshlet) == 0, "Invalid meshlets chunk size ", chunk.byte_count);
+				meshlets_ = span<const meshlet>(reinterpret_cast<const meshlet*>(file_.data() + offset),
+					chunk.byte_count / sizeof(meshlet));
+
+				for (const meshlet& m : meshlets_) {
+					ENFORCE(m.index_count % 3 == 0 && m.first_index <= index_count
+						&& m.index_count <= index_count - m.first_index,
+						"Meshlet index range [", m.first_index, ", ", uint64_t(m.first_index) + m.index_count,
+						") is out of the index buffer.");
+				}
+			}
+			else if (std::memcmp(chunk.id, geo_chunk_header::c_lods_id, sizeof(chunk.id)) == 0) {
+				ENFORCE(chunk.byte_count % sizeof(mesh_lod) == 0, "Invalid lods chunk size ", chunk.byte_count);
+				lods_ = span<const mesh_lod>(reinterpret_cast<const mesh_lod*>(file_.data() + offset),
+					chunk.byte_count / sizeof(mesh_lod));
+			}
+			else if (std::memcmp(chunk.id, geo_chunk_header::c_submeshes_id, sizeof(chunk.id)) == 0) {
+				ENFORCE(chunk.byte_count % sizeof(submesh) == 0, "Invalid submeshes chunk size ", chunk.byte_count);
+				submeshes_ = span<const submesh>(reinterpret_cast<const submesh*>(file_.data() + offset),
+					chunk.byte_count / sizeof(submesh));
+
+				for (const submesh& sm : submeshes_) {
+					ENFORCE(sm.index_count % 3 == 0 && sm.first_index <= index_count
+						&& sm.index_count <= index_count - sm.first_index,
+						"Submesh index range [", sm.first_index, ", ", uint64_t(sm.first_index) + sm.index_count,
+						") is out of the index buffer.");
+				}
+			}
+			else if (std::memcmp(chunk.id, geo_chunk_header::c_bounds_id, sizeof(chunk.id)) == 0) {
+				ENFORCE(chunk.byte_count > 0 && chunk.byte_count % sizeof(mesh_bounds) == 0,
+					"Invalid bounds chunk size ", chunk.byte_count);
+				has_bounds = true;
+				std::memcpy(&bounds_, file_.data() + offset, sizeof(mesh_bounds));
+				submesh_bounds_ = span<const mesh_bounds>(
+					reinterpret_cast<const mesh_bounds*>(file_.data() + offset) + 1,
+					chunk.byte_count / sizeof(mesh_bounds) - 1);
+			}
+
+			offset += chunk.byte_count;
+		}
+
+		// the lods chunk may precede the meshlets chunk, validate the lods after all the chunks are read.
+		for (const mesh_lod& l : lods_) {
+			ENFORCE(l.index_count % 3 == 0 && l.first_index <= index_count
+				&& l.index_count <= index_count - l.first_index,
+				"Lod index range [", l.first_index, ", ", uint64_t(l.first_index) + l.index_count,
+				") is out of the index buffer.");
+			ENFORCE(l.first_meshlet <= meshlets_.size() && l.meshlet_count <= meshlets_.size() - l.first_meshlet,
+				"Lod meshlet range [", l.first_meshlet, ", ", uint64_t(l.first_meshlet) + l.meshlet_count,
+				") is out of the meshlets.");
+		}
+		ENFORCE(submeshes_.size() % std::max<size_t>(1, lods_.size()) == 0, "Submesh count ", submeshes_.size(),
+			" is not a multiple of lod count ", lods_.size(), ".");
+		ENFORCE(submesh_bounds_.size() == 0 || submesh_bounds_.size() == submeshes_.size(), "Submesh bounds count ",
+			submesh_bounds_.size(), " does not match submesh count ", submeshes_.size(), ".");
+
+		// files written before the bounds chunk.
+		if (!has_bounds) bounds_ = compute_bounds(vertices_);
+	}
+	catch (...) {
+		file_.dispose();
+		encoding_ = geo_encoding::raw;
+		decoded_vertices_.dispose();
+		decoded_index_data_.dispose();
+		vertices_ = span<const vertex_t>();
+		index_data_ = span<const uint8_t>();
+		meshlets_ = span<const meshlet>();
+		lods_ = span<const mesh_lod>();
+		submeshes_ = span<const submesh>();
+		bounds_ = {};
+		submesh_bounds_ = span<const mesh_bounds>();
+
+		std::string exc_msg = EXCEPTION_MSG("Map geometry file error. File: ", p_filename);
+		std::throw_with_nested(std::runtime_error(exc_msg));
+	}
+}
+
+mapped_geo_file::mapped_geo_file(mapped_geo_file&& f) noexcept
+{
+	*this = std::move(f);
+}
+
+mapped_geo_file& mapped_geo_file::operator=(mapped_geo_file&& f) noexcept
+{
+	if (this == &f) return *this;
+
+	file_ = std::move(f.file_);
+	encoding_ = f.encoding_;
+	decoded_vertices_ = std::move(f.decoded_vertices_);
+	decoded_index_data_ = std::move(f.decoded_index_data_);
+	vertices_ = f.vertices_;
+	index_data_ = f.index_data_;
+	index_fmt_ = f.index_fmt_;
+	meshlets_ = f.meshlets_;
+	lods_ = f.lods_;
+	submeshes_ = f.submeshes_;
+	bounds_ = f.bounds_;
+	submesh_bounds_ = f.submesh_bounds_;
+	f.encoding_ = geo_encoding::raw;
+	f.vertices_ = span<const vertex_t>();
+	f.index_data_ = span<const uint8_t>();
+	f.meshlets_ = span<const meshlet>();
+	f.lods_ = span<const mesh_lod>();
+	f.submeshes_ = span<const submesh>();
+	f.bounds_ = {};
+	f.submesh_bounds_ = span<const mesh_bounds>();
+	return *this;
+}
+
+// ----- funcs -----
+
+mesh_geometry<vertex_attribs::p_n_uv_ts> load_from_fbx_file(const char* p_filename)
+{
+	return flatten_scene(load_scene_from_fbx_file(p_filename));
+}
+
+scene_geometry load_scene_from_fbx_file(const char* p_filename)
+{
+	assert(p_filename);
+
+	try {
+		fbx_ptr<FbxManager> fbx_manager(FbxManager::Create());
+		fbx_ptr<FbxScene> scene = read_fbx_scene(fbx_manager.get(), p_filename);
+		assert(scene);
+
+		FbxNode* root = scene->GetRootNode();
+		ENFORCE(root, "Fbx scene has no root node.");
+
+		// The hierarchy & the materials are set up by this thread, the workers only read their own meshes
+		// and generate their tangents.
+		scene_geometry out;
+		std::vector<fbx_mesh_source> sources;
+		for (int i = 0; i < root->GetChildCount(); ++i)
+			add_fbx_node(root->GetChild(i), c_scene_no_index, out, sources);
+
+		ENFORCE(sources.size() > 0, "Fbx scene does not contain meshes.");
+
+		std::unordered_map<const FbxSurfaceMaterial*, uint32_t> material_indices;
+		for (fbx_mesh_source& src : sources)
+			prepare_fbx_mesh(src, out, material_indices);
+
+		out.meshes.resize(sources.size());
+		std::vector<std::exception_ptr> errors(sources.size());
+		parallel_for(sources.size(), 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				try {
+					out.meshes[i].name = sources[i].p_node->GetName();
+					out.meshes[i].geometry = extract_fbx_mesh(sources[i]);
+					generate_tangents(out.meshes[i].geometry);
+				}
+				catch (...) {
+					errors[i] = std::current_exception();
+				}
+			}
+		});
+
+		for (const std::exception_ptr& e : errors) {
+			if (e) std::rethrow_exception(e);
+		}
+
+		return out;
+	}
+	catch (...) {
+		std::string exc_msg = EXCEPTION_MSG("Fbx reading error. ", p_filename);
+		std::throw_with_nested(std::runtime_error(exc_msg));
+	}
+}
+
+std::vector<math::float4x4> compute_world_matrices(const scene_geometry& scene)
+{
+	std::vector<math::float4x4> matrices(scene.nodes.size());
+
+	for (size_t i = 0; i < scene.nodes.size(); ++i) {
+		const scene_node& node = scene.nodes[i];
+		assert(node.parent_index == c_scene_no_index || node.parent_index < i);
+
+		matrices[i] = (node.parent_index == c_scene_no_index)
+			? node.local_matrix
+			: matrices[node.parent_index] * node.local_matrix;
+	}
+
+	return matrices;
+}
+
+mesh_geometry<vertex_attribs::p_n_uv_ts> flatten_scene(const scene_geometry& scene)
+{
+	using vertex_t = vertex<vertex_attribs::p_n_uv_ts>;
+
+	struct mesh_instance final {
+		uint32_t	node_index;
+		uint32_t	first_vertex;
+	};
+
+	const std::vector<math::float4x4> world_matrices = compute_world_matrices(scene);
+
+	std::vector<mesh_instance> instances;
+	size_t vertex_count = 0;
+	for (uint32_t i = 0; i < uint32_t(scene.nodes.size()); ++i) {
+		if (scene.nodes[i].mesh_index == c_scene_no_index) continue;
+
+		assert(scene.nodes[i].mesh_index < scene.meshes.size());
+		instances.push_back({ i, uint32_t(vertex_count) });
+		vertex_count += scene.meshes[scene.nodes[i].mesh_index].geometry.vertices.size();
+	}
+
+	ENFORCE(instances.size() > 0, "The scene does not contain meshes.");
+	ENFORCE(vertex_count <= std::numeric_limits<uint32_t>::max(), "The scene has too many vertices ", vertex_count);
+
+	mesh_geometry<vertex_attribs::p_n_uv_ts> out;
+	out.vertices.resize(vertex_count);
+	parallel_for(instances.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			const mesh_instance& inst = instances[i];
+			const math::float4x4& m = world_matrices[inst.node_index];
+			const auto& vertices = scene.meshes[scene.nodes[inst.node_index].mesh_index].geometry.vertices;
+
+			// the transform runs over positions & normals 8-wide, see transform_mesh_streams.
+			mesh_streams streams = make_mesh_streams(span<const vertex_t>(vertices.data(), vertices.size()));
+			transform_mesh_streams(streams, m);
+			store_mesh_streams(streams, span<vertex_t>(out.vertices.data() + inst.first_vertex, vertices.size()));
+		}
+	});
+
+	// lod 0 of each mesh, grouped by material. Mirroring transforms flip the triangles' winding.
+	std::vector<uint32_t> indices;
+	std::vector<submesh> submeshes;
+	for (uint32_t material_index = 0; material_index < uint32_t(std::max<size_t>(1, scene.materials.size()));
+		++material_index) {
+		const uint32_t first_index = uint32_t(indices.size());
+
+		for (const mesh_instance& inst : instances) {
+			const auto& mesh = scene.meshes[scene.nodes[inst.node_index].mesh_index].geometry;
+			const bool flip = determinant_3x3(world_matrices[inst.node_index]) < 0.0f;
+			const uint32_t lod_index_count = (mesh.lods.size() > 0) ? mesh.lods[0].index_count : uint32_t(mesh.indices.size());
+			const std::vector<submesh> ranges = (mesh.submeshes.size() > 0)
+				? std::vector<submesh>(mesh.submeshes.begin(), mesh.submeshes.begin() + submesh_count(mesh))
+				: std::vector<submesh>(1, submesh{ 0, lod_index_count, 0 });
+
+			for (const submesh& sm : ranges) {
+				if (sm.material_index != material_index) continue;
+
+				for (uint32_t i = sm.first_index; i < sm.first_index + sm.index_count; i += 3) {
+					indices.push_back(inst.first_vertex + mesh.indices[i]);
+					indices.push_back(inst.first_vertex + mesh.indices[i + (flip ? 2 : 1)]);
+					indices.push_back(inst.first_vertex + mesh.indices[i + (flip ? 1 : 2)]);
+				}
+			}
+		}
+
+		if (indices.size() > first_index)
+			submeshes.push_back({ first_index, uint32_t(indices.size()) - first_index, material_index });
+	}
+
+	out.indices.resize(indices.size());
+	std::copy(indices.cbegin(), indices.cend(), out.indices.data());
+	out.submeshes.resize(submeshes.size());
+	std::copy(submeshes.cbegin(), submeshes.cend(), out.submeshes.data());
+	out.index_fmt = pick_index_format(out.vertices.size());
+
+	return out;
+}
+
 mesh_geometry<vertex_attribs::p_n_uv_ts> read_from_geo_file(const char* p_filename)
 {
 	assert(p_filename);
 
 	try {
-		std::unique_ptr<FILE, decltype(&std::fclose)> file(std::fopen(p_filename, "rb"), &std::fclose);
-		ENFORCE(file, "Failed to open file ", p_filename);
+		const mapped_geo_file file(p_filename);
+		mesh_geometry<vertex_attribs::p_n_uv_ts> mesh(file.vertices().size(), file.index_count());
+		mesh.index_fmt = file.index_fmt();
+		std::memcpy(mesh.vertices.data(), file.vertices().data(), byte_count(file.vertices()));
 
-		// header
-		uint64_t vertex_count = 0;
-		uint64_t index_count = 0;
-		std::fread(&vertex_count, sizeof(uint64_t), 1, file.get());
-		std::fread(&index_count, sizeof(uint64_t), 1, file.get());
+		if (file.index_fmt() == index_format::uint32) {
+			std::memcpy(mesh.indices.data(), file.index_data().data(), byte_count(file.index_data()));
+		}
+		else {
+			const uint16_t* p_indices = reinterpret_cast<const uint16_t*>(file.index_data().data());
+			std::copy(p_indices, p_indices + mesh.indices.size(), mesh.indices.data());
+		}
 
-		mesh_geometry<vertex_attribs::p_n_uv_ts> mesh(vertex_count, index_count);
-		std::fread(mesh.vertices.data(), byte_count(mesh.vertices), 1, file.get());
-		std::fread(mesh.indices.data(), byte_count(mesh.indices), 1, file.get());
+		mesh.meshlets.resize(file.meshlets().size());
+		std::copy(file.meshlets().begin(), file.meshlets().end(), mesh.meshlets.data());
+		mesh.lods.resize(file.lods().size());
+		std::copy(file.lods().begin(), file.lods().end(), mesh.lods.data());
+		mesh.submeshes.resize(file.submeshes().size());
+		std::copy(file.submeshes().begin(), file.submeshes().end(), mesh.submeshes.data());
 
 		return mesh;
 	}
@@ -216,25 +1121,93 @@ mesh_geometry<vertex_attribs::p_n_uv_ts> read_from_geo_file(const char* p_filena
 	}
 }
 
-void save_to_geo_file(const char* p_filename, const mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh)
+void save_to_geo_file(const char* p_filename, const mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh,
+	geo_encoding encoding)
 {
 	assert(p_filename);
 	assert((mesh.vertices.size() > 0) && (mesh.indices.size() > 0));
 
 	try {
+		ENFORCE(mesh.index_fmt == index_format::uint32 || mesh.vertices.size() <= c_max_uint16_vertex_count,
+			"16-bit indices can not address ", mesh.vertices.size(), " vertices.");
+
 		std::unique_ptr<FILE, decltype(&std::fclose)> file(std::fopen(p_filename, "wb"), &std::fclose);
 		ENFORCE(file, "Failed to create/open the file ", p_filename);
 
 		// header
-		// rex/geometry.h model_geometry_file_header
-		uint64_t vertex_count = uint64_t(mesh.vertices.size());
-		uint64_t index_count = uint64_t(mesh.indices.size());
-		std::fwrite(&vertex_count, sizeof(uint64_t), 1, file.get());
-		std::fwrite(&index_count, sizeof(uint64_t), 1, file.get());
-		// vertices
-		std::fwrite(mesh.vertices.data(), byte_count(mesh.vertices), 1, file.get());
-		// indices
-		std::fwrite(mesh.indices.data(), byte_count(mesh.indices), 1, file.get());
+		geo_file_header_v2 header = {};
+		std::memcpy(header.magic, geo_file_header_v2::c_magic, sizeof(header.magic));
+		header.version				= (encoding == geo_encoding::compressed)
+			? geo_file_header_v2::c_compressed_version : geo_file_header_v2::c_version;
+		header.vertex_count			= uint64_t(mesh.vertices.size());
+		header.index_count			= uint64_t(mesh.indices.size());
+		header.index_fmt			= mesh.index_fmt;
+		header.vertex_byte_count	= uint32_t(sizeof(vertex<vertex_attribs::p_n_uv_ts>));
+		std::fwrite(&header, sizeof(geo_file_header_v2), 1, file.get());
+		uint64_t offset = sizeof(geo_file_header_v2);
+
+		if (encoding == geo_encoding::compressed) {
+			// vertices & indices
+			const std::vector<uint8_t> block = encode_geo_streams(mesh, offset);
+			std::fwrite(block.data(), block.size(), 1, file.get());
+			offset += block.size();
+		}
+		else {
+			// vertices
+			std::fwrite(mesh.vertices.data(), byte_count(mesh.vertices), 1, file.get());
+			// indices
+			if (mesh.index_fmt == index_format::uint32) {
+				std::fwrite(mesh.indices.data(), byte_count(mesh.indices), 1, file.get());
+			}
+			else {
+				std::vector<uint16_t> indices(mesh.indices.size());
+				std::transform(mesh.indices.begin(), mesh.indices.end(), indices.begin(),
+					[](uint32_t i) { return uint16_t(i); });
+				std::fwrite(indices.data(), byte_count(indices), 1, file.get());
+			}
+			offset += byte_count(mesh.vertices) + mesh.indices.size() * byte_count(mesh.index_fmt);
+		}
+
+		// chunks
+		// the bounds & the meshlet cones enclose the positions which are read back,
+		// compressed positions are quantized.
+		aligned_buffer<geo_vertex_t> decoded_vertices;
+		span<const geo_vertex_t> vertices(mesh.vertices.data(), mesh.vertices.size());
+		aligned_buffer<meshlet> decoded_meshlets;
+		span<const meshlet> meshlets(mesh.meshlets.data(), mesh.meshlets.size());
+		if (encoding == geo_encoding::compressed) {
+			decoded_vertices = make_decoded_positions(vertices);
+			vertices = span<const geo_vertex_t>(decoded_vertices.data(), decoded_vertices.size());
+
+			decoded_meshlets.resize(mesh.meshlets.size());
+			std::copy(mesh.meshlets.begin(), mesh.meshlets.end(), decoded_meshlets.data());
+			update_meshlet_bounds(span<meshlet>(decoded_meshlets.data(), decoded_meshlets.size()),
+				span<const uint32_t>(mesh.indices.data(), mesh.indices.size()), vertices);
+			meshlets = span<const meshlet>(decoded_meshlets.data(), decoded_meshlets.size());
+		}
+
+		std::vector<mesh_bounds> bounds;
+		bounds.reserve(1 + mesh.submeshes.size());
+		bounds.push_back(compute_bounds(vertices));
+		for (const submesh& sm : mesh.submeshes) {
+			bounds.push_back(compute_bounds(vertices,
+				span<const uint32_t>(mesh.indices.data() + sm.first_index, sm.index_count)));
+		}
+		offset = write_geo_chunk(file.get(), offset, geo_chunk_header::c_bounds_id,
+			bounds.data(), byte_count(bounds));
+		if (meshlets.size() > 0)
+			offset = write_geo_chunk(file.get(), offset, geo_chunk_header::c_meshlets_id,
+				meshlets.data(), byte_count(meshlets));
+		if (mesh.lods.size() > 0)
+			offset = write_geo_chunk(file.get(), offset, geo_chunk_header::c_lods_id,
+				mesh.lods.data(), byte_count(mesh.lods));
+		if (mesh.submeshes.size() > 0)
+			offset = write_geo_chunk(file.get(), offset, geo_chunk_header::c_submeshes_id,
+				mesh.submeshes.data(), byte_count(mesh.submeshes));
+
+		// fclose flushes the buffered data, it may fail too.
+		ENFORCE(std::ferror(file.get()) == 0, "Failed to write the file ", p_filename);
+		ENFORCE(std::fclose(file.release()) == 0, "Failed to write the file ", p_filename);
 	}
 	catch (...) {
 		std::string exc_msg = EXCEPTION_MSG("Write geometry file error. File: ", p_filename);
@@ -242,6 +1215,75 @@ void save_to_geo_file(const char* p_filename, const mesh_geometry<vertex_attribs
 	}
 }
 
+size_t select_lod(span<const mesh_lod> lods, const math::float4x4& projection_matrix,
+	float distance, float viewport_height, float max_pixel_error) noexcept
+{
+	assert(viewport_height > 0.0f);
+	assert(max_pixel_error > 0.0f);
+	if (lods.size() == 0) return 0;
+
+	// an error of e units at distance d covers e / d * m11 * viewport_height / 2 pixels.
+	const float pixels_per_unit = projection_matrix.m11 * viewport_height * 0.5f / std::max(distance, 1e-6f);
+
+	size_t index = 0;
+	for (size_t i = 1; i < lods.size(); ++i) {
+		if (lods[i].error * pixels_per_unit > max_pixel_error) break;
+		index = i;
+	}
+
+	return index;
+}
+
+frustum make_frustum(const math::float4x4& pvm_matrix) noexcept
+{
+	// Gribb & Hartmann: a clip space point is inside if -w <= x <= w, -w <= y <= w, 0 <= z <= w.
+	const math::float4x4& m = pvm_matrix;
+	const math::float4 r0(m.m00, m.m01, m.m02, m.m03);
+	const math::float4 r1(m.m10, m.m11, m.m12, m.m13);
+	const math::float4 r2(m.m20, m.m21, m.m22, m.m23);
+	const math::float4 r3(m.m30, m.m31, m.m32, m.m33);
+
+	frustum f;
+	f.planes[0] = r3 + r0;	// left
+	f.planes[1] = r3 - r0;	// right
+	f.planes[2] = r3 + r1;	// bottom
+	f.planes[3] = r3 - r1;	// top
+	f.planes[4] = r2;		// near
+	f.planes[5] = r3 - r2;	// far
+
+	for (math::float4& p : f.planes)
+		p = p / math::len(math::xyz(p));
+
+	return f;
+}
+
+bool cull_bounds(const mesh_bounds& b, const frustum& f) noexcept
+{
+	for (const math::float4& p : f.planes) {
+		const math::float3 n = math::xyz(p);
+		if (math::dot(n, b.center) + p.w < -b.radius) return true;
+
+		// the box corner which is the farthest along the plane's normal.
+		const math::float3 corner((n.x >= 0.0f) ? b.max.x : b.min.x, (n.y >= 0.0f) ? b.max.y : b.min.y,
+			(n.z >= 0.0f) ? b.max.z : b.min.z);
+		if (math::dot(n, corner) + p.w < 0.0f) return true;
+	}
+
+	return false;
+}
+
+bool cull_meshlet(const meshlet& m, const frustum& f, const math::float3& camera_position) noexcept
+{
+	for (const math::float4& p : f.planes) {
+		if (math::dot(math::xyz(p), m.center) + p.w < -m.radius) return true;
+	}
+
+	// All the triangles face away if the direction to the camera is outside the normal cone
+	// extended by 90 degrees, the bounding sphere accounts for the triangles' positions.
+	const math::float3 v = m.center - camera_position;
+	return math::dot(v, m.cone_axis) >= m.cone_cutoff * math::len(v) + m.radius;
+}
+
 } // namespace core
 } // namespace sparki
 
@@ -1,21 +1,51 @@
 #pragma once
 
+#include <algorithm>
+#include <limits>
+#include <string>
 #include <vector>
+#include "sparki/core/memory.h"
+#include "sparki/core/platform_file.h"
+#include "sparki/core/utility.h"
 #include "math/math.h"
 
 
 namespace sparki {
 namespace core {
 
+// The width of the values of an index buffer.
+enum class index_format : unsigned char {
+	uint16 = 0,
+	uint32
+};
+
+// Returns the size of one index in bytes.
+inline size_t byte_count(index_format fmt) noexcept
+{
+	return (fmt == index_format::uint16) ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+// The max number of vertices 16-bit indices can address.
+// 0xffff is left unused by 16-bit indices, it is the strip cut value.
+constexpr size_t c_max_uint16_vertex_count = 0xffff;
+
+// Returns the narrowest index format which can address vertex_count vertices.
+inline index_format pick_index_format(size_t vertex_count) noexcept
+{
+	return (vertex_count <= c_max_uint16_vertex_count) ? index_format::uint16 : index_format::uint32;
+}
+
 // All possible combinations of vertex attributes.
 // p - position;
 // n - normal;
 // uv - texture coordinates in the range [0, 1];
 // ts - tangent space (tangnet & handedness);
+// compact - quantized attributes, see vertex<vertex_attribs::p_n_uv_ts_compact>.
 enum class vertex_attribs : unsigned char {
 	p = 0,
 	p_n_uv,
-	p_n_uv_ts
+	p_n_uv_ts,
+	p_n_uv_ts_compact
 };
 
 // Desribes vertex attribs order, byte offset etc. 
@@ -56,6 +86,43 @@ template<> struct vertex_interleaved_format<vertex_attribs::p_n_uv_ts> final {
 		+ tangent_space_byte_count;
 };
 
+template<> struct vertex_interleaved_format<vertex_attribs::p_n_uv_ts_compact> final {
+	static constexpr vertex_attribs attribs = vertex_attribs::p_n_uv_ts_compact;
+	static constexpr size_t	attrib_count = 4;
+
+	// 16-bit unorm xyz + padding (R16G16B16A16_UNORM).
+	static constexpr size_t position_component_count = 4;
+	static constexpr size_t position_byte_count = sizeof(uint16_t) * position_component_count;
+	static constexpr size_t position_byte_offset = 0;
+
+	// Octahedral encoded unit vector, 16-bit snorm (R16G16_SNORM).
+	static constexpr size_t normal_component_count = 2;
+	static constexpr size_t normal_byte_count = sizeof(int16_t) * normal_component_count;
+	static constexpr size_t normal_byte_offset = position_byte_offset + position_byte_count;
+
+	// 16-bit unorm (R16G16_UNORM).
+	static constexpr size_t uv_component_count = 2;
+	static constexpr size_t uv_byte_count = sizeof(uint16_t) * uv_component_count;
+	static constexpr size_t uv_byte_offset = normal_byte_offset + normal_byte_count;
+
+	// The same packed value as p_n_uv_ts (R10G10B10A2_UNORM).
+	static constexpr size_t tangent_space_component_count = 1;
+	static constexpr size_t tangent_space_byte_count = sizeof(uint32_t) * tangent_space_component_count;
+	static constexpr size_t tangent_space_byte_offset = uv_byte_offset + uv_byte_count;
+
+	static constexpr size_t vertex_component_count =
+		position_component_count
+		+ normal_component_count
+		+ uv_component_count
+		+ tangent_space_component_count;
+
+	static constexpr size_t vertex_byte_count =
+		position_byte_count
+		+ normal_byte_count
+		+ uv_byte_count
+		+ tangent_space_byte_count;
+};
+
 // Represents a vertex with the specified set of attributes.
 template<vertex_attribs attribs>
 struct vertex;
@@ -82,6 +149,84 @@ template<> struct vertex<vertex_attribs::p_n_uv_ts> final {
 	uint32_t tangent_h;
 };
 
+// Quantized p_n_uv_ts vertex, 20 bytes instead of 36.
+// Positions are dequantized by the per-mesh transform (see quantized_mesh_geometry),
+// normals are octahedral encoded, uvs are 16-bit unorm.
+template<> struct vertex<vertex_attribs::p_n_uv_ts_compact> final {
+
+	static constexpr vertex_attribs attribs = vertex_attribs::p_n_uv_ts_compact;
+
+
+	uint16_t	position[4];
+	int16_t		normal[2];
+	uint16_t	uv[2];
+	uint32_t	tangent_h;
+};
+
+static_assert(sizeof(vertex<vertex_attribs::p_n_uv_ts_compact>)
+	== vertex_interleaved_format<vertex_attribs::p_n_uv_ts_compact>::vertex_byte_count,
+	"vertex<p_n_uv_ts_compact> must match its interleaved format.");
+
+// Limits of a meshlet, they match the sizes which are recommended for mesh shaders.
+constexpr size_t c_meshlet_max_vertex_count = 64;
+constexpr size_t c_meshlet_max_triangle_count = 124;
+
+// meshlet is a cluster of spatially close triangles which occupy a contiguous range of the index buffer.
+// The bounds are used to skip whole meshlets which are outside the view frustum or face away from the camera.
+struct meshlet final {
+	uint32_t		first_index;
+	uint32_t		index_count;
+	// bounding sphere
+	math::float3	center;
+	float			radius;
+	// Normal cone: all the triangle normals lie within the cone around cone_axis.
+	// cone_cutoff is the sine of the cone's half-angle, 1 means that the cone can not be used for culling.
+	math::float3	cone_axis;
+	float			cone_cutoff;
+};
+
+static_assert(sizeof(meshlet) == 40, "meshlet is stored in .geo files, its layout must not change.");
+
+// mesh_lod is a level of detail: a contiguous range of the index buffer & its meshlets.
+// All the lods share the vertex buffer, lod 0 is the full resolution mesh.
+struct mesh_lod final {
+	uint32_t	first_index;
+	uint32_t	index_count;
+	uint32_t	first_meshlet;
+	uint32_t	meshlet_count;	// 0 if the meshlets have not been built.
+	// The max deviation from lod 0 surface in the model space units.
+	float		error;
+};
+
+static_assert(sizeof(mesh_lod) == 20, "mesh_lod is stored in .geo files, its layout must not change.");
+
+// submesh is a contiguous range of the index buffer whose triangles share a material.
+struct submesh final {
+	uint32_t	first_index;
+	uint32_t	index_count;
+	uint32_t	material_index;
+};
+
+static_assert(sizeof(submesh) == 12, "submesh is stored in .geo files, its layout must not change.");
+
+// mesh_bounds encloses the positions of a mesh or a submesh. The bounds are stored in .geo files,
+// so that culling & lod selection do not have to read the vertices.
+struct mesh_bounds final {
+	// bounding box
+	math::float3	min;
+	math::float3	max;
+	// bounding sphere
+	math::float3	center;
+	float			radius;
+};
+
+static_assert(sizeof(mesh_bounds) == 40, "mesh_bounds is stored in .geo files, its layout must not change.");
+
+// The view frustum planes. xyz is the plane's unit normal which points inside the frustum, w is the distance.
+struct frustum final {
+	math::float4 planes[6];
+};
+
 //
 template<vertex_attribs attribs>
 struct mesh_geometry final {
@@ -102,21 +247,210 @@ struct mesh_geometry final {
 	}
 
 
-	std::vector<vertex_t> vertices;
-	std::vector<uint32_t> indices;
+	// The constructor leaves vertices & indices uninitialized.
+	aligned_buffer<vertex_t>	vertices;
+	// Indices are always 32-bit in memory, index_fmt is the width
+	// which is used by .geo files & gpu index buffers (see pick_index_format).
+	aligned_buffer<uint32_t>	indices;
+	index_format				index_fmt = index_format::uint32;
+	// Empty unless the meshlets have been built. They refer to the index buffer,
+	// any change of the index order invalidates them.
+	aligned_buffer<meshlet>		meshlets;
+	// Empty unless the lods have been built, the whole index buffer is the only lod then.
+	aligned_buffer<mesh_lod>	lods;
+	// Empty means that each lod is one submesh of material 0. Otherwise each lod has the same number (n)
+	// of submeshes which partition its index range in order: the submeshes of lod l are [l * n, (l + 1) * n).
+	aligned_buffer<submesh>		submeshes;
 };
 
+// Returns the number of submeshes per lod, see mesh_geometry::submeshes.
+template<vertex_attribs attribs>
+inline size_t submesh_count(const mesh_geometry<attribs>& mesh) noexcept
+{
+	return mesh.submeshes.size() / std::max<size_t>(1, mesh.lods.size());
+}
+
+// The value of scene_node's indices which refer to nothing.
+constexpr uint32_t c_scene_no_index = std::numeric_limits<uint32_t>::max();
+
+// scene_node places a mesh (if any) into the scene's hierarchy.
+struct scene_node final {
+	std::string		name;
+	// The transform relative to the parent node (the scene's space for the roots).
+	math::float4x4	local_matrix = math::float4x4::identity;
+	// A parent always precedes its children in scene_geometry::nodes.
+	uint32_t		parent_index = c_scene_no_index;
+	uint32_t		mesh_index = c_scene_no_index;
+};
 
-void convert_fbx_to_geo(const char* p_fbx_filename, const char* p_desc_filename);
+struct scene_mesh final {
+	std::string									name;
+	// Submesh material indices refer to scene_geometry::materials.
+	mesh_geometry<vertex_attribs::p_n_uv_ts>	geometry;
+};
 
-// Reads mesh geometry from the specified .fbx file.
+// scene_geometry is a hierarchy of nodes which reference meshes,
+// the meshes keep their own (model space) vertices & triangles grouped into per material submeshes.
+struct scene_geometry final {
+	std::vector<scene_node>		nodes;
+	std::vector<scene_mesh>		meshes;
+	// Material names in the order of their first reference.
+	std::vector<std::string>	materials;
+};
+
+// The way .geo files store vertices & indices.
+enum class geo_encoding : unsigned char {
+	// The arrays are stored as they are in memory, mapped_geo_file refers to the file's data.
+	raw,
+	// Quantized vertex streams & delta coded indices in independently decodable chunks.
+	// Positions & uvs are quantized to 16 bits within their bounds, normals are octahedral snorm16,
+	// tangent spaces are stored losslessly.
+	compressed
+};
+
+// mapped_geo_file maps a .geo file into memory and exposes its vertices, indices & meshlets without copying.
+// The header & chunk table are validated by the constructor, all the arrays must lie within the file.
+// Index values of raw files are not checked, the file is expected to be produced by save_to_geo_file.
+// Compressed files are decoded by the constructor, the chunks are decoded on the task system's worker threads.
+// The spans stay valid until the object is destroyed.
+class mapped_geo_file final {
+public:
+
+	using vertex_t = vertex<vertex_attribs::p_n_uv_ts>;
+
+
+	mapped_geo_file() noexcept = default;
+
+	explicit mapped_geo_file(const char* p_filename);
+
+	mapped_geo_file(mapped_geo_file&& f) noexcept;
+	mapped_geo_file& operator=(mapped_geo_file&& f) noexcept;
+
+
+	geo_encoding encoding() const noexcept
+	{
+		return encoding_;
+	}
+
+	span<const vertex_t> vertices() const noexcept
+	{
+		return vertices_;
+	}
+
+	index_format index_fmt() const noexcept
+	{
+		return index_fmt_;
+	}
+
+	size_t index_count() const noexcept
+	{
+		return index_data_.size() / byte_count(index_fmt_);
+	}
+
+	// index_count() indices, each one is byte_count(index_fmt()) bytes.
+	span<const uint8_t> index_data() const noexcept
+	{
+		return index_data_;
+	}
+
+	// Empty if the file has no meshlets chunk.
+	span<const meshlet> meshlets() const noexcept
+	{
+		return meshlets_;
+	}
+
+	// Empty if the file has no lods chunk.
+	span<const mesh_lod> lods() const noexcept
+	{
+		return lods_;
+	}
+
+	// Empty if the file has no submeshes chunk, see mesh_geometry::submeshes.
+	span<const submesh> submeshes() const noexcept
+	{
+		return submeshes_;
+	}
+
+	// The bounds of all the vertices. Computed from the vertices if the file has no bounds chunk.
+	const mesh_bounds& bounds() const noexcept
+	{
+		return bounds_;
+	}
+
+	// The bounds of each submesh (the same order as submeshes()).
+	// Empty if the file has no bounds chunk or no submeshes chunk.
+	span<const mesh_bounds> submesh_bounds() const noexcept
+	{
+		return submesh_bounds_;
+	}
+
+	// Asks the os to read the mapped pages ahead of the first access.
+	void prefetch() const noexcept
+	{
+		file_.prefetch();
+	}
+
+private:
+
+	mapped_file				file_;
+	geo_encoding			encoding_ = geo_encoding::raw;
+	span<const vertex_t>	vertices_;
+	span<const uint8_t>		index_data_;
+	index_format			index_fmt_ = index_format::uint32;
+	span<const meshlet>		meshlets_;
+	span<const mesh_lod>	lods_;
+	span<const submesh>		submeshes_;
+	mesh_bounds				bounds_ = {};
+	span<const mesh_bounds>	submesh_bounds_;
+	// The decoded arrays of a compressed file, vertices_ & index_data_ refer to them.
+	aligned_buffer<vertex_t>	decoded_vertices_;
+	aligned_buffer<uint8_t>		decoded_index_data_;
+};
+
+
+// Reads all the meshes of the specified .fbx file into one mesh, see flatten_scene.
 mesh_geometry<vertex_attribs::p_n_uv_ts> load_from_fbx_file(const char* p_filename);
 
-// Reads mesh geometry from the specified .geo file.
+// Reads the node hierarchy, the meshes and their materials from the specified .fbx file.
+// Each mesh node gets its own scene_mesh, the triangles are grouped into submeshes by material.
+// The meshes are extracted on the task system's worker threads.
+scene_geometry load_scene_from_fbx_file(const char* p_filename);
+
+// Returns the transforms from the nodes' spaces to the scene's space.
+std::vector<math::float4x4> compute_world_matrices(const scene_geometry& scene);
+
+// Transforms the meshes of all the nodes into the scene's space and concatenates them into one mesh.
+// Triangles are grouped into one submesh per used material in the order of scene.materials.
+// Lods & meshlets of the meshes are dropped. Vertices are transformed on the task system's worker threads.
+mesh_geometry<vertex_attribs::p_n_uv_ts> flatten_scene(const scene_geometry& scene);
+
+// Reads mesh geometry from the specified .geo file. The contents are copied,
+// use mapped_geo_file to access the file without copying.
 mesh_geometry<vertex_attribs::p_n_uv_ts> read_from_geo_file(const char* p_filename);
 
-// Writes mesh geometry in the specified .geo file.
-void save_to_geo_file(const char* p_filename, const mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh);
+// Writes mesh geometry in the specified .geo file. Indices are narrowed to mesh.index_fmt.
+// The bounds of the mesh & its submeshes are computed and stored in the bounds chunk (see compute_bounds).
+// Compressed chunks are encoded on the task system's worker threads.
+void save_to_geo_file(const char* p_filename, const mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh,
+	geo_encoding encoding = geo_encoding::raw);
+
+// Returns the index of the coarsest lod whose error projected onto the screen is at most max_pixel_error.
+// distance is the distance from the camera to the mesh, viewport_height is in pixels.
+// projection_matrix is a perspective matrix, its m11 is the vertical scale (cot(fov / 2)).
+size_t select_lod(span<const mesh_lod> lods, const math::float4x4& projection_matrix,
+	float distance, float viewport_height, float max_pixel_error = 1.0f) noexcept;
+
+// Extracts the view frustum planes from the projection * view * model matrix.
+// The planes are in the model space, the depth range is [0, 1] (directx).
+frustum make_frustum(const math::float4x4& pvm_matrix) noexcept;
+
+// Returns true if the bounds are outside the frustum: the sphere or the box lies behind one of the planes.
+bool cull_bounds(const mesh_bounds& b, const frustum& f) noexcept;
+
+// Returns true if the meshlet can be skipped: its bounding sphere is outside the frustum
+// or all its triangles face away from camera_position (model space).
+// The test is conservative, false does not mean that the meshlet is visible.
+bool cull_meshlet(const meshlet& m, const frustum& f, const math::float3& camera_position) noexcept;
 
 
 } // namespace core
@@ -0,0 +1,1692 @@
+#include "sparki/core/asset_geometry_import.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include "sparki/core/asset_geometry_tool.h"
+#include "sparki/core/parallel.h"
+#include "sparki/core/platform_file.h"
+#include "sparki/core/utility.h"
+
+
+namespace {
+
+using namespace sparki::core;
+using math::float2;
+using math::float3;
+using mesh_geometry_t = mesh_geometry<vertex_attribs::p_n_uv_ts>;
+using vertex_t = vertex<vertex_attribs::p_n_uv_ts>;
+
+// The value of a missing (or not yet resolved) index.
+constexpr uint32_t c_no_index = std::numeric_limits<uint32_t>::max();
+
+// ----- text parsing -----
+
+inline bool is_space(char c) noexcept
+{
+	return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\f') || (c == '\v');
+}
+
+inline bool is_digit(char c) noexcept
+{
+	return ('0' <= c) && (c <= '9');
+}
+
+inline const char* skip_spaces(const char* p, const char* p_end) noexcept
+{
+	while (p < p_end && is_space(*p)) ++p;
+	return p;
+}
+
+// Parses a decimal number: optional sign, digits, optional fraction & exponent.
+// 19 significant digits are taken into account, the value is scaled by an exact power of 10 when possible.
+// The text does not have to be null-terminated. Returns false if there is no number at p.
+bool parse_number(const char*& p, const char* p_end, double& out) noexcept
+{
+	static constexpr double c_powers_of_10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	const char* s = p;
+	bool negative = false;
+	if (s < p_end && (*s == '-' || *s == '+')) {
+		negative = (*s == '-');
+		++s;
+	}
+
+	uint64_t mantissa = 0;
+	int digit_count = 0;
+	int exponent = 0;
+	bool has_digits = false;
+	for (; s < p_end && is_digit(*s); ++s) {
+		has_digits = true;
+		if (digit_count < 19) {
+			mantissa = mantissa * 10 + uint64_t(*s - '0');
+			if (mantissa > 0) ++digit_count;
+		}
+		else {
+			++exponent;
+		}
+	}
+
+	if (s < p_end && *s == '.') {
+		++s;
+		for (; s < p_end && is_digit(*s); ++s) {
+			has_digits = true;
+			if (digit_count < 19) {
+				mantissa = mantissa * 10 + uint64_t(*s - '0');
+				if (mantissa > 0) ++digit_count;
+				--exponent;
+			}
+		}
+	}
+
+	if (!has_digits) return false;
+
+	if (s < p_end && (*s == 'e' || *s == 'E')) {
+		++s;
+		bool negative_exp = false;
+		if (s < p_end && (*s == '-' || *s == '+')) {
+			negative_exp = (*s == '-');
+			++s;
+		}
+		if (s == p_end || !is_digit(*s)) return false;
+
+		int e = 0;
+		for (; s < p_end && is_digit(*s); ++s)
+			e = std::min(e * 10 + (*s - '0'), 100000);
+
+		exponent += negative_exp ? -e : e;
+	}
+
+	double v = double(mantissa);
+	if (mantissa == 0) v = 0.0;
+	else if (0 <= exponent && exponent <= 22) v *= c_powers_of_10[exponent];
+	else if (-22 <= exponent && exponent < 0) v /= c_powers_of_10[-exponent];
+	else v *= std::pow(10.0, double(exponent));
+
+	out = negative ? -v : v;
+	p = s;
+	return true;
+}
+
+// Parses an optionally signed decimal integer which fits into int32_t.
+bool parse_int(const char*& p, const char* p_end, int64_t& out) noexcept
+{
+	const char* s = p;
+	bool negative = false;
+	if (s < p_end && (*s == '-' || *s == '+')) {
+		negative = (*s == '-');
+		++s;
+	}
+	if (s == p_end || !is_digit(*s)) return false;
+
+	int64_t v = 0;
+	for (; s < p_end && is_digit(*s); ++s) {
+		v = v * 10 + (*s - '0');
+		if (v > std::numeric_limits<int32_t>::max()) return false;
+	}
+
+	out = negative ? -v : v;
+	p = s;
+	return true;
+}
+
+// The unit normal of the triangle, an arbitrary one if the triangle is degenerate.
+float3 triangle_normal(const float3& p0, const float3& p1, const float3& p2) noexcept
+{
+	const float3 n = cross(p1 - p0, p2 - p0);
+	const float l = len(n);
+	return (l > 0.0f) ? (n / l) : float3::unit_z;
+}
+
+// ----- obj -----
+
+// The size of the text chunks which are parsed in parallel.
+// Chunks end at line boundaries, so each one is slightly larger.
+constexpr size_t c_obj_chunk_byte_count = size_t(4) << 20;
+
+// Components of obj_corner::index.
+constexpr size_t c_obj_position = 0;
+constexpr size_t c_obj_uv = 1;
+constexpr size_t c_obj_normal = 2;
+
+// The value of a missing uv or normal index.
+constexpr int32_t c_obj_no_index = std::numeric_limits<int32_t>::min();
+
+// A triangle corner: 0-based position, uv & normal indices.
+// Indices of a parsed chunk are relative to the chunk's own attributes if the file uses negative indices,
+// see obj_chunk::relative_components.
+struct obj_corner final {
+	int32_t index[3];
+};
+
+// A change of the object or material which takes effect at the chunk's triangle triangle_offset.
+struct obj_event final {
+	size_t		triangle_offset;
+	bool		is_material;
+	std::string	name;
+};
+
+// The attributes & triangles of a text chunk.
+struct obj_chunk final {
+	const char*					p_begin = nullptr;
+	const char*					p_end = nullptr;
+	// The offset of p_begin within the file, error messages refer to byte offsets.
+	size_t						byte_offset = 0;
+	std::vector<float3>			positions;
+	std::vector<float2>			uvs;
+	std::vector<float3>			normals;
+	// 3 corners per triangle.
+	std::vector<obj_corner>		corners;
+	// 3 * corner + component of each index which is relative to the chunk's attributes.
+	// The count of the attributes of the preceding chunks is added once all the chunks have been parsed.
+	std::vector<size_t>			relative_components;
+	std::vector<obj_event>		events;
+};
+
+// A run of a chunk's triangles which belongs to one mesh & material.
+struct obj_range final {
+	size_t		chunk_index;
+	size_t		first_triangle;
+	size_t		triangle_count;
+	uint32_t	mesh_index;
+	uint32_t	material_index;
+	// The first vertex of the range within its mesh, the triangles are unrolled.
+	size_t		first_vertex;
+};
+
+inline bool is_keyword(const char* p, const char* p_end, const char* p_keyword) noexcept
+{
+	const size_t len = std::strlen(p_keyword);
+	return (size_t(p_end - p) == len) && (std::memcmp(p, p_keyword, len) == 0);
+}
+
+std::string parse_obj_name(const char* p, const char* p_end)
+{
+	while (p_end > p && is_space(p_end[-1])) --p_end;
+	return std::string(p, p_end);
+}
+
+template<size_t count>
+void parse_obj_floats(const char* p, const char* p_end, size_t required_count, float (&out)[count],
+	size_t byte_offset)
+{
+	for (size_t i = 0; i < count; ++i) {
+		p = skip_spaces(p, p_end);
+		double v = 0.0;
+		if (p == p_end && i >= required_count) {
+			out[i] = 0.0f;
+			continue;
+		}
+
+		ENFORCE(parse_number(p, p_end, v) && (p == p_end || is_space(*p)),
+			"Invalid number at byte ", byte_offset);
+		out[i] = float(v);
+	}
+}
+
+// Resolves the 1-based (or negative, relative to the end) obj index into 0-based.
+// Negative indices are resolved against the chunk's attribute count, relative is set then.
+int32_t resolve_obj_index(int64_t index, size_t chunk_count, bool& relative, size_t byte_offset)
+{
+	ENFORCE(index != 0, "Invalid face index 0 at byte ", byte_offset);
+
+	relative = (index < 0);
+	if (index > 0) return int32_t(index - 1);
+
+	const int64_t r = int64_t(chunk_count) + index;
+	ENFORCE(r > std::numeric_limits<int32_t>::min(), "Invalid face index at byte ", byte_offset);
+	return int32_t(r);
+}
+
+// Parses the corners of an 'f' line & appends its triangles (a fan) to the chunk.
+void parse_obj_face(const char* p, const char* p_end, obj_chunk& chunk,
+	std::vector<std::pair<obj_corner, uint8_t>>& polygon, size_t byte_offset)
+{
+	polygon.clear();
+
+	for (p = skip_spaces(p, p_end); p < p_end; p = skip_spaces(p, p_end)) {
+		obj_corner c = { { 0, c_obj_no_index, c_obj_no_index } };
+		uint8_t relative_mask = 0;
+		bool relative = false;
+		int64_t v = 0;
+
+		ENFORCE(parse_int(p, p_end, v), "Invalid face at byte ", byte_offset);
+		c.index[c_obj_position] = resolve_obj_index(v, chunk.positions.size(), relative, byte_offset);
+		relative_mask |= relative ? (1 << c_obj_position) : 0;
+
+		if (p < p_end && *p == '/') {
+			++p;
+			if (p < p_end && *p != '/') {
+				ENFORCE(parse_int(p, p_end, v), "Invalid face at byte ", byte_offset);
+				c.index[c_obj_uv] = resolve_obj_index(v, chunk.uvs.size(), relative, byte_offset);
+				relative_mask |= relative ? (1 << c_obj_uv) : 0;
+			}
+			if (p < p_end && *p == '/') {
+				++p;
+				ENFORCE(parse_int(p, p_end, v), "Invalid face at byte ", byte_offset);
+				c.index[c_obj_normal] = resolve_obj_index(v, chunk.normals.size(), relative, byte_offset);
+				relative_mask |= relative ? (1 << c_obj_normal) : 0;
+			}
+		}
+
+		ENFORCE(p == p_end || is_space(*p), "Invalid face at byte ", byte_offset);
+		polygon.emplace_back(c, relative_mask);
+	}
+
+	ENFORCE(polygon.size() >= 3, "A face must have at least 3 corners. Byte ", byte_offset);
+
+	for (size_t i = 1; i + 1 < polygon.size(); ++i) {
+		for (size_t k : { size_t(0), i, i + 1 }) {
+			const size_t corner_index = chunk.corners.size();
+			for (size_t comp = 0; comp < 3; ++comp) {
+				if (polygon[k].second & (1 << comp)) chunk.relative_components.push_back(3 * corner_index + comp);
+			}
+
+			chunk.corners.push_back(polygon[k].first);
+		}
+	}
+}
+
+// Parses the lines of the chunk. Unknown statements are ignored.
+void parse_obj_chunk(obj_chunk& chunk)
+{
+	std::vector<std::pair<obj_corner, uint8_t>> polygon;
+
+	const char* p = chunk.p_begin;
+	while (p < chunk.p_end) {
+		const char* p_line_end = static_cast<const char*>(std::memchr(p, '\n', size_t(chunk.p_end - p)));
+		if (!p_line_end) p_line_end = chunk.p_end;
+		const size_t byte_offset = chunk.byte_offset + size_t(p - chunk.p_begin);
+
+		const char* p_keyword = skip_spaces(p, p_line_end);
+		const char* p_keyword_end = p_keyword;
+		while (p_keyword_end < p_line_end && !is_space(*p_keyword_end)) ++p_keyword_end;
+		const char* p_args = skip_spaces(p_keyword_end, p_line_end);
+
+		if (is_keyword(p_keyword, p_keyword_end, "v")) {
+			float v[3];
+			parse_obj_floats(p_args, p_line_end, 3, v, byte_offset);
+			chunk.positions.emplace_back(v[0], v[1], v[2]);
+		}
+		else if (is_keyword(p_keyword, p_keyword_end, "vt")) {
+			float v[2];
+			parse_obj_floats(p_args, p_line_end, 1, v, byte_offset);
+			chunk.uvs.emplace_back(v[0], v[1]);
+		}
+		else if (is_keyword(p_keyword, p_keyword_end, "vn")) {
+			float v[3];
+			parse_obj_floats(p_args, p_line_end, 3, v, byte_offset);
+			chunk.normals.emplace_back(v[0], v[1], v[2]);
+		}
+		else if (is_keyword(p_keyword, p_keyword_end, "f")) {
+			parse_obj_face(p_args, p_line_end, chunk, polygon, byte_offset);
+		}
+		else if (is_keyword(p_keyword, p_keyword_end, "o")) {
+			chunk.events.push_back({ chunk.corners.size() / 3, false, parse_obj_name(p_args, p_line_end) });
+		}
+		else if (is_keyword(p_keyword, p_keyword_end, "usemtl")) {
+			chunk.events.push_back({ chunk.corners.size() / 3, true, parse_obj_name(p_args, p_line_end) });
+		}
+
+		p = (p_line_end < chunk.p_end) ? p_line_end + 1 : chunk.p_end;
+	}
+}
+
+// Splits the file into chunks which end at line boundaries.
+std::vector<obj_chunk> make_obj_chunks(const mapped_file& file)
+{
+	const char* p_data = reinterpret_cast<const char*>(file.data());
+	const char* p_data_end = p_data + file.size();
+
+	std::vector<obj_chunk> chunks;
+	for (const char* p = p_data; p < p_data_end;) {
+		const char* p_end = p_data_end;
+		if (size_t(p_data_end - p) > c_obj_chunk_byte_count) {
+			const char* p_newline = static_cast<const char*>(
+				std::memchr(p + c_obj_chunk_byte_count, '\n', size_t(p_data_end - p - c_obj_chunk_byte_count)));
+			if (p_newline) p_end = p_newline + 1;
+		}
+
+		chunks.emplace_back();
+		chunks.back().p_begin = p;
+		chunks.back().p_end = p_end;
+		chunks.back().byte_offset = size_t(p - p_data);
+		p = p_end;
+	}
+
+	return chunks;
+}
+
+// Writes the unrolled vertices of the range into the mesh. Indices are validated against the attribute counts.
+void fill_obj_range(const obj_range& range, const obj_chunk& chunk, const std::vector<float3>& positions,
+	const std::vector<float2>& uvs, const std::vector<float3>& normals, mesh_geometry_t& mesh)
+{
+	const auto in_range = [](int32_t index, size_t count) { return (index >= 0) && (size_t(index) < count); };
+
+	for (size_t t = 0; t < range.triangle_count; ++t) {
+		const obj_corner* p_corners = chunk.corners.data() + 3 * (range.first_triangle + t);
+		vertex_t* p_vertices = mesh.vertices.data() + range.first_vertex + 3 * t;
+
+		bool has_normals = true;
+		for (size_t c = 0; c < 3; ++c) {
+			const obj_corner& corner = p_corners[c];
+			vertex_t& v = p_vertices[c];
+
+			ENFORCE(in_range(corner.index[c_obj_position], positions.size()),
+				"Invalid position index ", corner.index[c_obj_position] + 1);
+			v.position = positions[corner.index[c_obj_position]];
+
+			if (corner.index[c_obj_uv] == c_obj_no_index) {
+				v.uv = float2(0.0f, 0.0f);
+			}
+			else {
+				ENFORCE(in_range(corner.index[c_obj_uv], uvs.size()), "Invalid uv index ", corner.index[c_obj_uv] + 1);
+				v.uv = uvs[corner.index[c_obj_uv]];
+			}
+
+			if (corner.index[c_obj_normal] == c_obj_no_index) {
+				has_normals = false;
+			}
+			else {
+				ENFORCE(in_range(corner.index[c_obj_normal], normals.size()),
+					"Invalid normal index ", corner.index[c_obj_normal] + 1);
+				v.normal = normals[corner.index[c_obj_normal]];
+			}
+
+			// the tangent space is computed by generate_tangents after the extraction.
+			v.tangent_h = 0;
+		}
+
+		if (!has_normals) {
+			const float3 n = triangle_normal(p_vertices[0].position, p_vertices[1].position, p_vertices[2].position);
+			p_vertices[0].normal = p_vertices[1].normal = p_vertices[2].normal = n;
+		}
+
+		uint32_t* p_indices = mesh.indices.data() + range.first_vertex + 3 * t;
+		p_indices[0] = uint32_t(range.first_vertex + 3 * t);
+		p_indices[1] = uint32_t(range.first_vertex + 3 * t + 1);
+		p_indices[2] = uint32_t(range.first_vertex + 3 * t + 2);
+	}
+}
+
+// Concatenates the attribute arrays of the chunks & makes the chunks' relative indices absolute.
+void merge_obj_attributes(std::vector<obj_chunk>& chunks, std::vector<float3>& positions,
+	std::vector<float2>& uvs, std::vector<float3>& normals)
+{
+	struct attribute_counts final {
+		size_t count[3];
+	};
+
+	std::vector<attribute_counts> bases(chunks.size());
+	attribute_counts total = { { 0, 0, 0 } };
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		bases[i] = total;
+		total.count[c_obj_position] += chunks[i].positions.size();
+		total.count[c_obj_uv] += chunks[i].uvs.size();
+		total.count[c_obj_normal] += chunks[i].normals.size();
+	}
+
+	for (size_t count : total.count) {
+		ENFORCE(count <= size_t(std::numeric_limits<int32_t>::max()), "The file has too many attributes ", count);
+	}
+
+	positions.resize(total.count[c_obj_position]);
+	uvs.resize(total.count[c_obj_uv]);
+	normals.resize(total.count[c_obj_normal]);
+
+	parallel_for(chunks.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			obj_chunk& chunk = chunks[i];
+			std::copy(chunk.positions.cbegin(), chunk.positions.cend(), positions.begin() + bases[i].count[c_obj_position]);
+			std::copy(chunk.uvs.cbegin(), chunk.uvs.cend(), uvs.begin() + bases[i].count[c_obj_uv]);
+			std::copy(chunk.normals.cbegin(), chunk.normals.cend(), normals.begin() + bases[i].count[c_obj_normal]);
+
+			for (size_t rc : chunk.relative_components) {
+				int32_t& index = chunk.corners[rc / 3].index[rc % 3];
+				index = int32_t(int64_t(index) + int64_t(bases[i].count[rc % 3]));
+			}
+
+			// the attributes have been copied, keep the memory peak low.
+			chunk.positions = std::vector<float3>();
+			chunk.uvs = std::vector<float2>();
+			chunk.normals = std::vector<float3>();
+		}
+	});
+}
+
+// ----- json -----
+
+enum class json_type : unsigned char {
+	null,
+	boolean,
+	number,
+	string,
+	array,
+	object
+};
+
+// json_value is a node of a parsed json document. Arrays keep their items in values,
+// objects keep their member names in keys and the member values in values (in the document's order).
+struct json_value final {
+
+	// Returns the member or nullptr if the value is not an object or has no such member.
+	const json_value* find(const char* p_key) const noexcept
+	{
+		if (type != json_type::object) return nullptr;
+
+		for (size_t i = 0; i < keys.size(); ++i) {
+			if (keys[i] == p_key) return &values[i];
+		}
+
+		return nullptr;
+	}
+
+
+	json_type				type = json_type::null;
+	bool					boolean = false;
+	double					number = 0.0;
+	std::string				string;
+	std::vector<std::string>	keys;
+	std::vector<json_value>	values;
+};
+
+// json_parser is a recursive descent parser of json text (RFC 8259), the text does not have to be null-terminated.
+class json_parser final {
+public:
+
+	json_parser(const char* p_text, size_t byte_count) noexcept
+		: p_(p_text), p_begin_(p_text), p_end_(p_text + byte_count)
+	{}
+
+
+	json_value parse()
+	{
+		json_value value;
+		parse_value(value, 0);
+		skip_whitespace();
+		ENFORCE(p_ == p_end_, "Unexpected json text at byte ", offset());
+		return value;
+	}
+
+private:
+
+	// The max nesting level of arrays & objects.
+	static constexpr size_t c_max_depth = 256;
+
+
+	size_t offset() const noexcept
+	{
+		return size_t(p_ - p_begin_);
+	}
+
+	void skip_whitespace() noexcept
+	{
+		while (p_ < p_end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) ++p_;
+	}
+
+	void expect(char c)
+	{
+		skip_whitespace();
+		ENFORCE(p_ < p_end_ && *p_ == c, "Expected '", c, "' at byte ", offset());
+		++p_;
+	}
+
+	bool consume(const char* p_literal) noexcept
+	{
+		const size_t len = std::strlen(p_literal);
+		if (size_t(p_end_ - p_) < len || std::memcmp(p_, p_literal, len) != 0) return false;
+
+		p_ += len;
+		return true;
+	}
+
+	uint32_t parse_hex4()
+	{
+		ENFORCE(p_end_ - p_ >= 4, "Invalid json escape at byte ", offset());
+
+		uint32_t v = 0;
+		for (size_t i = 0; i < 4; ++i, ++p_) {
+			const char c = *p_;
+			uint32_t d;
+			if (is_digit(c)) d = uint32_t(c - '0');
+			else if ('a' <= c && c <= 'f') d = uint32_t(c - 'a' + 10);
+			else if ('A' <= c && c <= 'F') d = uint32_t(c - 'A' + 10);
+			else throw std::runtime_error(EXCEPTION_MSG("Invalid json escape at byte ", offset()));
+
+			v = (v << 4) | d;
+		}
+
+		return v;
+	}
+
+	void parse_string(std::string& out)
+	{
+		expect('"');
+		out.clear();
+
+		while (true) {
+			ENFORCE(p_ < p_end_, "Unterminated json string.");
+
+			const char c = *p_++;
+			if (c == '"') break;
+			if (c != '\\') {
+				out.push_back(c);
+				continue;
+			}
+
+			ENFORCE(p_ < p_end_, "Unterminated json string.");
+			const char e = *p_++;
+			switch (e) {
+				case '"': out.push_back('"'); break;
+				case '\\': out.push_back('\\'); break;
+				case '/': out.push_back('/'); break;
+				case 'b': out.push_back('\b'); break;
+				case 'f': out.push_back('\f'); break;
+				case 'n': out.push_back('\n'); break;
+				case 'r': out.push_back('\r'); break;
+				case 't': out.push_back('\t'); break;
+				case 'u': {
+					uint32_t cp = parse_hex4();
+					if (0xd800 <= cp && cp < 0xdc00 && consume("\\u")) {
+						const uint32_t low = parse_hex4();
+						ENFORCE(0xdc00 <= low && low < 0xe000, "Invalid json surrogate pair at byte ", offset());
+						cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+					}
+
+					// utf-8
+					if (cp < 0x80) {
+						out.push_back(char(cp));
+					}
+					else if (cp < 0x800) {
+						out.push_back(char(0xc0 | (cp >> 6)));
+						out.push_back(char(0x80 | (cp & 0x3f)));
+					}
+					else if (cp < 0x10000) {
+						out.push_back(char(0xe0 | (cp >> 12)));
+						out.push_back(char(0x80 | ((cp >> 6) & 0x3f)));
+						out.push_back(char(0x80 | (cp & 0x3f)));
+					}
+					else {
+						out.push_back(char(0xf0 | (cp >> 18)));
+						out.push_back(char(0x80 | ((cp >> 12) & 0x3f)));
+						out.push_back(char(0x80 | ((cp >> 6) & 0x3f)));
+						out.push_back(char(0x80 | (cp & 0x3f)));
+					}
+					break;
+				}
+
+				default: throw std::runtime_error(EXCEPTION_MSG("Invalid json escape at byte ", offset()));
+			}
+		}
+	}
+
+	void parse_value(json_value& out, size_t depth)
+	{
+		ENFORCE(depth < c_max_depth, "The json document is nested too deeply.");
+
+		skip_whitespace();
+		ENFORCE(p_ < p_end_, "Unexpected end of json text.");
+
+		switch (*p_) {
+			case '{': {
+				out.type = json_type::object;
+				++p_;
+				skip_whitespace();
+				if (p_ < p_end_ && *p_ == '}') {
+					++p_;
+					break;
+				}
+
+				do {
+					out.keys.emplace_back();
+					parse_string(out.keys.back());
+					expect(':');
+					out.values.emplace_back();
+					parse_value(out.values.back(), depth + 1);
+					skip_whitespace();
+				} while (p_ < p_end_ && *p_ == ',' && ++p_);
+
+				expect('}');
+				break;
+			}
+
+			case '[': {
+				out.type = json_type::array;
+				++p_;
+				skip_whitespace();
+				if (p_ < p_end_ && *p_ == ']') {
+					++p_;
+					break;
+				}
+
+				do {
+					out.values.emplace_back();
+					parse_value(out.values.back(), depth + 1);
+					skip_whitespace();
+				} while (p_ < p_end_ && *p_ == ',' && ++p_);
+
+				expect(']');
+				break;
+			}
+
+			case '"': {
+				out.type = json_type::string;
+				parse_string(out.string);
+				break;
+			}
+
+			default: {
+				if (consume("true")) {
+					out.type = json_type::boolean;
+					out.boolean = true;
+				}
+				else if (consume("false")) {
+					out.type = json_type::boolean;
+				}
+				else if (consume("null")) {
+					out.type = json_type::null;
+				}
+				else {
+					out.type = json_type::number;
+					ENFORCE(parse_number(p_, p_end_, out.number), "Invalid json value at byte ", offset());
+				}
+				break;
+			}
+		}
+	}
+
+
+	const char*	p_;
+	const char*	p_begin_;
+	const char*	p_end_;
+};
+
+// Returns the member, throws if there is no such member.
+const json_value& json_member(const json_value& obj, const char* p_key)
+{
+	const json_value* p = obj.find(p_key);
+	ENFORCE(p, "Missing gltf property '", p_key, "'.");
+	return *p;
+}
+
+// Returns true if the value is a non-negative integer which fits into uint32_t.
+bool is_json_size(const json_value& v) noexcept
+{
+	return v.type == json_type::number && v.number >= 0.0 && v.number == std::floor(v.number)
+		&& v.number <= double(std::numeric_limits<uint32_t>::max());
+}
+
+// Returns the member which must be a non-negative integer or default_value if there is no such member.
+size_t json_size(const json_value& obj, const char* p_key, size_t default_value)
+{
+	const json_value* p = obj.find(p_key);
+	if (!p) return default_value;
+
+	ENFORCE(is_json_size(*p), "gltf property '", p_key, "' must be a non-negative integer.");
+	return size_t(p->number);
+}
+
+// Returns the element of an index array (e.g. node's children) which must be a non-negative integer.
+size_t json_index(const json_value& v, const char* p_array_key)
+{
+	ENFORCE(is_json_size(v), "gltf '", p_array_key, "' elements must be non-negative integers.");
+	return size_t(v.number);
+}
+
+// Returns the member which must be a non-negative integer, throws if there is no such member.
+size_t json_size(const json_value& obj, const char* p_key)
+{
+	json_member(obj, p_key);
+	return json_size(obj, p_key, 0);
+}
+
+// Returns the array member or an empty array if there is no such member.
+const std::vector<json_value>& json_array(const json_value& obj, const char* p_key)
+{
+	static const std::vector<json_value> c_empty;
+
+	const json_value* p = obj.find(p_key);
+	if (!p) return c_empty;
+
+	ENFORCE(p->type == json_type::array, "gltf property '", p_key, "' must be an array.");
+	return p->values;
+}
+
+std::string json_string(const json_value& obj, const char* p_key)
+{
+	const json_value* p = obj.find(p_key);
+	return (p && p->type == json_type::string) ? p->string : std::string();
+}
+
+// Reads count numbers of the array member, returns false if there is no such member.
+bool json_floats(const json_value& obj, const char* p_key, float* p_out, size_t count)
+{
+	const std::vector<json_value>& arr = json_array(obj, p_key);
+	if (arr.empty()) return false;
+
+	ENFORCE(arr.size() == count, "gltf property '", p_key, "' must have ", count, " items.");
+	for (size_t i = 0; i < count; ++i) {
+		ENFORCE(arr[i].type == json_type::number, "gltf property '", p_key, "' must contain numbers.");
+		p_out[i] = float(arr[i].number);
+	}
+
+	return true;
+}
+
+// ----- gltf -----
+
+constexpr uint32_t c_glb_magic = 0x46546c67;		// 'glTF'
+constexpr uint32_t c_glb_json_chunk = 0x4e4f534a;	// 'JSON'
+constexpr uint32_t c_glb_bin_chunk = 0x004e4942;	// 'BIN\0'
+
+// Component types of gltf accessors.
+constexpr uint32_t c_gltf_byte = 5120;
+constexpr uint32_t c_gltf_unsigned_byte = 5121;
+constexpr uint32_t c_gltf_short = 5122;
+constexpr uint32_t c_gltf_unsigned_short = 5123;
+constexpr uint32_t c_gltf_unsigned_int = 5125;
+constexpr uint32_t c_gltf_float = 5126;
+
+// Primitive modes which are imported.
+constexpr size_t c_gltf_triangles = 4;
+constexpr size_t c_gltf_triangle_strip = 5;
+constexpr size_t c_gltf_triangle_fan = 6;
+
+struct gltf_buffer_view final {
+	const uint8_t*	p_data = nullptr;
+	size_t			byte_count = 0;
+	// 0 means that the elements are tightly packed.
+	size_t			byte_stride = 0;
+};
+
+// gltf_accessor refers to the elements of a buffer view in place.
+struct gltf_accessor final {
+	const uint8_t*	p_data = nullptr;
+	size_t			count = 0;
+	size_t			stride = 0;
+	uint32_t		component_type = 0;
+	size_t			component_count = 0;
+	bool			normalized = false;
+};
+
+// gltf_document keeps the parsed json & the memory of all the buffers.
+struct gltf_document final {
+	std::string							dirname;
+	mapped_file							file;
+	json_value							root;
+	// buffers which are external files
+	std::vector<mapped_file>			buffer_files;
+	// buffers which are data uris
+	std::vector<std::vector<uint8_t>>	decoded_buffers;
+	std::vector<span<const uint8_t>>	buffers;
+	std::vector<gltf_buffer_view>		views;
+};
+
+// A triangle primitive of a mesh which is extracted into a submesh.
+struct gltf_primitive_source final {
+	gltf_accessor	positions;
+	gltf_accessor	normals;	// count == 0 if the primitive has no normals.
+	gltf_accessor	uvs;		// count == 0 if the primitive has no uvs.
+	gltf_accessor	indices;	// count == 0 if the primitive is not indexed.
+	size_t			mode = c_gltf_triangles;
+	uint32_t		material_index = 0;
+};
+
+struct gltf_mesh_source final {
+	std::string							name;
+	std::vector<gltf_primitive_source>	primitives;
+};
+
+inline size_t gltf_component_byte_count(uint32_t component_type)
+{
+	switch (component_type) {
+		case c_gltf_byte:
+		case c_gltf_unsigned_byte:		return 1;
+		case c_gltf_short:
+		case c_gltf_unsigned_short:		return 2;
+		case c_gltf_unsigned_int:
+		case c_gltf_float:				return 4;
+		default: throw std::runtime_error(EXCEPTION_MSG("Unknown gltf component type ", component_type));
+	}
+}
+
+inline size_t gltf_component_count(const std::string& type)
+{
+	if (type == "SCALAR") return 1;
+	if (type == "VEC2") return 2;
+	if (type == "VEC3") return 3;
+	if (type == "VEC4") return 4;
+	throw std::runtime_error(EXCEPTION_MSG("Unsupported gltf accessor type ", type));
+}
+
+// Reads up to count components of the element, normalized integers are converted to [0, 1] or [-1, 1].
+void read_gltf_floats(const gltf_accessor& a, size_t index, float* p_out, size_t count) noexcept
+{
+	assert(index < a.count);
+
+	const uint8_t* p = a.p_data + index * a.stride;
+	for (size_t c = 0; c < count; ++c) {
+		if (c >= a.component_count) {
+			p_out[c] = 0.0f;
+			continue;
+		}
+
+		switch (a.component_type) {
+			case c_gltf_float: {
+				std::memcpy(p_out + c, p + 4 * c, sizeof(float));
+				break;
+			}
+			case c_gltf_unsigned_byte: {
+				const uint8_t v = p[c];
+				p_out[c] = a.normalized ? (v / 255.0f) : float(v);
+				break;
+			}
+			case c_gltf_byte: {
+				const int8_t v = int8_t(p[c]);
+				p_out[c] = a.normalized ? std::max(v / 127.0f, -1.0f) : float(v);
+				break;
+			}
+			case c_gltf_unsigned_short: {
+				uint16_t v;
+				std::memcpy(&v, p + 2 * c, sizeof(v));
+				p_out[c] = a.normalized ? (v / 65535.0f) : float(v);
+				break;
+			}
+			case c_gltf_short: {
+				int16_t v;
+				std::memcpy(&v, p + 2 * c, sizeof(v));
+				p_out[c] = a.normalized ? std::max(v / 32767.0f, -1.0f) : float(v);
+				break;
+			}
+			default: {
+				uint32_t v;
+				std::memcpy(&v, p + 4 * c, sizeof(v));
+				p_out[c] = float(v);
+				break;
+			}
+		}
+	}
+}
+
+uint32_t read_gltf_index(const gltf_accessor& a, size_t index) noexcept
+{
+	assert(index < a.count);
+
+	const uint8_t* p = a.p_data + index * a.stride;
+	switch (a.component_type) {
+		case c_gltf_unsigned_byte: return *p;
+		case c_gltf_unsigned_short: {
+			uint16_t v;
+			std::memcpy(&v, p, sizeof(v));
+			return v;
+		}
+		default: {
+			uint32_t v;
+			std::memcpy(&v, p, sizeof(v));
+			return v;
+		}
+	}
+}
+
+std::vector<uint8_t> decode_base64(const char* p, const char* p_end)
+{
+	std::vector<uint8_t> out;
+	out.reserve(size_t(p_end - p) / 4 * 3);
+
+	uint32_t bits = 0;
+	int bit_count = 0;
+	for (; p < p_end && *p != '='; ++p) {
+		const char c = *p;
+		uint32_t v;
+		if ('A' <= c && c <= 'Z') v = uint32_t(c - 'A');
+		else if ('a' <= c && c <= 'z') v = uint32_t(c - 'a' + 26);
+		else if (is_digit(c)) v = uint32_t(c - '0' + 52);
+		else if (c == '+') v = 62;
+		else if (c == '/') v = 63;
+		else throw std::runtime_error(EXCEPTION_MSG("Invalid base64 character."));
+
+		bits = (bits << 6) | v;
+		bit_count += 6;
+		if (bit_count >= 8) {
+			bit_count -= 8;
+			out.push_back(uint8_t(bits >> bit_count));
+		}
+	}
+
+	return out;
+}
+
+// Decodes %XX sequences of the uri.
+std::string decode_uri(const std::string& uri)
+{
+	const auto hex = [](char c) -> int {
+		if (is_digit(c)) return c - '0';
+		if ('a' <= c && c <= 'f') return c - 'a' + 10;
+		if ('A' <= c && c <= 'F') return c - 'A' + 10;
+		return -1;
+	};
+
+	std::string out;
+	for (size_t i = 0; i < uri.size(); ++i) {
+		if (uri[i] == '%' && i + 2 < uri.size() && hex(uri[i + 1]) >= 0 && hex(uri[i + 2]) >= 0) {
+			out.push_back(char(hex(uri[i + 1]) * 16 + hex(uri[i + 2])));
+			i += 2;
+		}
+		else {
+			out.push_back(uri[i]);
+		}
+	}
+
+	return out;
+}
+
+inline bool is_data_uri(const std::string& uri) noexcept
+{
+	return uri.compare(0, 5, "data:") == 0;
+}
+
+// Maps the file and parses its json. The binary chunk of a .glb file is returned in out_bin.
+void read_gltf_json(gltf_document& doc, const char* p_filename, span<const uint8_t>& out_bin)
+{
+	doc.file = mapped_file(p_filename);
+	doc.file.prefetch();
+
+	const std::string filename(p_filename);
+	const size_t sep = filename.find_last_of("/\\");
+	doc.dirname = (sep == std::string::npos) ? std::string() : filename.substr(0, sep + 1);
+
+	const uint8_t* p_data = doc.file.data();
+	const size_t byte_count = doc.file.size();
+
+	uint32_t magic = 0;
+	if (byte_count >= sizeof(magic)) std::memcpy(&magic, p_data, sizeof(magic));
+
+	if (magic != c_glb_magic) {
+		doc.root = json_parser(reinterpret_cast<const char*>(p_data), byte_count).parse();
+		return;
+	}
+
+	// glb: 12-byte header (magic, version, length) and chunks (length, type, data).
+	uint32_t header[3];
+	ENFORCE(byte_count >= sizeof(header), "The glb file is too small to contain the header.");
+	std::memcpy(header, p_data, sizeof(header));
+	ENFORCE(header[1] == 2, "Unsupported glb version ", header[1]);
+	ENFORCE(header[2] <= byte_count, "The glb length exceeds the file size.");
+
+	span<const uint8_t> json;
+	for (size_t offset = sizeof(header); offset + 8 <= header[2];) {
+		uint32_t chunk[2];
+		std::memcpy(chunk, p_data + offset, sizeof(chunk));
+		offset += sizeof(chunk);
+		ENFORCE(chunk[0] <= header[2] - offset, "A glb chunk exceeds the file size.");
+
+		if (chunk[1] == c_glb_json_chunk && json.empty()) json = span<const uint8_t>(p_data + offset, chunk[0]);
+		else if (chunk[1] == c_glb_bin_chunk && out_bin.empty()) out_bin = span<const uint8_t>(p_data + offset, chunk[0]);
+
+		offset += (size_t(chunk[0]) + 3) & ~size_t(3);
+	}
+
+	ENFORCE(!json.empty(), "The glb file has no json chunk.");
+	doc.root = json_parser(reinterpret_cast<const char*>(json.data()), json.size()).parse();
+}
+
+// Reads the json & sets up the buffers and buffer views.
+gltf_document load_gltf_document(const char* p_filename)
+{
+	gltf_document doc;
+	span<const uint8_t> bin;
+	read_gltf_json(doc, p_filename, bin);
+
+	ENFORCE(doc.root.type == json_type::object, "The gltf json must be an object.");
+	const std::string version = json_string(json_member(doc.root, "asset"), "version");
+	ENFORCE(version.compare(0, 2, "2.") == 0, "Unsupported gltf version ", version);
+
+	const std::vector<json_value>& buffers = json_array(doc.root, "buffers");
+	for (size_t i = 0; i < buffers.size(); ++i) {
+		const size_t byte_count = json_size(buffers[i], "byteLength");
+		const json_value* p_uri = buffers[i].find("uri");
+
+		span<const uint8_t> data;
+		if (!p_uri) {
+			// the glb's binary chunk may be padded.
+			ENFORCE(i == 0 && !bin.empty(), "Buffer ", i, " has no uri.");
+			data = bin;
+		}
+		else if (is_data_uri(p_uri->string)) {
+			const std::string& uri = p_uri->string;
+			const size_t comma = uri.find(',');
+			ENFORCE(comma != std::string::npos && uri.rfind(";base64", comma) != std::string::npos,
+				"Buffer ", i, " data uri must be base64 encoded.");
+
+			doc.decoded_buffers.push_back(decode_base64(uri.data() + comma + 1, uri.data() + uri.size()));
+			data = span<const uint8_t>(doc.decoded_buffers.back().data(), doc.decoded_buffers.back().size());
+		}
+		else {
+			const std::string path = doc.dirname + decode_uri(p_uri->string);
+			doc.buffer_files.emplace_back(path.c_str());
+			data = span<const uint8_t>(doc.buffer_files.back().data(), doc.buffer_files.back().size());
+		}
+
+		ENFORCE(byte_count <= data.size(), "Buffer ", i, " is smaller than its byteLength.");
+		doc.buffers.emplace_back(data.data(), byte_count);
+	}
+
+	const std::vector<json_value>& views = json_array(doc.root, "bufferViews");
+	for (size_t i = 0; i < views.size(); ++i) {
+		const size_t buffer_index = json_size(views[i], "buffer");
+		const size_t byte_offset = json_size(views[i], "byteOffset", 0);
+		const size_t byte_count = json_size(views[i], "byteLength");
+		ENFORCE(buffer_index < doc.buffers.size(), "Buffer view ", i, " refers to an invalid buffer.");
+		ENFORCE(byte_offset <= doc.buffers[buffer_index].size()
+			&& byte_count <= doc.buffers[buffer_index].size() - byte_offset,
+			"Buffer view ", i, " exceeds its buffer.");
+
+		gltf_buffer_view view;
+		view.p_data = doc.buffers[buffer_index].data() + byte_offset;
+		view.byte_count = byte_count;
+		view.byte_stride = json_size(views[i], "byteStride", 0);
+		doc.views.push_back(view);
+	}
+
+	return doc;
+}
+
+// Validates the accessor and returns the view of its elements.
+gltf_accessor make_gltf_accessor(const gltf_document& doc, size_t accessor_index)
+{
+	const std::vector<json_value>& accessors = json_array(doc.root, "accessors");
+	ENFORCE(accessor_index < accessors.size(), "Invalid accessor index ", accessor_index);
+
+	const json_value& a = accessors[accessor_index];
+	ENFORCE(!a.find("sparse"), "Sparse accessors are not supported. Accessor ", accessor_index);
+	const size_t view_index = json_size(a, "bufferView", c_no_index);
+	ENFORCE(view_index < doc.views.size(), "Accessor ", accessor_index, " has no valid buffer view.");
+
+	gltf_accessor out;
+	out.count = json_size(a, "count");
+	out.component_type = uint32_t(json_size(a, "componentType"));
+	out.component_count = gltf_component_count(json_string(a, "type"));
+	const json_value* p_normalized = a.find("normalized");
+	out.normalized = p_normalized && p_normalized->boolean;
+
+	const gltf_buffer_view& view = doc.views[view_index];
+	const size_t byte_offset = json_size(a, "byteOffset", 0);
+	const size_t element_byte_count = gltf_component_byte_count(out.component_type) * out.component_count;
+	out.stride = (view.byte_stride > 0) ? view.byte_stride : element_byte_count;
+	out.p_data = view.p_data + byte_offset;
+
+	ENFORCE(out.count > 0, "Accessor ", accessor_index, " is empty.");
+	ENFORCE(byte_offset <= view.byte_count
+		&& (out.count - 1) <= (view.byte_count - byte_offset) / out.stride
+		&& (out.count - 1) * out.stride + element_byte_count <= view.byte_count - byte_offset,
+		"Accessor ", accessor_index, " exceeds its buffer view.");
+
+	return out;
+}
+
+// Returns the node's local transform: the matrix or translation * rotation * scale.
+math::float4x4 make_gltf_local_matrix(const json_value& node)
+{
+	math::float4x4 r;
+
+	float m[16];
+	if (json_floats(node, "matrix", m, 16)) {
+		// gltf matrices are column-major.
+		r.m00 = m[0];	r.m01 = m[4];	r.m02 = m[8];	r.m03 = m[12];
+		r.m10 = m[1];	r.m11 = m[5];	r.m12 = m[9];	r.m13 = m[13];
+		r.m20 = m[2];	r.m21 = m[6];	r.m22 = m[10];	r.m23 = m[14];
+		r.m30 = m[3];	r.m31 = m[7];	r.m32 = m[11];	r.m33 = m[15];
+		return r;
+	}
+
+	float t[3] = { 0.0f, 0.0f, 0.0f };
+	float q[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	float s[3] = { 1.0f, 1.0f, 1.0f };
+	json_floats(node, "translation", t, 3);
+	json_floats(node, "rotation", q, 4);
+	json_floats(node, "scale", s, 3);
+
+	const float x = q[0], y = q[1], z = q[2], w = q[3];
+	r.m00 = (1.0f - 2.0f * (y * y + z * z)) * s[0];
+	r.m01 = (2.0f * (x * y - z * w)) * s[1];
+	r.m02 = (2.0f * (x * z + y * w)) * s[2];
+	r.m03 = t[0];
+	r.m10 = (2.0f * (x * y + z * w)) * s[0];
+	r.m11 = (1.0f - 2.0f * (x * x + z * z)) * s[1];
+	r.m12 = (2.0f * (y * z - x * w)) * s[2];
+	r.m13 = t[1];
+	r.m20 = (2.0f * (x * z - y * w)) * s[0];
+	r.m21 = (2.0f * (y * z + x * w)) * s[1];
+	r.m22 = (1.0f - 2.0f * (x * x + y * y)) * s[2];
+	r.m23 = t[2];
+	r.m30 = 0.0f;	r.m31 = 0.0f;	r.m32 = 0.0f;	r.m33 = 1.0f;
+	return r;
+}
+
+// Appends the node & its subtree to scene.nodes in depth-first order, so that parents precede their children.
+// Each gltf mesh gets one scene mesh index, its source is appended to sources on the first reference.
+void add_gltf_node(const gltf_document& doc, size_t node_index, uint32_t parent_index, scene_geometry& scene,
+	std::vector<uint32_t>& mesh_indices, std::vector<size_t>& mesh_sources, std::vector<bool>& visited)
+{
+	const std::vector<json_value>& nodes = json_array(doc.root, "nodes");
+	ENFORCE(node_index < nodes.size(), "Invalid node index ", node_index);
+	ENFORCE(!visited[node_index], "Node ", node_index, " is referenced more than once.");
+	visited[node_index] = true;
+
+	const json_value& node = nodes[node_index];
+	const uint32_t index = uint32_t(scene.nodes.size());
+	scene.nodes.emplace_back();
+	scene.nodes.back().name = json_string(node, "name");
+	scene.nodes.back().local_matrix = make_gltf_local_matrix(node);
+	scene.nodes.back().parent_index = parent_index;
+
+	const size_t mesh = json_size(node, "mesh", c_no_index);
+	if (mesh != c_no_index) {
+		ENFORCE(mesh < mesh_indices.size(), "Node ", node_index, " refers to an invalid mesh.");
+		if (mesh_indices[mesh] == c_no_index) {
+			mesh_indices[mesh] = uint32_t(mesh_sources.size());
+			mesh_sources.push_back(mesh);
+		}
+
+		scene.nodes[index].mesh_index = mesh_indices[mesh];
+	}
+
+	for (const json_value& child : json_array(node, "children"))
+		add_gltf_node(doc, json_index(child, "children"), index, scene, mesh_indices, mesh_sources, visited);
+}
+
+// Validates the mesh's triangle primitives & maps their materials. Modifies the scene's materials,
+// must not run in parallel.
+gltf_mesh_source prepare_gltf_mesh(const gltf_document& doc, size_t mesh_index, scene_geometry& scene,
+	std::unordered_map<size_t, uint32_t>& material_indices)
+{
+	const json_value& mesh = json_array(doc.root, "meshes")[mesh_index];
+	const std::vector<json_value>& materials = json_array(doc.root, "materials");
+
+	gltf_mesh_source src;
+	src.name = json_string(mesh, "name");
+
+	for (const json_value& p : json_array(mesh, "primitives")) {
+		gltf_primitive_source prim;
+		prim.mode = json_size(p, "mode", c_gltf_triangles);
+		if (prim.mode != c_gltf_triangles && prim.mode != c_gltf_triangle_strip && prim.mode != c_gltf_triangle_fan)
+			continue;
+
+		const json_value& attributes = json_member(p, "attributes");
+		prim.positions = make_gltf_accessor(doc, json_size(attributes, "POSITION"));
+		ENFORCE(prim.positions.component_type == c_gltf_float && prim.positions.component_count == 3,
+			"POSITION must be a float VEC3 accessor.");
+
+		if (attributes.find("NORMAL")) {
+			prim.normals = make_gltf_accessor(doc, json_size(attributes, "NORMAL"));
+			ENFORCE(prim.normals.component_type == c_gltf_float && prim.normals.component_count == 3,
+				"NORMAL must be a float VEC3 accessor.");
+			ENFORCE(prim.normals.count == prim.positions.count, "NORMAL & POSITION counts differ.");
+		}
+
+		if (attributes.find("TEXCOORD_0")) {
+			prim.uvs = make_gltf_accessor(doc, json_size(attributes, "TEXCOORD_0"));
+			ENFORCE(prim.uvs.component_count == 2, "TEXCOORD_0 must be a VEC2 accessor.");
+			ENFORCE(prim.uvs.count == prim.positions.count, "TEXCOORD_0 & POSITION counts differ.");
+		}
+
+		if (p.find("indices")) {
+			prim.indices = make_gltf_accessor(doc, json_size(p, "indices"));
+			ENFORCE(prim.indices.component_count == 1 && (prim.indices.component_type == c_gltf_unsigned_byte
+				|| prim.indices.component_type == c_gltf_unsigned_short
+				|| prim.indices.component_type == c_gltf_unsigned_int),
+				"indices must be an unsigned integer SCALAR accessor.");
+		}
+
+		// a primitive without a material gets an unnamed one.
+		const size_t material = json_size(p, "material", c_no_index);
+		ENFORCE(material == c_no_index || material < materials.size(), "Invalid material index ", material);
+		auto res = material_indices.emplace(material, uint32_t(scene.materials.size()));
+		if (res.second) scene.materials.push_back((material == c_no_index) ? "" : json_string(materials[material], "name"));
+
+		prim.material_index = res.first->second;
+		src.primitives.push_back(prim);
+	}
+
+	return src;
+}
+
+// Returns the triangle list indices of the primitive, strips & fans are converted to lists.
+std::vector<uint32_t> make_gltf_triangles(const gltf_primitive_source& prim)
+{
+	const size_t count = (prim.indices.count > 0) ? prim.indices.count : prim.positions.count;
+	const auto index = [&prim](size_t i) {
+		return (prim.indices.count > 0) ? read_gltf_index(prim.indices, i) : uint32_t(i);
+	};
+
+	std::vector<uint32_t> out;
+	if (prim.mode == c_gltf_triangles) {
+		out.resize(count - count % 3);
+		for (size_t i = 0; i < out.size(); ++i) out[i] = index(i);
+	}
+	else if (prim.mode == c_gltf_triangle_strip) {
+		// every other triangle is flipped to keep the winding.
+		for (size_t i = 0; i + 2 < count; ++i) {
+			const bool odd = (i % 2) != 0;
+			out.push_back(index(i));
+			out.push_back(index(odd ? i + 2 : i + 1));
+			out.push_back(index(odd ? i + 1 : i + 2));
+		}
+	}
+	else {
+		for (size_t i = 1; i + 1 < count; ++i) {
+			out.push_back(index(0));
+			out.push_back(index(i));
+			out.push_back(index(i + 1));
+		}
+	}
+
+	for (uint32_t i : out) {
+		ENFORCE(i < prim.positions.count, "Invalid vertex index ", i);
+	}
+
+	return out;
+}
+
+inline float2 read_gltf_uv(const gltf_primitive_source& prim, size_t index) noexcept
+{
+	if (prim.uvs.count == 0) return float2(0.0f, 0.0f);
+
+	float uv[2];
+	read_gltf_floats(prim.uvs, index, uv, 2);
+	// gltf's v axis points down, .fbx & .obj uvs start at the bottom.
+	return float2(uv[0], 1.0f - uv[1]);
+}
+
+// Reads the primitives into one mesh, each primitive is a submesh. Primitives without normals are unrolled
+// into 3 vertices per triangle with the triangle's normal. Submeshes of the same material are merged.
+mesh_geometry_t extract_gltf_mesh(const gltf_mesh_source& src)
+{
+	try {
+		std::vector<size_t> order(src.primitives.size());
+		for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [&src](size_t l, size_t r) {
+			return src.primitives[l].material_index < src.primitives[r].material_index;
+		});
+
+		std::vector<std::vector<uint32_t>> triangles(src.primitives.size());
+		std::vector<size_t> first_vertices(src.primitives.size());
+		size_t vertex_count = 0;
+		size_t index_count = 0;
+		for (size_t i : order) {
+			const gltf_primitive_source& prim = src.primitives[i];
+			triangles[i] = make_gltf_triangles(prim);
+			// an empty primitive must not reserve vertices, they would stay uninitialized.
+			if (triangles[i].empty()) continue;
+
+			first_vertices[i] = vertex_count;
+			vertex_count += (prim.normals.count > 0) ? prim.positions.count : triangles[i].size();
+			index_count += triangles[i].size();
+		}
+
+		if (index_count == 0) return mesh_geometry_t();
+		ENFORCE(vertex_count <= std::numeric_limits<uint32_t>::max(), "The mesh has too many vertices ", vertex_count);
+
+		mesh_geometry_t mesh(vertex_count, index_count);
+		std::vector<submesh> submeshes;
+		size_t first_index = 0;
+		for (size_t i : order) {
+			const gltf_primitive_source& prim = src.primitives[i];
+			const std::vector<uint32_t>& tris = triangles[i];
+			const size_t first_vertex = first_vertices[i];
+			if (tris.empty()) continue;
+
+			if (prim.normals.count > 0) {
+				parallel_for(prim.positions.count, 4096, [&](size_t begin, size_t end) {
+					for (size_t v = begin; v < end; ++v) {
+						vertex_t& out = mesh.vertices[first_vertex + v];
+						float p[3];
+						float n[3];
+						read_gltf_floats(prim.positions, v, p, 3);
+						read_gltf_floats(prim.normals, v, n, 3);
+						out.position = float3(p[0], p[1], p[2]);
+						out.normal = float3(n[0], n[1], n[2]);
+						out.uv = read_gltf_uv(prim, v);
+						// the tangent space is computed by generate_tangents after the extraction.
+						out.tangent_h = 0;
+					}
+				});
+
+				for (size_t k = 0; k < tris.size(); ++k)
+					mesh.indices[first_index + k] = uint32_t(first_vertex + tris[k]);
+			}
+			else {
+				parallel_for(tris.size() / 3, 1024, [&](size_t begin, size_t end) {
+					for (size_t t = begin; t < end; ++t) {
+						vertex_t* p_out = mesh.vertices.data() + first_vertex + 3 * t;
+						for (size_t c = 0; c < 3; ++c) {
+							float p[3];
+							read_gltf_floats(prim.positions, tris[3 * t + c], p, 3);
+							p_out[c].position = float3(p[0], p[1], p[2]);
+							p_out[c].uv = read_gltf_uv(prim, tris[3 * t + c]);
+							p_out[c].tangent_h = 0;
+							mesh.indices[first_index + 3 * t + c] = uint32_t(first_vertex + 3 * t + c);
+						}
+
+						const float3 n = triangle_normal(p_out[0].position, p_out[1].position, p_out[2].position);
+						p_out[0].normal = p_out[1].normal = p_out[2].normal = n;
+					}
+				});
+			}
+
+			if (!submeshes.empty() && submeshes.back().material_index == prim.material_index)
+				submeshes.back().index_count += uint32_t(tris.size());
+			else
+				submeshes.push_back({ uint32_t(first_index), uint32_t(tris.size()), prim.material_index });
+
+			first_index += tris.size();
+		}
+
+		mesh.submeshes.resize(submeshes.size());
+		std::copy(submeshes.cbegin(), submeshes.cend(), mesh.submeshes.data());
+		mesh.index_fmt = pick_index_format(mesh.vertices.size());
+		return mesh;
+	}
+	catch (...) {
+		std::string exc_msg = EXCEPTION_MSG("Mesh extraction error. Mesh: ", src.name);
+		std::throw_with_nested(std::runtime_error(exc_msg));
+	}
+}
+
+} // namespace
+
+
+namespace sparki {
+namespace core {
+
+scene_geometry load_scene_from_obj_file(const char* p_filename)
+{
+	assert(p_filename);
+
+	try {
+		const mapped_file file(p_filename);
+		file.prefetch();
+
+		// parse the chunks
+		std::vector<obj_chunk> chunks = make_obj_chunks(file);
+		std::vector<std::exception_ptr> errors(chunks.size());
+		parallel_for(chunks.size(), 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				try {
+					parse_obj_chunk(chunks[i]);
+				}
+				catch (...) {
+					errors[i] = std::current_exception();
+				}
+			}
+		});
+
+		for (const std::exception_ptr& e : errors) {
+			if (e) std::rethrow_exception(e);
+		}
+
+		std::vector<float3> positions;
+		std::vector<float2> uvs;
+		std::vector<float3> normals;
+		merge_obj_attributes(chunks, positions, uvs, normals);
+
+		// Split the triangles into ranges of one mesh & material. An object or a material is added
+		// when the first triangle refers to it, so that empty objects & unused materials are skipped.
+		scene_geometry scene;
+		std::vector<obj_range> ranges;
+		std::vector<size_t> triangle_counts;
+		std::unordered_map<std::string, uint32_t> material_indices;
+		std::string object_name;
+		std::string material_name;
+		uint32_t mesh_index = c_no_index;
+		uint32_t material_index = c_no_index;
+
+		const auto add_range = [&](size_t chunk_index, size_t first_triangle, size_t end_triangle) {
+			if (first_triangle == end_triangle) return;
+
+			if (mesh_index == c_no_index) {
+				mesh_index = uint32_t(scene.meshes.size());
+				scene.meshes.emplace_back();
+				scene.meshes.back().name = object_name;
+				triangle_counts.push_back(0);
+			}
+			if (material_index == c_no_index) {
+				auto res = material_indices.emplace(material_name, uint32_t(scene.materials.size()));
+				if (res.second) scene.materials.push_back(material_name);
+				material_index = res.first->second;
+			}
+
+			ranges.push_back({ chunk_index, first_triangle, end_triangle - first_triangle, mesh_index, material_index, 0 });
+			triangle_counts[mesh_index] += end_triangle - first_triangle;
+		};
+
+		for (size_t c = 0; c < chunks.size(); ++c) {
+			size_t first_triangle = 0;
+			for (const obj_event& e : chunks[c].events) {
+				add_range(c, first_triangle, e.triangle_offset);
+				first_triangle = e.triangle_offset;
+
+				if (e.is_material) {
+					material_name = e.name;
+					material_index = c_no_index;
+				}
+				else {
+					object_name = e.name;
+					mesh_index = c_no_index;
+				}
+			}
+
+			add_range(c, first_triangle, chunks[c].corners.size() / 3);
+		}
+
+		ENFORCE(scene.meshes.size() > 0, "The file does not contain faces.");
+
+		// Each mesh's triangles are grouped by material, the order within a group is kept.
+		std::stable_sort(ranges.begin(), ranges.end(), [](const obj_range& l, const obj_range& r) {
+			return (l.mesh_index != r.mesh_index) ? (l.mesh_index < r.mesh_index) : (l.material_index < r.material_index);
+		});
+
+		std::vector<std::vector<submesh>> submeshes(scene.meshes.size());
+		std::vector<size_t> vertex_counts(scene.meshes.size(), 0);
+		for (obj_range& r : ranges) {
+			r.first_vertex = vertex_counts[r.mesh_index];
+			vertex_counts[r.mesh_index] += 3 * r.triangle_count;
+
+			std::vector<submesh>& sm = submeshes[r.mesh_index];
+			if (!sm.empty() && sm.back().material_index == r.material_index)
+				sm.back().index_count += uint32_t(3 * r.triangle_count);
+			else
+				sm.push_back({ uint32_t(r.first_vertex), uint32_t(3 * r.triangle_count), r.material_index });
+		}
+
+		for (size_t i = 0; i < scene.meshes.size(); ++i) {
+			ENFORCE(vertex_counts[i] <= std::numeric_limits<uint32_t>::max(),
+				"Object ", scene.meshes[i].name, " has too many vertices ", vertex_counts[i]);
+
+			mesh_geometry_t& mesh = scene.meshes[i].geometry;
+			mesh = mesh_geometry_t(vertex_counts[i], vertex_counts[i]);
+			mesh.submeshes.resize(submeshes[i].size());
+			std::copy(submeshes[i].cbegin(), submeshes[i].cend(), mesh.submeshes.data());
+			mesh.index_fmt = pick_index_format(mesh.vertices.size());
+		}
+
+		// unroll the triangles
+		errors.assign(ranges.size(), nullptr);
+		parallel_for(ranges.size(), 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				try {
+					const obj_range& r = ranges[i];
+					fill_obj_range(r, chunks[r.chunk_index], positions, uvs, normals, scene.meshes[r.mesh_index].geometry);
+				}
+				catch (...) {
+					errors[i] = std::current_exception();
+				}
+			}
+		});
+
+		for (const std::exception_ptr& e : errors) {
+			if (e) std::rethrow_exception(e);
+		}
+
+		chunks.clear();
+		positions = std::vector<float3>();
+		uvs = std::vector<float2>();
+		normals = std::vector<float3>();
+
+		errors.assign(scene.meshes.size(), nullptr);
+		parallel_for(scene.meshes.size(), 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				try {
+					generate_tangents(scene.meshes[i].geometry);
+				}
+				catch (...) {
+					errors[i] = std::current_exception();
+				}
+			}
+		});
+
+		for (const std::exception_ptr& e : errors) {
+			if (e) std::rethrow_exception(e);
+		}
+
+		// obj has no hierarchy, each object is a root node.
+		scene.nodes.resize(scene.meshes.size());
+		for (size_t i = 0; i < scene.meshes.size(); ++i) {
+			scene.nodes[i].name = scene.meshes[i].name;
+			scene.nodes[i].mesh_index = uint32_t(i);
+		}
+
+		return scene;
+	}
+	catch (...) {
+		std::string exc_msg = EXCEPTION_MSG("Obj reading error. ", p_filename);
+		std::throw_with_nested(std::runtime_error(exc_msg));
+	}
+}
+
+scene_geometry load_scene_from_gltf_file(const char* p_filename)
+{
+	assert(p_filename);
+
+	try {
+		const gltf_document doc = load_gltf_document(p_filename);
+		const std::vector<json_value>& nodes = json_array(doc.root, "nodes");
+
+		// the roots of the default scene, or all the nodes which are not children if there are no scenes.
+		std::vector<size_t> roots;
+		const std::vector<json_value>& scenes = json_array(doc.root, "scenes");
+		if (!scenes.empty()) {
+			const size_t scene_index = json_size(doc.root, "scene", 0);
+			ENFORCE(scene_index < scenes.size(), "Invalid default scene ", scene_index);
+
+			for (const json_value& n : json_array(scenes[scene_index], "nodes"))
+				roots.push_back(json_index(n, "nodes"));
+		}
+		else {
+			std::vector<bool> is_child(nodes.size(), false);
+			for (const json_value& node : nodes) {
+				for (const json_value& child : json_array(node, "children")) {
+					const size_t child_index = json_index(child, "children");
+					ENFORCE(child_index < nodes.size(), "Invalid node index ", child_index);
+					is_child[child_index] = true;
+				}
+			}
+
+			for (size_t i = 0; i < nodes.size(); ++i) {
+				if (!is_child[i]) roots.push_back(i);
+			}
+		}
+
+		// The hierarchy & the materials are set up by this thread, the workers only read their own meshes
+		// and generate their tangents.
+		scene_geometry scene;
+		std::vector<uint32_t> mesh_indices(json_array(doc.root, "meshes").size(), c_no_index);
+		std::vector<size_t> mesh_sources;
+		std::vector<bool> visited(nodes.size(), false);
+		for (size_t root : roots)
+			add_gltf_node(doc, root, c_scene_no_index, scene, mesh_indices, mesh_sources, visited);
+
+		ENFORCE(mesh_sources.size() > 0, "The gltf scene does not contain meshes.");
+
+		std::unordered_map<size_t, uint32_t> material_indices;
+		std::vector<gltf_mesh_source> sources;
+		for (size_t m : mesh_sources)
+			sources.push_back(prepare_gltf_mesh(doc, m, scene, material_indices));
+
+		scene.meshes.resize(sources.size());
+		std::vector<std::exception_ptr> errors(sources.size());
+		parallel_for(sources.size(), 1, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				try {
+					scene.meshes[i].name = sources[i].name;
+					scene.meshes[i].geometry = extract_gltf_mesh(sources[i]);
+					if (scene.meshes[i].geometry.vertices.size() > 0) generate_tangents(scene.meshes[i].geometry);
+				}
+				catch (...) {
+					errors[i] = std::current_exception();
+				}
+			}
+		});
+
+		for (const std::exception_ptr& e : errors) {
+			if (e) std::rethrow_exception(e);
+		}
+
+		// drop the meshes without triangles (points & lines only).
+		std::vector<uint32_t> remap(scene.meshes.size(), c_scene_no_index);
+		std::vector<scene_mesh> meshes;
+		for (size_t i = 0; i < scene.meshes.size(); ++i) {
+			if (scene.meshes[i].geometry.vertices.size() == 0) continue;
+
+			remap[i] = uint32_t(meshes.size());
+			meshes.push_back(std::move(scene.meshes[i]));
+		}
+
+		ENFORCE(meshes.size() > 0, "The gltf scene does not contain triangles.");
+		scene.meshes = std::move(meshes);
+		for (scene_node& node : scene.nodes) {
+			if (node.mesh_index != c_scene_no_index) node.mesh_index = remap[node.mesh_index];
+		}
+
+		return scene;
+	}
+	catch (...) {
+		std::string exc_msg = EXCEPTION_MSG("Gltf reading error. ", p_filename);
+		std::throw_with_nested(std::runtime_error(exc_msg));
+	}
+}
+
+std::vector<std::string> list_gltf_dependencies(const char* p_filename)
+{
+	assert(p_filename);
+
+	try {
+		gltf_document doc;
+		span<const uint8_t> bin;
+		read_gltf_json(doc, p_filename, bin);
+
+		std::vector<std::string> filenames;
+		for (const json_value& b : json_array(doc.root, "buffers")) {
+			const json_value* p_uri = b.find("uri");
+			if (p_uri && p_uri->type == json_type::string && !is_data_uri(p_uri->string))
+				filenames.push_back(decode_uri(p_uri->string));
+		}
+
+		return filenames;
+	}
+	catch (...) {
+		std::string exc_msg = EXCEPTION_MSG("Gltf reading error. ", p_filename);
+		std::throw_with_nested(std::runtime_error(exc_msg));
+	}
+}
+
+} // namespace core
+} // namespace sparki
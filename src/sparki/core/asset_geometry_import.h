@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "sparki/core/asset_geometry.h"
+
+
+namespace sparki {
+namespace core {
+
+// Reads the objects of the specified .obj file. Each object ('o') becomes a scene_mesh referenced by
+// its own root node, the triangles are grouped into submeshes by material ('usemtl').
+// Polygons are triangulated as fans, triangles are unrolled into 3 vertices each (see weld_vertices).
+// Missing normals are replaced by the triangle's normal, missing uvs by zero.
+// The file is mapped into memory and parsed in chunks on the task system's worker threads,
+// the meshes are assembled & their tangents are generated in parallel as well.
+scene_geometry load_scene_from_obj_file(const char* p_filename);
+
+// Reads the node hierarchy of the default scene, the meshes and their materials
+// from the specified .gltf or .glb (binary glTF 2.0) file.
+// Each referenced mesh becomes a scene_mesh, its triangle primitives become submeshes.
+// Buffers are mapped files or the glb's binary chunk, accessors are read in place without copying the buffers.
+// Missing normals are replaced by the triangle's normal (the triangles are unrolled then), missing uvs by zero.
+// Uvs are converted to the .fbx convention (v = 1 - v). Other primitive modes than triangles are skipped.
+// The meshes are extracted & their tangents are generated on the task system's worker threads.
+scene_geometry load_scene_from_gltf_file(const char* p_filename);
+
+// Returns the external files (buffers) which the specified .gltf file refers to.
+// The names are relative to the .gltf file's directory, data uris are skipped.
+std::vector<std::string> list_gltf_dependencies(const char* p_filename);
+
+} // namespace core
+} // namespace sparki
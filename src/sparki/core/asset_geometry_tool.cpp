@@ -0,0 +1,1975 @@
+#include "sparki/core/asset_geometry_tool.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include "sparki/core/hash.h"
+#include "sparki/core/parallel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define SPARKI_GEOMETRY_SSE 1
+	#include <emmintrin.h>
+#endif
+
+
+namespace {
+
+using namespace sparki::core;
+
+using math::float3;
+using vertex_t = vertex<vertex_attribs::p_n_uv_ts>;
+
+// Returns the submeshes of the specified lod. A mesh without submeshes has one of material 0 per lod.
+std::vector<submesh> submesh_ranges(const mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh, size_t lod_index)
+{
+	assert(lod_index < std::max<size_t>(1, mesh.lods.size()));
+
+	const size_t n = submesh_count(mesh);
+	if (n == 0) {
+		if (mesh.lods.size() == 0) return { submesh{ 0, uint32_t(mesh.indices.size()), 0 } };
+		return { submesh{ mesh.lods[lod_index].first_index, mesh.lods[lod_index].index_count, 0 } };
+	}
+
+	const submesh* p_first = mesh.submeshes.data() + lod_index * n;
+	return std::vector<submesh>(p_first, p_first + n);
+}
+
+// ----- weld -----
+
+// 8 float attributes (position, normal, uv) + packed tangent space.
+struct weld_key final {
+	uint32_t values[9];
+};
+
+inline bool operator==(const weld_key& l, const weld_key& r) noexcept
+{
+	return std::memcmp(l.values, r.values, sizeof(l.values)) == 0;
+}
+
+inline uint32_t exact_key_value(float v) noexcept
+{
+	// all the NaNs get the bits of the quiet NaN, so that they are equal to each other.
+	if (std::isnan(v)) return 0x7fc00000;
+
+	v += 0.0f; // -0.0 -> 0.0
+	uint32_t u;
+	std::memcpy(&u, &v, sizeof(u));
+	return u;
+}
+
+inline uint32_t quantized_key_value(float v, float inv_epsilon) noexcept
+{
+	constexpr double c_limit = double(std::numeric_limits<int32_t>::max());
+
+	const double q = std::floor(double(v) * inv_epsilon + 0.5);
+	// NaN can not be converted, it gets int32_t's min which the clamped values never take.
+	if (std::isnan(q)) return uint32_t(std::numeric_limits<int32_t>::min());
+
+	const double c = (q < -c_limit) ? -c_limit : ((q > c_limit) ? c_limit : q);
+	return uint32_t(int32_t(c));
+}
+
+weld_key make_weld_key(const vertex_t& v, float epsilon) noexcept
+{
+	const float attribs[8] = {
+		v.position.x, v.position.y, v.position.z,
+		v.normal.x, v.normal.y, v.normal.z,
+		v.uv.x, v.uv.y
+	};
+
+	weld_key key;
+
+	if (epsilon > 0.0f) {
+		const float inv_epsilon = 1.0f / epsilon;
+		for (size_t i = 0; i < 8; ++i)
+			key.values[i] = quantized_key_value(attribs[i], inv_epsilon);
+	}
+	else {
+		for (size_t i = 0; i < 8; ++i)
+			key.values[i] = exact_key_value(attribs[i]);
+	}
+
+	key.values[8] = v.tangent_h;
+	return key;
+}
+
+// ----- vertex cache -----
+
+// Forsyth's "Linear-Speed Vertex Cache Optimisation" scoring parameters.
+constexpr uint32_t c_forsyth_cache_size = 32;
+constexpr float c_forsyth_cache_decay_power = 1.5f;
+constexpr float c_forsyth_last_triangle_score = 0.75f;
+constexpr float c_forsyth_valence_boost_scale = 2.0f;
+constexpr float c_forsyth_valence_boost_power = 0.5f;
+
+float forsyth_vertex_score(int32_t cache_position, uint32_t active_triangle_count) noexcept
+{
+	if (active_triangle_count == 0) return -1.0f; // the vertex is not used by the remaining triangles.
+
+	float score = 0.0f;
+	if (cache_position >= 0) {
+		if (cache_position < 3) {
+			// the vertices of the last triangle get a fixed score,
+			// otherwise the optimizer prefers triangles which reuse only 2 of them.
+			score = c_forsyth_last_triangle_score;
+		}
+		else {
+			const float scaler = 1.0f / float(c_forsyth_cache_size - 3);
+			score = std::pow(1.0f - float(cache_position - 3) * scaler, c_forsyth_cache_decay_power);
+		}
+	}
+
+	// vertices with few remaining triangles are boosted, so that lone triangles are not left behind.
+	score += c_forsyth_valence_boost_scale
+		* std::pow(float(active_triangle_count), -c_forsyth_valence_boost_power);
+	return score;
+}
+
+// Vertex -> adjacent triangles in the compressed sparse row form.
+struct vertex_adjacency final {
+	std::vector<uint32_t> offsets;	// vertex_count + 1 items
+	std::vector<uint32_t> triangles;
+};
+
+vertex_adjacency make_vertex_adjacency(span<const uint32_t> indices, size_t vertex_count)
+{
+	vertex_adjacency adj;
+	adj.offsets.assign(vertex_count + 1, 0);
+	adj.triangles.resize(indices.size());
+
+	for (uint32_t i : indices) ++adj.offsets[i + 1];
+	for (size_t v = 0; v < vertex_count; ++v) adj.offsets[v + 1] += adj.offsets[v];
+
+	std::vector<uint32_t> fill(adj.offsets.cbegin(), adj.offsets.cend() - 1);
+	for (size_t i = 0; i < indices.size(); ++i)
+		adj.triangles[fill[indices[i]]++] = uint32_t(i / 3);
+
+	return adj;
+}
+
+// Returns the number of vertices which miss the fifo cache when the triangle is processed.
+// timestamps[v] is the moment vertex v has been put into the cache.
+inline uint32_t simulate_fifo_cache(const uint32_t* p_triangle, uint32_t cache_size,
+	std::vector<uint32_t>& timestamps, uint32_t& time) noexcept
+{
+	uint32_t misses = 0;
+	for (size_t k = 0; k < 3; ++k) {
+		const uint32_t v = p_triangle[k];
+		if (time - timestamps[v] > cache_size) {
+			timestamps[v] = time++;
+			++misses;
+		}
+	}
+	return misses;
+}
+
+// ----- overdraw -----
+
+// Splits the triangle sequence into clusters which can be reordered without a significant cache penalty.
+// Hard boundaries are the triangles which miss the cache with all 3 vertices (the optimizer jumps elsewhere).
+// Hard clusters are split further while the cluster's acmr stays below threshold * acmr of the hard cluster.
+std::vector<uint32_t> make_overdraw_clusters(span<const uint32_t> indices, size_t vertex_count,
+	uint32_t cache_size, float threshold)
+{
+	const size_t triangle_count = indices.size() / 3;
+	std::vector<uint32_t> timestamps(vertex_count, 0);
+	uint32_t time = cache_size + 1;
+
+	std::vector<uint32_t> hard;
+	for (size_t t = 0; t < triangle_count; ++t) {
+		if (simulate_fifo_cache(&indices[t * 3], cache_size, timestamps, time) == 3)
+			hard.push_back(uint32_t(t));
+	}
+	if (hard.empty() || hard[0] != 0) hard.insert(hard.begin(), 0);
+	hard.push_back(uint32_t(triangle_count));
+
+	std::vector<uint32_t> clusters;
+	for (size_t h = 0; h + 1 < hard.size(); ++h) {
+		const uint32_t begin = hard[h];
+		const uint32_t end = hard[h + 1];
+
+		// acmr of the hard cluster
+		time += cache_size + 1;
+		uint32_t misses = 0;
+		for (uint32_t t = begin; t < end; ++t)
+			misses += simulate_fifo_cache(&indices[t * 3], cache_size, timestamps, time);
+		const float max_acmr = threshold * float(misses) / float(end - begin);
+
+		clusters.push_back(begin);
+		time += cache_size + 1;
+		misses = 0;
+		uint32_t first = begin;
+		for (uint32_t t = begin; t < end; ++t) {
+			misses += simulate_fifo_cache(&indices[t * 3], cache_size, timestamps, time);
+
+			if ((t + 1 < end) && (float(misses) / float(t + 1 - first) <= max_acmr)) {
+				clusters.push_back(t + 1);
+				first = t + 1;
+				time += cache_size + 1;
+				misses = 0;
+			}
+		}
+	}
+
+	return clusters;
+}
+
+// ----- quantization -----
+
+using compact_vertex_t = vertex<vertex_attribs::p_n_uv_ts_compact>;
+
+inline float clamp(float v, float lo, float hi) noexcept
+{
+	return std::min(hi, std::max(lo, v));
+}
+
+// v is expected to be in [0, 1].
+inline uint16_t quantize_unorm16(float v) noexcept
+{
+	return uint16_t(int32_t(clamp(v, 0.0f, 1.0f) * 65535.0f + 0.5f));
+}
+
+// v is expected to be in [-1, 1]. Rounds half away from zero.
+inline int16_t quantize_snorm16(float v) noexcept
+{
+	const float c = clamp(v, -1.0f, 1.0f) * 32767.0f;
+	return int16_t(int32_t(c + ((c >= 0.0f) ? 0.5f : -0.5f)));
+}
+
+// Position quantization: q = (p - offset) * inv_scale, inv_scale is 0 for degenerate axes.
+struct position_quantizer final {
+	float offset[3];
+	float inv_scale[3];
+};
+
+void quantize_vertex(const vertex_t& v, const position_quantizer& pq, compact_vertex_t& out) noexcept
+{
+	const float p[3] = { v.position.x, v.position.y, v.position.z };
+	for (size_t c = 0; c < 3; ++c)
+		out.position[c] = quantize_unorm16((p[c] - pq.offset[c]) * pq.inv_scale[c]);
+	out.position[3] = 0;
+
+	encode_octahedral(v.normal, out.normal);
+	out.uv[0] = quantize_unorm16(v.uv.x);
+	out.uv[1] = quantize_unorm16(v.uv.y);
+	out.tangent_h = v.tangent_h;
+}
+
+#if defined(SPARKI_GEOMETRY_SSE)
+
+inline __m128 clamp_ps(__m128 v, __m128 lo, __m128 hi) noexcept
+{
+	return _mm_min_ps(hi, _mm_max_ps(lo, v));
+}
+
+inline __m128i quantize_unorm16_ps(__m128 v) noexcept
+{
+	const __m128 c = clamp_ps(v, _mm_setzero_ps(), _mm_set1_ps(1.0f));
+	return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(c, _mm_set1_ps(65535.0f)), _mm_set1_ps(0.5f)));
+}
+
+inline __m128i quantize_snorm16_ps(__m128 v) noexcept
+{
+	const __m128 sign_mask = _mm_set1_ps(-0.0f);
+	const __m128 c = _mm_mul_ps(clamp_ps(v, _mm_set1_ps(-1.0f), _mm_set1_ps(1.0f)), _mm_set1_ps(32767.0f));
+	// +-0.5 with the sign of c, -0.0 is treated as 0 like in quantize_snorm16.
+	const __m128 negative = _mm_cmplt_ps(c, _mm_setzero_ps());
+	const __m128 half = _mm_or_ps(_mm_set1_ps(0.5f), _mm_and_ps(negative, sign_mask));
+	return _mm_cvttps_epi32(_mm_add_ps(c, half));
+}
+
+// Converts 4 vertices. The attributes are transposed into 4-wide lanes (one vertex per lane).
+void quantize_vertices_sse(const vertex_t* p_src, const position_quantizer& pq, compact_vertex_t* p_dst) noexcept
+{
+	const vertex_t& v0 = p_src[0];
+	const vertex_t& v1 = p_src[1];
+	const vertex_t& v2 = p_src[2];
+	const vertex_t& v3 = p_src[3];
+
+	alignas(16) int32_t q[7][4];
+
+	// positions
+	const __m128 px = _mm_setr_ps(v0.position.x, v1.position.x, v2.position.x, v3.position.x);
+	const __m128 py = _mm_setr_ps(v0.position.y, v1.position.y, v2.position.y, v3.position.y);
+	const __m128 pz = _mm_setr_ps(v0.position.z, v1.position.z, v2.position.z, v3.position.z);
+	_mm_store_si128(reinterpret_cast<__m128i*>(q[0]), quantize_unorm16_ps(
+		_mm_mul_ps(_mm_sub_ps(px, _mm_set1_ps(pq.offset[0])), _mm_set1_ps(pq.inv_scale[0]))));
+	_mm_store_si128(reinterpret_cast<__m128i*>(q[1]), quantize_unorm16_ps(
+		_mm_mul_ps(_mm_sub_ps(py, _mm_set1_ps(pq.offset[1])), _mm_set1_ps(pq.inv_scale[1]))));
+	_mm_store_si128(reinterpret_cast<__m128i*>(q[2]), quantize_unorm16_ps(
+		_mm_mul_ps(_mm_sub_ps(pz, _mm_set1_ps(pq.offset[2])), _mm_set1_ps(pq.inv_scale[2]))));
+
+	// normals: project onto the octahedron, fold the lower hemisphere.
+	const __m128 sign_mask = _mm_set1_ps(-0.0f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 nx = _mm_setr_ps(v0.normal.x, v1.normal.x, v2.normal.x, v3.normal.x);
+	const __m128 ny = _mm_setr_ps(v0.normal.y, v1.normal.y, v2.normal.y, v3.normal.y);
+	const __m128 nz = _mm_setr_ps(v0.normal.z, v1.normal.z, v2.normal.z, v3.normal.z);
+	const __m128 l1 = _mm_add_ps(_mm_add_ps(_mm_andnot_ps(sign_mask, nx), _mm_andnot_ps(sign_mask, ny)),
+		_mm_andnot_ps(sign_mask, nz));
+	const __m128 valid = _mm_cmpgt_ps(l1, _mm_setzero_ps());
+	// divide (not multiply by the reciprocal) to get the same results as encode_octahedral.
+	const __m128 safe_l1 = _mm_or_ps(_mm_and_ps(valid, l1), _mm_andnot_ps(valid, one));
+	const __m128 ox = _mm_and_ps(valid, _mm_div_ps(nx, safe_l1));
+	const __m128 oy = _mm_and_ps(valid, _mm_div_ps(ny, safe_l1));
+	// sign(v) is +-1, 0 is positive.
+	const __m128 sx = _mm_or_ps(one, _mm_and_ps(_mm_cmplt_ps(ox, _mm_setzero_ps()), sign_mask));
+	const __m128 sy = _mm_or_ps(one, _mm_and_ps(_mm_cmplt_ps(oy, _mm_setzero_ps()), sign_mask));
+	const __m128 fx = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(sign_mask, oy)), sx);
+	const __m128 fy = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(sign_mask, ox)), sy);
+	const __m128 lower = _mm_cmplt_ps(nz, _mm_setzero_ps());
+	const __m128 ex = _mm_or_ps(_mm_and_ps(lower, fx), _mm_andnot_ps(lower, ox));
+	const __m128 ey = _mm_or_ps(_mm_and_ps(lower, fy), _mm_andnot_ps(lower, oy));
+	_mm_store_si128(reinterpret_cast<__m128i*>(q[3]), quantize_snorm16_ps(ex));
+	_mm_store_si128(reinterpret_cast<__m128i*>(q[4]), quantize_snorm16_ps(ey));
+
+	// uvs
+	const __m128 u = _mm_setr_ps(v0.uv.x, v1.uv.x, v2.uv.x, v3.uv.x);
+	const __m128 v = _mm_setr_ps(v0.uv.y, v1.uv.y, v2.uv.y, v3.uv.y);
+	_mm_store_si128(reinterpret_cast<__m128i*>(q[5]), quantize_unorm16_ps(u));
+	_mm_store_si128(reinterpret_cast<__m128i*>(q[6]), quantize_unorm16_ps(v));
+
+	for (size_t i = 0; i < 4; ++i) {
+		compact_vertex_t& out = p_dst[i];
+		out.position[0] = uint16_t(q[0][i]);
+		out.position[1] = uint16_t(q[1][i]);
+		out.position[2] = uint16_t(q[2][i]);
+		out.position[3] = 0;
+		out.normal[0] = int16_t(q[3][i]);
+		out.normal[1] = int16_t(q[4][i]);
+		out.uv[0] = uint16_t(q[5][i]);
+		out.uv[1] = uint16_t(q[6][i]);
+		out.tangent_h = p_src[i].tangent_h;
+	}
+}
+
+#endif // defined(SPARKI_GEOMETRY_SSE)
+
+// ----- meshlets -----
+
+// Computes the bounding sphere & normal cone of the meshlet's triangles.
+void compute_meshlet_bounds(meshlet& m, const uint32_t* p_indices, const vertex_t* p_vertices) noexcept
+{
+	const uint32_t* p_begin = p_indices + m.first_index;
+	const uint32_t* p_end = p_begin + m.index_count;
+
+	// sphere: the centre of the bounding box, the radius reaches the farthest vertex.
+	float3 min_p = p_vertices[*p_begin].position;
+	float3 max_p = min_p;
+	for (const uint32_t* p = p_begin; p != p_end; ++p) {
+		const float3& pos = p_vertices[*p].position;
+		min_p = float3(std::min(min_p.x, pos.x), std::min(min_p.y, pos.y), std::min(min_p.z, pos.z));
+		max_p = float3(std::max(max_p.x, pos.x), std::max(max_p.y, pos.y), std::max(max_p.z, pos.z));
+	}
+
+	m.center = (min_p + max_p) * 0.5f;
+	float radius_sq = 0.0f;
+	for (const uint32_t* p = p_begin; p != p_end; ++p)
+		radius_sq = std::max(radius_sq, math::len_squared(p_vertices[*p].position - m.center));
+	m.radius = std::sqrt(radius_sq);
+
+	// cone: the axis is the average face normal, the spread is the widest angle between the axis & a normal.
+	// Face normals follow the winding (counter-clockwise front faces), degenerate triangles are ignored.
+	float3 normal_sum(0.0f);
+	for (const uint32_t* p = p_begin; p != p_end; p += 3) {
+		const float3& p0 = p_vertices[p[0]].position;
+		const float3 n = math::cross(p_vertices[p[1]].position - p0, p_vertices[p[2]].position - p0);
+		const float l = math::len(n);
+		if (l > 0.0f) normal_sum += n / l;
+	}
+
+	m.cone_axis = float3(0.0f, 0.0f, 1.0f);
+	m.cone_cutoff = 1.0f;
+	const float sum_len = math::len(normal_sum);
+	if (sum_len == 0.0f) return;
+
+	m.cone_axis = normal_sum / sum_len;
+	float min_dp = 1.0f;
+	for (const uint32_t* p = p_begin; p != p_end; p += 3) {
+		const float3& p0 = p_vertices[p[0]].position;
+		const float3 n = math::cross(p_vertices[p[1]].position - p0, p_vertices[p[2]].position - p0);
+		const float l = math::len(n);
+		if (l > 0.0f) min_dp = std::min(min_dp, math::dot(n / l, m.cone_axis));
+	}
+
+	// A cone which is (almost) as wide as a hemisphere rejects nothing.
+	if (min_dp > 0.1f)
+		m.cone_cutoff = std::sqrt(1.0f - min_dp * min_dp);
+}
+
+// Returns the remap table: positions[v] is the first vertex which has the same position as v.
+// Vertices which are split by uv or normal seams map to the same value.
+// Positions are compared as weld keys (exact_key_value), so -0.0 equals 0.0 and NaNs equal each other.
+std::vector<uint32_t> make_position_remap(span<const vertex_t> vertices)
+{
+	const size_t vertex_count = vertices.size();
+	std::vector<uint32_t> order(vertex_count);
+	for (size_t v = 0; v < vertex_count; ++v) order[v] = uint32_t(v);
+
+	// Float comparisons are not a strict weak ordering if there are NaNs, the keys are integers.
+	const auto position_key = [vertices](uint32_t v) {
+		const float3& p = vertices[v].position;
+		return std::make_tuple(exact_key_value(p.x), exact_key_value(p.y), exact_key_value(p.z));
+	};
+	std::sort(order.begin(), order.end(), [&position_key](uint32_t l, uint32_t r) {
+		return std::make_tuple(position_key(l), l) < std::make_tuple(position_key(r), r);
+	});
+
+	std::vector<uint32_t> positions(vertex_count);
+	for (size_t i = 0; i < vertex_count; ++i) {
+		const bool same = (i > 0) && (position_key(order[i]) == position_key(order[i - 1]));
+		positions[order[i]] = same ? positions[order[i - 1]] : order[i];
+	}
+
+	return positions;
+}
+
+// Groups the triangles of indices into meshlets, appends the grouped indices to out_indices
+// and the meshlets to out_meshlets (first_index refers to out_indices).
+void build_range_meshlets(span<const uint32_t> indices, span<const vertex_t> vertices,
+	const std::vector<uint32_t>& positions, std::vector<uint32_t>& out_indices, std::vector<meshlet>& out_meshlets)
+{
+	constexpr uint32_t c_none = std::numeric_limits<uint32_t>::max();
+	const size_t vertex_count = vertices.size();
+	const size_t triangle_count = indices.size() / 3;
+	if (triangle_count == 0) return;
+
+	// Triangles are adjacent if they share a position: uv & normal seams split vertices
+	// but must not split meshlets.
+	std::vector<uint32_t> position_indices(indices.size());
+	for (size_t i = 0; i < indices.size(); ++i) position_indices[i] = positions[indices[i]];
+	const vertex_adjacency adj = make_vertex_adjacency(
+		span<const uint32_t>(position_indices.data(), position_indices.size()), vertex_count);
+
+	std::vector<float3> centroids(triangle_count);
+	float3 mesh_centroid(0.0f);
+	float mesh_area = 0.0f;
+	for (size_t t = 0; t < triangle_count; ++t) {
+		const float3& p0 = vertices[indices[t * 3]].position;
+		const float3& p1 = vertices[indices[t * 3 + 1]].position;
+		const float3& p2 = vertices[indices[t * 3 + 2]].position;
+		const float a = len(cross(p1 - p0, p2 - p0));
+		centroids[t] = (p0 + p1 + p2) / 3.0f;
+		mesh_centroid += centroids[t] * a;
+		mesh_area += a;
+	}
+	if (mesh_area > 0.0f) mesh_centroid /= mesh_area;
+
+	// Meshlets are grown from a seed triangle over the shared vertices. The next triangle adds
+	// the fewest new vertices, ties are broken by the distance to the meshlet's centre.
+	// Seeds are taken in the current triangle order.
+	std::vector<uint8_t> emitted(triangle_count, 0);
+	std::vector<uint32_t> owners(vertex_count, c_none); // vertex -> the last meshlet which has referenced it.
+	std::vector<uint32_t> meshlet_vertices;
+	meshlet_vertices.reserve(c_meshlet_max_vertex_count);
+	std::vector<meshlet> meshlets;
+	std::vector<uint32_t> grouped_indices;
+	grouped_indices.reserve(indices.size());
+
+	size_t seed = 0;
+	while (grouped_indices.size() < indices.size()) {
+		while (emitted[seed]) ++seed;
+
+		const uint32_t id = uint32_t(meshlets.size());
+		meshlet m = {};
+		m.first_index = uint32_t(grouped_indices.size());
+		meshlet_vertices.clear();
+		float3 centroid_sum(0.0f);
+
+		uint32_t tri = uint32_t(seed);
+		while (tri != c_none) {
+			emitted[tri] = 1;
+			grouped_indices.insert(grouped_indices.end(), &indices[size_t(tri) * 3], &indices[0] + size_t(tri) * 3 + 3);
+			m.index_count += 3;
+			centroid_sum += centroids[tri];
+			for (size_t c = 0; c < 3; ++c) {
+				const uint32_t v = indices[tri * 3 + c];
+				if (owners[v] == id) continue;
+				owners[v] = id;
+				meshlet_vertices.push_back(v);
+			}
+
+			if (m.index_count / 3 == c_meshlet_max_triangle_count) break;
+
+			const float3 center = centroid_sum / float(m.index_count / 3);
+			uint32_t best_extra = 4;
+			float best_distance = std::numeric_limits<float>::max();
+			tri = c_none;
+
+			for (uint32_t v : meshlet_vertices) {
+				const uint32_t pv = positions[v];
+				for (uint32_t a = adj.offsets[pv]; a < adj.offsets[pv + 1]; ++a) {
+					const uint32_t t = adj.triangles[a];
+					if (emitted[t]) continue;
+
+					const uint32_t* p_tri = &indices[size_t(t) * 3];
+					const uint32_t extra = uint32_t(owners[p_tri[0]] != id)
+						+ uint32_t(owners[p_tri[1]] != id && p_tri[1] != p_tri[0])
+						+ uint32_t(owners[p_tri[2]] != id && p_tri[2] != p_tri[0] && p_tri[2] != p_tri[1]);
+					if (meshlet_vertices.size() + extra > c_meshlet_max_vertex_count) continue;
+
+					const float distance = len_squared(centroids[t] - center);
+					if (extra < best_extra || (extra == best_extra && distance < best_distance)) {
+						best_extra = extra;
+						best_distance = distance;
+						tri = t;
+					}
+				}
+			}
+		}
+
+		meshlets.push_back(m);
+	}
+
+	const uint32_t* p_indices = grouped_indices.data();
+	const vertex_t* p_vertices = vertices.data();
+	parallel_for(meshlets.size(), 64, [&meshlets, p_indices, p_vertices](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i)
+			compute_meshlet_bounds(meshlets[i], p_indices, p_vertices);
+	});
+
+	// The grouping has discarded the overdraw order, restore it at the meshlet level (see optimize_overdraw):
+	// meshlets which face away from the mesh centre are likely to occlude the others, draw them first.
+	std::vector<float> sort_keys(meshlets.size());
+	for (size_t i = 0; i < meshlets.size(); ++i)
+		sort_keys[i] = dot(meshlets[i].center - mesh_centroid, meshlets[i].cone_axis);
+
+	std::vector<uint32_t> order(meshlets.size());
+	for (size_t i = 0; i < order.size(); ++i) order[i] = uint32_t(i);
+	std::stable_sort(order.begin(), order.end(),
+		[&sort_keys](uint32_t l, uint32_t r) { return sort_keys[l] > sort_keys[r]; });
+
+	for (uint32_t i : order) {
+		meshlet m = meshlets[i];
+		const uint32_t first_index = uint32_t(out_indices.size());
+		out_indices.insert(out_indices.end(), p_indices + m.first_index, p_indices + m.first_index + m.index_count);
+		m.first_index = first_index;
+		out_meshlets.push_back(m);
+	}
+}
+
+// ----- simplification -----
+
+// Weight of the planes which keep open borders & seams in place, relative to the face planes.
+constexpr double c_border_plane_weight = 10.0;
+
+// Symmetric 4x4 matrix which sums the squared distances to a set of planes (Garland & Heckbert)
+// and the total weight of the planes.
+struct quadric final {
+	double a2 = 0.0, b2 = 0.0, c2 = 0.0, d2 = 0.0;
+	double ab = 0.0, ac = 0.0, ad = 0.0;
+	double bc = 0.0, bd = 0.0;
+	double cd = 0.0;
+	double weight = 0.0;
+};
+
+// n must be a unit vector, the plane is dot(n, p) + d = 0.
+void add_plane(quadric& q, const float3& n, float d, double weight) noexcept
+{
+	const double a = n.x, b = n.y, c = n.z, dd = d;
+	q.a2 += weight * a * a;	q.b2 += weight * b * b;	q.c2 += weight * c * c;	q.d2 += weight * dd * dd;
+	q.ab += weight * a * b;	q.ac += weight * a * c;	q.ad += weight * a * dd;
+	q.bc += weight * b * c;	q.bd += weight * b * dd;
+	q.cd += weight * c * dd;
+	q.weight += weight;
+}
+
+void add_quadric(quadric& q, const quadric& r) noexcept
+{
+	q.a2 += r.a2;	q.b2 += r.b2;	q.c2 += r.c2;	q.d2 += r.d2;
+	q.ab += r.ab;	q.ac += r.ac;	q.ad += r.ad;
+	q.bc += r.bc;	q.bd += r.bd;
+	q.cd += r.cd;
+	q.weight += r.weight;
+}
+
+// Returns the weighted mean of the squared distances from p to the planes of q.
+double evaluate_quadric(const quadric& q, const float3& p) noexcept
+{
+	if (q.weight <= 0.0) return 0.0;
+
+	const double x = p.x, y = p.y, z = p.z;
+	const double e = q.a2 * x * x + q.b2 * y * y + q.c2 * z * z + q.d2
+		+ 2.0 * (q.ab * x * y + q.ac * x * z + q.bc * y * z)
+		+ 2.0 * (q.ad * x + q.bd * y + q.cd * z);
+	return std::max(0.0, e) / q.weight;
+}
+
+enum class vertex_kind : unsigned char {
+	manifold,	// an interior vertex, collapses into any neighbour.
+	border,		// lies on an open border, collapses along the border only.
+	seam,		// one of the two wedges of a uv/normal seam, collapses along the seam together with its twin.
+	locked		// is never removed: corners, complex seams, unreferenced vertices.
+};
+
+// Returns true if one of the triangles which are adjacent to a contains the directed edge a -> b.
+bool has_edge(const vertex_adjacency& adj, const std::vector<uint32_t>& indices, uint32_t a, uint32_t b) noexcept
+{
+	for (uint32_t i = adj.offsets[a]; i < adj.offsets[a + 1]; ++i) {
+		const uint32_t* p_tri = &indices[size_t(adj.triangles[i]) * 3];
+		for (size_t c = 0; c < 3; ++c) {
+			if (p_tri[c] == a && p_tri[(c + 1) % 3] == b) return true;
+		}
+	}
+
+	return false;
+}
+
+// Returns true if the edge a - b (any direction) has only one adjacent triangle.
+bool is_open_edge(const vertex_adjacency& adj, const std::vector<uint32_t>& indices, uint32_t a, uint32_t b) noexcept
+{
+	return has_edge(adj, indices, a, b) != has_edge(adj, indices, b, a);
+}
+
+// Same as has_edge but compares positions: any wedge of a -> any wedge of b.
+bool has_position_edge(const vertex_adjacency& adj, const std::vector<uint32_t>& indices,
+	const std::vector<uint32_t>& positions, const std::vector<uint32_t>& wedges, uint32_t a, uint32_t b) noexcept
+{
+	uint32_t w = a;
+	do {
+		for (uint32_t i = adj.offsets[w]; i < adj.offsets[w + 1]; ++i) {
+			const uint32_t* p_tri = &indices[size_t(adj.triangles[i]) * 3];
+			for (size_t c = 0; c < 3; ++c) {
+				if (p_tri[c] == w && positions[p_tri[(c + 1) % 3]] == positions[b]) return true;
+			}
+		}
+		w = wedges[w];
+	} while (w != a);
+
+	return false;
+}
+
+std::vector<vertex_kind> classify_vertices(const vertex_adjacency& adj, const std::vector<uint32_t>& indices,
+	const std::vector<uint32_t>& positions, const std::vector<uint32_t>& wedges)
+{
+	const size_t vertex_count = positions.size();
+	std::vector<vertex_kind> kinds(vertex_count, vertex_kind::locked);
+
+	for (uint32_t v = 0; v < uint32_t(vertex_count); ++v) {
+		if (adj.offsets[v] == adj.offsets[v + 1]) continue;
+
+		uint32_t wedge_count = 0;
+		uint32_t w = v;
+		do { ++wedge_count; w = wedges[w]; } while (w != v);
+
+		// open edges which leave & enter v.
+		uint32_t out_count = 0, in_count = 0;
+		uint32_t open_out = v, open_in = v;
+		for (uint32_t i = adj.offsets[v]; i < adj.offsets[v + 1]; ++i) {
+			const uint32_t* p_tri = &indices[size_t(adj.triangles[i]) * 3];
+			const size_t c = (p_tri[0] == v) ? 0 : ((p_tri[1] == v) ? 1 : 2);
+			const uint32_t next = p_tri[(c + 1) % 3];
+			const uint32_t prev = p_tri[(c + 2) % 3];
+			if (!has_edge(adj, indices, next, v)) { ++out_count; open_out = next; }
+			if (!has_edge(adj, indices, v, prev)) { ++in_count; open_in = prev; }
+		}
+
+		if (out_count == 0 && in_count == 0) {
+			kinds[v] = (wedge_count == 1) ? vertex_kind::manifold : vertex_kind::locked;
+		}
+		else if (out_count == 1 && in_count == 1) {
+			// the edge is a seam if the other side exists in terms of positions.
+			const bool seam_out = has_position_edge(adj, indices, positions, wedges, open_out, v);
+			const bool seam_in = has_position_edge(adj, indices, positions, wedges, v, open_in);
+			if (!seam_out && !seam_in && wedge_count == 1) kinds[v] = vertex_kind::border;
+			else if (seam_out && seam_in && wedge_count == 2) kinds[v] = vertex_kind::seam;
+		}
+	}
+
+	return kinds;
+}
+
+// Returns the wedge of target's position which w collapses into, c_none if the collapse breaks the topology.
+// w is a wedge of the collapsing vertex.
+uint32_t find_collapse_target(const vertex_adjacency& adj, const std::vector<uint32_t>& indices,
+	const std::vector<uint32_t>& wedges, const std::vector<vertex_kind>& kinds, uint32_t w, uint32_t target) noexcept
+{
+	constexpr uint32_t c_none = std::numeric_limits<uint32_t>::max();
+
+	uint32_t t = target;
+	do {
+		switch (kinds[w]) {
+			default: assert(false); break;
+
+			case vertex_kind::manifold: {
+				if (has_edge(adj, indices, w, t) || has_edge(adj, indices, t, w)) return t;
+				break;
+			}
+
+			case vertex_kind::border:
+			case vertex_kind::seam: {
+				if (is_open_edge(adj, indices, w, t)) return t;
+				break;
+			}
+		}
+
+		t = wedges[t];
+	} while (t != target);
+
+	return c_none;
+}
+
+// Returns true if moving the triangles of v's wedges to the position of target flips any of them.
+// Triangles which contain the target position are removed by the collapse and are not checked.
+bool collapse_flips_triangles(const vertex_adjacency& adj, const std::vector<uint32_t>& indices,
+	span<const vertex_t> vertices, const std::vector<uint32_t>& positions, const std::vector<uint32_t>& wedges,
+	uint32_t v, uint32_t target) noexcept
+{
+	const float3& p_target = vertices[target].position;
+
+	uint32_t w = v;
+	do {
+		for (uint32_t i = adj.offsets[w]; i < adj.offsets[w + 1]; ++i) {
+			const uint32_t* p_tri = &indices[size_t(adj.triangles[i]) * 3];
+			if (positions[p_tri[0]] == positions[target] || positions[p_tri[1]] == positions[target]
+				|| positions[p_tri[2]] == positions[target]) continue;
+
+			float3 p[3] = { vertices[p_tri[0]].position, vertices[p_tri[1]].position, vertices[p_tri[2]].position };
+			const float3 n_before = cross(p[1] - p[0], p[2] - p[0]);
+			for (size_t c = 0; c < 3; ++c) {
+				if (p_tri[c] == w) p[c] = p_target;
+			}
+			const float3 n_after = cross(p[1] - p[0], p[2] - p[0]);
+
+			if (dot(n_before, n_after) <= 0.0f) return true;
+		}
+		w = wedges[w];
+	} while (w != v);
+
+	return false;
+}
+
+// ----- tangent space -----
+
+// The weighted tangent of one triangle corner.
+// xyz: the triangle's tangent projected onto the corner's tangent plane, scaled by the corner's angle.
+// w: 1 if the triangle preserves the uv orientation, -1 if its uvs are mirrored, 0 if the uvs are degenerate.
+struct alignas(16) tangent_contribution final {
+	float v[4];
+};
+
+// Returns the remap table: attributes[v] is the first vertex which has the same position, normal & uv as v
+// (the tangent space is ignored). MikkTSpace shares tangent spaces between such vertices.
+std::vector<uint32_t> make_attribute_remap(span<const vertex_t> vertices)
+{
+	const size_t vertex_count = vertices.size();
+
+	std::vector<weld_key> keys(vertex_count);
+	std::vector<uint64_t> hashes(vertex_count);
+	parallel_for(vertex_count, 1024, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			keys[i] = make_weld_key(vertices[i], 0.0f);
+			keys[i].values[8] = 0;
+			hashes[i] = hash_bytes(&keys[i], sizeof(weld_key));
+		}
+	});
+
+	// open addressing, the table is at most half full.
+	constexpr uint32_t c_empty = std::numeric_limits<uint32_t>::max();
+	size_t table_size = 16;
+	while (table_size < vertex_count * 2) table_size <<= 1;
+	const size_t mask = table_size - 1;
+	std::vector<uint32_t> table(table_size, c_empty);
+	std::vector<uint32_t> attributes(vertex_count);
+
+	for (size_t v = 0; v < vertex_count; ++v) {
+		size_t slot = size_t(hashes[v]) & mask;
+		while (true) {
+			const uint32_t candidate = table[slot];
+			if (candidate == c_empty) {
+				table[slot] = uint32_t(v);
+				attributes[v] = uint32_t(v);
+				break;
+			}
+
+			if (keys[candidate] == keys[v]) {
+				attributes[v] = candidate;
+				break;
+			}
+
+			slot = (slot + 1) & mask;
+		}
+	}
+
+	return attributes;
+}
+
+inline float3 project_normalized(const float3& v, const float3& n) noexcept
+{
+	const float3 p = v - dot(n, v) * n;
+	const float l = len(p);
+	return (l > 0.0f) ? (p / l) : p;
+}
+
+// Computes the contributions of the triangle's corners, see MikkTSpace's InitTriInfo & EvalTspace.
+void compute_tangent_contributions(const uint32_t* p_tri, span<const vertex_t> vertices,
+	tangent_contribution* p_out) noexcept
+{
+	const vertex_t& v0 = vertices[p_tri[0]];
+	const vertex_t& v1 = vertices[p_tri[1]];
+	const vertex_t& v2 = vertices[p_tri[2]];
+
+	const float3 e1 = v1.position - v0.position;
+	const float3 e2 = v2.position - v0.position;
+	const float t21x = v1.uv.x - v0.uv.x;
+	const float t21y = v1.uv.y - v0.uv.y;
+	const float t31x = v2.uv.x - v0.uv.x;
+	const float t31y = v2.uv.y - v0.uv.y;
+	const float signed_area_uv = t21x * t31y - t21y * t31x;
+
+	// the direction of increasing u, mirrored uvs flip it back.
+	const float3 os_raw = t31y * e1 - t21y * e2;
+	const float os_len = len(os_raw);
+	const bool degenerate = (std::abs(signed_area_uv) <= std::numeric_limits<float>::min())
+		|| (os_len <= std::numeric_limits<float>::min());
+	const float orientation = (signed_area_uv > 0.0f) ? 1.0f : -1.0f;
+	const float3 os = os_raw * (orientation / std::max(os_len, std::numeric_limits<float>::min()));
+
+	const vertex_t* corners[3] = { &v0, &v1, &v2 };
+	for (size_t c = 0; c < 3; ++c) {
+		tangent_contribution& out = p_out[c];
+		if (degenerate) {
+			out = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+			continue;
+		}
+
+		const vertex_t& prev = *corners[(c + 2) % 3];
+		const vertex_t& curr = *corners[c];
+		const vertex_t& next = *corners[(c + 1) % 3];
+		const float3& n = curr.normal;
+
+		// the corner's angle within the tangent plane.
+		const float3 a = project_normalized(prev.position - curr.position, n);
+		const float3 b = project_normalized(next.position - curr.position, n);
+		const float angle = std::acos(std::min(1.0f, std::max(-1.0f, dot(a, b))));
+		const float3 t = angle * project_normalized(os, n);
+
+		out = { { t.x, t.y, t.z, orientation } };
+	}
+}
+
+// Returns the tangent space packed as vertex_t::tangent_h. A zero tangent is replaced by an arbitrary
+// unit vector which is orthogonal to the normal.
+uint32_t pack_tangent_space(float3 t, const float3& n, float orientation) noexcept
+{
+	float l = len(t);
+	if (!(l > 0.0f)) {
+		t = (std::abs(n.x) < 0.9f) ? cross(n, float3::unit_x) : cross(n, float3::unit_y);
+		l = len(t);
+		if (!(l > 0.0f)) t = float3::unit_x, l = 1.0f;
+	}
+
+	return math::pack_unorm_10_10_10_2(math::float4(t / l, orientation) * 0.5f + 0.5f);
+}
+
+// acc += c, component-wise.
+inline void accumulate_tangent(tangent_contribution& acc, const tangent_contribution& c) noexcept
+{
+#if defined(SPARKI_GEOMETRY_SSE)
+	_mm_store_ps(acc.v, _mm_add_ps(_mm_load_ps(acc.v), _mm_load_ps(c.v)));
+#else
+	for (size_t i = 0; i < 4; ++i) acc.v[i] += c.v[i];
+#endif
+}
+
+// ----- bounds -----
+
+constexpr size_t c_bounds_chunk_size = 16384;
+
+// The box of a range of points & the points which are extreme along each axis. Lanes 0-2 are x, y, z.
+struct bounds_accumulator final {
+	alignas(16) float		min[4];
+	alignas(16) float		max[4];
+	alignas(16) uint32_t	min_points[4];
+	alignas(16) uint32_t	max_points[4];
+};
+
+// The i-th point of the range: p_vertices[p_indices[i]] or p_vertices[i] if there are no indices.
+inline const float3& bounds_point(const vertex_t* p_vertices, const uint32_t* p_indices, size_t i) noexcept
+{
+	return p_vertices[p_indices ? p_indices[i] : i].position;
+}
+
+bounds_accumulator make_bounds_accumulator() noexcept
+{
+	constexpr float c_max = std::numeric_limits<float>::max();
+
+	bounds_accumulator acc;
+	for (size_t c = 0; c < 4; ++c) {
+		acc.min[c] = c_max;
+		acc.max[c] = -c_max;
+		acc.min_points[c] = 0;
+		acc.max_points[c] = 0;
+	}
+
+	return acc;
+}
+
+void accumulate_bounds(const vertex_t* p_vertices, const uint32_t* p_indices, size_t begin, size_t end,
+	bounds_accumulator& acc) noexcept
+{
+#if defined(SPARKI_GEOMETRY_SSE)
+	// one point per iteration, the lanes track x, y, z (lane 3 reads normal.x & is ignored).
+	__m128 mn = _mm_load_ps(acc.min);
+	__m128 mx = _mm_load_ps(acc.max);
+	__m128i mn_points = _mm_load_si128(reinterpret_cast<const __m128i*>(acc.min_points));
+	__m128i mx_points = _mm_load_si128(reinterpret_cast<const __m128i*>(acc.max_points));
+
+	for (size_t i = begin; i < end; ++i) {
+		const __m128 p = _mm_loadu_ps(&bounds_point(p_vertices, p_indices, i).x);
+		const __m128i index = _mm_set1_epi32(int32_t(i));
+		const __m128i lt = _mm_castps_si128(_mm_cmplt_ps(p, mn));
+		const __m128i gt = _mm_castps_si128(_mm_cmpgt_ps(p, mx));
+		mn_points = _mm_or_si128(_mm_and_si128(lt, index), _mm_andnot_si128(lt, mn_points));
+		mx_points = _mm_or_si128(_mm_and_si128(gt, index), _mm_andnot_si128(gt, mx_points));
+		mn = _mm_min_ps(mn, p);
+		mx = _mm_max_ps(mx, p);
+	}
+
+	_mm_store_ps(acc.min, mn);
+	_mm_store_ps(acc.max, mx);
+	_mm_store_si128(reinterpret_cast<__m128i*>(acc.min_points), mn_points);
+	_mm_store_si128(reinterpret_cast<__m128i*>(acc.max_points), mx_points);
+#else
+	for (size_t i = begin; i < end; ++i) {
+		const float3& pt = bounds_point(p_vertices, p_indices, i);
+		const float p[3] = { pt.x, pt.y, pt.z };
+		for (size_t c = 0; c < 3; ++c) {
+			if (p[c] < acc.min[c]) {
+				acc.min[c] = p[c];
+				acc.min_points[c] = uint32_t(i);
+			}
+			if (p[c] > acc.max[c]) {
+				acc.max[c] = p[c];
+				acc.max_points[c] = uint32_t(i);
+			}
+		}
+	}
+#endif
+}
+
+void merge_bounds(bounds_accumulator& acc, const bounds_accumulator& other) noexcept
+{
+	for (size_t c = 0; c < 3; ++c) {
+		if (other.min[c] < acc.min[c]) {
+			acc.min[c] = other.min[c];
+			acc.min_points[c] = other.min_points[c];
+		}
+		if (other.max[c] > acc.max[c]) {
+			acc.max[c] = other.max[c];
+			acc.max_points[c] = other.max_points[c];
+		}
+	}
+}
+
+// Returns the squared distance from center to the farthest point of the range.
+float max_distance_sq(const vertex_t* p_vertices, const uint32_t* p_indices, size_t begin, size_t end,
+	const float3& center) noexcept
+{
+#if defined(SPARKI_GEOMETRY_SSE)
+	const __m128 c = _mm_setr_ps(center.x, center.y, center.z, 0.0f);
+	const __m128 xyz_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	__m128 max_d = _mm_setzero_ps();
+
+	for (size_t i = begin; i < end; ++i) {
+		const __m128 p = _mm_loadu_ps(&bounds_point(p_vertices, p_indices, i).x);
+		const __m128 d = _mm_and_ps(_mm_sub_ps(p, c), xyz_mask);
+		const __m128 d2 = _mm_mul_ps(d, d);
+		// horizontal sum: (x + z, y + w, ...) then x + y.
+		const __m128 s = _mm_add_ps(d2, _mm_movehl_ps(d2, d2));
+		max_d = _mm_max_ss(max_d, _mm_add_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1))));
+	}
+
+	return _mm_cvtss_f32(max_d);
+#else
+	float max_d = 0.0f;
+	for (size_t i = begin; i < end; ++i)
+		max_d = std::max(max_d, len_squared(bounds_point(p_vertices, p_indices, i) - center));
+
+	return max_d;
+#endif
+}
+
+// The bounds of count points (see bounds_point). The box & the extreme points are accumulated on worker threads.
+// The sphere is the smaller one of:
+// - Ritter's sphere: starts from the most distant pair of axis-extreme points and grows to enclose all the points;
+// - the sphere around the box's centre which reaches the farthest point.
+mesh_bounds compute_point_bounds(const vertex_t* p_vertices, const uint32_t* p_indices, size_t count)
+{
+	assert(p_vertices);
+	assert(count > 0);
+
+	const size_t chunk_count = (count + c_bounds_chunk_size - 1) / c_bounds_chunk_size;
+	std::vector<bounds_accumulator> accumulators(chunk_count, make_bounds_accumulator());
+	parallel_for(chunk_count, 1, [&](size_t begin, size_t end) {
+		for (size_t c = begin; c < end; ++c) {
+			const size_t first = c * c_bounds_chunk_size;
+			accumulate_bounds(p_vertices, p_indices, first, std::min(count, first + c_bounds_chunk_size),
+				accumulators[c]);
+		}
+	});
+
+	bounds_accumulator acc = accumulators[0];
+	for (size_t c = 1; c < chunk_count; ++c)
+		merge_bounds(acc, accumulators[c]);
+
+	mesh_bounds b;
+	b.min = float3(acc.min[0], acc.min[1], acc.min[2]);
+	b.max = float3(acc.max[0], acc.max[1], acc.max[2]);
+
+	// the radius of the sphere around center which encloses all the points.
+	std::vector<float> distances(chunk_count);
+	auto enclosing_radius = [&](const float3& center) {
+		parallel_for(chunk_count, 1, [&](size_t begin, size_t end) {
+			for (size_t c = begin; c < end; ++c) {
+				const size_t first = c * c_bounds_chunk_size;
+				distances[c] = max_distance_sq(p_vertices, p_indices, first,
+					std::min(count, first + c_bounds_chunk_size), center);
+			}
+		});
+
+		return std::sqrt(*std::max_element(distances.cbegin(), distances.cend()));
+	};
+
+	// box sphere
+	const float3 box_center = (b.min + b.max) * 0.5f;
+	const float box_radius = enclosing_radius(box_center);
+
+	// Ritter's sphere
+	size_t axis = 0;
+	float max_span_sq = -1.0f;
+	for (size_t c = 0; c < 3; ++c) {
+		const float span_sq = len_squared(bounds_point(p_vertices, p_indices, acc.max_points[c])
+			- bounds_point(p_vertices, p_indices, acc.min_points[c]));
+		if (span_sq > max_span_sq) {
+			max_span_sq = span_sq;
+			axis = c;
+		}
+	}
+
+	const float3& p_min = bounds_point(p_vertices, p_indices, acc.min_points[axis]);
+	const float3& p_max = bounds_point(p_vertices, p_indices, acc.max_points[axis]);
+	float3 center = (p_min + p_max) * 0.5f;
+	float radius = std::sqrt(max_span_sq) * 0.5f;
+	for (size_t i = 0; i < count; ++i) {
+		const float3& p = bounds_point(p_vertices, p_indices, i);
+		const float d_sq = len_squared(p - center);
+		if (d_sq <= radius * radius) continue;
+
+		// move the centre towards p so that the new sphere touches p & the far side of the old one.
+		const float d = std::sqrt(d_sq);
+		const float new_radius = (radius + d) * 0.5f;
+		center += (p - center) * ((new_radius - radius) / d);
+		radius = new_radius;
+	}
+	// the moved centre may leave the earlier points outside by rounding errors.
+	radius = std::max(radius, enclosing_radius(center));
+
+	if (radius < box_radius) {
+		b.center = center;
+		b.radius = radius;
+	}
+	else {
+		b.center = box_center;
+		b.radius = box_radius;
+	}
+
+	return b;
+}
+
+} // namespace
+
+
+namespace sparki {
+namespace core {
+
+mesh_geometry<vertex_attribs::p_n_uv_ts> weld_vertices(
+	const mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh, const weld_desc& desc)
+{
+	assert(mesh.vertices.size() > 0);
+	assert(mesh.indices.size() > 0);
+	assert(desc.epsilon >= 0.0f);
+
+	const size_t vertex_count = mesh.vertices.size();
+	const size_t index_count = mesh.indices.size();
+
+	std::vector<weld_key> keys(vertex_count);
+	std::vector<uint64_t> hashes(vertex_count);
+	parallel_for(vertex_count, 1024, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			keys[i] = make_weld_key(mesh.vertices[i], desc.epsilon);
+			hashes[i] = hash_bytes(&keys[i], sizeof(weld_key));
+		}
+	});
+
+	// open addressing, the table is at most half full.
+	constexpr uint32_t c_empty = std::numeric_limits<uint32_t>::max();
+	size_t table_size = 16;
+	while (table_size < vertex_count * 2) table_size <<= 1;
+	const size_t mask = table_size - 1;
+	std::vector<uint32_t> table(table_size, c_empty);	// new vertex index
+	std::vector<uint32_t> remap(vertex_count, c_empty);	// old vertex index -> new vertex index
+	std::vector<uint32_t> representatives;				// new vertex index -> old vertex index
+	representatives.reserve(vertex_count);
+
+	mesh_geometry<vertex_attribs::p_n_uv_ts> out;
+	out.indices.resize(index_count);
+
+	for (size_t i = 0; i < index_count; ++i) {
+		const uint32_t old_index = mesh.indices[i];
+		assert(old_index < vertex_count);
+
+		if (remap[old_index] == c_empty) {
+			size_t slot = size_t(hashes[old_index]) & mask;
+			while (true) {
+				const uint32_t candidate = table[slot];
+				if (candidate == c_empty) {
+					table[slot] = uint32_t(representatives.size());
+					remap[old_index] = uint32_t(representatives.size());
+					representatives.push_back(old_index);
+					break;
+				}
+
+				if (keys[representatives[candidate]] == keys[old_index]) {
+					remap[old_index] = candidate;
+					break;
+				}
+
+				slot = (slot + 1) & mask;
+			}
+		}
+
+		out.indices[i] = remap[old_index];
+	}
+
+	out.vertices.resize(representatives.size());
+	for (size_t i = 0; i < representatives.size(); ++i)
+		out.vertices[i] = mesh.vertices[representatives[i]];
+	out.index_fmt = pick_index_format(out.vertices.size());
+	// the triangle order does not change.
+	out.meshlets = mesh.meshlets;
+	out.lods = mesh.lods;
+	out.submeshes = mesh.submeshes;
+
+	return out;
+}
+
+void generate_tangents(mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh)
+{
+	assert(mesh.vertices.size() > 0);
+	assert(mesh.indices.size() % 3 == 0);
+
+	const size_t vertex_count = mesh.vertices.size();
+	const size_t index_count = mesh.indices.size();
+	const span<const vertex_t> vertices(mesh.vertices.data(), vertex_count);
+
+	// canonical vertex of each corner
+	const std::vector<uint32_t> attributes = make_attribute_remap(vertices);
+	std::vector<uint32_t> corner_vertices(index_count);
+	parallel_for(index_count, 4096, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			assert(mesh.indices[i] < vertex_count);
+			corner_vertices[i] = attributes[mesh.indices[i]];
+		}
+	});
+
+	std::vector<tangent_contribution> contributions(index_count);
+	parallel_for(index_count / 3, 1024, [&](size_t begin, size_t end) {
+		for (size_t t = begin; t < end; ++t)
+			compute_tangent_contributions(mesh.indices.data() + 3 * t, vertices, contributions.data() + 3 * t);
+	});
+
+	// corners of each canonical vertex: corners[offsets[v], offsets[v + 1])
+	std::vector<uint32_t> offsets(vertex_count + 1, 0);
+	for (uint32_t v : corner_vertices) ++offsets[v + 1];
+	for (size_t v = 0; v < vertex_count; ++v) offsets[v + 1] += offsets[v];
+
+	std::vector<uint32_t> corners(index_count);
+	{
+		std::vector<uint32_t> cursors(offsets.cbegin(), offsets.cend() - 1);
+		for (size_t i = 0; i < index_count; ++i)
+			corners[cursors[corner_vertices[i]]++] = uint32_t(i);
+	}
+
+	// Corners of a vertex share the tangent space if their triangles have the same uv orientation.
+	// Degenerate corners take the orientation which is present (uv preserving if both are).
+	std::vector<uint32_t> corner_ts(index_count);
+	parallel_for(vertex_count, 1024, [&](size_t begin, size_t end) {
+		for (size_t v = begin; v < end; ++v) {
+			const uint32_t first = offsets[v];
+			const uint32_t last = offsets[v + 1];
+			if (first == last) continue;
+
+			tangent_contribution preserving = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+			tangent_contribution mirrored = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+			for (uint32_t c = first; c < last; ++c) {
+				const tangent_contribution& tc = contributions[corners[c]];
+				if (tc.v[3] > 0.0f) accumulate_tangent(preserving, tc);
+				else if (tc.v[3] < 0.0f) accumulate_tangent(mirrored, tc);
+			}
+
+			const float3& n = vertices[v].normal;
+			const uint32_t ts_preserving = pack_tangent_space(
+				float3(preserving.v[0], preserving.v[1], preserving.v[2]), n, 1.0f);
+			const uint32_t ts_mirrored = pack_tangent_space(
+				float3(mirrored.v[0], mirrored.v[1], mirrored.v[2]), n, -1.0f);
+			const bool degenerate_preserves = (preserving.v[3] > 0.0f) || !(mirrored.v[3] < 0.0f);
+
+			for (uint32_t c = first; c < last; ++c) {
+				const float w = contributions[corners[c]].v[3];
+				const bool preserves = (w > 0.0f) || ((w == 0.0f) && degenerate_preserves);
+				corner_ts[corners[c]] = preserves ? ts_preserving : ts_mirrored;
+			}
+		}
+	});
+
+	// The first corner of a vertex sets its tangent space, a corner with a different one
+	// gets a copy of the vertex.
+	std::vector<bool> assigned(vertex_count, false);
+	std::unordered_map<uint64_t, uint32_t> splits;
+	for (size_t i = 0; i < index_count; ++i) {
+		const uint32_t index = mesh.indices[i];
+		const uint32_t ts = corner_ts[i];
+
+		if (!assigned[index]) {
+			assigned[index] = true;
+			mesh.vertices[index].tangent_h = ts;
+			continue;
+		}
+
+		if (mesh.vertices[index].tangent_h == ts) continue;
+
+		const uint64_t key = (uint64_t(index) << 32) | ts;
+		auto it = splits.find(key);
+		if (it == splits.cend()) {
+			vertex_t v = mesh.vertices[index];
+			v.tangent_h = ts;
+			mesh.vertices.push_back(v);
+			it = splits.emplace(key, uint32_t(mesh.vertices.size() - 1)).first;
+		}
+
+		mesh.indices[i] = it->second;
+	}
+
+	if (mesh.index_fmt == index_format::uint16)
+		mesh.index_fmt = pick_index_format(mesh.vertices.size());
+}
+
+vertex_cache_stats analyze_vertex_cache(span<const uint32_t> indices, size_t vertex_count, uint32_t cache_size)
+{
+	assert(indices.size() % 3 == 0);
+	assert(cache_size > 0);
+
+	vertex_cache_stats stats;
+	if (indices.empty()) return stats;
+
+	std::vector<uint32_t> timestamps(vertex_count, 0);
+	std::vector<bool> referenced(vertex_count, false);
+	uint32_t time = cache_size + 1;
+	size_t misses = 0;
+	size_t referenced_count = 0;
+
+	for (size_t t = 0; t < indices.size(); t += 3) {
+		misses += simulate_fifo_cache(&indices[t], cache_size, timestamps, time);
+
+		for (size_t k = 0; k < 3; ++k) {
+			if (referenced[indices[t + k]]) continue;
+			referenced[indices[t + k]] = true;
+			++referenced_count;
+		}
+	}
+
+	stats.acmr = float(misses) / float(indices.size() / 3);
+	stats.atvr = float(misses) / float(referenced_count);
+	return stats;
+}
+
+void optimize_vertex_cache(span<uint32_t> indices, size_t vertex_count)
+{
+	assert(indices.size() % 3 == 0);
+	if (indices.empty()) return;
+
+	constexpr uint32_t c_none = std::numeric_limits<uint32_t>::max();
+
+	const size_t triangle_count = indices.size() / 3;
+	// the active triangles of each vertex are kept at the front of its adjacency list.
+	vertex_adjacency adj = make_vertex_adjacency(indices, vertex_count);
+
+	std::vector<uint32_t> active_counts(vertex_count);
+	std::vector<int32_t> cache_positions(vertex_count, -1);
+	std::vector<float> vertex_scores(vertex_count);
+	for (size_t v = 0; v < vertex_count; ++v) {
+		active_counts[v] = adj.offsets[v + 1] - adj.offsets[v];
+		vertex_scores[v] = forsyth_vertex_score(-1, active_counts[v]);
+	}
+
+	auto triangle_score = [&](uint32_t t) {
+		return vertex_scores[indices[t * 3]] + vertex_scores[indices[t * 3 + 1]] + vertex_scores[indices[t * 3 + 2]];
+	};
+
+	std::vector<bool> emitted(triangle_count, false);
+	std::vector<uint32_t> out(indices.size());
+	// the cache temporarily holds 3 extra vertices, before it is trimmed.
+	std::vector<uint32_t> cache, next_cache;
+	cache.reserve(c_forsyth_cache_size + 3);
+	next_cache.reserve(c_forsyth_cache_size + 3);
+	size_t next_unemitted = 0;
+
+	uint32_t best_triangle = 0;
+	for (uint32_t t = 1; t < triangle_count; ++t) {
+		if (triangle_score(t) > triangle_score(best_triangle)) best_triangle = t;
+	}
+
+	for (size_t i = 0; i < triangle_count; ++i) {
+		if (best_triangle == c_none) {
+			// no candidates around the cached vertices, take the next triangle in the original order.
+			while (emitted[next_unemitted]) ++next_unemitted;
+			best_triangle = uint32_t(next_unemitted);
+		}
+
+		const uint32_t tri[3] = {
+			indices[size_t(best_triangle) * 3],
+			indices[size_t(best_triangle) * 3 + 1],
+			indices[size_t(best_triangle) * 3 + 2]
+		};
+		emitted[best_triangle] = true;
+		std::copy(tri, tri + 3, &out[i * 3]);
+
+		// the triangle's vertices move to the front of the lru cache, the triangle becomes inactive.
+		// A degenerate triangle repeats a vertex, the cache must hold it once.
+		next_cache.clear();
+		for (uint32_t v : tri) {
+			if (std::find(next_cache.cbegin(), next_cache.cend(), v) == next_cache.cend())
+				next_cache.push_back(v);
+
+			uint32_t* p_list = &adj.triangles[adj.offsets[v]];
+			const uint32_t count = active_counts[v]--;
+			std::swap(*std::find(p_list, p_list + count, best_triangle), p_list[count - 1]);
+		}
+		for (uint32_t v : cache) {
+			if (v != tri[0] && v != tri[1] && v != tri[2]) next_cache.push_back(v);
+		}
+		for (size_t c = c_forsyth_cache_size; c < next_cache.size(); ++c) {
+			const uint32_t v = next_cache[c];
+			cache_positions[v] = -1;
+			vertex_scores[v] = forsyth_vertex_score(-1, active_counts[v]);
+		}
+		if (next_cache.size() > c_forsyth_cache_size) next_cache.resize(c_forsyth_cache_size);
+		cache.swap(next_cache);
+
+		for (size_t c = 0; c < cache.size(); ++c) {
+			cache_positions[cache[c]] = int32_t(c);
+			vertex_scores[cache[c]] = forsyth_vertex_score(int32_t(c), active_counts[cache[c]]);
+		}
+
+		// the next triangle is the best one among the active triangles of the cached vertices.
+		best_triangle = c_none;
+		float best_score = -1.0f;
+		for (uint32_t v : cache) {
+			const uint32_t* p_list = &adj.triangles[adj.offsets[v]];
+
+			for (uint32_t j = 0; j < active_counts[v]; ++j) {
+				const float score = triangle_score(p_list[j]);
+				if (score > best_score) {
+					best_score = score;
+					best_triangle = p_list[j];
+				}
+			}
+		}
+	}
+
+	std::copy(out.cbegin(), out.cend(), indices.begin());
+}
+
+void optimize_overdraw(span<uint32_t> indices, span<const vertex<vertex_attribs::p_n_uv_ts>> vertices,
+	float threshold, uint32_t cache_size)
+{
+	assert(indices.size() % 3 == 0);
+	assert(threshold >= 1.0f);
+	if (indices.empty()) return;
+
+	const std::vector<uint32_t> clusters = make_overdraw_clusters(indices, vertices.size(), cache_size, threshold);
+	const size_t cluster_count = clusters.size();
+	const uint32_t triangle_count = uint32_t(indices.size() / 3);
+
+	// mesh centroid (area weighted)
+	float3 mesh_centroid(0.0f);
+	float mesh_area = 0.0f;
+	std::vector<float3> cluster_centroids(cluster_count);
+	std::vector<float3> cluster_normals(cluster_count);
+
+	for (size_t c = 0; c < cluster_count; ++c) {
+		const uint32_t end = (c + 1 < cluster_count) ? clusters[c + 1] : triangle_count;
+		float3 centroid(0.0f);
+		float3 normal(0.0f);
+		float area = 0.0f;
+
+		for (uint32_t t = clusters[c]; t < end; ++t) {
+			const float3& p0 = vertices[indices[t * 3]].position;
+			const float3& p1 = vertices[indices[t * 3 + 1]].position;
+			const float3& p2 = vertices[indices[t * 3 + 2]].position;
+			const float3 n = cross(p1 - p0, p2 - p0); // |n| = 2 * area
+			const float a = len(n);
+
+			centroid += (p0 + p1 + p2) * (a / 3.0f);
+			normal += n;
+			area += a;
+		}
+
+		mesh_centroid += centroid;
+		mesh_area += area;
+		cluster_centroids[c] = (area > 0.0f) ? centroid / area : centroid;
+		cluster_normals[c] = normal;
+	}
+	if (mesh_area > 0.0f) mesh_centroid /= mesh_area;
+
+	// clusters which face away from the mesh centre are likely to occlude the others, draw them first.
+	std::vector<float> sort_keys(cluster_count);
+	std::vector<uint32_t> order(cluster_count);
+	for (size_t c = 0; c < cluster_count; ++c) {
+		const float nl = len(cluster_normals[c]);
+		const float3 n = (nl > 0.0f) ? cluster_normals[c] / nl : float3(0.0f);
+		sort_keys[c] = dot(cluster_centroids[c] - mesh_centroid, n);
+		order[c] = uint32_t(c);
+	}
+	std::stable_sort(order.begin(), order.end(),
+		[&sort_keys](uint32_t l, uint32_t r) { return sort_keys[l] > sort_keys[r]; });
+
+	std::vector<uint32_t> out;
+	out.reserve(indices.size());
+	for (uint32_t c : order) {
+		const uint32_t end = (c + 1 < cluster_count) ? clusters[c + 1] : triangle_count;
+		out.insert(out.end(), &indices[size_t(clusters[c]) * 3], &indices[0] + size_t(end) * 3);
+	}
+
+	std::copy(out.cbegin(), out.cend(), indices.begin());
+}
+
+void optimize_vertex_fetch(mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh)
+{
+	constexpr uint32_t c_unused = std::numeric_limits<uint32_t>::max();
+
+	std::vector<uint32_t> remap(mesh.vertices.size(), c_unused);
+	aligned_buffer<vertex<vertex_attribs::p_n_uv_ts>> vertices(mesh.vertices.size());
+	uint32_t next = 0;
+
+	for (uint32_t& i : mesh.indices) {
+		if (remap[i] == c_unused) {
+			vertices[next] = mesh.vertices[i];
+			remap[i] = next++;
+		}
+		i = remap[i];
+	}
+
+	// vertices which are not referenced by any triangle are dropped.
+	vertices.resize(next);
+	mesh.vertices = std::move(vertices);
+}
+
+mesh_optimization_report optimize_mesh(mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh, float overdraw_threshold)
+{
+	assert(mesh.vertices.size() > 0);
+	assert(mesh.indices.size() > 0);
+
+	const span<uint32_t> indices(mesh.indices.data(), mesh.indices.size());
+	const span<const vertex<vertex_attribs::p_n_uv_ts>> vertices(mesh.vertices.data(), mesh.vertices.size());
+
+	assert(mesh.lods.size() == 0);
+
+	mesh_optimization_report report;
+	report.before = analyze_vertex_cache(indices, vertices.size());
+
+	// triangles are reordered within their submeshes.
+	for (const submesh& sm : submesh_ranges(mesh, 0)) {
+		const span<uint32_t> range(indices.data() + sm.first_index, sm.index_count);
+		optimize_vertex_cache(range, vertices.size());
+		optimize_overdraw(range, vertices, overdraw_threshold);
+	}
+	optimize_vertex_fetch(mesh);
+
+	report.after = analyze_vertex_cache(span<const uint32_t>(mesh.indices.data(), mesh.indices.size()),
+		mesh.vertices.size());
+	return report;
+}
+
+std::vector<uint32_t> simplify_mesh(span<const uint32_t> indices, span<const vertex<vertex_attribs::p_n_uv_ts>> vertices,
+	size_t target_index_count, float target_error, float* p_error)
+{
+	assert(indices.size() % 3 == 0);
+	assert(target_error >= 0.0f);
+
+	constexpr uint32_t c_none = std::numeric_limits<uint32_t>::max();
+	const size_t vertex_count = vertices.size();
+	std::vector<uint32_t> result(indices.begin(), indices.end());
+	if (p_error) *p_error = 0.0f;
+	if (result.size() <= target_index_count) return result;
+
+	// wedges[v] is the next vertex which has the same position (a circular list).
+	const std::vector<uint32_t> positions = make_position_remap(vertices);
+	std::vector<uint32_t> wedges(vertex_count);
+	for (uint32_t v = 0; v < uint32_t(vertex_count); ++v) {
+		const uint32_t p = positions[v];
+		if (p == v) {
+			wedges[v] = v;
+		}
+		else {
+			wedges[v] = wedges[p];
+			wedges[p] = v;
+		}
+	}
+
+	vertex_adjacency adj = make_vertex_adjacency(span<const uint32_t>(result.data(), result.size()), vertex_count);
+	const std::vector<vertex_kind> kinds = classify_vertices(adj, result, positions, wedges);
+
+	// quadrics are accumulated per position, so that the wedges of a seam share the error.
+	std::vector<quadric> quadrics(vertex_count);
+	for (size_t i = 0; i < result.size(); i += 3) {
+		const uint32_t* p_tri = &result[i];
+		const float3 n = cross(vertices[p_tri[1]].position - vertices[p_tri[0]].position,
+			vertices[p_tri[2]].position - vertices[p_tri[0]].position);
+		const float l = len(n);
+		if (l == 0.0f) continue;
+
+		const float3 face_n = n / l;
+		for (size_t c = 0; c < 3; ++c) {
+			const float3& p0 = vertices[p_tri[c]].position;
+			add_plane(quadrics[positions[p_tri[c]]], face_n, -dot(face_n, p0), 0.5 * l);
+
+			// open border or seam: a plane which is perpendicular to the face keeps the edge in place.
+			const uint32_t next = p_tri[(c + 1) % 3];
+			if (has_edge(adj, result, next, p_tri[c])) continue;
+
+			const float3 edge = vertices[next].position - p0;
+			const float3 edge_n = cross(edge, face_n);
+			const float el = len(edge_n);
+			if (el == 0.0f) continue;
+
+			const float3 plane_n = edge_n / el;
+			const double weight = c_border_plane_weight * double(len_squared(edge));
+			add_plane(quadrics[positions[p_tri[c]]], plane_n, -dot(plane_n, p0), weight);
+			add_plane(quadrics[positions[next]], plane_n, -dot(plane_n, p0), weight);
+		}
+	}
+
+	const double max_cost = double(target_error) * double(target_error);
+	double result_cost = 0.0;
+	std::vector<uint32_t> targets(vertex_count);
+	std::vector<double> costs(vertex_count);
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> remap(vertex_count);
+	std::vector<uint8_t> touched(vertex_count);
+
+	while (result.size() > target_index_count) {
+		// the cheapest valid collapse of each vertex.
+		parallel_for(vertex_count, 1024, [&](size_t begin, size_t end) {
+			for (uint32_t v = uint32_t(begin); v < uint32_t(end); ++v) {
+				targets[v] = c_none;
+				costs[v] = std::numeric_limits<double>::max();
+				if (kinds[v] == vertex_kind::locked) continue;
+
+				for (uint32_t i = adj.offsets[v]; i < adj.offsets[v + 1]; ++i) {
+					const uint32_t* p_tri = &result[size_t(adj.triangles[i]) * 3];
+					for (size_t c = 0; c < 3; ++c) {
+						const uint32_t t = p_tri[c];
+						if (positions[t] == positions[v]) continue;
+						if (find_collapse_target(adj, result, wedges, kinds, v, t) != t) continue;
+
+						// both wedges of a seam must be able to collapse.
+						if (kinds[v] == vertex_kind::seam && (kinds[wedges[v]] != vertex_kind::seam
+							|| find_collapse_target(adj, result, wedges, kinds, wedges[v], t) == c_none)) continue;
+
+						const double cost = evaluate_quadric(quadrics[positions[v]], vertices[t].position);
+						if (cost < costs[v]) {
+							costs[v] = cost;
+							targets[v] = t;
+						}
+					}
+				}
+			}
+		});
+
+		// both wedges of a seam may be in the list, the second one is skipped as a touched vertex.
+		order.clear();
+		for (uint32_t v = 0; v < uint32_t(vertex_count); ++v) {
+			if (targets[v] != c_none && costs[v] <= max_cost) order.push_back(v);
+		}
+		std::sort(order.begin(), order.end(), [&costs](uint32_t l, uint32_t r) { return costs[l] < costs[r]; });
+
+		// Collapse the cheapest edges. A collapse changes the one-ring of the removed vertex,
+		// the vertices of the ring are not touched again in this pass.
+		for (uint32_t v = 0; v < uint32_t(vertex_count); ++v) remap[v] = v;
+		std::fill(touched.begin(), touched.end(), uint8_t(0));
+		size_t triangle_count = result.size() / 3;
+		size_t collapse_count = 0;
+
+		for (uint32_t v : order) {
+			if (triangle_count * 3 <= target_index_count) break;
+
+			const uint32_t t = targets[v];
+			if (touched[positions[v]] || touched[positions[t]]) continue;
+			if (collapse_flips_triangles(adj, result, vertices, positions, wedges, v, t)) continue;
+
+			uint32_t w = v;
+			do {
+				remap[w] = find_collapse_target(adj, result, wedges, kinds, w, t);
+				assert(remap[w] != c_none);
+
+				for (uint32_t i = adj.offsets[w]; i < adj.offsets[w + 1]; ++i) {
+					const uint32_t* p_tri = &result[size_t(adj.triangles[i]) * 3];
+					bool removed = false;
+					for (size_t c = 0; c < 3; ++c) {
+						touched[positions[p_tri[c]]] = 1;
+						removed |= (positions[p_tri[c]] == positions[t]);
+					}
+					if (removed) --triangle_count;
+				}
+
+				w = wedges[w];
+			} while (w != v);
+
+			add_quadric(quadrics[positions[t]], quadrics[positions[v]]);
+			result_cost = std::max(result_cost, costs[v]);
+			++collapse_count;
+		}
+
+		if (collapse_count == 0) break;
+
+		// apply the collapses & drop the triangles which have become degenerate.
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3) {
+			const uint32_t a = remap[result[i]];
+			const uint32_t b = remap[result[i + 1]];
+			const uint32_t c = remap[result[i + 2]];
+			if (positions[a] == positions[b] || positions[b] == positions[c] || positions[a] == positions[c]) continue;
+
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+		adj = make_vertex_adjacency(span<const uint32_t>(result.data(), result.size()), vertex_count);
+	}
+
+	if (p_error) *p_error = float(std::sqrt(result_cost));
+	return result;
+}
+
+void build_lods(mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh, const lod_chain_desc& desc)
+{
+	assert(mesh.vertices.size() > 0);
+	assert(mesh.indices.size() > 0);
+	assert(mesh.lods.size() == 0);
+	assert(desc.max_error >= 0.0f);
+
+	const span<const vertex_t> vertices(mesh.vertices.data(), mesh.vertices.size());
+
+	// the error bound is relative to the diagonal of the mesh's bounding box.
+	float3 min_p = vertices[0].position;
+	float3 max_p = min_p;
+	for (const vertex_t& v : vertices) {
+		min_p = float3(std::min(min_p.x, v.position.x), std::min(min_p.y, v.position.y), std::min(min_p.z, v.position.z));
+		max_p = float3(std::max(max_p.x, v.position.x), std::max(max_p.y, v.position.y), std::max(max_p.z, v.position.z));
+	}
+	const float max_error = desc.max_error * len(max_p - min_p);
+
+	// Submeshes are simplified separately, so that material borders stay in place.
+	// lod 0 submeshes are the originals, the submeshes of the next lods are appended in the same order.
+	const std::vector<submesh> lod0_submeshes = submesh_ranges(mesh, 0);
+	std::vector<submesh> submeshes = lod0_submeshes;
+	std::vector<mesh_lod> lods;
+	lods.push_back({ 0, uint32_t(mesh.indices.size()), 0, 0, 0.0f });
+	std::vector<uint32_t> indices(mesh.indices.begin(), mesh.indices.end());
+
+	// each lod is simplified from the previous one, the errors add up.
+	for (float ratio : desc.ratios) {
+		assert(0.0f < ratio && ratio < 1.0f);
+
+		const mesh_lod prev = lods.back();
+		const size_t prev_submesh_offset = submeshes.size() - lod0_submeshes.size();
+		std::vector<uint32_t> lod_indices;
+		std::vector<submesh> lod_submeshes;
+		float lod_error = 0.0f;
+
+		for (size_t i = 0; i < lod0_submeshes.size(); ++i) {
+			const submesh& sm = submeshes[prev_submesh_offset + i];
+			const size_t target_index_count = size_t(float(lod0_submeshes[i].index_count / 3) * ratio) * 3;
+
+			float error = 0.0f;
+			std::vector<uint32_t> sm_indices = simplify_mesh(
+				span<const uint32_t>(indices.data() + sm.first_index, sm.index_count),
+				vertices, target_index_count, std::max(0.0f, max_error - prev.error), &error);
+			optimize_vertex_cache(span<uint32_t>(sm_indices.data(), sm_indices.size()), vertices.size());
+
+			lod_submeshes.push_back({ uint32_t(indices.size() + lod_indices.size()), uint32_t(sm_indices.size()),
+				sm.material_index });
+			lod_indices.insert(lod_indices.end(), sm_indices.cbegin(), sm_indices.cend());
+			lod_error = std::max(lod_error, error);
+		}
+
+		// the error bound has stopped the simplification, the coarser lods would not differ either.
+		if (lod_indices.empty() || lod_indices.size() > size_t(float(prev.index_count) * 0.9f)) break;
+
+		lods.push_back({ uint32_t(indices.size()), uint32_t(lod_indices.size()), 0, 0, prev.error + lod_error });
+		indices.insert(indices.end(), lod_indices.cbegin(), lod_indices.cend());
+		submeshes.insert(submeshes.end(), lod_submeshes.cbegin(), lod_submeshes.cend());
+	}
+
+	mesh.indices.resize(indices.size());
+	std::copy(indices.cbegin(), indices.cend(), mesh.indices.data());
+	mesh.lods.resize(lods.size());
+	std::copy(lods.cbegin(), lods.cend(), mesh.lods.data());
+	if (mesh.submeshes.size() > 0) {
+		mesh.submeshes.resize(submeshes.size());
+		std::copy(submeshes.cbegin(), submeshes.cend(), mesh.submeshes.data());
+	}
+}
+
+void build_meshlets(mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh)
+{
+	assert(mesh.vertices.size() > 0);
+	assert(mesh.indices.size() % 3 == 0);
+
+	const span<const vertex_t> vertices(mesh.vertices.data(), mesh.vertices.size());
+	const std::vector<uint32_t> positions = make_position_remap(vertices);
+	std::vector<uint32_t> indices;
+	indices.reserve(mesh.indices.size());
+	std::vector<meshlet> meshlets;
+
+	// meshlets do not cross submesh borders, so that each submesh of each lod is a range of meshlets.
+	const size_t lod_count = std::max<size_t>(1, mesh.lods.size());
+	const size_t n = submesh_count(mesh);
+	for (size_t l = 0; l < lod_count; ++l) {
+		const uint32_t first_index = uint32_t(indices.size());
+		const uint32_t first_meshlet = uint32_t(meshlets.size());
+		const std::vector<submesh> ranges = submesh_ranges(mesh, l);
+
+		for (size_t i = 0; i < ranges.size(); ++i) {
+			const span<const uint32_t> range(mesh.indices.data() + ranges[i].first_index, ranges[i].index_count);
+			if (n > 0) mesh.submeshes[l * n + i].first_index = uint32_t(indices.size());
+			build_range_meshlets(range, vertices, positions, indices, meshlets);
+		}
+
+		if (mesh.lods.size() > 0) {
+			mesh.lods[l].first_index = first_index;
+			mesh.lods[l].first_meshlet = first_meshlet;
+			mesh.lods[l].meshlet_count = uint32_t(meshlets.size()) - first_meshlet;
+		}
+	}
+
+	assert(indices.size() == mesh.indices.size());
+	std::copy(indices.cbegin(), indices.cend(), mesh.indices.data());
+	mesh.meshlets.resize(meshlets.size());
+	std::copy(meshlets.cbegin(), meshlets.cend(), mesh.meshlets.data());
+
+	// the index values are remapped, the order of the indices (& meshlet ranges) does not change.
+	optimize_vertex_fetch(mesh);
+}
+
+void update_meshlet_bounds(span<meshlet> meshlets, span<const uint32_t> indices, span<const vertex_t> vertices)
+{
+	assert(std::all_of(meshlets.begin(), meshlets.end(),
+		[&indices](const meshlet& m) { return size_t(m.first_index) + m.index_count <= indices.size(); }));
+
+	const uint32_t* p_indices = indices.data();
+	const vertex_t* p_vertices = vertices.data();
+	parallel_for(meshlets.size(), 64, [meshlets, p_indices, p_vertices](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i)
+			compute_meshlet_bounds(meshlets[i], p_indices, p_vertices);
+	});
+}
+
+quantized_mesh_geometry quantize_mesh(const mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh)
+{
+	assert(mesh.vertices.size() > 0);
+	assert(mesh.indices.size() > 0);
+
+	const size_t vertex_count = mesh.vertices.size();
+
+	float min_p[3] = { mesh.vertices[0].position.x, mesh.vertices[0].position.y, mesh.vertices[0].position.z };
+	float max_p[3] = { min_p[0], min_p[1], min_p[2] };
+	for (const vertex_t& v : mesh.vertices) {
+		const float p[3] = { v.position.x, v.position.y, v.position.z };
+		for (size_t c = 0; c < 3; ++c) {
+			min_p[c] = std::min(min_p[c], p[c]);
+			max_p[c] = std::max(max_p[c], p[c]);
+		}
+	}
+
+	quantized_mesh_geometry out;
+	position_quantizer pq;
+	float scale[3];
+	for (size_t c = 0; c < 3; ++c) {
+		const float extent = max_p[c] - min_p[c];
+		pq.offset[c] = min_p[c];
+		pq.inv_scale[c] = (extent > 0.0f) ? (1.0f / extent) : 0.0f;
+		scale[c] = extent / 65535.0f;
+	}
+	out.position_offset = math::float3(min_p[0], min_p[1], min_p[2]);
+	out.position_scale = math::float3(scale[0], scale[1], scale[2]);
+
+	out.mesh.vertices.resize(vertex_count);
+	out.mesh.indices = mesh.indices;
+	out.mesh.index_fmt = mesh.index_fmt;
+	out.mesh.meshlets = mesh.meshlets;
+	out.mesh.lods = mesh.lods;
+	out.mesh.submeshes = mesh.submeshes;
+
+	const vertex_t* p_src = mesh.vertices.data();
+	compact_vertex_t* p_dst = out.mesh.vertices.data();
+	parallel_for(vertex_count, 4096, [p_src, p_dst, &pq](size_t begin, size_t end) {
+		size_t i = begin;
+#if defined(SPARKI_GEOMETRY_SSE)
+		for (; i + 4 <= end; i += 4)
+			quantize_vertices_sse(p_src + i, pq, p_dst + i);
+#endif
+		for (; i < end; ++i)
+			quantize_vertex(p_src[i], pq, p_dst[i]);
+	});
+
+	return out;
+}
+
+void encode_octahedral(const math::float3& n, int16_t (&out)[2]) noexcept
+{
+	const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	float ox = (l1 > 0.0f) ? n.x / l1 : 0.0f;
+	float oy = (l1 > 0.0f) ? n.y / l1 : 0.0f;
+
+	if (n.z < 0.0f) {
+		// fold the lower hemisphere over the diagonals.
+		const float fx = (1.0f - std::abs(oy)) * ((ox < 0.0f) ? -1.0f : 1.0f);
+		const float fy = (1.0f - std::abs(ox)) * ((oy < 0.0f) ? -1.0f : 1.0f);
+		ox = fx;
+		oy = fy;
+	}
+
+	out[0] = quantize_snorm16(ox);
+	out[1] = quantize_snorm16(oy);
+}
+
+math::float3 decode_octahedral(int16_t x, int16_t y) noexcept
+{
+	const float ox = std::max(-1.0f, float(x) / 32767.0f);
+	const float oy = std::max(-1.0f, float(y) / 32767.0f);
+	const float oz = 1.0f - std::abs(ox) - std::abs(oy);
+
+	math::float3 n(ox, oy, oz);
+	if (oz < 0.0f) {
+		n.x = (1.0f - std::abs(oy)) * ((ox < 0.0f) ? -1.0f : 1.0f);
+		n.y = (1.0f - std::abs(ox)) * ((oy < 0.0f) ? -1.0f : 1.0f);
+	}
+
+	return normalize(n);
+}
+
+mesh_bounds compute_bounds(span<const vertex<vertex_attribs::p_n_uv_ts>> vertices)
+{
+	assert(vertices.size() > 0);
+	return compute_point_bounds(vertices.data(), nullptr, vertices.size());
+}
+
+mesh_bounds compute_bounds(span<const vertex<vertex_attribs::p_n_uv_ts>> vertices, span<const uint32_t> indices)
+{
+	assert(vertices.size() > 0);
+	assert(indices.size() > 0);
+	assert(std::all_of(indices.begin(), indices.end(), [&](uint32_t i) { return i < vertices.size(); }));
+	return compute_point_bounds(vertices.data(), indices.data(), indices.size());
+}
+
+mesh_optimization_report process_scene(scene_geometry& scene, const weld_desc& weld_desc)
+{
+	std::vector<mesh_optimization_report> reports(scene.meshes.size());
+	std::vector<std::exception_ptr> errors(scene.meshes.size());
+
+	parallel_for(scene.meshes.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			try {
+				mesh_geometry<vertex_attribs::p_n_uv_ts>& geometry = scene.meshes[i].geometry;
+				geometry = weld_vertices(geometry, weld_desc);
+				reports[i] = optimize_mesh(geometry);
+			}
+			catch (...) {
+				errors[i] = std::current_exception();
+			}
+		}
+	});
+
+	for (size_t i = 0; i < errors.size(); ++i) {
+		if (!errors[i]) continue;
+
+		try {
+			std::rethrow_exception(errors[i]);
+		}
+		catch (...) {
+			std::string exc_msg = EXCEPTION_MSG("Mesh processing error. Mesh: ", scene.meshes[i].name);
+			std::throw_with_nested(std::runtime_error(exc_msg));
+		}
+	}
+
+	// acmr is weighted by the triangle counts, atvr by the vertex counts.
+	mesh_optimization_report report;
+	double triangle_count = 0.0;
+	double vertex_count = 0.0;
+	for (size_t i = 0; i < reports.size(); ++i) {
+		const double tc = double(scene.meshes[i].geometry.indices.size() / 3);
+		const double vc = double(scene.meshes[i].geometry.vertices.size());
+		report.before.acmr += float(reports[i].before.acmr * tc);
+		report.before.atvr += float(reports[i].before.atvr * vc);
+		report.after.acmr += float(reports[i].after.acmr * tc);
+		report.after.atvr += float(reports[i].after.atvr * vc);
+		triangle_count += tc;
+		vertex_count += vc;
+	}
+	if (triangle_count > 0.0) {
+		report.before.acmr = float(report.before.acmr / triangle_count);
+		report.after.acmr = float(report.after.acmr / triangle_count);
+		report.before.atvr = float(report.before.atvr / vertex_count);
+		report.after.atvr = float(report.after.atvr / vertex_count);
+	}
+
+	return report;
+}
+
+mesh_optimization_report convert_scene_to_geo(scene_geometry scene, const char* p_geo_filename,
+	const weld_desc& weld_desc, const lod_chain_desc& lod_desc, geo_encoding encoding)
+{
+	assert(p_geo_filename);
+
+	// importers unroll polygons into 3 unique vertices per triangle, weld them before the optimization.
+	mesh_optimization_report report = process_scene(scene, weld_desc);
+	// flattening keeps the optimized triangle order of each mesh within the material groups.
+	auto mesh = flatten_scene(scene);
+	build_lods(mesh, lod_desc);
+	build_meshlets(mesh);
+	// the stats of lod 0, the coarser lods are appended to the index buffer.
+	report.after = analyze_vertex_cache(span<const uint32_t>(mesh.indices.data(), mesh.lods[0].index_count),
+		mesh.vertices.size());
+	mesh.index_fmt = pick_index_format(mesh.vertices.size());
+	save_to_geo_file(p_geo_filename, mesh, encoding);
+	return report;
+}
+
+mesh_optimization_report convert_fbx_to_geo(const char* p_fbx_filename, const char* p_geo_filename,
+	const weld_desc& weld_desc, const lod_chain_desc& lod_desc, geo_encoding encoding)
+{
+	assert(p_fbx_filename);
+	assert(p_geo_filename);
+
+	try {
+		return convert_scene_to_geo(load_scene_from_fbx_file(p_fbx_filename), p_geo_filename,
+			weld_desc, lod_desc, encoding);
+	}
+	catch (...) {
+		std::string exc_msg = EXCEPTION_MSG("Convert .fbx to .geo error. File: ", p_fbx_filename);
+		std::throw_with_nested(std::runtime_error(exc_msg));
+	}
+}
+
+} // namespace core
+} // namespace sparki
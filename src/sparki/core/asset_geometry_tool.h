@@ -0,0 +1,156 @@
+#pragma once
+
+#include <vector>
+#include "sparki/core/asset_geometry.h"
+
+
+namespace sparki {
+namespace core {
+
+struct weld_desc final {
+	// Grid step which is used to quantize positions, normals and uvs before comparison.
+	// Vertices whose attributes fall into the same grid cells are merged.
+	// 0 means that the attributes have to be bitwise equal (-0.0 and 0.0 are considered equal).
+	float epsilon = 0.0f;
+};
+
+// Collapses vertices which have identical position/normal/uv/tangent space tuples and rewrites the indices.
+// The vertices of the result are ordered by their first reference in the index buffer,
+// a merged vertex takes the attributes of its first occurrence.
+// The index format of the result is picked by pick_index_format.
+// Vertex keys are computed on the task system's worker threads.
+mesh_geometry<vertex_attribs::p_n_uv_ts> weld_vertices(
+	const mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh, const weld_desc& desc);
+
+// Computes the tangent space of each vertex, the result matches MikkTSpace for meshes whose
+// seams are explicit (vertices with bitwise-equal position, normal & uv are shared by the adjacent triangles).
+// Corners of such vertices are grouped by the uv orientation of their triangles instead of mikktspace's
+// connectivity search. A vertex whose corners get different tangent spaces is split,
+// the copies are appended to mesh.vertices and the indices are rewritten, the triangle order does not change.
+// Triangle & vertex passes are executed on the task system's worker threads. Call before optimize_mesh.
+void generate_tangents(mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh);
+
+// The size of the fifo cache which is used to compute vertex_cache_stats.
+// Matches the post-transform cache of the most of the gpus which have one.
+constexpr uint32_t c_vertex_cache_size = 16;
+
+struct vertex_cache_stats final {
+	// Average cache miss ratio: the number of transformed vertices per triangle.
+	// Lies in [0.5, 3] for closed meshes, lower is better.
+	float acmr = 0.0f;
+	// Average transform to vertex ratio: the number of transformed vertices per referenced vertex.
+	// 1 is the optimum, the metric does not depend on the mesh topology unlike acmr.
+	float atvr = 0.0f;
+};
+
+struct mesh_optimization_report final {
+	vertex_cache_stats before;
+	vertex_cache_stats after;
+};
+
+// Simulates the post-transform fifo vertex cache of the specified size.
+vertex_cache_stats analyze_vertex_cache(span<const uint32_t> indices, size_t vertex_count,
+	uint32_t cache_size = c_vertex_cache_size);
+
+// Reorders triangles to improve the post-transform vertex cache reuse (Tom Forsyth's algorithm).
+// The algorithm is cache size agnostic: lru scoring does not rely on the exact size of the gpu cache.
+void optimize_vertex_cache(span<uint32_t> indices, size_t vertex_count);
+
+// Reorders clusters of triangles to reduce overdraw. indices should be optimized by optimize_vertex_cache.
+// The triangle sequence is split into clusters whose acmr is at most threshold * the original acmr,
+// clusters which face away from the mesh centre are moved to the front, they are likely to occlude the rest.
+void optimize_overdraw(span<uint32_t> indices, span<const vertex<vertex_attribs::p_n_uv_ts>> vertices,
+	float threshold = 1.05f, uint32_t cache_size = c_vertex_cache_size);
+
+// Reorders vertices by their first reference in the index buffer to improve vertex fetch locality,
+// rewrites the indices. Vertices which are not referenced are removed.
+void optimize_vertex_fetch(mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh);
+
+// Runs optimize_vertex_cache and optimize_overdraw for each submesh and optimize_vertex_fetch.
+// Returns the vertex cache stats before & after the optimization. Must be called before build_lods.
+mesh_optimization_report optimize_mesh(mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh,
+	float overdraw_threshold = 1.05f);
+
+// Simplifies the triangles by collapsing edges in the order of the quadric error (Garland & Heckbert)
+// until the index count is at most target_index_count or the next collapse would exceed target_error
+// (model space distance). Returns the new indices, the vertices are not moved, only referenced less.
+// Open borders and uv/normal seams are preserved: their vertices collapse only along the border/seam,
+// both wedges of a seam collapse together. p_error receives the error of the result.
+// Collapse candidates are evaluated on the task system's worker threads.
+std::vector<uint32_t> simplify_mesh(span<const uint32_t> indices, span<const vertex<vertex_attribs::p_n_uv_ts>> vertices,
+	size_t target_index_count, float target_error, float* p_error = nullptr);
+
+struct lod_chain_desc final {
+	// Triangle counts of the lods relative to lod 0, descending, each one is in (0, 1).
+	std::vector<float> ratios = { 0.5f, 0.25f, 0.125f };
+	// The max error of the coarsest lod relative to the diagonal of the mesh's bounding box.
+	float max_error = 0.02f;
+};
+
+// Fills mesh.lods: lod 0 is the current index buffer, each next lod is simplified from the previous one
+// (see simplify_mesh) and appended to the index buffer, its error is the sum of the collapse errors.
+// Submeshes are simplified separately, each lod gets the same set of submeshes.
+// The chain ends early if the error bound prevents a lod from removing at least 10% of the triangles.
+// Must be called before build_meshlets.
+void build_lods(mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh, const lod_chain_desc& desc);
+
+// Groups the triangles into meshlets of at most c_meshlet_max_vertex_count unique vertices
+// and c_meshlet_max_triangle_count triangles, computes their bounds and fills mesh.meshlets.
+// Each lod (see build_lods) gets its own range of meshlets, meshlets do not cross submesh borders.
+// The index buffer is reordered so that each meshlet is a contiguous range, the meshlets are sorted
+// to reduce overdraw and the vertices are reordered for fetch locality (see optimize_vertex_fetch).
+// Seeds are taken in the current triangle order, run optimize_mesh before.
+void build_meshlets(mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh);
+
+// Recomputes the bounding sphere & normal cone of each meshlet from the specified vertices
+// (e.g. the positions which are restored from a compressed .geo file). The index ranges are not changed.
+void update_meshlet_bounds(span<meshlet> meshlets, span<const uint32_t> indices,
+	span<const vertex<vertex_attribs::p_n_uv_ts>> vertices);
+
+// mesh_geometry<p_n_uv_ts_compact> and the transform which restores positions:
+// position = position_offset + float3(q.x, q.y, q.z) * position_scale, q is the 16-bit unorm value [0, 65535].
+struct quantized_mesh_geometry final {
+	mesh_geometry<vertex_attribs::p_n_uv_ts_compact>	mesh;
+	math::float3										position_offset;
+	math::float3										position_scale;
+};
+
+// Converts the full precision mesh into the compact vertex format, the indices are copied.
+// Positions are quantized within the mesh's bounding box, uvs are clamped to [0, 1].
+// Vertices are converted 4 at a time using SSE2 (scalar code on other cpus)
+// on the task system's worker threads.
+quantized_mesh_geometry quantize_mesh(const mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh);
+
+// Octahedral encoding of the unit vector n into two 16-bit snorm values.
+void encode_octahedral(const math::float3& n, int16_t (&out)[2]) noexcept;
+
+// Decodes the unit vector which has been encoded by encode_octahedral.
+math::float3 decode_octahedral(int16_t x, int16_t y) noexcept;
+
+// Computes the bounding box & sphere of the vertex positions. The sphere is the smaller one of Ritter's sphere
+// and the sphere around the box's centre. The box & the extreme points are found using SSE
+// (scalar code on other cpus) on the task system's worker threads.
+mesh_bounds compute_bounds(span<const vertex<vertex_attribs::p_n_uv_ts>> vertices);
+
+// Computes the bounds of the vertices which are referenced by the indices.
+mesh_bounds compute_bounds(span<const vertex<vertex_attribs::p_n_uv_ts>> vertices, span<const uint32_t> indices);
+
+// Welds & optimizes each mesh of the scene (see weld_vertices, optimize_mesh).
+// The meshes are processed in parallel on the task system's worker threads.
+// Returns the stats of all the meshes: acmr is weighted by triangle counts, atvr by vertex counts.
+mesh_optimization_report process_scene(scene_geometry& scene, const weld_desc& weld_desc);
+
+// Welds & optimizes the meshes of the scene (see process_scene), merges them into one mesh (see flatten_scene),
+// builds lods & meshlets and writes the result into the specified .geo file.
+// Meshes with at most 65535 vertices are written with 16-bit indices.
+// The returned stats are measured before the optimization & after building meshlets.
+mesh_optimization_report convert_scene_to_geo(scene_geometry scene, const char* p_geo_filename,
+	const weld_desc& weld_desc, const lod_chain_desc& lod_desc, geo_encoding encoding);
+
+// Reads all the meshes of the specified .fbx file and converts them into the specified .geo file
+// (see convert_scene_to_geo).
+mesh_optimization_report convert_fbx_to_geo(const char* p_fbx_filename, const char* p_geo_filename,
+	const weld_desc& weld_desc, const lod_chain_desc& lod_desc, geo_encoding encoding);
+
+} // namespace core
+} // namespace sparki
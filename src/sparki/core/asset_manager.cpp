@@ -0,0 +1,201 @@
+#include "sparki/core/asset_manager.h"
+
+#include <algorithm>
+#include <iterator>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+#include "sparki/core/utility.h"
+#include "ts/task_system.h"
+
+
+namespace sparki {
+namespace core {
+
+// ----- asset_manager -----
+
+asset_manager::~asset_manager() noexcept
+{
+	decltype(queue_) queue;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		shutting_down_ = true;
+		std::swap(queue, queue_);
+	}
+
+	// Waiters on the futures of the dropped requests must not block forever.
+	for (; !queue.empty(); queue.pop())
+		queue.top().cancel();
+
+	for (auto& p_worker : workers_)
+		ts::wait_for(p_worker->wait_counter);
+}
+
+template<typename T, typename Load_func>
+asset_handle<T> asset_manager::enqueue(asset_priority priority, Load_func load_func, callback_t<T> callback)
+{
+	auto p_state = std::make_shared<intrinsic::asset_state<T>>();
+
+	request r;
+	r.priority = priority;
+	r.load = [p_state, load_func] {
+		try {
+			p_state->p_data = load_func();
+			p_state->status.store(asset_status::ready, std::memory_order_release);
+		}
+		catch (const std::exception& e) {
+			p_state->error_message = make_exception_message(e);
+			p_state->status.store(asset_status::failed, std::memory_order_release);
+		}
+		catch (...) {
+			p_state->error_message = "Unknown asset loading error.";
+			p_state->status.store(asset_status::failed, std::memory_order_release);
+		}
+
+		p_state->promise.set_value();
+	};
+	r.cancel = [p_state] {
+		std::exception_ptr error;
+		try {
+			p_state->error_message = "The asset manager has been destroyed before the request was started.";
+			error = std::make_exception_ptr(std::runtime_error(p_state->error_message));
+		}
+		catch (...) {
+			error = std::current_exception();
+		}
+
+		p_state->status.store(asset_status::cancelled, std::memory_order_release);
+		p_state->promise.set_exception(error);
+	};
+	r.complete = [p_state, callback] {
+		if (callback) callback(asset_handle<T>(p_state));
+	};
+
+	worker* p_worker = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		r.id = next_request_id_++;
+		queue_.push(std::move(r));
+
+		if (running_worker_count_ < asset_manager::c_worker_count) {
+			// running_worker_count_ is decremented by the worker itself when the queue is empty,
+			// so the request is guaranteed to be picked up either by a running worker or by the new one.
+			++running_worker_count_;
+			workers_.push_back(std::make_unique<worker>());
+			p_worker = workers_.back().get();
+			p_worker->wait_counter = 0;
+			p_worker->running = true;
+		}
+	}
+
+	if (p_worker)
+		ts::run([this, p_worker] { run_worker(*p_worker); }, p_worker->wait_counter);
+
+	return asset_handle<T>(std::move(p_state));
+}
+
+void asset_manager::dispatch_completed()
+{
+	std::vector<std::function<void()>> completed;
+	std::vector<std::unique_ptr<worker>> stopped_workers;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		completed.swap(completed_);
+
+		auto it = std::partition(workers_.begin(), workers_.end(), 
+			[](const std::unique_ptr<worker>& p_worker) { return p_worker->running.load(); });
+		std::move(it, workers_.end(), std::back_inserter(stopped_workers));
+		workers_.erase(it, workers_.end());
+	}
+
+	// a stopped worker's task might still be returning, the wait is short.
+	for (auto& p_worker : stopped_workers)
+		ts::wait_for(p_worker->wait_counter);
+
+	// callbacks may enqueue new requests, mutex_ must not be locked.
+	// A failed callback does not stop the others, they have been taken out of completed_ already.
+	std::exception_ptr first_error;
+	size_t error_count = 0;
+	for (auto& complete : completed) {
+		try {
+			complete();
+		}
+		catch (...) {
+			if (!first_error) first_error = std::current_exception();
+			++error_count;
+		}
+	}
+
+	if (!first_error) return;
+
+	try {
+		std::rethrow_exception(first_error);
+	}
+	catch (...) {
+		std::string exc_msg = EXCEPTION_MSG("Asset completion callback error. Failed callbacks: ", error_count);
+		std::throw_with_nested(std::runtime_error(exc_msg));
+	}
+}
+
+texture_handle asset_manager::load_texture(const texture_request& request, asset_priority priority,
+	callback_t<texture_data> callback)
+{
+	assert(!request.filename.empty());
+
+	return enqueue<texture_data>(priority,
+		[this, request] {
+			return get_texture_cache().load(request.filename.c_str(), request.channel_count, request.flip_vertically);
+		},
+		std::move(callback));
+}
+
+mesh_handle asset_manager::load_mesh(const std::string& filename, asset_priority priority,
+	callback_t<mapped_geo_file> callback)
+{
+	assert(!filename.empty());
+
+	return enqueue<mapped_geo_file>(priority,
+		[filename] {
+			auto p_file = std::make_shared<const mapped_geo_file>(filename.c_str());
+			p_file->prefetch();
+			return p_file;
+		},
+		std::move(callback));
+}
+
+size_t asset_manager::pending_count() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return queue_.size() + loading_count_;
+}
+
+void asset_manager::run_worker(worker& w)
+{
+	while (true) {
+		request r;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (queue_.empty() || shutting_down_) {
+				--running_worker_count_;
+				w.running = false;
+				return;
+			}
+
+			// priority_queue::top returns a const reference, the request is copied.
+			r = queue_.top();
+			queue_.pop();
+			++loading_count_;
+		}
+
+		r.load();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			--loading_count_;
+			completed_.push_back(std::move(r.complete));
+		}
+	}
+}
+
+} // namespace core
+} // namespace sparki
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <cassert>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <vector>
+#include "sparki/core/asset_geometry.h"
+#include "sparki/core/asset_texture.h"
+#include "sparki/core/asset_texture_cache.h"
+
+
+namespace sparki {
+namespace core {
+
+// Requests with higher priority are loaded first,
+// requests with the same priority are loaded in the order they have been made.
+enum class asset_priority : unsigned char {
+	low = 0,
+	normal,
+	high
+};
+
+enum class asset_status : unsigned char {
+	pending = 0,
+	ready,
+	failed,
+	// The asset_manager has been destroyed before the request was started.
+	cancelled
+};
+
+namespace intrinsic {
+
+// The state shared between an asset_handle and the asset_manager's worker which loads the asset.
+// p_data & error_message are written by the worker before status leaves asset_status::pending.
+template<typename T>
+struct asset_state final {
+
+	asset_state()
+		: future(promise.get_future().share())
+	{}
+
+
+	std::atomic<asset_status>	status { asset_status::pending };
+	std::shared_ptr<const T>	p_data;
+	std::string					error_message;
+	std::promise<void>			promise;
+	std::shared_future<void>	future;
+};
+
+} // namespace intrinsic
+
+
+// asset_handle refers to an asset which is being loaded (or has been loaded) by the asset_manager.
+// Copies of a handle refer to the same asset. The asset is released with the last handle.
+template<typename T>
+class asset_handle final {
+public:
+
+	asset_handle() noexcept = default;
+
+	explicit asset_handle(std::shared_ptr<intrinsic::asset_state<T>> p_state) noexcept
+		: p_state_(std::move(p_state))
+	{}
+
+
+	bool operator==(const asset_handle& h) const noexcept
+	{
+		return p_state_ == h.p_state_;
+	}
+
+	bool operator!=(const asset_handle& h) const noexcept
+	{
+		return p_state_ != h.p_state_;
+	}
+
+	// Returns true if the handle refers to an asset.
+	bool valid() const noexcept
+	{
+		return bool(p_state_);
+	}
+
+	asset_status status() const noexcept
+	{
+		assert(valid());
+		return p_state_->status.load(std::memory_order_acquire);
+	}
+
+	bool ready() const noexcept
+	{
+		return status() == asset_status::ready;
+	}
+
+	// Returns the loaded asset. The status must be asset_status::ready.
+	const T& get() const noexcept
+	{
+		assert(ready());
+		return *p_state_->p_data;
+	}
+
+	// Returns the message of the exception which has been thrown while loading the asset
+	// or the reason of the cancellation. The status must be asset_status::failed or asset_status::cancelled.
+	const std::string& error_message() const noexcept
+	{
+		assert(status() == asset_status::failed || status() == asset_status::cancelled);
+		return p_state_->error_message;
+	}
+
+	// The future becomes ready when the asset leaves asset_status::pending (either loaded or failed).
+	// The future of a cancelled request holds an exception, get() rethrows it.
+	// Waiting for the future blocks the calling thread, prefer completion callbacks on the main thread.
+	std::shared_future<void> future() const noexcept
+	{
+		assert(valid());
+		return p_state_->future;
+	}
+
+private:
+
+	std::shared_ptr<intrinsic::asset_state<T>> p_state_;
+};
+
+using texture_handle	= asset_handle<texture_data>;
+using mesh_handle		= asset_handle<mapped_geo_file>;
+
+struct texture_request final {
+
+	texture_request() = default;
+
+	texture_request(std::string filename, uint8_t channel_count, bool flip_vertically = false)
+		: filename(std::move(filename)), channel_count(channel_count), flip_vertically(flip_vertically)
+	{}
+
+
+	// .tex files are read using load_from_tex_file, other files are treated as images.
+	// See texture_cache::load.
+	std::string		filename;
+	// Image files only. See load_from_image_file.
+	uint8_t			channel_count = 4;
+	// Image files only. .tex files are expected to be flipped during the conversion.
+	bool			flip_vertically = false;
+};
+
+// asset_manager loads textures and meshes on the task system's worker threads.
+// Requests are put into a priority queue, at most c_worker_count workers drain the queue.
+// A worker task lives while there are requests in the queue, no thread is blocked when the queue is empty.
+// Textures go through the process-wide texture_cache (get_texture_cache), so loading the same file again is cheap.
+// Completion callbacks are invoked by dispatch_completed on the thread which owns the asset consumers
+// (the main thread), so a consumer may keep using the previous resource until the new one is ready.
+class asset_manager final {
+public:
+
+	template<typename T>
+	using callback_t = std::function<void(const asset_handle<T>&)>;
+
+	static constexpr size_t c_worker_count = 2;
+
+
+	asset_manager() = default;
+
+	asset_manager(asset_manager&&) = delete;
+	asset_manager& operator=(asset_manager&&) = delete;
+
+	// Cancels the requests which have not been started (their callbacks are not invoked)
+	// and waits for the workers.
+	~asset_manager() noexcept;
+
+
+	// Returns the process-wide cache, see get_texture_cache.
+	core::texture_cache& texture_cache()
+	{
+		return get_texture_cache();
+	}
+
+	// Enqueues the texture loading. May be called from any thread.
+	// callback (if any) is invoked by dispatch_completed when the texture is either loaded or failed.
+	texture_handle load_texture(const texture_request& request, asset_priority priority,
+		callback_t<texture_data> callback = nullptr);
+
+	// Enqueues the .geo file mapping. May be called from any thread.
+	// The worker validates the file and prefetches its pages, the mesh data is not copied.
+	// callback (if any) is invoked by dispatch_completed when the mesh is either loaded or failed.
+	mesh_handle load_mesh(const std::string& filename, asset_priority priority,
+		callback_t<mapped_geo_file> callback = nullptr);
+
+	// Invokes the callbacks of the requests which have been completed since the previous call.
+	// Must be called from one thread only, usually once per frame.
+	// All the callbacks are invoked even if some of them throw, the first error is rethrown afterwards.
+	void dispatch_completed();
+
+	// Returns the number of requests which are either queued or being loaded.
+	size_t pending_count() const;
+
+private:
+
+	struct request final {
+		uint64_t				id = 0;
+		asset_priority			priority = asset_priority::normal;
+		// Loads the asset on a worker thread. Never throws, errors are stored in the asset state.
+		std::function<void()>	load;
+		// Marks the asset state as cancelled, called instead of load. Never throws.
+		std::function<void()>	cancel;
+		// Invokes the completion callback.
+		std::function<void()>	complete;
+	};
+
+	struct request_order final {
+		// std::priority_queue puts the greatest element on top.
+		bool operator()(const request& l, const request& r) const noexcept
+		{
+			if (l.priority != r.priority) return l.priority < r.priority;
+			return l.id > r.id;
+		}
+	};
+
+	struct worker final {
+		std::atomic_size_t	wait_counter;
+		// False when the worker does not touch the manager any more.
+		std::atomic_bool	running;
+	};
+
+
+	template<typename T, typename Load_func>
+	asset_handle<T> enqueue(asset_priority priority, Load_func load_func, callback_t<T> callback);
+
+	void run_worker(worker& w);
+
+
+	mutable std::mutex						mutex_;
+	std::priority_queue<request, std::vector<request>, request_order>	queue_;
+	std::vector<std::function<void()>>		completed_;
+	std::vector<std::unique_ptr<worker>>	workers_;
+	uint64_t								next_request_id_ = 0;
+	size_t									running_worker_count_ = 0;
+	size_t									loading_count_ = 0;
+	bool									shutting_down_ = false;
+};
+
+} // namespace core
+} // namespace sparki
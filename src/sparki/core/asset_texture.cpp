@@ -1,8 +1,12 @@
 #include "sparki/core/asset_texture.h"
 
 #include <cassert>
+#include <algorithm>
+#include <climits>
 #include <cstdio>
+#include <cstring>
 #include <memory>
+#include "sparki/core/half_float.h"
 #include "sparki/core/utility.h"
 #pragma warning(push)
 #pragma warning(disable:4244) // C4244 '=': conversion from 'int' to 'stbi__uint16', possible loss of data.
@@ -16,6 +20,54 @@
 #pragma warning(push)
 #pragma warning(disable:4996) // C4996 'fopen': This function or variable may be unsafe.
 
+namespace {
+
+using namespace sparki::core;
+
+// .tex v2 layout:
+// - tex_file_header_v2;
+// - subresource table: array_size * mipmap_count tex_subresource_entry items (slice-major order);
+// - texel data of each subresource. Each subresource starts at c_data_alignment boundary.
+// v1 files have no magic. They start with texture_type which can never be equal to 'S'.
+struct tex_file_header_v2 final {
+	static constexpr char		c_magic[4] = { 'S', 'T', 'E', 'X' };
+	static constexpr uint32_t	c_version = 2;
+	static constexpr uint32_t	c_data_alignment = 64;
+
+	char			magic[4];
+	uint32_t		version;
+	texture_type	type;
+	pixel_format	format;
+	uint16_t		reserved;
+	uint32_t		width;
+	uint32_t		height;
+	uint32_t		depth;
+	uint32_t		mipmap_count;
+	uint32_t		array_size;
+	uint32_t		data_alignment;
+};
+
+static_assert(sizeof(tex_file_header_v2) == 36, "tex_file_header_v2 layout must not change.");
+
+constexpr char tex_file_header_v2::c_magic[4];
+
+struct tex_subresource_entry final {
+	// Byte offset from the beginning of the file.
+	uint64_t offset;
+	uint64_t byte_count;
+};
+
+static_assert(sizeof(tex_subresource_entry) == 16, "tex_subresource_entry layout must not change.");
+
+
+inline uint64_t align_up(uint64_t value, uint64_t alignment) noexcept
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+
 namespace sparki {
 namespace core {
 
@@ -35,6 +87,120 @@ texture_data::texture_data(texture_type type, const math::uint3& size,
 	buffer.resize(c);
 }
 
+// ----- texture_view -----
+
+texture_view::texture_view(const char* p_filename, uint32_t first_mipmap)
+{
+	assert(p_filename);
+
+	try {
+		file_ = mapped_file(p_filename);
+
+		const bool is_v2 = (file_.size() >= sizeof(tex_file_header_v2))
+			&& (std::memcmp(file_.data(), tex_file_header_v2::c_magic, sizeof(tex_file_header_v2::c_magic)) == 0);
+		
+		if (is_v2) init_v2();
+		else init_v1();
+
+		ENFORCE(first_mipmap < mipmap_count_, "first_mipmap (", first_mipmap, ") must be less than mipmap count (", mipmap_count_, ").");
+		if (first_mipmap > 0) {
+			// drop the top mipmap levels of each array slice.
+			std::vector<span<const uint8_t>> subresources;
+			subresources.reserve(size_t(array_size_) * (mipmap_count_ - first_mipmap));
+			for (uint32_t a = 0; a < array_size_; ++a) {
+				for (uint32_t m = first_mipmap; m < mipmap_count_; ++m)
+					subresources.push_back(subresources_[size_t(a) * mipmap_count_ + m]);
+			}
+
+			subresources_ = std::move(subresources);
+			size_.x = std::max(1u, size_.x >> first_mipmap);
+			size_.y = std::max(1u, size_.y >> first_mipmap);
+			mipmap_count_ -= first_mipmap;
+		}
+	}
+	catch (...) {
+		std::string exc_msg = EXCEPTION_MSG("Texture view creation error. File: ", p_filename);
+		std::throw_with_nested(std::runtime_error(exc_msg));
+	}
+}
+
+void texture_view::init_v1()
+{
+	// header: texture_type, uint3 size, uint32_t mipmap_count, uint32_t array_size, pixel_format
+	constexpr size_t c_header_byte_count = sizeof(texture_type) + sizeof(math::uint3)
+		+ 2 * sizeof(uint32_t) + sizeof(pixel_format);
+	ENFORCE(file_.size() >= c_header_byte_count, "The file is too small to be a .tex file.");
+
+	const uint8_t* ptr = file_.data();
+	std::memcpy(&type_, ptr, sizeof(texture_type));
+	ptr += sizeof(texture_type);
+	std::memcpy(&size_.x, ptr, sizeof(math::uint3));
+	ptr += sizeof(math::uint3);
+	std::memcpy(&mipmap_count_, ptr, sizeof(uint32_t));
+	ptr += sizeof(uint32_t);
+	std::memcpy(&array_size_, ptr, sizeof(uint32_t));
+	ptr += sizeof(uint32_t);
+	std::memcpy(&format_, ptr, sizeof(pixel_format));
+	ptr += sizeof(pixel_format);
+	validate_header();
+
+	const size_t expected_bc = byte_count(type_, size_, mipmap_count_, array_size_, format_);
+	ENFORCE(file_.size() - c_header_byte_count >= expected_bc, "The file is truncated.");
+
+	// v1 has no subresource table, texel data of all the subresources 
+	// is tightly packed right after the header.
+	subresources_.reserve(size_t(array_size_) * mipmap_count_);
+	for (uint32_t a = 0; a < array_size_; ++a) {
+		for (uint32_t m = 0; m < mipmap_count_; ++m) {
+			const size_t bc = byte_count(size_, m, format_);
+			subresources_.emplace_back(ptr, bc);
+			ptr += bc;
+		}
+	}
+}
+
+void texture_view::init_v2()
+{
+	tex_file_header_v2 header;
+	std::memcpy(&header, file_.data(), sizeof(tex_file_header_v2));
+	ENFORCE(header.version == tex_file_header_v2::c_version, "Unsupported .tex version ", header.version);
+
+	type_			= header.type;
+	size_			= math::uint3(header.width, header.height, header.depth);
+	mipmap_count_	= header.mipmap_count;
+	array_size_		= header.array_size;
+	format_			= header.format;
+	validate_header();
+
+	const size_t subresource_count = size_t(array_size_) * mipmap_count_;
+	const size_t table_bc = subresource_count * sizeof(tex_subresource_entry);
+	ENFORCE(file_.size() >= sizeof(tex_file_header_v2) + table_bc, "The file is truncated.");
+	const uint8_t* p_table = file_.data() + sizeof(tex_file_header_v2);
+
+	subresources_.reserve(subresource_count);
+	for (uint32_t a = 0; a < array_size_; ++a) {
+		for (uint32_t m = 0; m < mipmap_count_; ++m) {
+			tex_subresource_entry e;
+			std::memcpy(&e, p_table + (size_t(a) * mipmap_count_ + m) * sizeof(tex_subresource_entry), sizeof(e));
+			ENFORCE(e.byte_count == byte_count(size_, m, format_), "Subresource [", a, ", ", m, "] has unexpected size.");
+			ENFORCE(e.offset <= file_.size() && e.byte_count <= file_.size() - e.offset, "The file is truncated.");
+
+			subresources_.emplace_back(file_.data() + e.offset, size_t(e.byte_count));
+		}
+	}
+}
+
+void texture_view::validate_header() const
+{
+	ENFORCE(type_ == texture_type::texture_2d || type_ == texture_type::texture_cube, "Invalid texture type.");
+	ENFORCE(size_ > 0 && size_.z == 1, "Invalid texture size.");
+	ENFORCE(mipmap_count_ > 0 && mipmap_count_ <= 32 
+		&& (std::max(size_.x, size_.y) >> (mipmap_count_ - 1)) > 0, "Invalid mipmap count.");
+	ENFORCE(array_size_ > 0, "Invalid array size.");
+	ENFORCE(type_ != texture_type::texture_cube || array_size_ == 6, "Cube texture must have 6 array slices.");
+	ENFORCE(byte_count(format_) > 0, "Invalid pixel format.");
+}
+
 // ----- funcs -----
 
 size_t byte_count(pixel_format fmt) noexcept
@@ -53,9 +219,40 @@ size_t byte_count(pixel_format fmt) noexcept
 		case pixel_format::rg_8:		return 2;
 		case pixel_format::rgb_8:		return 3;
 		case pixel_format::rgba_8:		return 4;
+
+		case pixel_format::bc5:			
+		case pixel_format::bc6h_uf16:
+		case pixel_format::bc7:			return 16;
 	}
 }
 
+bool is_block_compressed(pixel_format fmt) noexcept
+{
+	return (fmt == pixel_format::bc5)
+		|| (fmt == pixel_format::bc6h_uf16)
+		|| (fmt == pixel_format::bc7);
+}
+
+size_t row_byte_count(uint32_t width, pixel_format fmt) noexcept
+{
+	const uint32_t w = (is_block_compressed(fmt)) ? ((width + 3) / 4) : (width);
+	return w * byte_count(fmt);
+}
+
+uint32_t row_count(uint32_t height, pixel_format fmt) noexcept
+{
+	return (is_block_compressed(fmt)) ? ((height + 3) / 4) : (height);
+}
+
+size_t byte_count(const math::uint3& size, uint32_t mipmap_index, pixel_format fmt) noexcept
+{
+	assert(size.z == 1); // the case z > 1 has not been implemented yet.
+
+	const uint32_t w = std::max(1u, size.x >> mipmap_index);
+	const uint32_t h = std::max(1u, size.y >> mipmap_index);
+	return row_byte_count(w, fmt) * row_count(h, fmt);
+}
+
 size_t byte_count(texture_type type, const math::uint3& size, uint32_t mipmap_count,
 	uint32_t array_size, pixel_format fmt) noexcept
 {
@@ -65,20 +262,14 @@ size_t byte_count(texture_type type, const math::uint3& size, uint32_t mipmap_co
 	assert(array_size > 0);
 	assert(fmt != pixel_format::none);
 
-	const size_t fmt_bytes = byte_count(fmt);
-
 	size_t array_slice_bytes = 0;
 	for (uint32_t i = 0; i < mipmap_count; ++i) {
-		const uint32_t wo = size.x >> i;
-		const uint32_t ho = size.y >> i;
-		assert((wo > 0) || (ho > 0)); // ensure size and mipmap_level_count compatibility
-
-		array_slice_bytes += std::max(1u, wo) * std::max(1u, ho) * fmt_bytes;
+		assert(((size.x >> i) > 0) || ((size.y >> i) > 0)); // ensure size and mipmap_level_count compatibility
+		array_slice_bytes += byte_count(size, i, fmt);
 	}
 
-	return (type == texture_type::texture_2d)
-		? array_slice_bytes
-		: array_slice_bytes * array_size;
+	// every array slice has the same mipmap chain, texture_2d arrays included.
+	return array_slice_bytes * array_size;
 }
 
 bool is_valid_texture_data(const texture_data& td) noexcept
@@ -95,20 +286,20 @@ bool is_valid_texture_data(const texture_data& td) noexcept
 	if (td.type == texture_type::texture_cube && td.array_size != 6) return false;
 
 	// check size and mipmap_count compatibility
-	for (uint32_t i = 0; i < td.mipmap_count; ++i) {
-		const uint32_t w = td.size.x >> i;
-		const uint32_t h = td.size.y >> i;
-
-		if (w == 0 || h == 0) return false;
-	}
+	if (td.mipmap_count > 32) return false;
+	if ((std::max(td.size.x, td.size.y) >> (td.mipmap_count - 1)) == 0) return false;
 
 	// check whether the buffer's memory is large enough
 	const size_t expected_bc = byte_count(td.type, td.size, td.mipmap_count, td.array_size, td.format);
 	return (byte_count(td.buffer) == expected_bc);
 }
 
-texture_data load_from_image_file(const char* p_filename, uint8_t channel_count, bool flip_vertically)
+texture_data decode_image(const uint8_t* p_data, size_t data_byte_count, const image_decode_options& options)
 {
+	assert(p_data);
+	assert(data_byte_count > 0);
+	ENFORCE(data_byte_count <= size_t(INT_MAX), "Image is too large.");
+
 	struct stb_image final {
 		stb_image() noexcept = default;
 		~stb_image() noexcept { stbi_image_free(p_data); p_data = nullptr; }
@@ -116,23 +307,30 @@ texture_data load_from_image_file(const char* p_filename, uint8_t channel_count,
 		uint8_t* p_data = nullptr;
 	};
 
-	// load stb image from the file
-	stbi_set_flip_vertically_on_load(flip_vertically);
+	// stbi_set_flip_vertically_on_load is never called (it changes global state),
+	// the rows are flipped while they are being copied into the texture data.
+	const int len = int(data_byte_count);
+	const bool is_hdr = stbi_is_hdr_from_memory(p_data, len) != 0;
+	const bool to_half = is_hdr && options.hdr_as_half;
+	uint8_t channel_count = options.channel_count;
+	// half float formats are available only for 2 & 4 channels, 32-bit float formats have no single channel one.
+	if (to_half) channel_count = (channel_count == 1 || channel_count == 2) ? 2 : 4;
+	else if (is_hdr && channel_count == 1) channel_count = 2;
 
 	stb_image img;
 	int width = 0;
 	int height = 0;
 	int actual_channel_count = 0;
-	const bool is_hdr = stbi_is_hdr(p_filename);
-
 	if (is_hdr)
-		img.p_data = reinterpret_cast<uint8_t*>(stbi_loadf(p_filename, &width, &height, &actual_channel_count, channel_count));
+		img.p_data = reinterpret_cast<uint8_t*>(stbi_loadf_from_memory(p_data, len, &width, &height, &actual_channel_count, channel_count));
 	else
-		img.p_data = stbi_load(p_filename, &width, &height, &actual_channel_count, channel_count);
+		img.p_data = stbi_load_from_memory(p_data, len, &width, &height, &actual_channel_count, channel_count);
 
 	if (!img.p_data) {
+		// stb_image versions which predate STBI_THREAD_LOCAL share the failure reason between threads,
+		// the message might belong to another failed decoding then.
 		const char* p_stb_error = stbi_failure_reason();
-		throw std::runtime_error(EXCEPTION_MSG("Loading ", p_filename, " image error. ", p_stb_error));
+		throw std::runtime_error(EXCEPTION_MSG("Image decoding error. ", p_stb_error));
 	}
 
 	// determine the pixel format
@@ -140,41 +338,72 @@ texture_data load_from_image_file(const char* p_filename, uint8_t channel_count,
 	const uint8_t cc = (channel_count) ? channel_count : uint8_t(actual_channel_count);
 	switch (cc) {
 		case 1: format = pixel_format::red_8; break;
-		case 2: format = pixel_format::rg_8; break;
+		case 2: format = (to_half) ? (pixel_format::rg_16f) 
+			: ((is_hdr) ? (pixel_format::rg_32f) : (pixel_format::rg_8)); break;
 		case 3: format = (is_hdr) ? (pixel_format::rgb_32f) : (pixel_format::rgb_8); break;
-		case 4: format = (is_hdr) ? (pixel_format::rgba_32f) : (pixel_format::rgba_8); break;
+		case 4: format = (to_half) ? (pixel_format::rgba_16f) 
+			: ((is_hdr) ? (pixel_format::rgba_32f) : (pixel_format::rgba_8)); break;
 	}
 
+	ENFORCE(format != pixel_format::none, "Unsupported image channel count ", int(cc));
+	ENFORCE(!is_hdr || format != pixel_format::red_8, "Single channel hdr images are not supported.");
+
 	// create texture data object and fill it with image's contents.
 	texture_data td(texture_type::texture_2d, math::uint3(width, height, 1), 1, 1, format);
-	std::memcpy(td.buffer.data(), img.p_data, byte_count(td.buffer));
+	const size_t value_count = size_t(width) * cc; // per row
+	const size_t src_row_bc = value_count * ((is_hdr) ? sizeof(float) : sizeof(uint8_t));
+	const size_t dst_row_bc = byte_count(td.buffer) / size_t(height);
+
+	for (size_t y = 0; y < size_t(height); ++y) {
+		const size_t src_y = (options.flip_vertically) ? (size_t(height) - 1 - y) : y;
+		const uint8_t* p_src = img.p_data + src_y * src_row_bc;
+		uint8_t* p_dst = td.buffer.data() + y * dst_row_bc;
+
+		if (to_half)
+			float_to_half(reinterpret_cast<const float*>(p_src), reinterpret_cast<uint16_t*>(p_dst), value_count);
+		else
+			std::memcpy(p_dst, p_src, src_row_bc);
+	}
 
 	return td;
 }
 
-texture_data load_from_tex_file(const char* p_filename)
+texture_data load_from_image_file(const char* p_filename, uint8_t channel_count, 
+	bool flip_vertically, bool hdr_as_half)
 {
 	assert(p_filename);
 
 	try {
-		std::unique_ptr<FILE, decltype(&std::fclose)> file(std::fopen(p_filename, "rb"), &std::fclose);
-		ENFORCE(file, "Failed to open file ", p_filename);
+		const mapped_file file(p_filename);
 
-		// header
-		texture_type	type = texture_type::unknown;
-		math::uint3		size;
-		uint32_t		mipmap_count = 0;
-		uint32_t		array_size = 0;
-		pixel_format	format = pixel_format::none;
-
-		std::fread(&type, sizeof(texture_type), 1, file.get());
-		std::fread(&size.x, sizeof(math::uint3), 1, file.get());
-		std::fread(&mipmap_count, sizeof(uint32_t), 1, file.get());
-		std::fread(&array_size, sizeof(uint32_t), 1, file.get());
-		std::fread(&format, sizeof(pixel_format), 1, file.get());
-		// texture data
-		texture_data td(type, size, mipmap_count, array_size, format);
-		std::fread(td.buffer.data(), byte_count(td.buffer), 1, file.get());
+		image_decode_options options;
+		options.channel_count	= channel_count;
+		options.flip_vertically	= flip_vertically;
+		options.hdr_as_half		= hdr_as_half;
+		return decode_image(file.data(), file.size(), options);
+	}
+	catch (...) {
+		const std::string exc_msg = EXCEPTION_MSG("Loading ", p_filename, " image error.");
+		std::throw_with_nested(std::runtime_error(exc_msg));
+	}
+}
+
+texture_data load_from_tex_file(const char* p_filename, uint32_t first_mipmap)
+{
+	assert(p_filename);
+
+	try {
+		const texture_view view(p_filename, first_mipmap);
+
+		texture_data td(view.type(), view.size(), view.mipmap_count(), view.array_size(), view.format());
+		uint8_t* ptr = td.buffer.data();
+		for (uint32_t a = 0; a < td.array_size; ++a) {
+			for (uint32_t m = 0; m < td.mipmap_count; ++m) {
+				const span<const uint8_t> sr = view.subresource(a, m);
+				std::memcpy(ptr, sr.data(), sr.size());
+				ptr += sr.size();
+			}
+		}
 
 		return td;
 	}
@@ -194,13 +423,46 @@ void save_to_tex_file(const char* p_filename, const texture_data& td)
 		ENFORCE(file, "Failed to create/open the file ", p_filename);
 
 		// header
-		std::fwrite(&td.type, sizeof(texture_type), 1, file.get());
-		std::fwrite(&td.size.x, sizeof(math::uint3), 1, file.get());
-		std::fwrite(&td.mipmap_count, sizeof(uint32_t), 1, file.get());
-		std::fwrite(&td.array_size, sizeof(uint32_t), 1, file.get());
-		std::fwrite(&td.format, sizeof(pixel_format), 1, file.get());
+		tex_file_header_v2 header = {};
+		std::memcpy(header.magic, tex_file_header_v2::c_magic, sizeof(header.magic));
+		header.version			= tex_file_header_v2::c_version;
+		header.type				= td.type;
+		header.format			= td.format;
+		header.width			= td.size.x;
+		header.height			= td.size.y;
+		header.depth			= td.size.z;
+		header.mipmap_count		= td.mipmap_count;
+		header.array_size		= td.array_size;
+		header.data_alignment	= tex_file_header_v2::c_data_alignment;
+
+		// subresource table
+		const size_t subresource_count = size_t(td.array_size) * td.mipmap_count;
+		std::vector<tex_subresource_entry> table(subresource_count);
+		uint64_t offset = sizeof(tex_file_header_v2) + subresource_count * sizeof(tex_subresource_entry);
+		for (uint32_t a = 0; a < td.array_size; ++a) {
+			for (uint32_t m = 0; m < td.mipmap_count; ++m) {
+				tex_subresource_entry& e = table[size_t(a) * td.mipmap_count + m];
+				e.offset = align_up(offset, tex_file_header_v2::c_data_alignment);
+				e.byte_count = byte_count(td.size, m, td.format);
+				offset = e.offset + e.byte_count;
+			}
+		}
+
+		std::fwrite(&header, sizeof(tex_file_header_v2), 1, file.get());
+		std::fwrite(table.data(), byte_count(table), 1, file.get());
+		offset = sizeof(tex_file_header_v2) + byte_count(table);
+
 		// texture data
-		std::fwrite(td.buffer.data(), byte_count(td.buffer), 1, file.get());
+		const uint8_t padding[tex_file_header_v2::c_data_alignment] = {};
+		const uint8_t* ptr = td.buffer.data();
+		for (const tex_subresource_entry& e : table) {
+			std::fwrite(padding, size_t(e.offset - offset), 1, file.get());
+			std::fwrite(ptr, size_t(e.byte_count), 1, file.get());
+			ptr += e.byte_count;
+			offset = e.offset + e.byte_count;
+		}
+
+		ENFORCE(std::ferror(file.get()) == 0, "Failed to write the file ", p_filename);
 	}
 	catch (...) {
 		std::string exc_msg = EXCEPTION_MSG("Save texture file error. File: ", p_filename);
@@ -208,7 +470,6 @@ void save_to_tex_file(const char* p_filename, const texture_data& td)
 	}
 }
 
-
 } // namespace core
 } // namespace sparki
 
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <vector>
+#include "sparki/core/memory.h"
+#include "sparki/core/platform_file.h"
+#include "sparki/core/utility.h"
 #include "math/math.h"
 
 
@@ -21,7 +24,12 @@ enum class pixel_format : unsigned char {
 	red_8,
 	rg_8,
 	rgb_8,
-	rgba_8
+	rgba_8,
+
+	// Block compressed formats. Each 4x4 block of pixels occupies 16 bytes.
+	bc5,		// two unorm channels (r, g). Used for normal maps.
+	bc6h_uf16,	// unsigned half float rgb. Used for hdr textures.
+	bc7			// unorm rgba.
 };
 
 enum class texture_type : unsigned char {
@@ -30,6 +38,13 @@ enum class texture_type : unsigned char {
 	texture_cube
 };
 
+// Returns the number of bytes occupied by one pixel of the specified format.
+// In case of block compressed formats returns the number of bytes occupied by one 4x4 block.
+size_t byte_count(pixel_format fmt) noexcept;
+
+// Returns true if fmt is one of the bc formats.
+bool is_block_compressed(pixel_format fmt) noexcept;
+
 struct texture_data final {
 	texture_data() noexcept = default;
 
@@ -41,30 +56,137 @@ struct texture_data final {
 	uint32_t				mipmap_count = 0;
 	uint32_t				array_size = 0;
 	pixel_format			format = pixel_format::none;
-	std::vector<uint8_t> 	buffer;
+	// 64-byte aligned, the constructor leaves the contents uninitialized.
+	aligned_buffer<uint8_t>	buffer;
 };
 
+// texture_view provides read-only access to the contents of a .tex file (v1 & v2).
+// The file is memory mapped, subresources point directly into the mapped pages
+// so no intermediate copy of texel data is made.
+class texture_view final {
+public:
 
-// Returns the number of bytes occupied by one pixel of the specified format.
-size_t byte_count(pixel_format fmt) noexcept;
+	texture_view() noexcept = default;
+
+	// first_mipmap: the number of top mipmap levels which are skipped. 
+	// The view's size and mipmap_count are adjusted accordingly and pages of the skipped levels are never touched.
+	explicit texture_view(const char* p_filename, uint32_t first_mipmap = 0);
+
+	texture_view(texture_view&&) noexcept = default;
+	texture_view& operator=(texture_view&&) noexcept = default;
+
+
+	texture_type type() const noexcept
+	{
+		return type_;
+	}
+
+	const math::uint3& size() const noexcept
+	{
+		return size_;
+	}
+
+	uint32_t mipmap_count() const noexcept
+	{
+		return mipmap_count_;
+	}
+
+	uint32_t array_size() const noexcept
+	{
+		return array_size_;
+	}
+
+	pixel_format format() const noexcept
+	{
+		return format_;
+	}
+
+	// Returns texel data of the specified mipmap level of the specified array slice.
+	span<const uint8_t> subresource(uint32_t array_index, uint32_t mipmap_index) const noexcept
+	{
+		assert(array_index < array_size_);
+		assert(mipmap_index < mipmap_count_);
+		return subresources_[array_index * mipmap_count_ + mipmap_index];
+	}
+
+	// Returns texel data of the specified mipmap level of the specified array slice.
+	// T must match the pixel format, for example math::float4 for rgba_32f.
+	template<typename T>
+	span<const T> subresource_as(uint32_t array_index, uint32_t mipmap_index) const noexcept
+	{
+		assert(sizeof(T) == byte_count(format_));
+
+		const span<const uint8_t> s = subresource(array_index, mipmap_index);
+		return span<const T>(reinterpret_cast<const T*>(s.data()), s.size() / sizeof(T));
+	}
+
+private:
+
+	void init_v1();
+
+	void init_v2();
+
+	void validate_header() const;
+
+
+	mapped_file							file_;
+	texture_type						type_ = texture_type::unknown;
+	math::uint3							size_;
+	uint32_t							mipmap_count_ = 0;
+	uint32_t							array_size_ = 0;
+	pixel_format						format_ = pixel_format::none;
+	// array_size_ * mipmap_count_ items. Slice-major order.
+	std::vector<span<const uint8_t>>	subresources_;
+};
+
+
+// Returns the number of bytes occupied by one row of a mipmap level which is width pixels wide.
+// In case of block compressed formats a row is a row of 4x4 blocks.
+size_t row_byte_count(uint32_t width, pixel_format fmt) noexcept;
+
+// Returns the number of rows of a mipmap level which is height pixels high (see row_byte_count).
+uint32_t row_count(uint32_t height, pixel_format fmt) noexcept;
+
+// Returns the number of bytes occupied by the specified mipmap level of a single array slice.
+size_t byte_count(const math::uint3& size, uint32_t mipmap_index, pixel_format fmt) noexcept;
 
 // Returns the number of bytes occupied by a texture of the specified type, size, format
-// and with the specified number of mipmap levels.
+// and with the specified number of mipmap levels in each of its array_size slices.
 size_t byte_count(texture_type type, const math::uint3& size, uint32_t mipmap_count,
 	uint32_t array_size, pixel_format fmt) noexcept;
 
 bool is_valid_texture_data(const texture_data& td) noexcept;
 
+struct image_decode_options final {
+	// The number of channels of the result. 0 means the number of channels stored in the image.
+	uint8_t		channel_count = 0;
+	// The first row of the result is the last row of the image.
+	bool		flip_vertically = false;
+	// hdr images are decoded into rg_16f (channel_count 1 or 2) or rgba_16f (channel_count 0, 3 or 4)
+	// instead of 32-bit float formats (rg_32f for channel_count 1 or 2, rgb_32f, rgba_32f).
+	// Has no effect on ldr images.
+	bool		hdr_as_half = false;
+};
+
+// Decodes an image (.jpg, .png, .tga, .hdr) which is stored in memory.
+// The options are applied per call and no global decoder state is modified,
+// several images can be decoded simultaneously on different threads.
+texture_data decode_image(const uint8_t* p_data, size_t data_byte_count, const image_decode_options& options);
+
 // Reads texture data from the specified file.
-// The file may be .jpg, .png, .hdr
+// The file may be .jpg, .png, .tga, .hdr. The file is memory mapped and decoded using decode_image.
 texture_data load_from_image_file(const char* p_filename, uint8_t channel_count,
-	bool flip_vertically = false);
+	bool flip_vertically = false, bool hdr_as_half = false);
 
 // Reads texture data from the specified file.
-// The file may be .tex
-texture_data load_from_tex_file(const char* p_filename);
+// The file may be .tex (v1 or v2).
+// first_mipmap: the number of top mipmap levels which are not loaded (see texture_view).
+// Prefer texture_view if the data is only read once (e.g. uploaded to gpu).
+texture_data load_from_tex_file(const char* p_filename, uint32_t first_mipmap = 0);
 
 // Writes texture into the specified .tex file.
+// The file is always written in v2 format: versioned header, subresource offset table
+// and texel data of each subresource aligned to 64 bytes.
 void save_to_tex_file(const char* p_filename, const texture_data& td);
 
 
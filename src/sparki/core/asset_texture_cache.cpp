@@ -0,0 +1,160 @@
+#include "sparki/core/asset_texture_cache.h"
+
+#include <cassert>
+#include <cstring>
+#include <functional>
+#include "sparki/core/platform_file.h"
+
+
+namespace {
+
+using namespace sparki::core;
+
+bool is_tex_file(const std::string& filename) noexcept
+{
+	const size_t len = filename.size();
+	return (len >= 4) && (std::strcmp(filename.c_str() + len - 4, ".tex") == 0);
+}
+
+} // namespace
+
+
+namespace sparki {
+namespace core {
+
+// ----- texture_cache -----
+
+size_t texture_cache::key_hash::operator()(const texture_cache_key& key) const noexcept
+{
+	size_t h = std::hash<std::string>()(key.canonical_path);
+	h ^= std::hash<uint64_t>()(key.last_write_time) + 0x9e3779b9 + (h << 6) + (h >> 2);
+	h ^= (size_t(key.channel_count) << 1 | size_t(key.flip_vertically)) + 0x9e3779b9 + (h << 6) + (h >> 2);
+	return h;
+}
+
+bool texture_cache::key_equal::operator()(const texture_cache_key& l, const texture_cache_key& r) const noexcept
+{
+	return (l.last_write_time == r.last_write_time)
+		&& (l.channel_count == r.channel_count)
+		&& (l.flip_vertically == r.flip_vertically)
+		&& (l.canonical_path == r.canonical_path);
+}
+
+size_t texture_cache::byte_budget() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return byte_budget_;
+}
+
+void texture_cache::set_byte_budget(size_t byte_budget)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	byte_budget_ = byte_budget;
+	evict(byte_budget_);
+}
+
+void texture_cache::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	entry_map_.clear();
+	entries_.clear();
+	stats_.byte_count = 0;
+	stats_.entry_count = 0;
+}
+
+void texture_cache::evict(size_t byte_budget)
+{
+	while (stats_.byte_count > byte_budget) {
+		assert(!entries_.empty());
+
+		const entry& e = entries_.back();
+		stats_.byte_count -= e.byte_count;
+		--stats_.entry_count;
+		++stats_.eviction_count;
+		entry_map_.erase(e.key);
+		entries_.pop_back();
+	}
+}
+
+std::shared_ptr<const texture_data> texture_cache::find(const texture_cache_key& key)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto it = entry_map_.find(key);
+	if (it == entry_map_.end()) {
+		++stats_.miss_count;
+		return nullptr;
+	}
+
+	++stats_.hit_count;
+	entries_.splice(entries_.begin(), entries_, it->second);
+	return it->second->p_td;
+}
+
+void texture_cache::insert(const texture_cache_key& key, std::shared_ptr<const texture_data> p_td)
+{
+	assert(p_td);
+
+	const size_t bc = byte_count(p_td->buffer);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (bc > byte_budget_) return;
+
+	auto it = entry_map_.find(key);
+	if (it != entry_map_.end()) {
+		// another thread has inserted the same texture, keep the existing entry.
+		entries_.splice(entries_.begin(), entries_, it->second);
+		return;
+	}
+
+	evict(byte_budget_ - bc);
+	entries_.push_front(entry{ key, std::move(p_td), bc });
+	entry_map_.emplace(key, entries_.begin());
+	stats_.byte_count += bc;
+	++stats_.entry_count;
+}
+
+std::shared_ptr<const texture_data> texture_cache::load(const char* p_filename,
+	uint8_t channel_count, bool flip_vertically)
+{
+	assert(p_filename);
+
+	try {
+		const file_info fi = get_file_info(p_filename);
+		const bool is_tex = is_tex_file(fi.canonical_path);
+
+		texture_cache_key key;
+		key.canonical_path	= fi.canonical_path;
+		key.last_write_time	= fi.last_write_time;
+		// load options do not affect .tex files.
+		key.channel_count	= (is_tex) ? 0 : channel_count;
+		key.flip_vertically	= (is_tex) ? false : flip_vertically;
+
+		if (auto p_td = find(key)) return p_td;
+
+		auto p_td = std::make_shared<const texture_data>((is_tex)
+			? load_from_tex_file(p_filename)
+			: load_from_image_file(p_filename, channel_count, flip_vertically));
+		insert(key, p_td);
+		return p_td;
+	}
+	catch (...) {
+		const std::string exc_msg = EXCEPTION_MSG("Texture cache loading error. File: ", p_filename);
+		std::throw_with_nested(std::runtime_error(exc_msg));
+	}
+}
+
+texture_cache_stats texture_cache::stats() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stats_;
+}
+
+texture_cache& get_texture_cache()
+{
+	static texture_cache cache;
+	return cache;
+}
+
+} // namespace core
+} // namespace sparki
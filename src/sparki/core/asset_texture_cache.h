@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "sparki/core/asset_texture.h"
+#include "sparki/core/utility.h"
+
+
+namespace sparki {
+namespace core {
+
+// Identifies a decoded texture. Modifying the file changes last_write_time,
+// so stale entries are never returned, they are evicted eventually.
+struct texture_cache_key final {
+	std::string		canonical_path;
+	uint64_t		last_write_time = 0;
+	uint8_t			channel_count = 0;
+	bool			flip_vertically = false;
+};
+
+struct texture_cache_stats final {
+	size_t	hit_count = 0;
+	size_t	miss_count = 0;
+	size_t	eviction_count = 0;
+	// The number of bytes of texel data held by the cache.
+	size_t	byte_count = 0;
+	size_t	entry_count = 0;
+};
+
+// texture_cache keeps recently loaded textures in memory up to the specified byte budget.
+// The least recently used entries are evicted when the budget is exceeded.
+// Entries are shared: an evicted texture stays alive while it is referenced outside the cache,
+// but it does not count towards the budget any more. All the methods are thread-safe.
+class texture_cache final {
+public:
+
+	static constexpr size_t c_default_byte_budget = megabytes(256);
+
+
+	explicit texture_cache(size_t byte_budget = c_default_byte_budget) noexcept
+		: byte_budget_(byte_budget)
+	{}
+
+	texture_cache(texture_cache&&) = delete;
+	texture_cache& operator=(texture_cache&&) = delete;
+
+
+	size_t byte_budget() const;
+
+	// Changes the budget, evicts entries if the current contents exceed the new budget.
+	void set_byte_budget(size_t byte_budget);
+
+	// Returns the texture from the cache or loads it and puts it into the cache.
+	// .tex files are read using load_from_tex_file (channel_count & flip_vertically are ignored),
+	// other files are loaded using load_from_image_file.
+	// The file is decoded without locking the cache. Several threads which miss the same key simultaneously
+	// decode the file independently, the first result is cached.
+	std::shared_ptr<const texture_data> load(const char* p_filename, uint8_t channel_count, bool flip_vertically);
+
+	// Returns the cached texture or nullptr. Counts a hit or a miss.
+	std::shared_ptr<const texture_data> find(const texture_cache_key& key);
+
+	// Puts the texture into the cache as the most recently used entry.
+	// A texture larger than the whole budget is not cached.
+	void insert(const texture_cache_key& key, std::shared_ptr<const texture_data> p_td);
+
+	// Removes all the entries. The counters are kept.
+	void clear();
+
+	texture_cache_stats stats() const;
+
+private:
+
+	struct key_hash final {
+		size_t operator()(const texture_cache_key& key) const noexcept;
+	};
+
+	struct key_equal final {
+		bool operator()(const texture_cache_key& l, const texture_cache_key& r) const noexcept;
+	};
+
+	struct entry final {
+		texture_cache_key					key;
+		std::shared_ptr<const texture_data>	p_td;
+		size_t								byte_count;
+	};
+
+	using entry_list_t = std::list<entry>;
+
+
+	// mutex_ must be locked.
+	void evict(size_t byte_budget);
+
+
+	mutable std::mutex	mutex_;
+	size_t				byte_budget_;
+	// the most recently used entry is at the front.
+	entry_list_t		entries_;
+	std::unordered_map<texture_cache_key, entry_list_t::iterator, key_hash, key_equal> entry_map_;
+	texture_cache_stats	stats_;
+};
+
+// Returns the process-wide texture cache. asset_managers load textures through it,
+// so textures are shared by all of them & the budget limits the whole process.
+texture_cache& get_texture_cache();
+
+} // namespace core
+} // namespace sparki
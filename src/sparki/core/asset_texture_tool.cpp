@@ -0,0 +1,1709 @@
+#include "sparki/core/asset_texture_tool.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <emmintrin.h>
+#include "sparki/core/half_float.h"
+#include "sparki/core/parallel.h"
+#include "sparki/core/utility.h"
+
+
+namespace {
+
+using namespace sparki::core;
+
+// Each block is encoded from 16 pixels, every pixel is represented by 4 float values.
+// The values are in the encoder's space: [0, 255] for unorm formats and
+// half float bit patterns ([0, 0x7bff]) for bc6h.
+using block_pixels = float[16][4];
+
+// Encoded block is written bit by bit starting from the least significant bit of the first byte.
+class block_writer final {
+public:
+
+	explicit block_writer(uint8_t* p_block) noexcept
+		: p_block_(p_block)
+	{
+		std::memset(p_block_, 0, 16);
+	}
+
+
+	void write(uint32_t value, uint32_t bit_count) noexcept
+	{
+		for (uint32_t i = 0; i < bit_count; ++i, ++offset_) {
+			assert(offset_ < 128);
+			const uint8_t bit = uint8_t((value >> i) & 1);
+			p_block_[offset_ >> 3] |= uint8_t(bit << (offset_ & 7));
+		}
+	}
+
+private:
+
+	uint8_t*	p_block_;
+	uint32_t	offset_ = 0;
+};
+
+// Describes a single row of 4x4 blocks which has to be encoded.
+struct block_row_job final {
+	const uint8_t*	p_src;
+	uint8_t*		p_dst;
+	uint32_t		width;
+	uint32_t		height;
+	uint32_t		block_y;
+};
+
+constexpr uint32_t c_bc_weights_4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+
+// Clamps half float value to be a valid bc6h_uf16 input: [0, max finite half].
+inline float clamp_bc6h_input(uint16_t h) noexcept
+{
+	if (h & 0x8000) return 0.0f;	// negative values and -0
+	if (h >= 0x7c00) return float(0x7bff); // inf & nan
+	return float(h);
+}
+
+// Fetches 4x4 block of pixels which starts at (bx * 4, by * 4).
+// Pixels outside the image replicate the closest edge pixel.
+void fetch_block(const uint8_t* p_src, uint32_t width, uint32_t height,
+	uint32_t bx, uint32_t by, pixel_format fmt, block_pixels& pixels) noexcept
+{
+	const size_t pixel_bc = byte_count(fmt);
+
+	for (uint32_t y = 0; y < 4; ++y) {
+		const uint32_t py = std::min(by * 4 + y, height - 1);
+
+		for (uint32_t x = 0; x < 4; ++x) {
+			const uint32_t px = std::min(bx * 4 + x, width - 1);
+			const uint8_t* ptr = p_src + (size_t(py) * width + px) * pixel_bc;
+			float* p = pixels[y * 4 + x];
+
+			switch (fmt) {
+				default: assert(false); break;
+
+				case pixel_format::rg_8: {
+					p[0] = ptr[0]; p[1] = ptr[1]; p[2] = 0.0f; p[3] = 255.0f;
+					break;
+				}
+
+				case pixel_format::rgba_8: {
+					p[0] = ptr[0]; p[1] = ptr[1]; p[2] = ptr[2]; p[3] = ptr[3];
+					break;
+				}
+
+				case pixel_format::rgba_16f: {
+					uint16_t h[4];
+					std::memcpy(h, ptr, sizeof(h));
+					for (int c = 0; c < 4; ++c) p[c] = clamp_bc6h_input(h[c]);
+					break;
+				}
+
+				case pixel_format::rgb_32f:
+				case pixel_format::rgba_32f: {
+					float f[3];
+					std::memcpy(f, ptr, sizeof(f));
+					for (int c = 0; c < 3; ++c) p[c] = clamp_bc6h_input(float_to_half(f[c]));
+					p[3] = 0.0f;
+					break;
+				}
+			}
+		}
+	}
+}
+
+// Finds the line which approximates the pixel colors best (principal component analysis)
+// and returns the line segment's ends (e0, e1) which cover all the projected pixels.
+void find_endpoints_pca(const block_pixels& pixels, uint32_t channel_count, float (&e0)[4], float (&e1)[4]) noexcept
+{
+	float mean[4] = {};
+	for (uint32_t i = 0; i < 16; ++i) {
+		for (uint32_t c = 0; c < channel_count; ++c) mean[c] += pixels[i][c];
+	}
+	for (uint32_t c = 0; c < channel_count; ++c) mean[c] /= 16.0f;
+
+	float cov[4][4] = {};
+	for (uint32_t i = 0; i < 16; ++i) {
+		for (uint32_t r = 0; r < channel_count; ++r) {
+			for (uint32_t c = 0; c < channel_count; ++c)
+				cov[r][c] += (pixels[i][r] - mean[r]) * (pixels[i][c] - mean[c]);
+		}
+	}
+
+	// power iteration
+	float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	for (int iter = 0; iter < 8; ++iter) {
+		float tmp[4] = {};
+		float max_component = 0.0f;
+		for (uint32_t r = 0; r < channel_count; ++r) {
+			for (uint32_t c = 0; c < channel_count; ++c) tmp[r] += cov[r][c] * axis[c];
+			max_component = std::max(max_component, std::abs(tmp[r]));
+		}
+
+		if (max_component < std::numeric_limits<float>::epsilon()) break;
+		for (uint32_t c = 0; c < channel_count; ++c) axis[c] = tmp[c] / max_component;
+	}
+
+	float axis_len_sq = 0.0f;
+	for (uint32_t c = 0; c < channel_count; ++c) axis_len_sq += axis[c] * axis[c];
+
+	float t_min = 0.0f;
+	float t_max = 0.0f;
+	if (axis_len_sq > 0.0f) {
+		t_min = std::numeric_limits<float>::max();
+		t_max = std::numeric_limits<float>::lowest();
+		for (uint32_t i = 0; i < 16; ++i) {
+			float t = 0.0f;
+			for (uint32_t c = 0; c < channel_count; ++c) t += (pixels[i][c] - mean[c]) * axis[c];
+			t /= axis_len_sq;
+			t_min = std::min(t_min, t);
+			t_max = std::max(t_max, t);
+		}
+	}
+
+	for (uint32_t c = 0; c < 4; ++c) {
+		e0[c] = (c < channel_count) ? (mean[c] + axis[c] * t_min) : 0.0f;
+		e1[c] = (c < channel_count) ? (mean[c] + axis[c] * t_max) : 0.0f;
+	}
+}
+
+// Refits endpoints e0 & e1 using least squares, given the interpolation weight of each pixel ([0, 1]).
+void refit_endpoints(const block_pixels& pixels, const float (&weights)[16], uint32_t channel_count,
+	float (&e0)[4], float (&e1)[4]) noexcept
+{
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float ax[4] = {}, bx[4] = {};
+
+	for (uint32_t i = 0; i < 16; ++i) {
+		const float b = weights[i];
+		const float a = 1.0f - b;
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+
+		for (uint32_t c = 0; c < channel_count; ++c) {
+			ax[c] += a * pixels[i][c];
+			bx[c] += b * pixels[i][c];
+		}
+	}
+
+	const float det = aa * bb - ab * ab;
+	if (std::abs(det) < 1e-6f) return;
+
+	const float inv_det = 1.0f / det;
+	for (uint32_t c = 0; c < channel_count; ++c) {
+		e0[c] = (ax[c] * bb - bx[c] * ab) * inv_det;
+		e1[c] = (bx[c] * aa - ax[c] * ab) * inv_det;
+	}
+}
+
+// ----- bc4/bc5 -----
+
+// Encodes a single channel (0 - r, 1 - g) of the pixels into bc4 unorm block (8 bytes).
+void encode_bc4_block(const block_pixels& pixels, uint32_t channel, block_writer& writer) noexcept
+{
+	float v_min = 255.0f;
+	float v_max = 0.0f;
+	for (uint32_t i = 0; i < 16; ++i) {
+		v_min = std::min(v_min, pixels[i][channel]);
+		v_max = std::max(v_max, pixels[i][channel]);
+	}
+
+	const uint32_t r0 = uint32_t(v_max + 0.5f);
+	const uint32_t r1 = uint32_t(v_min + 0.5f);
+	writer.write(r0, 8);
+	writer.write(r1, 8);
+
+	// r0 == r1 means that index 0 (r0) is exact for each pixel.
+	if (r0 == r1) {
+		writer.write(0, 32);
+		writer.write(0, 16);
+		return;
+	}
+
+	// r0 > r1: 8 values palette.
+	float palette[8];
+	palette[0] = float(r0);
+	palette[1] = float(r1);
+	for (uint32_t i = 2; i < 8; ++i)
+		palette[i] = float((8 - i) * r0 + (i - 1) * r1) / 7.0f;
+
+	for (uint32_t i = 0; i < 16; ++i) {
+		uint32_t best_index = 0;
+		float best_error = std::numeric_limits<float>::max();
+		for (uint32_t p = 0; p < 8; ++p) {
+			const float error = std::abs(palette[p] - pixels[i][channel]);
+			if (error < best_error) {
+				best_error = error;
+				best_index = p;
+			}
+		}
+
+		writer.write(best_index, 3);
+	}
+}
+
+void encode_bc5_block(const block_pixels& pixels, uint8_t* p_block) noexcept
+{
+	block_writer writer(p_block);
+	encode_bc4_block(pixels, 0, writer);
+	encode_bc4_block(pixels, 1, writer);
+}
+
+// ----- bc6h -----
+
+// Quantizes half float bit pattern into 10-bit endpoint value of bc6h_uf16 mode 11.
+inline uint32_t quantize_bc6h_endpoint(float h) noexcept
+{
+	// the decoder maps endpoint q to the half value ~ (q * 31 + 15.5)
+	const float q = std::round((h - 15.5f) / 31.0f);
+	return uint32_t(std::min(1023.0f, std::max(0.0f, q)));
+}
+
+inline uint32_t unquantize_bc6h_endpoint(uint32_t q) noexcept
+{
+	if (q == 0) return 0;
+	if (q == 1023) return 0xffff;
+	return ((q << 16) + 0x8000) >> 10;
+}
+
+// Computes indices of the pixels for the specified quantized endpoints & returns the total error.
+float find_bc6h_indices(const block_pixels& pixels, const uint32_t (&q0)[3], const uint32_t (&q1)[3],
+	uint32_t (&indices)[16]) noexcept
+{
+	float palette[16][3];
+	for (uint32_t p = 0; p < 16; ++p) {
+		const uint32_t w = c_bc_weights_4[p];
+		for (uint32_t c = 0; c < 3; ++c) {
+			const uint32_t u0 = unquantize_bc6h_endpoint(q0[c]);
+			const uint32_t u1 = unquantize_bc6h_endpoint(q1[c]);
+			const uint32_t u = ((64 - w) * u0 + w * u1 + 32) >> 6;
+			palette[p][c] = float((u * 31) >> 6);
+		}
+	}
+
+	float total_error = 0.0f;
+	for (uint32_t i = 0; i < 16; ++i) {
+		float best_error = std::numeric_limits<float>::max();
+		for (uint32_t p = 0; p < 16; ++p) {
+			float error = 0.0f;
+			for (uint32_t c = 0; c < 3; ++c) {
+				const float d = palette[p][c] - pixels[i][c];
+				error += d * d;
+			}
+
+			if (error < best_error) {
+				best_error = error;
+				indices[i] = p;
+			}
+		}
+
+		total_error += best_error;
+	}
+
+	return total_error;
+}
+
+// Encodes the pixels using bc6h mode 11 (single region, 10-bit endpoints, 4-bit indices).
+void encode_bc6h_block(const block_pixels& pixels, uint8_t* p_block) noexcept
+{
+	float e0[4];
+	float e1[4];
+	find_endpoints_pca(pixels, 3, e0, e1);
+
+	uint32_t q0[3];
+	uint32_t q1[3];
+	uint32_t indices[16];
+	float best_error = std::numeric_limits<float>::max();
+	uint32_t best_q0[3];
+	uint32_t best_q1[3];
+	uint32_t best_indices[16];
+
+	for (int iter = 0; iter < 3; ++iter) {
+		for (uint32_t c = 0; c < 3; ++c) {
+			q0[c] = quantize_bc6h_endpoint(e0[c]);
+			q1[c] = quantize_bc6h_endpoint(e1[c]);
+		}
+
+		const float error = find_bc6h_indices(pixels, q0, q1, indices);
+		if (error >= best_error) break;
+
+		best_error = error;
+		std::copy(std::begin(q0), std::end(q0), std::begin(best_q0));
+		std::copy(std::begin(q1), std::end(q1), std::begin(best_q1));
+		std::copy(std::begin(indices), std::end(indices), std::begin(best_indices));
+
+		float weights[16];
+		for (uint32_t i = 0; i < 16; ++i) weights[i] = c_bc_weights_4[indices[i]] / 64.0f;
+		refit_endpoints(pixels, weights, 3, e0, e1);
+	}
+
+	// the most significant bit of the first index is implicitly 0.
+	if (best_indices[0] & 8) {
+		std::swap(best_q0, best_q1);
+		for (uint32_t& i : best_indices) i = 15 - i;
+	}
+
+	block_writer writer(p_block);
+	writer.write(0x03, 5); // mode 11
+	for (uint32_t c = 0; c < 3; ++c) writer.write(best_q0[c], 10);
+	for (uint32_t c = 0; c < 3; ++c) writer.write(best_q1[c], 10);
+	writer.write(best_indices[0], 3);
+	for (uint32_t i = 1; i < 16; ++i) writer.write(best_indices[i], 4);
+}
+
+// ----- bc7 -----
+
+// Quantizes 8-bit rgba endpoint into 7-bit components plus the shared p-bit (mode 6).
+void quantize_bc7_endpoint(const float (&e)[4], uint32_t (&q)[4], uint32_t& p_bit) noexcept
+{
+	float best_error = std::numeric_limits<float>::max();
+
+	for (uint32_t p = 0; p < 2; ++p) {
+		uint32_t tmp[4];
+		float error = 0.0f;
+		for (uint32_t c = 0; c < 4; ++c) {
+			const float v = std::round((e[c] - float(p)) / 2.0f);
+			tmp[c] = uint32_t(std::min(127.0f, std::max(0.0f, v)));
+			const float d = float((tmp[c] << 1) | p) - e[c];
+			error += d * d;
+		}
+
+		if (error < best_error) {
+			best_error = error;
+			p_bit = p;
+			std::copy(std::begin(tmp), std::end(tmp), std::begin(q));
+		}
+	}
+}
+
+float find_bc7_indices(const block_pixels& pixels, const uint32_t (&q0)[4], uint32_t p0,
+	const uint32_t (&q1)[4], uint32_t p1, uint32_t (&indices)[16]) noexcept
+{
+	float palette[16][4];
+	for (uint32_t p = 0; p < 16; ++p) {
+		const uint32_t w = c_bc_weights_4[p];
+		for (uint32_t c = 0; c < 4; ++c) {
+			const uint32_t v0 = (q0[c] << 1) | p0;
+			const uint32_t v1 = (q1[c] << 1) | p1;
+			palette[p][c] = float(((64 - w) * v0 + w * v1 + 32) >> 6);
+		}
+	}
+
+	float total_error = 0.0f;
+	for (uint32_t i = 0; i < 16; ++i) {
+		float best_error = std::numeric_limits<float>::max();
+		for (uint32_t p = 0; p < 16; ++p) {
+			float error = 0.0f;
+			for (uint32_t c = 0; c < 4; ++c) {
+				const float d = palette[p][c] - pixels[i][c];
+				error += d * d;
+			}
+
+			if (error < best_error) {
+				best_error = error;
+				indices[i] = p;
+			}
+		}
+
+		total_error += best_error;
+	}
+
+	return total_error;
+}
+
+// Encodes the pixels using bc7 mode 6 (single subset, rgba 7.7.7.7 endpoints + p-bit, 4-bit indices).
+void encode_bc7_block(const block_pixels& pixels, uint8_t* p_block) noexcept
+{
+	float e0[4];
+	float e1[4];
+	find_endpoints_pca(pixels, 4, e0, e1);
+
+	uint32_t q0[4], q1[4], p0 = 0, p1 = 0;
+	uint32_t indices[16];
+	float best_error = std::numeric_limits<float>::max();
+	uint32_t best_q0[4], best_q1[4], best_p0 = 0, best_p1 = 0;
+	uint32_t best_indices[16];
+
+	for (int iter = 0; iter < 3; ++iter) {
+		for (uint32_t c = 0; c < 4; ++c) {
+			e0[c] = std::min(255.0f, std::max(0.0f, e0[c]));
+			e1[c] = std::min(255.0f, std::max(0.0f, e1[c]));
+		}
+		quantize_bc7_endpoint(e0, q0, p0);
+		quantize_bc7_endpoint(e1, q1, p1);
+
+		const float error = find_bc7_indices(pixels, q0, p0, q1, p1, indices);
+		if (error >= best_error) break;
+
+		best_error = error;
+		best_p0 = p0;
+		best_p1 = p1;
+		std::copy(std::begin(q0), std::end(q0), std::begin(best_q0));
+		std::copy(std::begin(q1), std::end(q1), std::begin(best_q1));
+		std::copy(std::begin(indices), std::end(indices), std::begin(best_indices));
+
+		float weights[16];
+		for (uint32_t i = 0; i < 16; ++i) weights[i] = c_bc_weights_4[indices[i]] / 64.0f;
+		refit_endpoints(pixels, weights, 4, e0, e1);
+	}
+
+	// the most significant bit of the first index is implicitly 0.
+	if (best_indices[0] & 8) {
+		std::swap(best_q0, best_q1);
+		std::swap(best_p0, best_p1);
+		for (uint32_t& i : best_indices) i = 15 - i;
+	}
+
+	block_writer writer(p_block);
+	writer.write(1 << 6, 7); // mode 6
+	for (uint32_t c = 0; c < 4; ++c) {
+		writer.write(best_q0[c], 7);
+		writer.write(best_q1[c], 7);
+	}
+	writer.write(best_p0, 1);
+	writer.write(best_p1, 1);
+	writer.write(best_indices[0], 3);
+	for (uint32_t i = 1; i < 16; ++i) writer.write(best_indices[i], 4);
+}
+
+// ----- mipmaps -----
+
+// The number of texels around each face/image which are filled before filtering.
+// Large enough to cover the widest filter footprint (kaiser, 3:1 downscale).
+constexpr int32_t c_mip_border = 5;
+
+// Linear rgba float image with a border of c_mip_border texels on each side.
+struct mip_image final {
+
+	mip_image() noexcept = default;
+
+	mip_image(uint32_t width, uint32_t height)
+		: width(width), height(height), 
+		stride(width + 2 * c_mip_border),
+		texels(size_t(width + 2 * c_mip_border) * (height + 2 * c_mip_border) * 4)
+	{}
+
+
+	// x, y are in range [-c_mip_border, size + c_mip_border).
+	float* texel(int32_t x, int32_t y) noexcept
+	{
+		return texels.data() + (size_t(y + c_mip_border) * stride + (x + c_mip_border)) * 4;
+	}
+
+	const float* texel(int32_t x, int32_t y) const noexcept
+	{
+		return texels.data() + (size_t(y + c_mip_border) * stride + (x + c_mip_border)) * 4;
+	}
+
+
+	uint32_t			width = 0;
+	uint32_t			height = 0;
+	uint32_t			stride = 0;
+	std::vector<float>	texels;
+};
+
+// Filter weights of each destination texel along one axis. 
+// Destination texel i is the weighted sum of the source texels [first[i], first[i] + tap_count).
+struct mip_filter_taps final {
+	std::vector<int32_t>	first;
+	std::vector<float>		weights;	// dst_count * tap_count items
+	uint32_t				tap_count = 0;
+};
+
+float srgb_to_linear(float v) noexcept
+{
+	return (v <= 0.04045f) ? (v / 12.92f) : std::pow((v + 0.055f) / 1.055f, 2.4f);
+}
+
+float linear_to_srgb(float v) noexcept
+{
+	return (v <= 0.0031308f) ? (v * 12.92f) : (1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f);
+}
+
+// Zero-order modified Bessel function of the first kind.
+float bessel_i0(float x) noexcept
+{
+	float sum = 1.0f;
+	float term = 1.0f;
+	const float q = x * x * 0.25f;
+	for (int k = 1; k < 32; ++k) {
+		term *= q / float(k * k);
+		sum += term;
+		if (term < sum * 1e-8f) break;
+	}
+
+	return sum;
+}
+
+float kaiser_sinc_weight(float t, float radius) noexcept
+{
+	constexpr float c_alpha = 4.0f;
+
+	const float x = t / radius;
+	if (std::abs(x) >= 1.0f) return 0.0f;
+
+	const float sinc = (std::abs(t) < 1e-5f) ? 1.0f : std::sin(math::pi * t) / (math::pi * t);
+	const float window = bessel_i0(c_alpha * std::sqrt(1.0f - x * x)) / bessel_i0(c_alpha);
+	return sinc * window;
+}
+
+mip_filter_taps make_mip_filter_taps(uint32_t src_count, uint32_t dst_count, mipmap_filter filter)
+{
+	const float scale = float(src_count) / float(dst_count);
+	const float radius = (filter == mipmap_filter::box) ? 0.5f : 1.5f; // in destination texels
+	const float src_radius = radius * scale;
+
+	mip_filter_taps taps;
+	taps.tap_count = uint32_t(std::ceil(2.0f * src_radius)) + 1;
+	taps.first.resize(dst_count);
+	taps.weights.resize(dst_count * taps.tap_count, 0.0f);
+
+	for (uint32_t i = 0; i < dst_count; ++i) {
+		const float center = (float(i) + 0.5f) * scale;
+		int32_t first = int32_t(std::floor(center - src_radius));
+		first = std::max(first, -c_mip_border);
+		first = std::min(first, int32_t(src_count) + c_mip_border - int32_t(taps.tap_count));
+		taps.first[i] = first;
+
+		float* p_weights = taps.weights.data() + i * taps.tap_count;
+		float weight_sum = 0.0f;
+		for (uint32_t t = 0; t < taps.tap_count; ++t) {
+			const float src_center = float(first + int32_t(t)) + 0.5f;
+			float w = 0.0f;
+
+			if (filter == mipmap_filter::box) {
+				// coverage of the source texel by the destination texel's footprint.
+				const float lo = std::max(src_center - 0.5f, center - src_radius);
+				const float hi = std::min(src_center + 0.5f, center + src_radius);
+				w = std::max(0.0f, hi - lo);
+			}
+			else {
+				w = kaiser_sinc_weight((src_center - center) / scale, radius);
+			}
+
+			p_weights[t] = w;
+			weight_sum += w;
+		}
+
+		assert(weight_sum > 0.0f);
+		for (uint32_t t = 0; t < taps.tap_count; ++t) p_weights[t] /= weight_sum;
+	}
+
+	return taps;
+}
+
+// Decodes the specified subresource into linear rgba floats.
+void decode_mip_image(const uint8_t* p_src, pixel_format fmt, bool srgb, mip_image& image)
+{
+	const size_t pixel_bc = byte_count(fmt);
+
+	if (fmt == pixel_format::rg_16f || fmt == pixel_format::rgba_16f) {
+		const size_t cc = pixel_bc / sizeof(uint16_t);
+		std::vector<float> row(image.width * cc);
+
+		for (uint32_t y = 0; y < image.height; ++y) {
+			const uint16_t* p_row = reinterpret_cast<const uint16_t*>(p_src + y * image.width * pixel_bc);
+			half_to_float(p_row, row.data(), row.size());
+
+			for (uint32_t x = 0; x < image.width; ++x) {
+				float* p = image.texel(x, y);
+				p[0] = p[1] = p[2] = 0.0f;
+				p[3] = 1.0f;
+				std::memcpy(p, row.data() + x * cc, cc * sizeof(float));
+			}
+		}
+
+		return;
+	}
+	
+	for (uint32_t y = 0; y < image.height; ++y) {
+		for (uint32_t x = 0; x < image.width; ++x) {
+			const uint8_t* ptr = p_src + (size_t(y) * image.width + x) * pixel_bc;
+			float* p = image.texel(x, y);
+			p[0] = p[1] = p[2] = 0.0f;
+			p[3] = 1.0f;
+
+			switch (fmt) {
+				default: assert(false); break;
+
+				case pixel_format::red_8:
+				case pixel_format::rg_8:
+				case pixel_format::rgb_8:
+				case pixel_format::rgba_8: {
+					for (size_t c = 0; c < pixel_bc; ++c) {
+						const float v = ptr[c] / 255.0f;
+						p[c] = (srgb && c < 3) ? srgb_to_linear(v) : v;
+					}
+					break;
+				}
+
+				case pixel_format::rg_16f:
+				case pixel_format::rgba_16f: {
+					// converted by rows, see below.
+					break;
+				}
+
+				case pixel_format::rg_32f:
+				case pixel_format::rgb_32f:
+				case pixel_format::rgba_32f: {
+					std::memcpy(p, ptr, pixel_bc);
+					break;
+				}
+			}
+		}
+	}
+}
+
+// Encodes a single row of the image into the specified pixel format.
+void encode_mip_image_row(const mip_image& image, uint32_t y, pixel_format fmt, bool srgb, uint8_t* p_dst)
+{
+	const size_t pixel_bc = byte_count(fmt);
+
+	if (fmt == pixel_format::rgba_16f) {
+		// the row is contiguous rgba floats, convert it in one go.
+		float_to_half(image.texel(0, y), reinterpret_cast<uint16_t*>(p_dst), image.width * 4);
+		return;
+	}
+
+	for (uint32_t x = 0; x < image.width; ++x) {
+		const float* p = image.texel(x, y);
+		uint8_t* ptr = p_dst + x * pixel_bc;
+
+		switch (fmt) {
+			default: assert(false); break;
+
+			case pixel_format::red_8:
+			case pixel_format::rg_8:
+			case pixel_format::rgb_8:
+			case pixel_format::rgba_8: {
+				for (size_t c = 0; c < pixel_bc; ++c) {
+					const float v = (srgb && c < 3) ? linear_to_srgb(p[c]) : p[c];
+					ptr[c] = uint8_t(std::min(1.0f, std::max(0.0f, v)) * 255.0f + 0.5f);
+				}
+				break;
+			}
+
+			case pixel_format::rg_16f: {
+				const uint16_t h[2] = { float_to_half(p[0]), float_to_half(p[1]) };
+				std::memcpy(ptr, h, pixel_bc);
+				break;
+			}
+
+			case pixel_format::rg_32f:
+			case pixel_format::rgb_32f:
+			case pixel_format::rgba_32f: {
+				std::memcpy(ptr, p, pixel_bc);
+				break;
+			}
+		}
+	}
+}
+
+// Maps texel (x, y) of the specified cube face (may be outside the face) to 
+// the face which actually contains the texel's direction.
+// Face order and orientation follow D3D11 conventions (+x, -x, +y, -y, +z, -z).
+void wrap_cube_texel(uint32_t size, uint32_t& face, int32_t& x, int32_t& y) noexcept
+{
+	const float s = 2.0f * (float(x) + 0.5f) / float(size) - 1.0f;
+	const float t = 2.0f * (float(y) + 0.5f) / float(size) - 1.0f;
+
+	float d[3];
+	switch (face) {
+		case 0: d[0] = 1.0f;	d[1] = -t;		d[2] = -s;		break;
+		case 1: d[0] = -1.0f;	d[1] = -t;		d[2] = s;		break;
+		case 2: d[0] = s;		d[1] = 1.0f;	d[2] = t;		break;
+		case 3: d[0] = s;		d[1] = -1.0f;	d[2] = -t;		break;
+		case 4: d[0] = s;		d[1] = -t;		d[2] = 1.0f;	break;
+		default:d[0] = -s;		d[1] = -t;		d[2] = -1.0f;	break;
+	}
+
+	const float ax = std::abs(d[0]);
+	const float ay = std::abs(d[1]);
+	const float az = std::abs(d[2]);
+	float fs, ft, ma;
+	if (ax >= ay && ax >= az) {
+		ma = ax;
+		face = (d[0] > 0.0f) ? 0 : 1;
+		fs = (d[0] > 0.0f) ? -d[2] : d[2];
+		ft = -d[1];
+	}
+	else if (ay >= az) {
+		ma = ay;
+		face = (d[1] > 0.0f) ? 2 : 3;
+		fs = d[0];
+		ft = (d[1] > 0.0f) ? d[2] : -d[2];
+	}
+	else {
+		ma = az;
+		face = (d[2] > 0.0f) ? 4 : 5;
+		fs = (d[2] > 0.0f) ? d[0] : -d[0];
+		ft = -d[1];
+	}
+
+	const int32_t max_index = int32_t(size) - 1;
+	x = std::min(max_index, std::max(0, int32_t(std::floor((fs / ma + 1.0f) * 0.5f * size))));
+	y = std::min(max_index, std::max(0, int32_t(std::floor((ft / ma + 1.0f) * 0.5f * size))));
+}
+
+// Fills the border texels of each image. 
+// Cube faces take the border from the adjacent faces, 2d images replicate the edge texels.
+void fill_mip_image_borders(std::vector<mip_image>& images, bool is_cube) noexcept
+{
+	for (uint32_t a = 0; a < uint32_t(images.size()); ++a) {
+		mip_image& image = images[a];
+		const int32_t w = int32_t(image.width);
+		const int32_t h = int32_t(image.height);
+
+		for (int32_t y = -c_mip_border; y < h + c_mip_border; ++y) {
+			for (int32_t x = -c_mip_border; x < w + c_mip_border; ++x) {
+				if (x >= 0 && x < w && y >= 0 && y < h) continue;
+
+				uint32_t face = a;
+				int32_t sx = x;
+				int32_t sy = y;
+				if (is_cube) {
+					wrap_cube_texel(image.width, face, sx, sy);
+				}
+				else {
+					sx = std::min(w - 1, std::max(0, x));
+					sy = std::min(h - 1, std::max(0, y));
+				}
+
+				std::memcpy(image.texel(x, y), images[face].texel(sx, sy), 4 * sizeof(float));
+			}
+		}
+	}
+}
+
+// Applies the filter along x. Processes all the rows including the border ones.
+void filter_mip_rows(const mip_image& src, const mip_filter_taps& taps, 
+	int32_t row_begin, int32_t row_end, mip_image& dst) noexcept
+{
+	for (int32_t y = row_begin; y < row_end; ++y) {
+		for (uint32_t x = 0; x < dst.width; ++x) {
+			const float* p_weights = taps.weights.data() + x * taps.tap_count;
+			const float* p_src = src.texel(taps.first[x], y);
+
+			__m128 acc = _mm_setzero_ps();
+			for (uint32_t t = 0; t < taps.tap_count; ++t, p_src += 4)
+				acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(p_weights[t]), _mm_loadu_ps(p_src)));
+
+			_mm_storeu_ps(dst.texel(x, y), acc);
+		}
+	}
+}
+
+// Applies the filter along y.
+void filter_mip_columns(const mip_image& src, const mip_filter_taps& taps,
+	int32_t row_begin, int32_t row_end, mip_image& dst) noexcept
+{
+	const size_t src_stride = size_t(src.stride) * 4;
+
+	for (int32_t y = row_begin; y < row_end; ++y) {
+		const float* p_weights = taps.weights.data() + y * taps.tap_count;
+
+		for (uint32_t x = 0; x < dst.width; ++x) {
+			const float* p_src = src.texel(x, taps.first[y]);
+
+			__m128 acc = _mm_setzero_ps();
+			for (uint32_t t = 0; t < taps.tap_count; ++t, p_src += src_stride)
+				acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(p_weights[t]), _mm_loadu_ps(p_src)));
+
+			_mm_storeu_ps(dst.texel(x, y), acc);
+		}
+	}
+}
+
+bool is_mipmap_format(pixel_format fmt) noexcept
+{
+	return (fmt != pixel_format::none) && !is_block_compressed(fmt);
+}
+
+bool is_valid_compression_source(pixel_format src_format, pixel_format bc_format) noexcept
+{
+	switch (bc_format) {
+		default:						return false;
+		case pixel_format::bc5:			return (src_format == pixel_format::rg_8) || (src_format == pixel_format::rgba_8);
+		case pixel_format::bc7:			return (src_format == pixel_format::rgba_8);
+		case pixel_format::bc6h_uf16:
+			return (src_format == pixel_format::rgba_16f)
+				|| (src_format == pixel_format::rgb_32f)
+				|| (src_format == pixel_format::rgba_32f);
+	}
+}
+
+
+// ----- specular brdf -----
+
+// The functions below replicate common_pbr.hlsl (hammersley, importance_sample_ggx, g_smith_correlated_ibl)
+// and specular_brdf_integrator.compute.hlsl, the results have to match the gpu version.
+
+void hammersley(uint32_t index, uint32_t count, float& x, float& y) noexcept
+{
+	uint32_t bits = index;
+	bits = (bits << 16u) | (bits >> 16u);
+	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+	bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+	bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+
+	x = float(index) / float(count);
+	y = float(bits) * 2.3283064365386963e-10f;
+}
+
+inline float saturate(float v) noexcept
+{
+	return std::min(1.0f, std::max(0.0f, v));
+}
+
+float g_lambda(float rs, float cos_angle) noexcept
+{
+	const float ta = std::sqrt(1.0f - cos_angle * cos_angle) / cos_angle;
+	return std::isinf(ta) ? 0.0f : std::sqrt(1.0f + rs * ta * ta) * 0.5f - 0.5f;
+}
+
+float g_smith_correlated_ibl(float dot_nl, float dot_nv, float linear_roughness) noexcept
+{
+	const float a2 = linear_roughness * linear_roughness * 0.5f;
+	return 1.0f / (1.0f + g_lambda(a2, dot_nl) + g_lambda(a2, dot_nv));
+}
+
+// Computes the importance sampled half vectors (ggx, tangent space) of the specified roughness.
+// The vectors do not depend on dot(n, v), so they are shared by all the texels of a row.
+void sample_ggx_half_vectors(float roughness, uint32_t sample_count, std::vector<float>& h_ts) noexcept
+{
+	constexpr float c_2pi = 6.28318530717958f;
+
+	const float a2 = roughness * roughness * roughness * roughness;
+
+	for (uint32_t i = 0; i < sample_count; ++i) {
+		float xi_x, xi_y;
+		hammersley(i, sample_count, xi_x, xi_y);
+
+		const float phi = c_2pi * xi_x;
+		const float cos_theta = std::sqrt((1.0f - xi_y) / (1.0f + (a2 - 1.0f) * xi_y));
+		const float sin_theta = std::sqrt(1.0f - cos_theta * cos_theta);
+		h_ts[i * 3 + 0] = sin_theta * std::cos(phi);
+		h_ts[i * 3 + 1] = sin_theta * std::sin(phi);
+		h_ts[i * 3 + 2] = cos_theta;
+	}
+}
+
+void integrate_specular_brdf(float dot_nv, float roughness, const std::vector<float>& h_ts,
+	float& a, float& b) noexcept
+{
+	const uint32_t sample_count = uint32_t(h_ts.size() / 3);
+	const float v_ts[3] = { std::sqrt(1.0f - dot_nv * dot_nv), 0.0f, dot_nv };
+
+	a = 0.0f;
+	b = 0.0f;
+
+	for (uint32_t i = 0; i < sample_count; ++i) {
+		const float* h = &h_ts[i * 3];
+		const float dot_vh_raw = v_ts[0] * h[0] + v_ts[1] * h[1] + v_ts[2] * h[2];
+		const float l_ts_z = 2.0f * dot_vh_raw * h[2] - v_ts[2];
+
+		const float dot_nl = saturate(l_ts_z);
+		if (dot_nl <= 0.0f) continue;
+
+		const float g = g_smith_correlated_ibl(dot_nl, dot_nv, roughness);
+		const float dot_nh = saturate(h[2]);
+		const float dot_vh = saturate(dot_vh_raw);
+		float g_vis = (g * dot_vh) / (dot_nh * dot_nv);
+		if (std::isinf(g_vis)) g_vis = 1.0f;
+
+		const float t = 1.0f - dot_vh;
+		const float fc = (t * t) * (t * t) * t; // pow(1 - dot_vh, 5)
+		a += (1.0f - fc) * g_vis;
+		b += fc * g_vis;
+	}
+
+	a /= float(sample_count);
+	b /= float(sample_count);
+}
+
+
+// ----- envmaps -----
+
+// The functions below replicate equirect_to_skybox.compute.hlsl, diffuse_envmap.compute.hlsl,
+// specular_envmap.compute.hlsl and cube_direction, tangent_to_world_matrix, cube_mipmap_level (common_pbr.hlsl).
+// Textures are sampled like the gpu does with a linear clamp sampler: cube faces are filtered across their edges
+// (the border texels of each face come from the adjacent faces), mipmap levels are blended linearly.
+
+constexpr float c_pi = 3.14159265358979f;
+
+// The corners of the cube and the face masks of cube_direction.
+constexpr float c_cube_vertices[8][3] = {
+	{ -1, -1, -1 }, { 1, -1, -1 }, { 1, 1, -1 }, { -1, 1, -1 },
+	{ -1, -1, 1 }, { 1, -1, 1 }, { 1, 1, 1 }, { -1, 1, 1 }
+};
+constexpr float c_cube_masks[6][3] = {
+	{ 0.5f, 0, 1 }, { 0.5f, 1, 0 },
+	{ 1, 0.5f, 0 }, { 0, 0.5f, 1 },
+	{ 1, 0, 0.5f }, { 0, 1, 0.5f }
+};
+// The vertices which are interpolated along u (first pair) and v (second pair) of each face.
+constexpr uint32_t c_cube_face_vertices[6][4] = {
+	{ 5, 1, 5, 6 }, { 0, 4, 0, 3 },
+	{ 0, 1, 0, 4 }, { 7, 6, 7, 3 },
+	{ 4, 5, 4, 7 }, { 1, 0, 1, 2 }
+};
+
+// The direction of texel (x, y) of a face is normalize(origin + du * x / side_size + dv * y / side_size).
+struct cube_face_basis final {
+	float	origin[3];
+	float	du[3];
+	float	dv[3];
+};
+
+cube_face_basis make_cube_face_basis(uint32_t face) noexcept
+{
+	assert(face < 6);
+
+	const float* u_mask = c_cube_masks[(face / 2) * 2];
+	const float* v_mask = c_cube_masks[(face / 2) * 2 + 1];
+	const uint32_t* v = c_cube_face_vertices[face];
+
+	cube_face_basis b;
+	for (size_t c = 0; c < 3; ++c) {
+		b.origin[c] = u_mask[c] * c_cube_vertices[v[0]][c] + v_mask[c] * c_cube_vertices[v[2]][c];
+		b.du[c] = u_mask[c] * (c_cube_vertices[v[1]][c] - c_cube_vertices[v[0]][c]);
+		b.dv[c] = v_mask[c] * (c_cube_vertices[v[3]][c] - c_cube_vertices[v[2]][c]);
+	}
+
+	return b;
+}
+
+inline __m128 select_ps(__m128 mask, __m128 a, __m128 b) noexcept
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+inline __m128 lerp_ps(__m128 a, __m128 b, __m128 t) noexcept
+{
+	return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+}
+
+// Computes the directions of texels [x, x + 4) of row y (cube_direction), y_sign flips the y component.
+// The directions are written into p_dirs as 3 arrays of 4 floats (x, y, z).
+inline void compute_cube_directions(const cube_face_basis& b, uint32_t x, uint32_t y, float side_size,
+	float y_sign, float* p_dirs) noexcept
+{
+	const __m128 u = _mm_div_ps(_mm_add_ps(_mm_set1_ps(float(x)), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f)),
+		_mm_set1_ps(side_size));
+	const float v = float(y) / side_size;
+
+	__m128 d[3];
+	for (size_t c = 0; c < 3; ++c) {
+		d[c] = _mm_add_ps(_mm_set1_ps(b.origin[c] + b.dv[c] * v), _mm_mul_ps(u, _mm_set1_ps(b.du[c])));
+	}
+
+	d[1] = _mm_mul_ps(d[1], _mm_set1_ps(y_sign));
+	const __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], d[0]), _mm_mul_ps(d[1], d[1])),
+		_mm_mul_ps(d[2], d[2])));
+
+	for (size_t c = 0; c < 3; ++c)
+		_mm_storeu_ps(p_dirs + c * 4, _mm_div_ps(d[c], len));
+}
+
+// The columns of tangent_to_world_matrix(oz).
+struct tangent_frame final {
+	float	ox[3];
+	float	oy[3];
+	float	oz[3];
+};
+
+tangent_frame make_tangent_frame(float x, float y, float z) noexcept
+{
+	const float up[3] = { (std::abs(z) < 0.999f) ? 0.0f : 1.0f, 0.0f, (std::abs(z) < 0.999f) ? 1.0f : 0.0f };
+
+	tangent_frame f;
+	f.oz[0] = x;
+	f.oz[1] = y;
+	f.oz[2] = z;
+
+	// ox = normalize(cross(up, oz))
+	f.ox[0] = up[1] * z - up[2] * y;
+	f.ox[1] = up[2] * x - up[0] * z;
+	f.ox[2] = up[0] * y - up[1] * x;
+	const float len = std::sqrt(f.ox[0] * f.ox[0] + f.ox[1] * f.ox[1] + f.ox[2] * f.ox[2]);
+	for (float& c : f.ox) c /= len;
+
+	// oy = cross(oz, ox)
+	f.oy[0] = y * f.ox[2] - z * f.ox[1];
+	f.oy[1] = z * f.ox[0] - x * f.ox[2];
+	f.oy[2] = x * f.ox[1] - y * f.ox[0];
+	return f;
+}
+
+// Transforms 4 tangent space vectors (SoA) into world space.
+inline void tangent_to_world(const tangent_frame& f, __m128 tx, __m128 ty, __m128 tz, __m128 (&out)[3]) noexcept
+{
+	for (size_t c = 0; c < 3; ++c) {
+		out[c] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(f.ox[c]), tx), _mm_mul_ps(_mm_set1_ps(f.oy[c]), ty)),
+			_mm_mul_ps(_mm_set1_ps(f.oz[c]), tz));
+	}
+}
+
+// Face coordinates of 4 cube samples, see wrap_cube_texel for the face conventions.
+// s & t are in [-1, 1], (-1, -1) is the top left corner of the face.
+struct cube_coords final {
+	alignas(16) float	s[4];
+	alignas(16) float	t[4];
+	alignas(16) int32_t	face[4];
+};
+
+// Selects the face of each direction (the major axis) & projects the direction onto the face.
+inline void project_to_cube(const __m128 (&d)[3], cube_coords& out) noexcept
+{
+	const __m128 sign_mask = _mm_set1_ps(-0.0f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 ax = _mm_andnot_ps(sign_mask, d[0]);
+	const __m128 ay = _mm_andnot_ps(sign_mask, d[1]);
+	const __m128 az = _mm_andnot_ps(sign_mask, d[2]);
+	const __m128 is_x = _mm_and_ps(_mm_cmpge_ps(ax, ay), _mm_cmpge_ps(ax, az));
+	const __m128 is_y = _mm_andnot_ps(is_x, _mm_cmpge_ps(ay, az));
+	const __m128 pos_x = _mm_cmpgt_ps(d[0], zero);
+	const __m128 pos_y = _mm_cmpgt_ps(d[1], zero);
+	const __m128 pos_z = _mm_cmpgt_ps(d[2], zero);
+	const __m128 neg_x = _mm_xor_ps(d[0], sign_mask);
+	const __m128 neg_y = _mm_xor_ps(d[1], sign_mask);
+	const __m128 neg_z = _mm_xor_ps(d[2], sign_mask);
+
+	// +x: (-z, -y), -x: (z, -y), +y: (x, z), -y: (x, -z), +z: (x, -y), -z: (-x, -y)
+	const __m128 ma = select_ps(is_x, ax, select_ps(is_y, ay, az));
+	const __m128 sc = select_ps(is_x, select_ps(pos_x, neg_z, d[2]),
+		select_ps(is_y, d[0], select_ps(pos_z, d[0], neg_x)));
+	const __m128 tc = select_ps(is_y, select_ps(pos_y, d[2], neg_z), neg_y);
+	const __m128 face = select_ps(is_x, select_ps(pos_x, _mm_set1_ps(0.0f), _mm_set1_ps(1.0f)),
+		select_ps(is_y, select_ps(pos_y, _mm_set1_ps(2.0f), _mm_set1_ps(3.0f)),
+			select_ps(pos_z, _mm_set1_ps(4.0f), _mm_set1_ps(5.0f))));
+
+	const __m128 inv_ma = _mm_div_ps(_mm_set1_ps(1.0f), ma);
+	_mm_store_ps(out.s, _mm_mul_ps(sc, inv_ma));
+	_mm_store_ps(out.t, _mm_mul_ps(tc, inv_ma));
+	_mm_store_si128(reinterpret_cast<__m128i*>(out.face), _mm_cvttps_epi32(face));
+}
+
+// Returns the bilinear sample (rgba) of the image at texel coordinates (s, t).
+// The coordinates must be within [-0.5, size - 0.5], the border provides the texels beyond the edges.
+inline __m128 sample_bilinear(const mip_image& image, float s, float t) noexcept
+{
+	const float fs = std::floor(s);
+	const float ft = std::floor(t);
+	const int32_t x = std::min(int32_t(image.width) - 1, std::max(-1, int32_t(fs)));
+	const int32_t y = std::min(int32_t(image.height) - 1, std::max(-1, int32_t(ft)));
+	const __m128 wx = _mm_set1_ps(s - fs);
+	const __m128 wy = _mm_set1_ps(t - ft);
+
+	const float* p0 = image.texel(x, y);
+	const float* p1 = image.texel(x, y + 1);
+	const __m128 r0 = lerp_ps(_mm_loadu_ps(p0), _mm_loadu_ps(p0 + 4), wx);
+	const __m128 r1 = lerp_ps(_mm_loadu_ps(p1), _mm_loadu_ps(p1 + 4), wx);
+	return lerp_ps(r0, r1, wy);
+}
+
+// Returns the offset of the subresource (array slice a, mipmap level m) within td.buffer.
+size_t subresource_offset(const texture_data& td, uint32_t a, uint32_t m) noexcept
+{
+	size_t offset = 0;
+	for (uint32_t i = 0; i < a * td.mipmap_count + m; ++i) offset += byte_count(td.size, i % td.mipmap_count, td.format);
+	return offset;
+}
+
+// cube_mipmaps keeps the decoded mipmap levels of a cube texture: levels[m][face].
+using cube_mipmaps = std::vector<std::vector<mip_image>>;
+
+// Decodes the levels [first_level, first_level + level_count) of the cube texture
+// and fills the borders of the faces.
+cube_mipmaps decode_cube_mipmaps(const texture_data& td, uint32_t first_level, uint32_t level_count)
+{
+	assert(td.type == texture_type::texture_cube);
+	assert(first_level + level_count <= td.mipmap_count);
+
+	cube_mipmaps levels(level_count, std::vector<mip_image>(6));
+	parallel_for(6 * size_t(level_count), 1, [&](size_t begin, size_t end) {
+		for (size_t j = begin; j < end; ++j) {
+			const uint32_t a = uint32_t(j % 6);
+			const uint32_t m = first_level + uint32_t(j / 6);
+
+			const uint32_t side_size = std::max(1u, td.size.x >> m);
+			mip_image& image = levels[m - first_level][a];
+			image = mip_image(side_size, side_size);
+			decode_mip_image(td.buffer.data() + subresource_offset(td, a, m), td.format, false, image);
+		}
+	});
+
+	parallel_for(level_count, 1, [&](size_t begin, size_t end) {
+		for (size_t m = begin; m < end; ++m) fill_mip_image_borders(levels[m], true);
+	});
+
+	return levels;
+}
+
+// Returns the level of the cube texture whose side size is side_size, the last level if there is no such level.
+uint32_t find_cube_level(const texture_data& td, uint32_t side_size) noexcept
+{
+	uint32_t m = 0;
+	while (m + 1 < td.mipmap_count && (td.size.x >> m) > side_size) ++m;
+	return m;
+}
+
+// Returns the bilinear sample of the face at face coordinates (s, t), see project_to_cube.
+inline __m128 sample_cube_face(const std::vector<mip_image>& faces, int32_t face, float s, float t) noexcept
+{
+	const mip_image& image = faces[face];
+	const float half_size = 0.5f * float(image.width);
+	return sample_bilinear(image, (s + 1.0f) * half_size - 0.5f, (t + 1.0f) * half_size - 0.5f);
+}
+
+// Returns the trilinear sample of the cube at face coordinates (s, t) and the specified mipmap level.
+inline __m128 sample_cube(const cube_mipmaps& levels, int32_t face, float s, float t, float level) noexcept
+{
+	const float max_level = float(levels.size() - 1);
+	level = std::min(max_level, std::max(0.0f, level));
+
+	const uint32_t m = uint32_t(level);
+	const float f = level - float(m);
+	const __m128 c0 = sample_cube_face(levels[m], face, s, t);
+	if (f == 0.0f) return c0;
+
+	return lerp_ps(c0, sample_cube_face(levels[m + 1], face, s, t), _mm_set1_ps(f));
+}
+
+// Computes the ggx half vectors (tangent space), their pdfs and the skybox levels which they are sampled from
+// (importance_sample_ggx, cube_mipmap_level). The arrays are padded to a multiple of 4 samples,
+// the padding has zero weight.
+void sample_ggx_lobe(float roughness, uint32_t sample_count, uint32_t skybox_side_size, uint32_t skybox_mipmap_count,
+	std::vector<float>& h_x, std::vector<float>& h_y, std::vector<float>& h_z,
+	std::vector<float>& levels, std::vector<float>& weights)
+{
+	const size_t padded_count = (sample_count + 3) / 4 * 4;
+	h_x.assign(padded_count, 0.0f);
+	h_y.assign(padded_count, 0.0f);
+	h_z.assign(padded_count, 1.0f);
+	levels.assign(padded_count, 0.0f);
+	weights.assign(padded_count, 0.0f);
+
+	const float a2 = roughness * roughness * roughness * roughness;
+	const float omega_p = 4.0f * c_pi / (6.0f * float(skybox_side_size) * float(skybox_side_size));
+
+	for (uint32_t i = 0; i < sample_count; ++i) {
+		float xi_x, xi_y;
+		hammersley(i, sample_count, xi_x, xi_y);
+
+		const float phi = 2.0f * c_pi * xi_x;
+		const float cos_theta = std::sqrt((1.0f - xi_y) / (1.0f + (a2 - 1.0f) * xi_y));
+		const float sin_theta = std::sqrt(1.0f - cos_theta * cos_theta);
+		h_x[i] = sin_theta * std::cos(phi);
+		h_y[i] = sin_theta * std::sin(phi);
+		h_z[i] = cos_theta;
+
+		const float d = (cos_theta * a2 - cos_theta) * cos_theta + 1.0f;
+		const float pdf = a2 / (c_pi * d * d) * cos_theta;
+		const float omega_s = 1.0f / (float(sample_count) * pdf);
+		levels[i] = std::min(float(skybox_mipmap_count), std::max(0.0f, 0.5f * std::log2(omega_s / omega_p)));
+		weights[i] = 1.0f;
+	}
+}
+
+} // namespace
+
+
+namespace sparki {
+namespace core {
+
+texture_data compress_texture(const texture_data& td, pixel_format bc_format)
+{
+	assert(is_valid_texture_data(td));
+	assert(is_block_compressed(bc_format));
+	ENFORCE(is_valid_compression_source(td.format, bc_format),
+		"Pixel format ", int(td.format), " can not be compressed into ", int(bc_format));
+
+	texture_data out(td.type, td.size, td.mipmap_count, td.array_size, bc_format);
+
+	// each job is a row of 4x4 blocks of a single subresource.
+	std::vector<block_row_job> jobs;
+	const uint8_t* p_src = td.buffer.data();
+	uint8_t* p_dst = out.buffer.data();
+	for (uint32_t a = 0; a < td.array_size; ++a) {
+		for (uint32_t m = 0; m < td.mipmap_count; ++m) {
+			const uint32_t w = std::max(1u, td.size.x >> m);
+			const uint32_t h = std::max(1u, td.size.y >> m);
+			const uint32_t block_row_count = row_count(h, bc_format);
+			const size_t block_row_bc = row_byte_count(w, bc_format);
+
+			for (uint32_t by = 0; by < block_row_count; ++by)
+				jobs.push_back({ p_src, p_dst + by * block_row_bc, w, h, by });
+
+			p_src += byte_count(td.size, m, td.format);
+			p_dst += byte_count(td.size, m, bc_format);
+		}
+	}
+
+	const pixel_format src_format = td.format;
+	parallel_for(jobs.size(), 8, [&jobs, src_format, bc_format](size_t begin, size_t end) {
+		block_pixels pixels;
+
+		for (size_t j = begin; j < end; ++j) {
+			const block_row_job& job = jobs[j];
+			const uint32_t block_count = (job.width + 3) / 4;
+
+			for (uint32_t bx = 0; bx < block_count; ++bx) {
+				fetch_block(job.p_src, job.width, job.height, bx, job.block_y, src_format, pixels);
+				uint8_t* p_block = job.p_dst + bx * 16;
+
+				switch (bc_format) {
+					case pixel_format::bc5:			encode_bc5_block(pixels, p_block); break;
+					case pixel_format::bc6h_uf16:	encode_bc6h_block(pixels, p_block); break;
+					case pixel_format::bc7:			encode_bc7_block(pixels, p_block); break;
+					default:						assert(false); break;
+				}
+			}
+		}
+	});
+
+	return out;
+}
+
+texture_data generate_mipmaps(const texture_data& td, const mipmap_desc& desc)
+{
+	assert(is_valid_texture_data(td));
+	ENFORCE(is_mipmap_format(td.format), "Mipmaps can not be generated for pixel format ", int(td.format));
+	ENFORCE(!desc.srgb || byte_count(td.format) <= 4, "sRGB averaging requires 8-bit unorm pixel format.");
+
+	const uint32_t full_count = full_mipmap_count(td.size);
+	const uint32_t mipmap_count = (desc.mipmap_count == 0) ? full_count : std::min(desc.mipmap_count, full_count);
+	const bool is_cube = (td.type == texture_type::texture_cube);
+	texture_data out(td.type, td.size, mipmap_count, td.array_size, td.format);
+
+	// mip #0 is copied as is. 
+	// The offset of each subresource in the source and destination buffers.
+	std::vector<size_t> src_offsets(td.array_size);
+	std::vector<size_t> dst_offsets(td.array_size * mipmap_count);
+	{
+		size_t src_offset = 0;
+		size_t dst_offset = 0;
+		for (uint32_t a = 0; a < td.array_size; ++a) {
+			src_offsets[a] = src_offset;
+			for (uint32_t m = 0; m < td.mipmap_count; ++m) src_offset += byte_count(td.size, m, td.format);
+
+			for (uint32_t m = 0; m < mipmap_count; ++m) {
+				dst_offsets[a * mipmap_count + m] = dst_offset;
+				dst_offset += byte_count(td.size, m, td.format);
+			}
+
+			std::memcpy(out.buffer.data() + dst_offsets[a * mipmap_count], 
+				td.buffer.data() + src_offsets[a], byte_count(td.size, 0, td.format));
+		}
+	}
+
+	// decode mip #0 of each slice.
+	std::vector<mip_image> src_images(td.array_size);
+	parallel_for(td.array_size, 1, [&](size_t begin, size_t end) {
+		for (size_t a = begin; a < end; ++a) {
+			src_images[a] = mip_image(td.size.x, td.size.y);
+			decode_mip_image(td.buffer.data() + src_offsets[a], td.format, desc.srgb, src_images[a]);
+		}
+	});
+
+	constexpr size_t c_rows_per_job = 16;
+
+	for (uint32_t m = 1; m < mipmap_count; ++m) {
+		const uint32_t src_w = src_images[0].width;
+		const uint32_t src_h = src_images[0].height;
+		const uint32_t dst_w = std::max(1u, td.size.x >> m);
+		const uint32_t dst_h = std::max(1u, td.size.y >> m);
+		const mip_filter_taps taps_x = make_mip_filter_taps(src_w, dst_w, desc.filter);
+		const mip_filter_taps taps_y = make_mip_filter_taps(src_h, dst_h, desc.filter);
+
+		fill_mip_image_borders(src_images, is_cube);
+
+		// horizontal pass: src -> tmp (border rows are filtered as well).
+		std::vector<mip_image> tmp_images(td.array_size, mip_image(dst_w, src_h));
+		const size_t tmp_rows = src_h + 2 * c_mip_border;
+		const size_t tmp_bands = (tmp_rows + c_rows_per_job - 1) / c_rows_per_job;
+		parallel_for(td.array_size * tmp_bands, 1, [&](size_t begin, size_t end) {
+			for (size_t j = begin; j < end; ++j) {
+				const size_t a = j / tmp_bands;
+				const int32_t row_begin = int32_t((j % tmp_bands) * c_rows_per_job) - c_mip_border;
+				const int32_t row_end = std::min(row_begin + int32_t(c_rows_per_job), int32_t(src_h) + c_mip_border);
+				filter_mip_rows(src_images[a], taps_x, row_begin, row_end, tmp_images[a]);
+			}
+		});
+
+		// vertical pass: tmp -> dst, each row is encoded right after it has been filtered.
+		std::vector<mip_image> dst_images(td.array_size, mip_image(dst_w, dst_h));
+		const size_t dst_bands = (dst_h + c_rows_per_job - 1) / c_rows_per_job;
+		const size_t dst_row_bc = row_byte_count(dst_w, td.format);
+		parallel_for(td.array_size * dst_bands, 1, [&](size_t begin, size_t end) {
+			for (size_t j = begin; j < end; ++j) {
+				const size_t a = j / dst_bands;
+				const int32_t row_begin = int32_t((j % dst_bands) * c_rows_per_job);
+				const int32_t row_end = std::min(row_begin + int32_t(c_rows_per_job), int32_t(dst_h));
+				filter_mip_columns(tmp_images[a], taps_y, row_begin, row_end, dst_images[a]);
+
+				uint8_t* p_dst = out.buffer.data() + dst_offsets[a * mipmap_count + m];
+				for (int32_t y = row_begin; y < row_end; ++y)
+					encode_mip_image_row(dst_images[a], y, td.format, desc.srgb, p_dst + y * dst_row_bc);
+			}
+		});
+
+		src_images = std::move(dst_images);
+	}
+
+	return out;
+}
+
+uint32_t full_mipmap_count(const math::uint3& size) noexcept
+{
+	uint32_t count = 1;
+	for (uint32_t s = std::max(size.x, size.y); s > 1; s >>= 1) ++count;
+	return count;
+}
+
+void convert_image_to_tex(const char* p_image_filename, const char* p_tex_filename,
+	pixel_format fmt, const mipmap_desc& mipmap_desc, bool flip_vertically)
+{
+	assert(p_image_filename);
+	assert(p_tex_filename);
+	assert(fmt != pixel_format::none);
+
+	try {
+		texture_data td = load_from_image_file(p_image_filename, 4, flip_vertically);
+		if (mipmap_desc.mipmap_count != 1)
+			td = generate_mipmaps(td, mipmap_desc);
+
+		if (is_block_compressed(fmt))
+			td = compress_texture(td, fmt);
+
+		ENFORCE(td.format == fmt, "The image can not be converted into pixel format ", int(fmt));
+		save_to_tex_file(p_tex_filename, td);
+	}
+	catch (...) {
+		std::string exc_msg = EXCEPTION_MSG("Image to tex conversion error. Image: ", p_image_filename);
+		std::throw_with_nested(std::runtime_error(exc_msg));
+	}
+}
+
+texture_data bake_specular_brdf(uint32_t side_size, uint32_t sample_count)
+{
+	assert(side_size > 1);
+	assert(sample_count > 0);
+
+	texture_data td(texture_type::texture_2d, math::uint3(side_size, side_size, 1), 1, 1, pixel_format::rg_16f);
+	uint16_t* p_dst = reinterpret_cast<uint16_t*>(td.buffer.data());
+
+	// one row per roughness value, rows are independent.
+	parallel_for(side_size, 4, [=](size_t begin, size_t end) {
+		std::vector<float> h_ts(size_t(sample_count) * 3);
+
+		for (size_t y = begin; y < end; ++y) {
+			const float roughness = float(y) / float(side_size - 1);
+			sample_ggx_half_vectors(roughness, sample_count, h_ts);
+
+			for (uint32_t x = 0; x < side_size; ++x) {
+				const float dot_nv = float(x) / float(side_size - 1);
+				float ab[2];
+				integrate_specular_brdf(dot_nv, roughness, h_ts, ab[0], ab[1]);
+				float_to_half(ab, p_dst + (y * side_size + x) * 2, 2);
+			}
+		}
+	});
+
+	return td;
+}
+
+
+texture_data bake_skybox(const texture_data& equirect, uint32_t side_size)
+{
+	assert(is_valid_texture_data(equirect));
+	assert(side_size > 0);
+	ENFORCE(equirect.type == texture_type::texture_2d, "The equirectangular image must be a 2d texture.");
+	ENFORCE(is_mipmap_format(equirect.format), "Unsupported equirectangular image pixel format ", int(equirect.format));
+
+	std::vector<mip_image> src(1, mip_image(equirect.size.x, equirect.size.y));
+	decode_mip_image(equirect.buffer.data(), equirect.format, false, src[0]);
+	// the border replicates the edges (clamp addressing).
+	fill_mip_image_borders(src, false);
+
+	texture_data out(texture_type::texture_cube, math::uint3(side_size, side_size, 1), 1, 6, pixel_format::rgba_16f);
+	const size_t row_bc = row_byte_count(side_size, out.format);
+	const float max_s = float(equirect.size.x) - 0.5f;
+	const float max_t = float(equirect.size.y) - 0.5f;
+
+	// faces x rows
+	parallel_for(6 * size_t(side_size), 4, [&](size_t begin, size_t end) {
+		std::vector<float> row(size_t(side_size) * 4);
+		alignas(16) float dirs[12];
+
+		for (size_t j = begin; j < end; ++j) {
+			const uint32_t face = uint32_t(j / side_size);
+			const uint32_t y = uint32_t(j % side_size);
+			const cube_face_basis basis = make_cube_face_basis(face);
+
+			for (uint32_t x = 0; x < side_size; x += 4) {
+				compute_cube_directions(basis, x, y, float(side_size), 1.0f, dirs);
+
+				for (uint32_t i = 0; i < 4 && x + i < side_size; ++i) {
+					const float u = std::atan2(dirs[8 + i], dirs[i]) * 0.1591f + 0.5f;
+					const float v = std::asin(dirs[4 + i]) * 0.3183f + 0.5f;
+					const float s = std::min(max_s, std::max(-0.5f, u * float(equirect.size.x) - 0.5f));
+					const float t = std::min(max_t, std::max(-0.5f, v * float(equirect.size.y) - 0.5f));
+					_mm_storeu_ps(row.data() + (x + i) * 4, sample_bilinear(src[0], s, t));
+				}
+			}
+
+			uint8_t* p_dst = out.buffer.data() + subresource_offset(out, face, 0) + y * row_bc;
+			float_to_half(row.data(), reinterpret_cast<uint16_t*>(p_dst), row.size());
+		}
+	});
+
+	return out;
+}
+
+texture_data bake_diffuse_envmap(const texture_data& skybox, uint32_t side_size)
+{
+	assert(is_valid_texture_data(skybox));
+	assert(side_size > 0);
+	ENFORCE(skybox.type == texture_type::texture_cube, "The skybox must be a cube texture.");
+	ENFORCE(is_mipmap_format(skybox.format), "Unsupported skybox pixel format ", int(skybox.format));
+
+	// The shader samples the skybox level of the envmap's size (#3: 512 -> 64).
+	const uint32_t level = find_cube_level(skybox, side_size);
+	const cube_mipmaps levels = decode_cube_mipmaps(skybox, level, 1);
+	const std::vector<mip_image>& faces = levels[0];
+
+	// The hemisphere samples are the same for all the texels. The loops match the shader's ones,
+	// the angles are accumulated in float to get the same sample count.
+	constexpr float c_sample_step = 0.025f;
+	std::vector<float> l_x;
+	std::vector<float> l_y;
+	std::vector<float> l_z;
+	std::vector<float> weights;
+	for (float phi = 0.0f; phi < 2.0f * c_pi; phi += c_sample_step) {
+		const float cos_phi = std::cos(phi);
+		const float sin_phi = std::sin(phi);
+
+		for (float theta = 0.0f; theta < c_pi / 2.0f; theta += c_sample_step) {
+			const float cos_theta = std::cos(theta);
+			const float sin_theta = std::sin(theta);
+			l_x.push_back(cos_phi * sin_theta);
+			l_y.push_back(sin_phi * sin_theta);
+			l_z.push_back(cos_theta);
+			weights.push_back(cos_theta * sin_theta);
+		}
+	}
+
+	const float total_weight = float(weights.size());
+	while (weights.size() % 4 != 0) {
+		l_x.push_back(0.0f);
+		l_y.push_back(0.0f);
+		l_z.push_back(1.0f);
+		weights.push_back(0.0f);
+	}
+
+	texture_data out(texture_type::texture_cube, math::uint3(side_size, side_size, 1), 1, 6, pixel_format::rgba_16f);
+	const size_t row_bc = row_byte_count(side_size, out.format);
+
+	// faces x rows, each texel integrates ~16k samples.
+	parallel_for(6 * size_t(side_size), 1, [&](size_t begin, size_t end) {
+		std::vector<float> row(size_t(side_size) * 4);
+		alignas(16) float dirs[12];
+		cube_coords coords;
+
+		for (size_t j = begin; j < end; ++j) {
+			const uint32_t face = uint32_t(j / side_size);
+			const uint32_t y = uint32_t(j % side_size);
+			const cube_face_basis basis = make_cube_face_basis(face);
+
+			for (uint32_t x = 0; x < side_size; x += 4) {
+				compute_cube_directions(basis, x, y, float(side_size), -1.0f, dirs);
+
+				for (uint32_t i = 0; i < 4 && x + i < side_size; ++i) {
+					const tangent_frame frame = make_tangent_frame(dirs[i], dirs[4 + i], dirs[8 + i]);
+
+					__m128 irradiance = _mm_setzero_ps();
+					for (size_t k = 0; k < weights.size(); k += 4) {
+						__m128 l_ws[3];
+						tangent_to_world(frame, _mm_loadu_ps(&l_x[k]), _mm_loadu_ps(&l_y[k]), _mm_loadu_ps(&l_z[k]), l_ws);
+						project_to_cube(l_ws, coords);
+
+						for (size_t l = 0; l < 4; ++l) {
+							const __m128 c = sample_cube_face(faces, coords.face[l], coords.s[l], coords.t[l]);
+							irradiance = _mm_add_ps(irradiance, _mm_mul_ps(c, _mm_set1_ps(weights[k + l])));
+						}
+					}
+
+					float* p = row.data() + (x + i) * 4;
+					_mm_storeu_ps(p, _mm_mul_ps(irradiance, _mm_set1_ps(c_pi / total_weight)));
+					p[3] = total_weight;
+				}
+			}
+
+			uint8_t* p_dst = out.buffer.data() + subresource_offset(out, face, 0) + y * row_bc;
+			float_to_half(row.data(), reinterpret_cast<uint16_t*>(p_dst), row.size());
+		}
+	});
+
+	return out;
+}
+
+texture_data bake_specular_envmap(const texture_data& skybox, uint32_t side_size, uint32_t mipmap_count)
+{
+	assert(is_valid_texture_data(skybox));
+	assert(side_size > 0);
+	assert(mipmap_count > 0);
+	ENFORCE(skybox.type == texture_type::texture_cube, "The skybox must be a cube texture.");
+	ENFORCE(skybox.format == pixel_format::rgba_16f, "The skybox pixel format must be rgba_16f.");
+
+	const uint32_t copy_level = find_cube_level(skybox, side_size);
+	ENFORCE((skybox.size.x >> copy_level) == side_size, "The skybox has no mipmap of size ", side_size);
+	mipmap_count = std::min(mipmap_count, full_mipmap_count(math::uint3(side_size, side_size, 1)));
+
+	const cube_mipmaps levels = decode_cube_mipmaps(skybox, 0, skybox.mipmap_count);
+	texture_data out(texture_type::texture_cube, math::uint3(side_size, side_size, 1), mipmap_count, 6,
+		pixel_format::rgba_16f);
+
+	// mipmap #0 is a copy of the skybox's level of the same size.
+	for (uint32_t a = 0; a < 6; ++a) {
+		std::memcpy(out.buffer.data() + subresource_offset(out, a, 0),
+			skybox.buffer.data() + subresource_offset(skybox, a, copy_level),
+			byte_count(out.size, 0, out.format));
+	}
+
+	std::vector<float> h_x;
+	std::vector<float> h_y;
+	std::vector<float> h_z;
+	std::vector<float> sample_levels;
+	std::vector<float> weights;
+
+	for (uint32_t m = 1; m < mipmap_count; ++m) {
+		const float roughness = float(m) / float(mipmap_count - 1);
+		const uint32_t mip_side_size = std::max(1u, side_size >> m);
+		const uint32_t sample_count = uint32_t(4.0f + roughness * (32.0f - 4.0f));
+		sample_ggx_lobe(roughness, sample_count, skybox.size.x, skybox.mipmap_count,
+			h_x, h_y, h_z, sample_levels, weights);
+
+		const size_t row_bc = row_byte_count(mip_side_size, out.format);
+
+		// faces x rows
+		parallel_for(6 * size_t(mip_side_size), 1, [&](size_t begin, size_t end) {
+			std::vector<float> row(size_t(mip_side_size) * 4);
+			alignas(16) float dirs[12];
+			alignas(16) float dot_nl[4];
+			cube_coords coords;
+
+			for (size_t j = begin; j < end; ++j) {
+				const uint32_t face = uint32_t(j / mip_side_size);
+				const uint32_t y = uint32_t(j % mip_side_size);
+				const cube_face_basis basis = make_cube_face_basis(face);
+
+				for (uint32_t x = 0; x < mip_side_size; x += 4) {
+					compute_cube_directions(basis, x, y, float(mip_side_size), -1.0f, dirs);
+
+					for (uint32_t i = 0; i < 4 && x + i < mip_side_size; ++i) {
+						const tangent_frame frame = make_tangent_frame(dirs[i], dirs[4 + i], dirs[8 + i]);
+						const __m128 n[3] = { _mm_set1_ps(dirs[i]), _mm_set1_ps(dirs[4 + i]), _mm_set1_ps(dirs[8 + i]) };
+
+						__m128 filtered_rgb = _mm_setzero_ps();
+						float total_weight = 0.0f;
+						for (size_t k = 0; k < weights.size(); k += 4) {
+							__m128 h_ws[3];
+							tangent_to_world(frame, _mm_loadu_ps(&h_x[k]), _mm_loadu_ps(&h_y[k]), _mm_loadu_ps(&h_z[k]), h_ws);
+
+							// l = 2 * dot(n, h) * h - n
+							const __m128 dot_nh2 = _mm_mul_ps(_mm_set1_ps(2.0f), _mm_add_ps(_mm_add_ps(
+								_mm_mul_ps(n[0], h_ws[0]), _mm_mul_ps(n[1], h_ws[1])), _mm_mul_ps(n[2], h_ws[2])));
+							__m128 l_ws[3];
+							for (size_t c = 0; c < 3; ++c) l_ws[c] = _mm_sub_ps(_mm_mul_ps(dot_nh2, h_ws[c]), n[c]);
+
+							const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n[0], l_ws[0]), _mm_mul_ps(n[1], l_ws[1])),
+								_mm_mul_ps(n[2], l_ws[2]));
+							_mm_store_ps(dot_nl, _mm_mul_ps(_mm_min_ps(_mm_set1_ps(1.0f), _mm_max_ps(_mm_setzero_ps(), d)),
+								_mm_loadu_ps(&weights[k])));
+							project_to_cube(l_ws, coords);
+
+							for (size_t l = 0; l < 4; ++l) {
+								if (dot_nl[l] <= 0.0f) continue;
+
+								const __m128 c = sample_cube(levels, coords.face[l], coords.s[l], coords.t[l], sample_levels[k + l]);
+								filtered_rgb = _mm_add_ps(filtered_rgb, _mm_mul_ps(c, _mm_set1_ps(dot_nl[l])));
+								total_weight += dot_nl[l];
+							}
+						}
+
+						float* p = row.data() + (x + i) * 4;
+						_mm_storeu_ps(p, _mm_div_ps(filtered_rgb, _mm_set1_ps(std::max(0.001f, total_weight))));
+						p[3] = 1.0f;
+					}
+				}
+
+				uint8_t* p_dst = out.buffer.data() + subresource_offset(out, face, m) + y * row_bc;
+				float_to_half(row.data(), reinterpret_cast<uint16_t*>(p_dst), row.size());
+			}
+		});
+	}
+
+	return out;
+}
+
+void convert_hdr_to_skybox(const char* p_hdr_filename, const char* p_skybox_filename,
+	const char* p_skybox_source_filename, const envmap_desc& desc)
+{
+	assert(p_hdr_filename);
+	assert(p_skybox_filename);
+	assert(p_skybox_source_filename);
+
+	try {
+		// Cube faces are filtered across their edges which removes seams from the blurry mipmaps
+		// that are sampled by the envmap convolutions.
+		texture_data skybox;
+		{
+			const texture_data equirect = load_from_image_file(p_hdr_filename, 4, false, true);
+			mipmap_desc mip_desc;
+			mip_desc.filter = mipmap_filter::kaiser;
+			mip_desc.mipmap_count = desc.skybox_mipmap_count;
+			skybox = generate_mipmaps(bake_skybox(equirect, desc.skybox_side_size), mip_desc);
+		}
+
+		save_to_tex_file(p_skybox_source_filename, skybox);
+		save_to_tex_file(p_skybox_filename, compress_texture(skybox, pixel_format::bc6h_uf16));
+	}
+	catch (...) {
+		std::string exc_msg = EXCEPTION_MSG("Skybox baking error. Image: ", p_hdr_filename);
+		std::throw_with_nested(std::runtime_error(exc_msg));
+	}
+}
+
+void convert_skybox_to_envmaps(const char* p_skybox_source_filename, const char* p_diffuse_envmap_filename,
+	const char* p_specular_envmap_filename, const envmap_desc& desc)
+{
+	assert(p_skybox_source_filename);
+	assert(p_diffuse_envmap_filename);
+	assert(p_specular_envmap_filename);
+
+	try {
+		const texture_data skybox = load_from_tex_file(p_skybox_source_filename);
+		ENFORCE(skybox.format == pixel_format::rgba_16f && skybox.type == texture_type::texture_cube,
+			"The skybox has to be an rgba_16f cube texture.");
+
+		const texture_data diffuse = bake_diffuse_envmap(skybox, desc.diffuse_envmap_side_size);
+		save_to_tex_file(p_diffuse_envmap_filename, compress_texture(diffuse, pixel_format::bc6h_uf16));
+
+		const texture_data specular = bake_specular_envmap(skybox, desc.specular_envmap_side_size,
+			desc.specular_envmap_mipmap_count);
+		save_to_tex_file(p_specular_envmap_filename, compress_texture(specular, pixel_format::bc6h_uf16));
+	}
+	catch (...) {
+		std::string exc_msg = EXCEPTION_MSG("Envmap baking error. Skybox: ", p_skybox_source_filename);
+		std::throw_with_nested(std::runtime_error(exc_msg));
+	}
+}
+
+} // namespace core
+} // namespace sparki
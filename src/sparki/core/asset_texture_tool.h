@@ -0,0 +1,97 @@
+#pragma once
+
+#include "sparki/core/asset_texture.h"
+
+
+namespace sparki {
+namespace core {
+
+enum class mipmap_filter : unsigned char {
+	// 2x2 average (weighted by coverage for non power of 2 sizes).
+	box,
+	// Kaiser windowed sinc. Sharper than box, uses 6x6 source texels per destination texel.
+	kaiser
+};
+
+// The sizes of the textures which are made by convert_hdr_to_skybox & convert_skybox_to_envmaps.
+// The defaults match envmap_texture_builder and the shaders.
+struct envmap_desc final {
+	uint32_t	skybox_side_size = 512;
+	uint32_t	skybox_mipmap_count = 10;
+	uint32_t	diffuse_envmap_side_size = 64;
+	uint32_t	specular_envmap_side_size = 128;
+	uint32_t	specular_envmap_mipmap_count = 5;
+};
+
+struct mipmap_desc final {
+	mipmap_filter	filter = mipmap_filter::box;
+	// The number of mipmap levels of the result. 0 means the full mipmap chain.
+	uint32_t		mipmap_count = 0;
+	// True means that rgb values are sRGB encoded and should be averaged in linear space.
+	// Valid only for 8-bit unorm pixel formats.
+	bool			srgb = false;
+};
+
+// Encodes each subresource of the specified texture into the block compressed format bc_format.
+// The blocks are encoded on the task system's worker threads.
+// Supported source formats:
+// - bc5:		rg_8, rgba_8 (r & g channels are encoded, b & a are dropped);
+// - bc6h_uf16:	rgba_16f, rgb_32f, rgba_32f (negative values are clamped to zero, alpha is dropped);
+// - bc7:		rgba_8.
+texture_data compress_texture(const texture_data& td, pixel_format bc_format);
+
+// Builds the mipmap chain of the specified texture. Mipmap #0 of each array slice is the source,
+// the other levels (if any) of td are ignored. Block compressed formats are not supported,
+// mipmaps have to be generated before compression.
+// Each level is computed from the previous one using a separable filter,
+// slices & bands of rows are processed on the task system's worker threads.
+// Cube faces are filtered across their edges, texels beyond an edge are taken from the adjacent face.
+texture_data generate_mipmaps(const texture_data& td, const mipmap_desc& desc);
+
+// Returns the number of levels of the full mipmap chain of a texture of the specified size.
+uint32_t full_mipmap_count(const math::uint3& size) noexcept;
+
+// Computes the split sum specular brdf lookup texture (rg_16f, side_size x side_size) on the cpu.
+// x is dot(n, v), y is linear roughness, r & g are the scale & bias of f0.
+// The result matches the texture which is produced by brdf_integrator (specular_brdf_integrator.compute.hlsl).
+texture_data bake_specular_brdf(uint32_t side_size, uint32_t sample_count);
+
+// The functions below are the cpu versions of envmap_texture_builder's passes, the results match the gpu ones
+// within the tolerances of sparki_assetc --self-check, which compares them with the checked-in pisa envmaps.
+// Faces x rows are processed on the task system's worker threads, directions & cube samples are computed 4-wide (SSE).
+
+// Projects the equirectangular image (e.g. an .hdr image, 2d texture) onto the faces of a cube
+// (rgba_16f, side_size x side_size, 1 mipmap). See equirect_to_skybox.compute.hlsl.
+texture_data bake_skybox(const texture_data& equirect, uint32_t side_size);
+
+// Computes the irradiance cube (rgba_16f, side_size x side_size, 1 mipmap) of the skybox (cube texture with mipmaps).
+// The skybox level of side_size (or the smallest one) is integrated over the hemisphere of each texel.
+// See diffuse_envmap.compute.hlsl.
+texture_data bake_diffuse_envmap(const texture_data& skybox, uint32_t side_size);
+
+// Computes the prefiltered specular cube (rgba_16f, side_size x side_size, mipmap_count mipmaps) of the skybox
+// (rgba_16f cube texture with mipmaps, one of them has to be side_size x side_size).
+// Mipmap #0 is a copy of the skybox, mipmap #m is the skybox convolved with the ggx lobe of roughness m / (mipmap_count - 1).
+// See specular_envmap.compute.hlsl.
+texture_data bake_specular_envmap(const texture_data& skybox, uint32_t side_size, uint32_t mipmap_count);
+
+// convert_hdr_to_skybox followed by convert_skybox_to_envmaps is the cpu version of envmap_texture_builder::perform.
+
+// Reads the specified .hdr file (equirectangular) and bakes the skybox (mipmaps: kaiser).
+// Writes it into p_skybox_filename (bc6h_uf16) & p_skybox_source_filename (rgba_16f),
+// the latter is the source of convert_skybox_to_envmaps.
+void convert_hdr_to_skybox(const char* p_hdr_filename, const char* p_skybox_filename,
+	const char* p_skybox_source_filename, const envmap_desc& desc = envmap_desc());
+
+// Reads the rgba_16f skybox which has been written by convert_hdr_to_skybox, bakes the diffuse & specular envmaps
+// and writes them into the specified .tex files (bc6h_uf16).
+void convert_skybox_to_envmaps(const char* p_skybox_source_filename, const char* p_diffuse_envmap_filename,
+	const char* p_specular_envmap_filename, const envmap_desc& desc = envmap_desc());
+
+// Reads the specified image file (.jpg, .png, .hdr), generates mipmaps (see mipmap_desc::mipmap_count),
+// encodes the result into fmt (if fmt is block compressed) and writes it into the specified .tex file.
+void convert_image_to_tex(const char* p_image_filename, const char* p_tex_filename,
+	pixel_format fmt, const mipmap_desc& mipmap_desc, bool flip_vertically = false);
+
+} // namespace core
+} // namespace sparki
@@ -0,0 +1,277 @@
+#include "sparki/core/half_float.h"
+
+#include <cassert>
+#include <cstring>
+
+#if defined(_M_ARM64) || defined(__aarch64__)
+	#define SPARKI_HALF_FLOAT_NEON 1
+	#include <arm_neon.h>
+#elif defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define SPARKI_HALF_FLOAT_SSE 1
+	#include <emmintrin.h>
+	#include <immintrin.h>
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+	#endif
+#endif
+
+#if defined(SPARKI_HALF_FLOAT_SSE) && (defined(__GNUC__) || defined(__clang__))
+	#define SPARKI_TARGET_F16C __attribute__((target("f16c")))
+#else
+	#define SPARKI_TARGET_F16C
+#endif
+
+
+namespace {
+
+using namespace sparki::core;
+
+#if defined(SPARKI_HALF_FLOAT_SSE)
+
+// Returns true if the cpu supports F16C instructions and the os saves ymm registers.
+bool cpu_supports_f16c() noexcept
+{
+	int regs[4] = {};
+#if defined(_MSC_VER)
+	__cpuid(regs, 1);
+#else
+	__cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+
+	const bool f16c = (regs[2] & (1 << 29)) != 0;
+	const bool osxsave = (regs[2] & (1 << 27)) != 0;
+	const bool avx = (regs[2] & (1 << 28)) != 0;
+	if (!(f16c && osxsave && avx)) return false;
+
+#if defined(_MSC_VER)
+	const unsigned long long xcr0 = _xgetbv(0);
+#else
+	uint32_t eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	const unsigned long long xcr0 = (uint64_t(edx) << 32) | eax;
+#endif
+	return (xcr0 & 0x6) == 0x6;
+}
+
+const bool g_cpu_supports_f16c = cpu_supports_f16c();
+
+SPARKI_TARGET_F16C void float_to_half_f16c(const float* p_src, uint16_t* p_dst, size_t count) noexcept
+{
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256 f = _mm256_loadu_ps(p_src + i);
+		const __m128i h = _mm256_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p_dst + i), h);
+	}
+
+	for (; i < count; ++i) p_dst[i] = float_to_half(p_src[i]);
+}
+
+SPARKI_TARGET_F16C void half_to_float_f16c(const uint16_t* p_src, float* p_dst, size_t count) noexcept
+{
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_src + i));
+		_mm256_storeu_ps(p_dst + i, _mm256_cvtph_ps(h));
+	}
+
+	for (; i < count; ++i) p_dst[i] = half_to_float(p_src[i]);
+}
+
+// Converts 4 floats. Each lane of the result contains sign extended half float.
+inline __m128i float_to_half_sse2(__m128 f) noexcept
+{
+	const __m128i c_f16max			= _mm_set1_epi32((127 + 16) << 23);	// values >= this round to inf
+	const __m128i c_nanbit			= _mm_set1_epi32(0x200);
+	const __m128i c_infty_as_fp16	= _mm_set1_epi32(0x7c00);
+	const __m128i c_min_normal		= _mm_set1_epi32((127 - 14) << 23);	// the smallest value which yields normalized half
+	const __m128i c_subnorm_magic	= _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+	const __m128i c_normal_bias		= _mm_set1_epi32(0xfff - ((127 - 15) << 23)); // exponent adjustment & rounding
+
+	const __m128 justsign	= _mm_and_ps(_mm_castsi128_ps(_mm_set1_epi32(int32_t(0x80000000u))), f);
+	const __m128 absf		= _mm_xor_ps(f, justsign);
+	const __m128i absf_int	= _mm_castps_si128(absf);
+	const __m128 b_isnan	= _mm_cmpunord_ps(absf, absf);
+	const __m128i b_isregular = _mm_cmpgt_epi32(c_f16max, absf_int);
+	const __m128i inf_or_nan = _mm_or_si128(_mm_and_si128(_mm_castps_si128(b_isnan), c_nanbit), c_infty_as_fp16);
+	const __m128i b_issub	= _mm_cmpgt_epi32(c_min_normal, absf_int);
+
+	// subnormal result
+	const __m128 subnorm1	= _mm_add_ps(absf, _mm_castsi128_ps(c_subnorm_magic));
+	const __m128i subnorm2	= _mm_sub_epi32(_mm_castps_si128(subnorm1), c_subnorm_magic);
+
+	// normal result, round to nearest even
+	const __m128i mantodd	= _mm_srai_epi32(_mm_slli_epi32(absf_int, 31 - 13), 31);
+	const __m128i round1	= _mm_add_epi32(absf_int, c_normal_bias);
+	const __m128i normal	= _mm_srli_epi32(_mm_sub_epi32(round1, mantodd), 13);
+
+	const __m128i nonspecial = _mm_or_si128(_mm_and_si128(subnorm2, b_issub), _mm_andnot_si128(b_issub, normal));
+	const __m128i joined	= _mm_or_si128(_mm_and_si128(nonspecial, b_isregular), _mm_andnot_si128(b_isregular, inf_or_nan));
+	return _mm_or_si128(joined, _mm_srai_epi32(_mm_castps_si128(justsign), 16));
+}
+
+// Converts 4 half floats which are stored in the low 16 bits of each lane.
+inline __m128 half_to_float_sse2(__m128i h) noexcept
+{
+	const __m128i c_mask_nosign	= _mm_set1_epi32(0x7fff);
+	const __m128 c_magic		= _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+	const __m128i c_was_infnan	= _mm_set1_epi32(0x7bff);
+	const __m128 c_exp_infnan	= _mm_castsi128_ps(_mm_set1_epi32(255 << 23));
+
+	const __m128i expmant	= _mm_and_si128(c_mask_nosign, h);
+	const __m128i justsign	= _mm_xor_si128(h, expmant);
+	const __m128 scaled		= _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expmant, 13)), c_magic);
+	const __m128i b_wasinfnan = _mm_cmpgt_epi32(expmant, c_was_infnan);
+	const __m128 infnanexp	= _mm_and_ps(_mm_castsi128_ps(b_wasinfnan), c_exp_infnan);
+	const __m128 sign_inf	= _mm_or_ps(_mm_castsi128_ps(_mm_slli_epi32(justsign, 16)), infnanexp);
+	return _mm_or_ps(scaled, sign_inf);
+}
+
+void float_to_half_sse2(const float* p_src, uint16_t* p_dst, size_t count) noexcept
+{
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m128i h0 = float_to_half_sse2(_mm_loadu_ps(p_src + i));
+		const __m128i h1 = float_to_half_sse2(_mm_loadu_ps(p_src + i + 4));
+		// the lanes are sign extended, signed saturation keeps them intact.
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p_dst + i), _mm_packs_epi32(h0, h1));
+	}
+
+	for (; i < count; ++i) p_dst[i] = float_to_half(p_src[i]);
+}
+
+void half_to_float_sse2(const uint16_t* p_src, float* p_dst, size_t count) noexcept
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_src + i));
+		_mm_storeu_ps(p_dst + i, half_to_float_sse2(_mm_unpacklo_epi16(h, zero)));
+		_mm_storeu_ps(p_dst + i + 4, half_to_float_sse2(_mm_unpackhi_epi16(h, zero)));
+	}
+
+	for (; i < count; ++i) p_dst[i] = half_to_float(p_src[i]);
+}
+
+#endif // defined(SPARKI_HALF_FLOAT_SSE)
+
+} // namespace
+
+
+namespace sparki {
+namespace core {
+
+uint16_t float_to_half(float value) noexcept
+{
+	constexpr uint32_t c_f32_infinity = 255 << 23;
+	constexpr uint32_t c_f16_max = (127 + 16) << 23;
+	constexpr uint32_t c_denorm_magic_bits = ((127 - 15) + (23 - 10) + 1) << 23;
+
+	uint32_t f;
+	std::memcpy(&f, &value, sizeof(float));
+	const uint32_t sign = f & 0x80000000u;
+	f ^= sign;
+
+	uint16_t h;
+	if (f >= c_f16_max) {
+		h = (f > c_f32_infinity) ? 0x7e00 : 0x7c00; // nan -> qnan, inf -> inf
+	}
+	else if (f < (113 << 23)) {
+		// subnormal or zero. The magic value aligns 10 mantissa bits at the bottom of the float.
+		float denorm_magic;
+		std::memcpy(&denorm_magic, &c_denorm_magic_bits, sizeof(float));
+		float tmp;
+		std::memcpy(&tmp, &f, sizeof(float));
+		tmp += denorm_magic;
+		std::memcpy(&f, &tmp, sizeof(float));
+		h = uint16_t(f - c_denorm_magic_bits);
+	}
+	else {
+		const uint32_t mant_odd = (f >> 13) & 1;
+		f += (uint32_t(15 - 127) << 23) + 0xfff;
+		f += mant_odd;
+		h = uint16_t(f >> 13);
+	}
+
+	return uint16_t(h | (sign >> 16));
+}
+
+float half_to_float(uint16_t value) noexcept
+{
+	constexpr uint32_t c_shifted_exp = 0x7c00 << 13; // exponent mask after shift
+	constexpr uint32_t c_magic_bits = 113 << 23;
+
+	uint32_t f = (value & 0x7fffu) << 13;	// exponent/mantissa bits
+	const uint32_t exp = c_shifted_exp & f;	// just the exponent
+	f += (127 - 15) << 23;					// exponent adjust
+
+	if (exp == c_shifted_exp) {
+		f += (128 - 16) << 23;				// extra exp adjust for inf/nan
+	}
+	else if (exp == 0) {
+		// zero/subnormal: renormalize
+		float magic;
+		std::memcpy(&magic, &c_magic_bits, sizeof(float));
+		f += 1 << 23;
+		float tmp;
+		std::memcpy(&tmp, &f, sizeof(float));
+		tmp -= magic;
+		std::memcpy(&f, &tmp, sizeof(float));
+	}
+
+	f |= uint32_t(value & 0x8000u) << 16;	// sign bit
+
+	float result;
+	std::memcpy(&result, &f, sizeof(float));
+	return result;
+}
+
+void float_to_half(const float* p_src, uint16_t* p_dst, size_t count) noexcept
+{
+	assert(count == 0 || (p_src && p_dst));
+
+#if defined(SPARKI_HALF_FLOAT_SSE)
+	if (g_cpu_supports_f16c) float_to_half_f16c(p_src, p_dst, count);
+	else float_to_half_sse2(p_src, p_dst, count);
+
+#elif defined(SPARKI_HALF_FLOAT_NEON)
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const float16x4_t h = vcvt_f16_f32(vld1q_f32(p_src + i));
+		vst1_u16(p_dst + i, vreinterpret_u16_f16(h));
+	}
+
+	for (; i < count; ++i) p_dst[i] = float_to_half(p_src[i]);
+
+#else
+	for (size_t i = 0; i < count; ++i) p_dst[i] = float_to_half(p_src[i]);
+#endif
+}
+
+void half_to_float(const uint16_t* p_src, float* p_dst, size_t count) noexcept
+{
+	assert(count == 0 || (p_src && p_dst));
+
+#if defined(SPARKI_HALF_FLOAT_SSE)
+	if (g_cpu_supports_f16c) half_to_float_f16c(p_src, p_dst, count);
+	else half_to_float_sse2(p_src, p_dst, count);
+
+#elif defined(SPARKI_HALF_FLOAT_NEON)
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const float16x4_t h = vreinterpret_f16_u16(vld1_u16(p_src + i));
+		vst1q_f32(p_dst + i, vcvt_f32_f16(h));
+	}
+
+	for (; i < count; ++i) p_dst[i] = half_to_float(p_src[i]);
+
+#else
+	for (size_t i = 0; i < count; ++i) p_dst[i] = half_to_float(p_src[i]);
+#endif
+}
+
+} // namespace core
+} // namespace sparki
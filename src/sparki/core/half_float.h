@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace sparki {
+namespace core {
+
+// Converts float value to half float (IEEE 754 binary16), rounds to nearest even.
+// Values which are too large become infinity, nan stays nan.
+uint16_t float_to_half(float value) noexcept;
+
+// Converts half float (IEEE 754 binary16) to float. The conversion is exact.
+float half_to_float(uint16_t value) noexcept;
+
+// Converts count float values to half floats.
+// Uses F16C if the cpu supports it, SSE2 or NEON otherwise.
+// The results match float_to_half (nan payloads aside).
+// p_src and p_dst must not overlap.
+void float_to_half(const float* p_src, uint16_t* p_dst, size_t count) noexcept;
+
+// Converts count half float values to floats.
+// Uses F16C if the cpu supports it, SSE2 or NEON otherwise. The results match half_to_float.
+// p_src and p_dst must not overlap.
+void half_to_float(const uint16_t* p_src, float* p_dst, size_t count) noexcept;
+
+} // namespace core
+} // namespace sparki
@@ -0,0 +1,131 @@
+#include "sparki/core/hash.h"
+
+#include <cassert>
+#include <cstring>
+#include "sparki/core/platform_file.h"
+#include "sparki/core/utility.h"
+
+
+namespace {
+
+constexpr uint64_t c_prime_1 = 0x9e3779b185ebca87ull;
+constexpr uint64_t c_prime_2 = 0xc2b2ae3d27d4eb4full;
+constexpr uint64_t c_prime_3 = 0x165667b19e3779f9ull;
+constexpr uint64_t c_prime_4 = 0x85ebca77c2b2ae63ull;
+constexpr uint64_t c_prime_5 = 0x27d4eb2f165667c5ull;
+
+inline uint64_t rotl(uint64_t v, int r) noexcept
+{
+	return (v << r) | (v >> (64 - r));
+}
+
+inline uint64_t read_u64(const uint8_t* p) noexcept
+{
+	uint64_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+inline uint32_t read_u32(const uint8_t* p) noexcept
+{
+	uint32_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input) noexcept
+{
+	acc += input * c_prime_2;
+	acc = rotl(acc, 31);
+	return acc * c_prime_1;
+}
+
+inline uint64_t merge_round(uint64_t acc, uint64_t v) noexcept
+{
+	acc ^= round(0, v);
+	return acc * c_prime_1 + c_prime_4;
+}
+
+} // namespace
+
+
+namespace sparki {
+namespace core {
+
+uint64_t hash_bytes(const void* p_data, size_t byte_count, uint64_t seed) noexcept
+{
+	assert(p_data || byte_count == 0);
+
+	const uint8_t* p = static_cast<const uint8_t*>(p_data);
+	const uint8_t* p_end = p + byte_count;
+	uint64_t h;
+
+	if (byte_count >= 32) {
+		// 4 independent lanes, each one consumes 8 bytes of every 32-byte stripe.
+		uint64_t v1 = seed + c_prime_1 + c_prime_2;
+		uint64_t v2 = seed + c_prime_2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - c_prime_1;
+
+		const uint8_t* p_limit = p_end - 32;
+		do {
+			v1 = round(v1, read_u64(p));
+			v2 = round(v2, read_u64(p + 8));
+			v3 = round(v3, read_u64(p + 16));
+			v4 = round(v4, read_u64(p + 24));
+			p += 32;
+		} while (p <= p_limit);
+
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = merge_round(h, v1);
+		h = merge_round(h, v2);
+		h = merge_round(h, v3);
+		h = merge_round(h, v4);
+	}
+	else {
+		h = seed + c_prime_5;
+	}
+
+	h += uint64_t(byte_count);
+
+	for (; p + 8 <= p_end; p += 8) {
+		h ^= round(0, read_u64(p));
+		h = rotl(h, 27) * c_prime_1 + c_prime_4;
+	}
+
+	if (p + 4 <= p_end) {
+		h ^= uint64_t(read_u32(p)) * c_prime_1;
+		h = rotl(h, 23) * c_prime_2 + c_prime_3;
+		p += 4;
+	}
+
+	for (; p < p_end; ++p) {
+		h ^= uint64_t(*p) * c_prime_5;
+		h = rotl(h, 11) * c_prime_1;
+	}
+
+	// avalanche
+	h ^= h >> 33;
+	h *= c_prime_2;
+	h ^= h >> 29;
+	h *= c_prime_3;
+	h ^= h >> 32;
+	return h;
+}
+
+uint64_t hash_file(const char* p_filename)
+{
+	assert(p_filename);
+
+	try {
+		const mapped_file file(p_filename);
+		return hash_bytes(file.data(), file.size());
+	}
+	catch (...) {
+		const std::string exc_msg = EXCEPTION_MSG("File hashing error. File: ", p_filename);
+		std::throw_with_nested(std::runtime_error(exc_msg));
+	}
+}
+
+} // namespace core
+} // namespace sparki
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace sparki {
+namespace core {
+
+// Computes 64-bit hash (XXH64) of the specified memory block.
+// The hash is stable across runs & platforms (little endian), so it can be stored in files.
+uint64_t hash_bytes(const void* p_data, size_t byte_count, uint64_t seed = 0) noexcept;
+
+// Mixes value into the hash h. The result depends on the order of the combined values.
+constexpr uint64_t hash_combine(uint64_t h, uint64_t value) noexcept
+{
+	return h ^ (value + 0x9e3779b97f4a7c15ull + (h << 12) + (h >> 4));
+}
+
+// Computes hash_bytes of the contents of the specified file. The file is memory mapped.
+uint64_t hash_file(const char* p_filename);
+
+} // namespace core
+} // namespace sparki
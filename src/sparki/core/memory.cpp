@@ -0,0 +1,147 @@
+#include "sparki/core/memory.h"
+
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#if defined(_WIN32)
+	#include <malloc.h>
+#endif
+
+
+namespace {
+
+using namespace sparki::core;
+
+// Free blocks of each size class. The pool is never destroyed: buffers which are destroyed
+// during static deinitialization may still return their blocks.
+struct memory_pool final {
+	std::mutex								mutex;
+	std::map<size_t, std::vector<void*>>	free_blocks;
+	memory_pool_stats						stats;
+};
+
+memory_pool& get_memory_pool()
+{
+	static memory_pool* p_pool = new memory_pool();
+	return *p_pool;
+}
+
+void* allocate_aligned(size_t byte_count)
+{
+#if defined(_WIN32)
+	void* p = _aligned_malloc(byte_count, c_pool_alignment);
+#else
+	void* p = nullptr;
+	if (posix_memalign(&p, c_pool_alignment, byte_count) != 0) p = nullptr;
+#endif
+
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+void free_aligned(void* p) noexcept
+{
+#if defined(_WIN32)
+	_aligned_free(p);
+#else
+	std::free(p);
+#endif
+}
+
+} // namespace
+
+
+namespace sparki {
+namespace core {
+
+size_t pool_block_byte_count(size_t byte_count) noexcept
+{
+	if (byte_count <= 256) return std::max<size_t>(64, (byte_count + 63) & ~size_t(63));
+	if (byte_count > c_pool_max_cached_block_byte_count) return byte_count;
+
+	// 4 classes per power of 2: step is a quarter of the greatest power of 2 which is less than byte_count.
+	size_t e = 0;
+	for (size_t v = (byte_count - 1) >> 1; v; v >>= 1) ++e;
+	const size_t step = size_t(1) << (e - 2);
+	return (byte_count + step - 1) & ~(step - 1);
+}
+
+void* pool_allocate(size_t byte_count)
+{
+	const size_t block_bc = pool_block_byte_count(byte_count);
+	memory_pool& pool = get_memory_pool();
+
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		++pool.stats.allocation_count;
+
+		auto it = pool.free_blocks.find(block_bc);
+		if (it != pool.free_blocks.end() && !it->second.empty()) {
+			void* p = it->second.back();
+			it->second.pop_back();
+			++pool.stats.reuse_count;
+			--pool.stats.cached_block_count;
+			pool.stats.cached_byte_count -= block_bc;
+			return p;
+		}
+	}
+
+	return allocate_aligned(block_bc);
+}
+
+void pool_deallocate(void* p, size_t byte_count) noexcept
+{
+	if (!p) return;
+
+	const size_t block_bc = pool_block_byte_count(byte_count);
+	memory_pool& pool = get_memory_pool();
+
+	if (block_bc <= c_pool_max_cached_block_byte_count) {
+		std::lock_guard<std::mutex> lock(pool.mutex);
+
+		if (pool.stats.cached_byte_count + block_bc <= c_pool_max_cached_byte_count) {
+			try {
+				pool.free_blocks[block_bc].push_back(p);
+				++pool.stats.cached_block_count;
+				pool.stats.cached_byte_count += block_bc;
+				return;
+			}
+			catch (...) {
+				// the block is returned to the os below.
+			}
+		}
+	}
+
+	free_aligned(p);
+}
+
+void pool_release_cached_blocks() noexcept
+{
+	memory_pool& pool = get_memory_pool();
+	std::map<size_t, std::vector<void*>> free_blocks;
+
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		free_blocks.swap(pool.free_blocks);
+		pool.stats.cached_block_count = 0;
+		pool.stats.cached_byte_count = 0;
+	}
+
+	for (auto& pair : free_blocks) {
+		for (void* p : pair.second)
+			free_aligned(p);
+	}
+}
+
+memory_pool_stats pool_stats() noexcept
+{
+	memory_pool& pool = get_memory_pool();
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	return pool.stats;
+}
+
+} // namespace core
+} // namespace sparki
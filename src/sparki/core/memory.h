@@ -0,0 +1,223 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+
+namespace sparki {
+namespace core {
+
+// The alignment of each memory block returned by pool_allocate.
+constexpr size_t c_pool_alignment = 64;
+
+// Blocks which are larger are never cached by the pool.
+constexpr size_t c_pool_max_cached_block_byte_count = size_t(1) << 30;
+
+// The max total size of free blocks kept by the pool. The blocks above the limit are returned to the os.
+constexpr size_t c_pool_max_cached_byte_count = size_t(512) << 20;
+
+struct memory_pool_stats final {
+	size_t	allocation_count = 0;
+	// The number of allocations which have been served by a cached block.
+	size_t	reuse_count = 0;
+	size_t	cached_block_count = 0;
+	size_t	cached_byte_count = 0;
+};
+
+// Returns the actual size of a block which is allocated for the specified number of bytes.
+// Sizes are rounded up to size classes: multiples of 64 bytes up to 256 bytes,
+// then 4 classes per power of 2 (the overhead is 25% at most).
+size_t pool_block_byte_count(size_t byte_count) noexcept;
+
+// Allocates an uninitialized memory block of at least byte_count bytes aligned to c_pool_alignment.
+// Freed blocks are cached per size class and reused by subsequent allocations of the same class.
+// Thread-safe. Throws std::bad_alloc on failure.
+void* pool_allocate(size_t byte_count);
+
+// Returns the block to the pool. byte_count must be the value which has been passed to pool_allocate.
+void pool_deallocate(void* p, size_t byte_count) noexcept;
+
+// Returns all the cached blocks to the os.
+void pool_release_cached_blocks() noexcept;
+
+memory_pool_stats pool_stats() noexcept;
+
+
+// aligned_buffer is a contiguous sequence of trivially copyable objects
+// which is allocated by pool_allocate (64-byte aligned).
+// Unlike std::vector, resize does not initialize the new elements,
+// the buffer is expected to be overwritten (fread, memcpy, decoders) right after the allocation.
+template<typename T>
+class aligned_buffer final {
+	static_assert(std::is_trivially_copyable<T>::value, "aligned_buffer: T must be trivially copyable.");
+	static_assert(alignof(T) <= c_pool_alignment, "aligned_buffer: T is overaligned.");
+
+public:
+
+	using value_type = T;
+
+
+	aligned_buffer() noexcept = default;
+
+	// Allocates size uninitialized elements.
+	explicit aligned_buffer(size_t size)
+	{
+		resize(size);
+	}
+
+	aligned_buffer(const aligned_buffer& b)
+	{
+		resize(b.size_);
+		if (size_ > 0) std::memcpy(p_data_, b.p_data_, size_ * sizeof(T));
+	}
+
+	aligned_buffer(aligned_buffer&& b) noexcept
+		: p_data_(b.p_data_), size_(b.size_), capacity_(b.capacity_)
+	{
+		b.p_data_ = nullptr;
+		b.size_ = 0;
+		b.capacity_ = 0;
+	}
+
+	aligned_buffer& operator=(const aligned_buffer& b)
+	{
+		if (this == &b) return *this;
+
+		size_ = 0;
+		resize(b.size_);
+		if (size_ > 0) std::memcpy(p_data_, b.p_data_, size_ * sizeof(T));
+		return *this;
+	}
+
+	aligned_buffer& operator=(aligned_buffer&& b) noexcept
+	{
+		if (this == &b) return *this;
+
+		dispose();
+		std::swap(p_data_, b.p_data_);
+		std::swap(size_, b.size_);
+		std::swap(capacity_, b.capacity_);
+		return *this;
+	}
+
+	~aligned_buffer() noexcept
+	{
+		dispose();
+	}
+
+
+	T& operator[](size_t index) noexcept
+	{
+		assert(index < size_);
+		return p_data_[index];
+	}
+
+	const T& operator[](size_t index) const noexcept
+	{
+		assert(index < size_);
+		return p_data_[index];
+	}
+
+	T* begin() noexcept
+	{
+		return p_data_;
+	}
+
+	const T* begin() const noexcept
+	{
+		return p_data_;
+	}
+
+	T* end() noexcept
+	{
+		return p_data_ + size_;
+	}
+
+	const T* end() const noexcept
+	{
+		return p_data_ + size_;
+	}
+
+	T* data() noexcept
+	{
+		return p_data_;
+	}
+
+	const T* data() const noexcept
+	{
+		return p_data_;
+	}
+
+	size_t capacity() const noexcept
+	{
+		return capacity_;
+	}
+
+	bool empty() const noexcept
+	{
+		return (size_ == 0);
+	}
+
+	size_t size() const noexcept
+	{
+		return size_;
+	}
+
+
+	// Sets size to 0, the memory is kept.
+	void clear() noexcept
+	{
+		size_ = 0;
+	}
+
+	// Returns the memory to the pool.
+	void dispose() noexcept
+	{
+		if (p_data_) pool_deallocate(p_data_, capacity_ * sizeof(T));
+
+		p_data_ = nullptr;
+		size_ = 0;
+		capacity_ = 0;
+	}
+
+	void push_back(const T& value)
+	{
+		if (size_ == capacity_) reserve(std::max<size_t>(size_ * 2, 16));
+		std::memcpy(p_data_ + size_, &value, sizeof(T));
+		++size_;
+	}
+
+	// Ensures that the buffer can hold capacity elements without reallocation.
+	void reserve(size_t capacity)
+	{
+		if (capacity <= capacity_) return;
+
+		const size_t bc = capacity * sizeof(T);
+		T* p = static_cast<T*>(pool_allocate(bc));
+		if (size_ > 0) std::memcpy(p, p_data_, size_ * sizeof(T));
+		if (p_data_) pool_deallocate(p_data_, capacity_ * sizeof(T));
+
+		p_data_ = p;
+		capacity_ = capacity;
+	}
+
+	// Changes the number of elements. The existing elements are kept, the new ones are uninitialized.
+	void resize(size_t size)
+	{
+		reserve(size);
+		size_ = size;
+	}
+
+private:
+
+	T*		p_data_ = nullptr;
+	size_t	size_ = 0;
+	size_t	capacity_ = 0;
+};
+
+} // namespace core
+} // namespace sparki
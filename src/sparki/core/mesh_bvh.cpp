@@ -0,0 +1,697 @@
+#include "sparki/core/mesh_bvh.h"
+
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <vector>
+#include "sparki/core/parallel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define SPARKI_BVH_SSE 1
+	#include <xmmintrin.h>
+#endif
+
+
+namespace {
+
+using namespace sparki::core;
+using math::float3;
+
+// The number of bins per axis which are evaluated by the surface area heuristic.
+constexpr size_t c_bin_count = 16;
+// The cost of a node traversal relative to the cost of a triangle test.
+constexpr float c_traversal_cost = 1.0f;
+// Ranges of at most this many triangles always become leaves, their triangles are tested one by one
+// which is cheaper than another level of nodes.
+constexpr uint32_t c_min_leaf_triangle_count = 4;
+// A range of at most this many triangles becomes a leaf if splitting it is not cheaper.
+constexpr uint32_t c_max_leaf_triangle_count = 8;
+// Ranges of at least this many triangles are binned & built on the task system's worker threads.
+constexpr uint32_t c_parallel_triangle_count = 16 * 1024;
+// Deeper ranges are split at the median, it bounds the tree depth and so the traversal stack size.
+constexpr size_t c_max_sah_depth = 48;
+// The binary tree is at most c_max_sah_depth + 32 levels deep, each 4-wide node pushes at most 3 extra entries.
+constexpr size_t c_traversal_stack_size = 256;
+
+// xyz & padding, the layout lets SSE process all the components at once.
+struct alignas(16) bvh_point final {
+	float v[4];
+};
+
+struct alignas(16) bvh_bounds final {
+	float min[4] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+		std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+	float max[4] = { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(),
+		-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+};
+
+struct bvh_bin final {
+	bvh_bounds	bounds;
+	uint32_t	count = 0;
+};
+
+// A node of the binary tree, count > 0 means that the node is a leaf.
+struct build_node final {
+	bvh_bounds	bounds;
+	uint32_t	left = 0;
+	uint32_t	right = 0;
+	uint32_t	first = 0;
+	uint32_t	count = 0;
+};
+
+struct build_split final {
+	bvh_bounds	left_bounds;
+	bvh_bounds	right_bounds;
+	uint32_t	left_count = 0;
+};
+
+struct build_context final {
+	const bvh_bounds*	p_triangle_bounds;
+	const bvh_point*	p_centroids;
+	uint32_t*			p_refs;
+};
+
+inline void grow(bvh_bounds& b, const bvh_point& p) noexcept
+{
+#ifdef SPARKI_BVH_SSE
+	const __m128 v = _mm_load_ps(p.v);
+	_mm_store_ps(b.min, _mm_min_ps(_mm_load_ps(b.min), v));
+	_mm_store_ps(b.max, _mm_max_ps(_mm_load_ps(b.max), v));
+#else
+	for (size_t i = 0; i < 4; ++i) {
+		b.min[i] = std::min(b.min[i], p.v[i]);
+		b.max[i] = std::max(b.max[i], p.v[i]);
+	}
+#endif
+}
+
+inline void grow(bvh_bounds& b, const bvh_bounds& o) noexcept
+{
+#ifdef SPARKI_BVH_SSE
+	_mm_store_ps(b.min, _mm_min_ps(_mm_load_ps(b.min), _mm_load_ps(o.min)));
+	_mm_store_ps(b.max, _mm_max_ps(_mm_load_ps(b.max), _mm_load_ps(o.max)));
+#else
+	for (size_t i = 0; i < 4; ++i) {
+		b.min[i] = std::min(b.min[i], o.min[i]);
+		b.max[i] = std::max(b.max[i], o.max[i]);
+	}
+#endif
+}
+
+inline float component(const float3& v, size_t axis) noexcept
+{
+	assert(axis < 3);
+	return (axis == 0) ? v.x : ((axis == 1) ? v.y : v.z);
+}
+
+inline float half_area(const bvh_bounds& b) noexcept
+{
+	if (b.min[0] > b.max[0]) return 0.0f;
+
+	const float ex = b.max[0] - b.min[0];
+	const float ey = b.max[1] - b.min[1];
+	const float ez = b.max[2] - b.min[2];
+	return ex * ey + ey * ez + ez * ex;
+}
+
+// Returns the bounds of the centroids of the range, large ranges are processed in parallel.
+bvh_bounds compute_centroid_bounds(const build_context& ctx, uint32_t first, uint32_t count)
+{
+	auto bound_chunk = [&ctx](const uint32_t* p, const uint32_t* p_end, bvh_bounds& b) {
+		for (; p < p_end; ++p) grow(b, ctx.p_centroids[*p]);
+	};
+
+	bvh_bounds b;
+	const uint32_t* p_first = ctx.p_refs + first;
+	if (count < c_parallel_triangle_count) {
+		bound_chunk(p_first, p_first + count, b);
+		return b;
+	}
+
+	const size_t chunk_count = (count + c_parallel_triangle_count - 1) / c_parallel_triangle_count;
+	std::vector<bvh_bounds> chunks(chunk_count);
+	parallel_for(chunk_count, 1, [&](size_t begin, size_t end) {
+		for (size_t c = begin; c < end; ++c) {
+			const size_t chunk_end = std::min<size_t>(count, (c + 1) * c_parallel_triangle_count);
+			bound_chunk(p_first + c * c_parallel_triangle_count, p_first + chunk_end, chunks[c]);
+		}
+	});
+
+	for (const bvh_bounds& c : chunks) grow(b, c);
+	return b;
+}
+
+// Bins the centroids of the range along all three axes, large ranges are processed in parallel.
+// scale[a] maps the centroid offset from centroid_bounds.min onto [0, c_bin_count], 0 for flat axes.
+void fill_bins(const build_context& ctx, uint32_t first, uint32_t count, const bvh_bounds& centroid_bounds,
+	const float (&scale)[3], bvh_bin (&bins)[3][c_bin_count])
+{
+	auto bin_chunk = [&](const uint32_t* p, const uint32_t* p_end, bvh_bin (&out_bins)[3][c_bin_count]) {
+		for (; p < p_end; ++p) {
+			const bvh_point& cen = ctx.p_centroids[*p];
+			const bvh_bounds& tb = ctx.p_triangle_bounds[*p];
+
+			for (size_t a = 0; a < 3; ++a) {
+				const size_t b = size_t((cen.v[a] - centroid_bounds.min[a]) * scale[a]);
+				bvh_bin& bin = out_bins[a][std::min(c_bin_count - 1, b)];
+				grow(bin.bounds, tb);
+				++bin.count;
+			}
+		}
+	};
+
+	const uint32_t* p_first = ctx.p_refs + first;
+	if (count < c_parallel_triangle_count) {
+		bin_chunk(p_first, p_first + count, bins);
+		return;
+	}
+
+	using bin_set = bvh_bin[3][c_bin_count];
+	const size_t chunk_count = (count + c_parallel_triangle_count - 1) / c_parallel_triangle_count;
+	std::unique_ptr<bin_set[]> chunks(new bin_set[chunk_count]);
+	parallel_for(chunk_count, 1, [&](size_t begin, size_t end) {
+		for (size_t c = begin; c < end; ++c) {
+			const size_t chunk_end = std::min<size_t>(count, (c + 1) * c_parallel_triangle_count);
+			bin_chunk(p_first + c * c_parallel_triangle_count, p_first + chunk_end, chunks[c]);
+		}
+	});
+
+	for (size_t c = 0; c < chunk_count; ++c) {
+		for (size_t a = 0; a < 3; ++a) {
+			for (size_t b = 0; b < c_bin_count; ++b) {
+				grow(bins[a][b].bounds, chunks[c][a][b].bounds);
+				bins[a][b].count += chunks[c][a][b].count;
+			}
+		}
+	}
+}
+
+// Splits the range at the median of the centroids along the widest axis.
+build_split split_at_median(const build_context& ctx, uint32_t first, uint32_t count, const bvh_bounds& centroid_bounds)
+{
+	const float e[3] = {
+		centroid_bounds.max[0] - centroid_bounds.min[0],
+		centroid_bounds.max[1] - centroid_bounds.min[1],
+		centroid_bounds.max[2] - centroid_bounds.min[2]
+	};
+	const size_t axis = (e[0] >= e[1] && e[0] >= e[2]) ? 0 : ((e[1] >= e[2]) ? 1 : 2);
+	uint32_t* p_first = ctx.p_refs + first;
+
+	build_split s;
+	s.left_count = count / 2;
+	std::nth_element(p_first, p_first + s.left_count, p_first + count, [&ctx, axis](uint32_t l, uint32_t r) {
+		return ctx.p_centroids[l].v[axis] < ctx.p_centroids[r].v[axis];
+	});
+
+	for (uint32_t i = 0; i < count; ++i)
+		grow((i < s.left_count) ? s.left_bounds : s.right_bounds, ctx.p_triangle_bounds[p_first[i]]);
+
+	return s;
+}
+
+// Partitions the range by the binned surface area heuristic.
+// Returns false if the range should become a leaf.
+bool find_split(const build_context& ctx, uint32_t first, uint32_t count, const bvh_bounds& bounds,
+	size_t depth, build_split& out_split)
+{
+	if (count <= c_min_leaf_triangle_count) return false;
+
+	const bvh_bounds centroid_bounds = compute_centroid_bounds(ctx, first, count);
+	float scale[3];
+	bool flat = true;
+	for (size_t a = 0; a < 3; ++a) {
+		const float extent = centroid_bounds.max[a] - centroid_bounds.min[a];
+		scale[a] = (extent > 0.0f) ? (c_bin_count / extent) : 0.0f;
+		flat &= (scale[a] == 0.0f);
+	}
+
+	if (flat || depth >= c_max_sah_depth) {
+		// coincident centroids can not be separated by the heuristic.
+		if (count <= c_max_leaf_triangle_count) return false;
+		out_split = split_at_median(ctx, first, count, centroid_bounds);
+		return true;
+	}
+
+	bvh_bin bins[3][c_bin_count];
+	fill_bins(ctx, first, count, centroid_bounds, scale, bins);
+
+	// sweep: right to left accumulates the right sides, left to right evaluates the costs.
+	float best_cost = std::numeric_limits<float>::max();
+	size_t best_axis = 0;
+	size_t best_bin = 0;
+	for (size_t a = 0; a < 3; ++a) {
+		if (scale[a] == 0.0f) continue;
+
+		float right_costs[c_bin_count];
+		bvh_bounds rb;
+		uint32_t rc = 0;
+		for (size_t b = c_bin_count - 1; b > 0; --b) {
+			grow(rb, bins[a][b].bounds);
+			rc += bins[a][b].count;
+			right_costs[b] = half_area(rb) * rc;
+		}
+
+		bvh_bounds lb;
+		uint32_t lc = 0;
+		for (size_t b = 0; b < c_bin_count - 1; ++b) {
+			grow(lb, bins[a][b].bounds);
+			lc += bins[a][b].count;
+			if (lc == 0 || lc == count) continue;
+
+			const float cost = half_area(lb) * lc + right_costs[b + 1];
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_axis = a;
+				best_bin = b;
+			}
+		}
+	}
+
+	const float area = half_area(bounds);
+	const float split_cost = c_traversal_cost + ((area > 0.0f) ? (best_cost / area) : float(count));
+	if (count <= c_max_leaf_triangle_count && split_cost >= float(count)) return false;
+
+	if (best_cost == std::numeric_limits<float>::max()) {
+		out_split = split_at_median(ctx, first, count, centroid_bounds);
+		return true;
+	}
+
+	// the same expression as in fill_bins, so the partition matches the bin counts.
+	const float min_a = centroid_bounds.min[best_axis];
+	const float scale_a = scale[best_axis];
+	uint32_t* p_mid = std::partition(ctx.p_refs + first, ctx.p_refs + first + count, [&](uint32_t r) {
+		const size_t b = std::min(c_bin_count - 1, size_t((ctx.p_centroids[r].v[best_axis] - min_a) * scale_a));
+		return b <= best_bin;
+	});
+
+	out_split = build_split();
+	out_split.left_count = uint32_t(p_mid - (ctx.p_refs + first));
+	for (size_t b = 0; b < c_bin_count; ++b)
+		grow((b <= best_bin) ? out_split.left_bounds : out_split.right_bounds, bins[best_axis][b].bounds);
+
+	assert(0 < out_split.left_count && out_split.left_count < count);
+	return true;
+}
+
+uint32_t build_serial(const build_context& ctx, uint32_t first, uint32_t count, const bvh_bounds& bounds,
+	size_t depth, std::vector<build_node>& nodes)
+{
+	const uint32_t index = uint32_t(nodes.size());
+	nodes.emplace_back();
+	nodes[index].bounds = bounds;
+
+	build_split s;
+	if (!find_split(ctx, first, count, bounds, depth, s)) {
+		nodes[index].first = first;
+		nodes[index].count = count;
+		return index;
+	}
+
+	const uint32_t left = build_serial(ctx, first, s.left_count, s.left_bounds, depth + 1, nodes);
+	const uint32_t right = build_serial(ctx, first + s.left_count, count - s.left_count, s.right_bounds, depth + 1, nodes);
+	nodes[index].left = left;
+	nodes[index].right = right;
+	return index;
+}
+
+// Large ranges are split in parallel and both subtrees are built concurrently into their own arrays,
+// the arrays are appended to nodes afterwards. The root of the range is the first appended node.
+void build_parallel(const build_context& ctx, uint32_t first, uint32_t count, const bvh_bounds& bounds,
+	size_t depth, std::vector<build_node>& nodes)
+{
+	if (count < c_parallel_triangle_count) {
+		build_serial(ctx, first, count, bounds, depth, nodes);
+		return;
+	}
+
+	const uint32_t index = uint32_t(nodes.size());
+	nodes.emplace_back();
+	nodes[index].bounds = bounds;
+
+	build_split s;
+	if (!find_split(ctx, first, count, bounds, depth, s)) {
+		nodes[index].first = first;
+		nodes[index].count = count;
+		return;
+	}
+
+	const uint32_t firsts[2] = { first, first + s.left_count };
+	const uint32_t counts[2] = { s.left_count, count - s.left_count };
+	const bvh_bounds* child_bounds[2] = { &s.left_bounds, &s.right_bounds };
+	std::vector<build_node> subtrees[2];
+	std::exception_ptr errors[2];
+
+	parallel_for(2, 1, [&](size_t begin, size_t end) {
+		for (size_t c = begin; c < end; ++c) {
+			try {
+				build_parallel(ctx, firsts[c], counts[c], *child_bounds[c], depth + 1, subtrees[c]);
+			}
+			catch (...) {
+				errors[c] = std::current_exception();
+			}
+		}
+	});
+
+	for (const std::exception_ptr& e : errors)
+		if (e) std::rethrow_exception(e);
+
+	uint32_t offsets[2];
+	for (size_t c = 0; c < 2; ++c) {
+		offsets[c] = uint32_t(nodes.size());
+
+		for (build_node n : subtrees[c]) {
+			if (n.count == 0) {
+				n.left += offsets[c];
+				n.right += offsets[c];
+			}
+			nodes.push_back(n);
+		}
+	}
+
+	nodes[index].left = offsets[0];
+	nodes[index].right = offsets[1];
+}
+
+void set_child(bvh_node4& node, size_t slot, const bvh_bounds& b, uint32_t child, uint32_t triangle_count) noexcept
+{
+	node.min_x[slot] = b.min[0];
+	node.min_y[slot] = b.min[1];
+	node.min_z[slot] = b.min[2];
+	node.max_x[slot] = b.max[0];
+	node.max_y[slot] = b.max[1];
+	node.max_z[slot] = b.max[2];
+	node.children[slot] = child;
+	node.triangle_counts[slot] = triangle_count;
+}
+
+bvh_node4 make_empty_node() noexcept
+{
+	constexpr float inf = std::numeric_limits<float>::infinity();
+
+	bvh_node4 node;
+	for (size_t i = 0; i < 4; ++i) {
+		node.min_x[i] = node.min_y[i] = node.min_z[i] = inf;
+		node.max_x[i] = node.max_y[i] = node.max_z[i] = -inf;
+		node.children[i] = 0;
+		node.triangle_counts[i] = 0;
+	}
+
+	return node;
+}
+
+// Pulls the grandchildren of the binary inner node up into one 4-wide node:
+// the child with the largest surface is replaced by its children until there are 4 of them.
+uint32_t collapse(const std::vector<build_node>& tree, uint32_t tree_index, std::vector<bvh_node4>& nodes)
+{
+	assert(tree[tree_index].count == 0);
+
+	uint32_t list[4] = { tree[tree_index].left, tree[tree_index].right };
+	size_t list_size = 2;
+	while (list_size < 4) {
+		size_t best = list_size;
+		float best_area = -1.0f;
+		for (size_t i = 0; i < list_size; ++i) {
+			const build_node& n = tree[list[i]];
+			if (n.count > 0) continue;
+
+			const float area = half_area(n.bounds);
+			if (area > best_area) {
+				best = i;
+				best_area = area;
+			}
+		}
+
+		if (best == list_size) break;
+
+		const build_node& n = tree[list[best]];
+		list[best] = n.left;
+		list[list_size++] = n.right;
+	}
+
+	const uint32_t index = uint32_t(nodes.size());
+	nodes.push_back(make_empty_node());
+
+	for (size_t i = 0; i < list_size; ++i) {
+		const build_node& n = tree[list[i]];
+		const uint32_t child = (n.count > 0) ? n.first : collapse(tree, list[i], nodes);
+		set_child(nodes[index], i, n.bounds, child, n.count);
+	}
+
+	return index;
+}
+
+// The ray & the values which are reused by every slab test.
+struct ray_context final {
+	float3	origin;
+	float3	direction;
+	float	origin_xyz[3];
+	float	inv_direction[3];
+	// 1 if the direction's component is negative: the far plane of the slab is the min one.
+	size_t	negative[3];
+};
+
+ray_context make_ray_context(const ray& r) noexcept
+{
+	// tiny components are replaced to keep the slab distances finite, inf * 0 would produce nan.
+	constexpr float c_min_component = 1e-20f;
+
+	ray_context rc;
+	rc.origin = r.origin;
+	rc.direction = r.direction;
+	for (size_t a = 0; a < 3; ++a) {
+		const float d = component(r.direction, a);
+		rc.origin_xyz[a] = component(r.origin, a);
+		const float safe_d = (std::abs(d) >= c_min_component) ? d : std::copysign(c_min_component, d);
+		rc.inv_direction[a] = 1.0f / safe_d;
+		rc.negative[a] = (safe_d < 0.0f) ? 1 : 0;
+	}
+
+	return rc;
+}
+
+// Tests the ray against the bounds of the 4 children, writes the entry distances into t_near.
+// Returns the mask of the children which are hit within [0, t_max].
+inline unsigned intersect_children(const bvh_node4& node, const ray_context& rc, float t_max,
+	float (&t_near)[4]) noexcept
+{
+	const float* bounds[3][2] = {
+		{ node.min_x, node.max_x },
+		{ node.min_y, node.max_y },
+		{ node.min_z, node.max_z }
+	};
+
+#ifdef SPARKI_BVH_SSE
+	__m128 t_min = _mm_setzero_ps();
+	__m128 t_far = _mm_set1_ps(t_max);
+	for (size_t a = 0; a < 3; ++a) {
+		const __m128 o = _mm_set1_ps(rc.origin_xyz[a]);
+		const __m128 inv = _mm_set1_ps(rc.inv_direction[a]);
+		const __m128 n = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds[a][rc.negative[a]]), o), inv);
+		const __m128 f = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds[a][1 - rc.negative[a]]), o), inv);
+		t_min = _mm_max_ps(t_min, n);
+		t_far = _mm_min_ps(t_far, f);
+	}
+
+	_mm_storeu_ps(t_near, t_min);
+	return unsigned(_mm_movemask_ps(_mm_cmple_ps(t_min, t_far)));
+#else
+	unsigned mask = 0;
+	for (size_t i = 0; i < 4; ++i) {
+		float t_min = 0.0f;
+		float t_far = t_max;
+		for (size_t a = 0; a < 3; ++a) {
+			const float n = (bounds[a][rc.negative[a]][i] - rc.origin_xyz[a]) * rc.inv_direction[a];
+			const float f = (bounds[a][1 - rc.negative[a]][i] - rc.origin_xyz[a]) * rc.inv_direction[a];
+			t_min = std::max(t_min, n);
+			t_far = std::min(t_far, f);
+		}
+
+		t_near[i] = t_min;
+		if (t_min <= t_far) mask |= (1u << i);
+	}
+
+	return mask;
+#endif
+}
+
+} // namespace
+
+
+namespace sparki {
+namespace core {
+
+// ----- mesh_bvh -----
+
+mesh_bvh::mesh_bvh(span<const vertex<vertex_attribs::p_n_uv_ts>> vertices, span<const uint32_t> indices)
+{
+	ENFORCE(indices.size() % 3 == 0, "The index count must be a multiple of 3.");
+	ENFORCE(indices.size() / 3 < c_bvh_no_triangle, "Too many triangles.");
+	ENFORCE(std::all_of(indices.begin(), indices.end(), [&vertices](uint32_t i) { return i < vertices.size(); }),
+		"An index is out of the vertex range.");
+
+	const uint32_t triangle_count = uint32_t(indices.size() / 3);
+	if (triangle_count == 0) return;
+
+	// per triangle bounds & centroids ---
+	std::vector<bvh_bounds> triangle_bounds(triangle_count);
+	std::vector<bvh_point> centroids(triangle_count);
+	std::vector<uint32_t> refs(triangle_count);
+
+	parallel_for(triangle_count, c_parallel_triangle_count, [&](size_t begin, size_t end) {
+		for (size_t t = begin; t < end; ++t) {
+			bvh_bounds b;
+			for (size_t k = 0; k < 3; ++k) {
+				const float3& p = vertices[indices[3 * t + k]].position;
+				grow(b, bvh_point{ { p.x, p.y, p.z, 0.0f } });
+			}
+
+			triangle_bounds[t] = b;
+			for (size_t a = 0; a < 4; ++a)
+				centroids[t].v[a] = 0.5f * (b.min[a] + b.max[a]);
+			refs[t] = uint32_t(t);
+		}
+	});
+
+	bvh_bounds root_bounds;
+	for (const bvh_bounds& b : triangle_bounds) grow(root_bounds, b);
+
+	// binary tree -> 4-wide nodes ---
+	const build_context ctx = { triangle_bounds.data(), centroids.data(), refs.data() };
+	std::vector<build_node> tree;
+	tree.reserve(2 * triangle_count / c_max_leaf_triangle_count + 1);
+	build_parallel(ctx, 0, triangle_count, root_bounds, 0, tree);
+
+	std::vector<bvh_node4> nodes;
+	nodes.reserve(tree.size() / 2 + 1);
+	if (tree[0].count > 0) {
+		// the whole mesh is one leaf.
+		nodes.push_back(make_empty_node());
+		set_child(nodes[0], 0, tree[0].bounds, tree[0].first, tree[0].count);
+	}
+	else {
+		collapse(tree, 0, nodes);
+	}
+
+	nodes_.resize(nodes.size());
+	std::copy(nodes.cbegin(), nodes.cend(), nodes_.begin());
+
+	// triangles in the leaf order ---
+	triangles_.resize(triangle_count);
+	parallel_for(triangle_count, c_parallel_triangle_count, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			const uint32_t t = refs[i];
+			const float3& p0 = vertices[indices[3 * t]].position;
+			const float3& p1 = vertices[indices[3 * t + 1]].position;
+			const float3& p2 = vertices[indices[3 * t + 2]].position;
+			triangles_[i] = { p0, p1 - p0, p2 - p0, t };
+		}
+	});
+}
+
+bool mesh_bvh::raycast(const ray& r, float max_distance, ray_hit& out_hit) const noexcept
+{
+	return traverse<true>(r, max_distance, &out_hit);
+}
+
+bool mesh_bvh::intersects(const ray& r, float max_distance) const noexcept
+{
+	return traverse<false>(r, max_distance, nullptr);
+}
+
+template<bool closest_hit>
+bool mesh_bvh::traverse(const ray& r, float max_distance, ray_hit* p_hit) const noexcept
+{
+	assert(max_distance >= 0.0f);
+	if (empty()) return false;
+
+	const ray_context rc = make_ray_context(r);
+
+	struct stack_entry final {
+		uint32_t	node;
+		float		t_near;
+	};
+
+	stack_entry stack[c_traversal_stack_size];
+	size_t stack_size = 0;
+	stack[stack_size++] = { 0, 0.0f };
+
+	float closest = max_distance;
+	ray_hit hit;
+
+	while (stack_size > 0) {
+		const stack_entry e = stack[--stack_size];
+		if (e.t_near > closest) continue; // a closer hit has been found since the node was pushed.
+
+		const bvh_node4& node = nodes_[e.node];
+		float t_near[4];
+		const unsigned mask = intersect_children(node, rc, closest, t_near);
+		if (mask == 0) continue;
+
+		// leaves are tested right away, inner children are pushed far to near.
+		stack_entry inner[4];
+		size_t inner_count = 0;
+
+		for (size_t i = 0; i < 4; ++i) {
+			if ((mask & (1u << i)) == 0) continue;
+
+			if (node.triangle_counts[i] == 0) {
+				size_t j = inner_count++;
+				for (; j > 0 && inner[j - 1].t_near < t_near[i]; --j)
+					inner[j] = inner[j - 1];
+
+				inner[j] = { node.children[i], t_near[i] };
+				continue;
+			}
+
+			const triangle* p_tri = triangles_.data() + node.children[i];
+			const triangle* p_end = p_tri + node.triangle_counts[i];
+			for (; p_tri < p_end; ++p_tri) {
+				// Moller-Trumbore
+				const float3 pvec = math::cross(rc.direction, p_tri->e2);
+				const float det = math::dot(p_tri->e1, pvec);
+				if (det == 0.0f) continue;
+
+				const float inv_det = 1.0f / det;
+				const float3 tvec = rc.origin - p_tri->p0;
+				const float u = math::dot(tvec, pvec) * inv_det;
+				if (u < 0.0f || u > 1.0f) continue;
+
+				const float3 qvec = math::cross(tvec, p_tri->e1);
+				const float v = math::dot(rc.direction, qvec) * inv_det;
+				if (v < 0.0f || u + v > 1.0f) continue;
+
+				const float t = math::dot(p_tri->e2, qvec) * inv_det;
+				if (t < 0.0f || t > closest) continue;
+
+				if (!closest_hit) return true;
+
+				closest = t;
+				hit = { p_tri->index, t, u, v };
+			}
+		}
+
+		assert(stack_size + inner_count <= c_traversal_stack_size);
+		for (size_t i = 0; i < inner_count; ++i)
+			stack[stack_size++] = inner[i];
+	}
+
+	if (hit.triangle_index == c_bvh_no_triangle) return false;
+
+	*p_hit = hit;
+	return true;
+}
+
+ray make_picking_ray(const math::float2& ndc, const math::float4x4& inv_pv_matrix) noexcept
+{
+	const math::float4 n = math::mul(inv_pv_matrix, float3(ndc.x, ndc.y, 0.0f));
+	const math::float4 f = math::mul(inv_pv_matrix, float3(ndc.x, ndc.y, 1.0f));
+	const float3 near_point = float3(n.x, n.y, n.z) / n.w;
+	const float3 far_point = float3(f.x, f.y, f.z) / f.w;
+
+	return { near_point, far_point - near_point };
+}
+
+} // namespace core
+} // namespace sparki
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <limits>
+#include "sparki/core/asset_geometry.h"
+#include "sparki/core/memory.h"
+#include "sparki/core/utility.h"
+#include "math/math.h"
+
+
+namespace sparki {
+namespace core {
+
+// The value of ray_hit::triangle_index if nothing has been hit.
+constexpr uint32_t c_bvh_no_triangle = std::numeric_limits<uint32_t>::max();
+
+// The point of the ray is origin + t * direction, the direction does not have to be normalized.
+struct ray final {
+	math::float3 origin;
+	math::float3 direction;
+};
+
+struct ray_hit final {
+	// The triangle's indices are [3 * triangle_index, 3 * triangle_index + 3) of the bvh's index buffer.
+	uint32_t	triangle_index = c_bvh_no_triangle;
+	// The hit point is origin + distance * direction.
+	float		distance = 0.0f;
+	// Barycentrics of the hit point: p = (1 - u - v) * p0 + u * p1 + v * p2.
+	float		u = 0.0f;
+	float		v = 0.0f;
+};
+
+// bvh_node4 is a node of the 4-wide bvh. The bounds of the children are stored as SoA
+// so that a ray is tested against all four of them at once.
+// An unused child slot has inverted bounds (min = +inf, max = -inf) which no ray can hit.
+struct alignas(16) bvh_node4 final {
+	float		min_x[4];
+	float		min_y[4];
+	float		min_z[4];
+	float		max_x[4];
+	float		max_y[4];
+	float		max_z[4];
+	// An inner child is the index of its node, a leaf child is its first triangle (in the bvh's order).
+	uint32_t	children[4];
+	// The number of triangles of a leaf child, 0 for inner children & unused slots.
+	uint32_t	triangle_counts[4];
+};
+
+static_assert(sizeof(bvh_node4) == 128, "bvh_node4 must occupy exactly two cache lines.");
+
+// mesh_bvh is a bounding volume hierarchy over the triangles of a mesh which answers ray queries on the cpu.
+// The binary tree is built by the binned surface area heuristic and collapsed into 4-wide nodes,
+// rays are tested against the nodes using SSE (scalar code on other cpus).
+// Triangle positions are copied, the bvh does not refer to the source mesh.
+class mesh_bvh final {
+public:
+
+	mesh_bvh() noexcept = default;
+
+	// Builds the bvh over the triangle list indices. Each index must refer to an item of vertices.
+	// The top-level splits and their subtrees are processed on the task system's worker threads.
+	mesh_bvh(span<const vertex<vertex_attribs::p_n_uv_ts>> vertices, span<const uint32_t> indices);
+
+	mesh_bvh(mesh_bvh&&) noexcept = default;
+	mesh_bvh& operator=(mesh_bvh&&) noexcept = default;
+
+
+	bool empty() const noexcept
+	{
+		return triangles_.size() == 0;
+	}
+
+	size_t triangle_count() const noexcept
+	{
+		return triangles_.size();
+	}
+
+	size_t node_count() const noexcept
+	{
+		return nodes_.size();
+	}
+
+	// Finds the closest triangle hit by the ray within [0, max_distance] (in units of r.direction).
+	// Both sides of the triangles are hit. Returns false if there is no hit, out_hit is not changed then.
+	bool raycast(const ray& r, float max_distance, ray_hit& out_hit) const noexcept;
+
+	// Returns true if the ray hits any triangle within [0, max_distance]. Faster than raycast,
+	// the traversal stops at the first hit (occlusion & shadow queries).
+	bool intersects(const ray& r, float max_distance) const noexcept;
+
+private:
+
+	// Precomputed for the Moller-Trumbore test: the vertices are p0, p0 + e1, p0 + e2.
+	struct triangle final {
+		math::float3	p0;
+		math::float3	e1;
+		math::float3	e2;
+		uint32_t		index;
+	};
+
+
+	template<bool closest_hit>
+	bool traverse(const ray& r, float max_distance, ray_hit* p_hit) const noexcept;
+
+
+	// nodes_[0] is the root.
+	aligned_buffer<bvh_node4>	nodes_;
+	// Ordered so that each leaf refers to a contiguous range.
+	aligned_buffer<triangle>	triangles_;
+};
+
+// Returns a ray which starts at the near plane and goes through the specified viewport point.
+// ndc is in [-1, 1] (y is up), inv_pv_matrix is inverse(projection * view), the depth range is [0, 1] (directx).
+ray make_picking_ray(const math::float2& ndc, const math::float4x4& inv_pv_matrix) noexcept;
+
+} // namespace core
+} // namespace sparki
@@ -0,0 +1,350 @@
+#include "sparki/core/mesh_streams.h"
+
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include "sparki/core/parallel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define SPARKI_MESH_STREAMS_SSE 1
+	#include <emmintrin.h>
+	#include <immintrin.h>
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+	#endif
+#endif
+
+#if defined(SPARKI_MESH_STREAMS_SSE) && (defined(__GNUC__) || defined(__clang__))
+	#define SPARKI_TARGET_AVX __attribute__((target("avx")))
+#else
+	#define SPARKI_TARGET_AVX
+#endif
+
+// The kernels of all the simd levels must round identically, so the compiler must not fuse
+// the multiplications & additions of some of them into fma instructions (e.g. gcc's default -ffp-contract=fast).
+// The msvc projects also build this file with /fp:precise.
+#if defined(__clang__)
+	#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+	#pragma GCC optimize("fp-contract=off")
+#elif defined(_MSC_VER)
+	#pragma fp_contract(off)
+#endif
+
+
+namespace {
+
+using namespace sparki::core;
+using vertex_t = vertex<vertex_attribs::p_n_uv_ts>;
+
+// The number of vertices each task of the conversions & transforms processes at least.
+constexpr size_t c_parallel_vertex_count = 4096;
+
+// transform_desc holds the scalar factors of a transform which are broadcast into the lanes.
+struct transform_desc final {
+	// The upper 3x4 part of the matrix, row-major.
+	float	m[12];
+	// The cofactor matrix of the upper 3x3 part, row-major.
+	float	cofactor[9];
+	// -1 if the matrix mirrors (negative determinant), 1 otherwise.
+	float	sign;
+};
+
+transform_desc make_transform_desc(const math::float4x4& m) noexcept
+{
+	const float det = m.m00 * (m.m11 * m.m22 - m.m12 * m.m21)
+		- m.m01 * (m.m10 * m.m22 - m.m12 * m.m20)
+		+ m.m02 * (m.m10 * m.m21 - m.m11 * m.m20);
+
+	return transform_desc{
+		{
+			m.m00, m.m01, m.m02, m.m03,
+			m.m10, m.m11, m.m12, m.m13,
+			m.m20, m.m21, m.m22, m.m23
+		},
+		{
+			m.m11 * m.m22 - m.m12 * m.m21, m.m12 * m.m20 - m.m10 * m.m22, m.m10 * m.m21 - m.m11 * m.m20,
+			m.m02 * m.m21 - m.m01 * m.m22, m.m00 * m.m22 - m.m02 * m.m20, m.m01 * m.m20 - m.m00 * m.m21,
+			m.m01 * m.m12 - m.m02 * m.m11, m.m02 * m.m10 - m.m00 * m.m12, m.m00 * m.m11 - m.m01 * m.m10
+		},
+		(det < 0.0f) ? -1.0f : 1.0f
+	};
+}
+
+// Fills the padding of the streams with copies of the last vertex.
+void pad_mesh_streams(mesh_streams& s) noexcept
+{
+	if (s.vertex_count == 0) return;
+
+	const size_t last = s.vertex_count - 1;
+	for (size_t i = s.vertex_count; i < s.padded_count(); ++i) {
+		s.position_x[i] = s.position_x[last];
+		s.position_y[i] = s.position_y[last];
+		s.position_z[i] = s.position_z[last];
+		s.normal_x[i] = s.normal_x[last];
+		s.normal_y[i] = s.normal_y[last];
+		s.normal_z[i] = s.normal_z[last];
+		s.uv_u[i] = s.uv_u[last];
+		s.uv_v[i] = s.uv_v[last];
+		s.tangent_h[i] = s.tangent_h[last];
+	}
+}
+
+// ----- scalar kernels -----
+
+void transform_positions_normals_scalar(mesh_streams& s, const transform_desc& d,
+	size_t begin, size_t end) noexcept
+{
+	for (size_t i = begin; i < end; ++i) {
+		const float px = s.position_x[i];
+		const float py = s.position_y[i];
+		const float pz = s.position_z[i];
+		s.position_x[i] = d.m[0] * px + d.m[1] * py + d.m[2] * pz + d.m[3];
+		s.position_y[i] = d.m[4] * px + d.m[5] * py + d.m[6] * pz + d.m[7];
+		s.position_z[i] = d.m[8] * px + d.m[9] * py + d.m[10] * pz + d.m[11];
+
+		const float nx = s.normal_x[i];
+		const float ny = s.normal_y[i];
+		const float nz = s.normal_z[i];
+		const float cx = d.cofactor[0] * nx + d.cofactor[1] * ny + d.cofactor[2] * nz;
+		const float cy = d.cofactor[3] * nx + d.cofactor[4] * ny + d.cofactor[5] * nz;
+		const float cz = d.cofactor[6] * nx + d.cofactor[7] * ny + d.cofactor[8] * nz;
+		const float len = std::sqrt(cx * cx + cy * cy + cz * cz);
+		// a normal which has become zero (e.g. the matrix is singular) stays zero.
+		const bool valid = (len > 0.0f);
+		s.normal_x[i] = valid ? (cx / len) * d.sign : 0.0f;
+		s.normal_y[i] = valid ? (cy / len) * d.sign : 0.0f;
+		s.normal_z[i] = valid ? (cz / len) * d.sign : 0.0f;
+	}
+}
+
+// The tangent space is packed, tangents are unpacked & transformed one by one.
+void transform_tangents(mesh_streams& s, const transform_desc& d, size_t begin, size_t end) noexcept
+{
+	for (size_t i = begin; i < end; ++i) {
+		// the tangent is packed as unorm, w is the bitangent's sign.
+		const math::float4 ts = math::unpack_unorm_10_10_10_2(s.tangent_h[i]) * 2.0f - math::float4(1.0f);
+		const math::float3 t = math::normalize(math::float3(
+			d.m[0] * ts.x + d.m[1] * ts.y + d.m[2] * ts.z,
+			d.m[4] * ts.x + d.m[5] * ts.y + d.m[6] * ts.z,
+			d.m[8] * ts.x + d.m[9] * ts.y + d.m[10] * ts.z));
+		s.tangent_h[i] = math::pack_unorm_10_10_10_2(math::float4(t, ts.w * d.sign) * 0.5f + 0.5f);
+	}
+}
+
+#if defined(SPARKI_MESH_STREAMS_SSE)
+
+// Returns true if the cpu supports AVX instructions and the os saves ymm registers.
+bool cpu_supports_avx() noexcept
+{
+	int regs[4] = {};
+#if defined(_MSC_VER)
+	__cpuid(regs, 1);
+#else
+	__cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+
+	const bool osxsave = (regs[2] & (1 << 27)) != 0;
+	const bool avx = (regs[2] & (1 << 28)) != 0;
+	if (!(osxsave && avx)) return false;
+
+#if defined(_MSC_VER)
+	const unsigned long long xcr0 = _xgetbv(0);
+#else
+	uint32_t eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	const unsigned long long xcr0 = (uint64_t(edx) << 32) | eax;
+#endif
+	return (xcr0 & 0x6) == 0x6;
+}
+
+const bool g_cpu_supports_avx = cpu_supports_avx();
+
+// ----- AVX kernels -----
+
+// begin & end must be multiples of 8.
+SPARKI_TARGET_AVX void transform_positions_normals_avx(mesh_streams& s, const transform_desc& d,
+	size_t begin, size_t end) noexcept
+{
+	__m256 m[12];
+	for (size_t k = 0; k < 12; ++k) m[k] = _mm256_set1_ps(d.m[k]);
+	__m256 c[9];
+	for (size_t k = 0; k < 9; ++k) c[k] = _mm256_set1_ps(d.cofactor[k]);
+	const __m256 sign = _mm256_set1_ps(d.sign);
+
+	for (size_t i = begin; i < end; i += 8) {
+		const __m256 px = _mm256_load_ps(s.position_x.data() + i);
+		const __m256 py = _mm256_load_ps(s.position_y.data() + i);
+		const __m256 pz = _mm256_load_ps(s.position_z.data() + i);
+		_mm256_store_ps(s.position_x.data() + i, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(m[0], px), _mm256_mul_ps(m[1], py)), _mm256_mul_ps(m[2], pz)), m[3]));
+		_mm256_store_ps(s.position_y.data() + i, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(m[4], px), _mm256_mul_ps(m[5], py)), _mm256_mul_ps(m[6], pz)), m[7]));
+		_mm256_store_ps(s.position_z.data() + i, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(m[8], px), _mm256_mul_ps(m[9], py)), _mm256_mul_ps(m[10], pz)), m[11]));
+
+		const __m256 nx = _mm256_load_ps(s.normal_x.data() + i);
+		const __m256 ny = _mm256_load_ps(s.normal_y.data() + i);
+		const __m256 nz = _mm256_load_ps(s.normal_z.data() + i);
+		const __m256 cx = _mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(c[0], nx), _mm256_mul_ps(c[1], ny)), _mm256_mul_ps(c[2], nz));
+		const __m256 cy = _mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(c[3], nx), _mm256_mul_ps(c[4], ny)), _mm256_mul_ps(c[5], nz));
+		const __m256 cz = _mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(c[6], nx), _mm256_mul_ps(c[7], ny)), _mm256_mul_ps(c[8], nz));
+		const __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(cx, cx), _mm256_mul_ps(cy, cy)), _mm256_mul_ps(cz, cz)));
+		// zero lengths (& NaNs) give zero normals, see the scalar kernel.
+		const __m256 valid = _mm256_cmp_ps(len, _mm256_setzero_ps(), _CMP_GT_OQ);
+		_mm256_store_ps(s.normal_x.data() + i, _mm256_and_ps(valid, _mm256_mul_ps(_mm256_div_ps(cx, len), sign)));
+		_mm256_store_ps(s.normal_y.data() + i, _mm256_and_ps(valid, _mm256_mul_ps(_mm256_div_ps(cy, len), sign)));
+		_mm256_store_ps(s.normal_z.data() + i, _mm256_and_ps(valid, _mm256_mul_ps(_mm256_div_ps(cz, len), sign)));
+	}
+}
+
+// ----- SSE kernels -----
+
+// begin & end must be multiples of 4.
+void transform_positions_normals_sse(mesh_streams& s, const transform_desc& d,
+	size_t begin, size_t end) noexcept
+{
+	__m128 m[12];
+	for (size_t k = 0; k < 12; ++k) m[k] = _mm_set1_ps(d.m[k]);
+	__m128 c[9];
+	for (size_t k = 0; k < 9; ++k) c[k] = _mm_set1_ps(d.cofactor[k]);
+	const __m128 sign = _mm_set1_ps(d.sign);
+
+	for (size_t i = begin; i < end; i += 4) {
+		const __m128 px = _mm_load_ps(s.position_x.data() + i);
+		const __m128 py = _mm_load_ps(s.position_y.data() + i);
+		const __m128 pz = _mm_load_ps(s.position_z.data() + i);
+		_mm_store_ps(s.position_x.data() + i, _mm_add_ps(_mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(m[0], px), _mm_mul_ps(m[1], py)), _mm_mul_ps(m[2], pz)), m[3]));
+		_mm_store_ps(s.position_y.data() + i, _mm_add_ps(_mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(m[4], px), _mm_mul_ps(m[5], py)), _mm_mul_ps(m[6], pz)), m[7]));
+		_mm_store_ps(s.position_z.data() + i, _mm_add_ps(_mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(m[8], px), _mm_mul_ps(m[9], py)), _mm_mul_ps(m[10], pz)), m[11]));
+
+		const __m128 nx = _mm_load_ps(s.normal_x.data() + i);
+		const __m128 ny = _mm_load_ps(s.normal_y.data() + i);
+		const __m128 nz = _mm_load_ps(s.normal_z.data() + i);
+		const __m128 cx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[0], nx), _mm_mul_ps(c[1], ny)), _mm_mul_ps(c[2], nz));
+		const __m128 cy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[3], nx), _mm_mul_ps(c[4], ny)), _mm_mul_ps(c[5], nz));
+		const __m128 cz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[6], nx), _mm_mul_ps(c[7], ny)), _mm_mul_ps(c[8], nz));
+		const __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)), _mm_mul_ps(cz, cz)));
+		// zero lengths (& NaNs) give zero normals, see the scalar kernel.
+		const __m128 valid = _mm_cmpgt_ps(len, _mm_setzero_ps());
+		_mm_store_ps(s.normal_x.data() + i, _mm_and_ps(valid, _mm_mul_ps(_mm_div_ps(cx, len), sign)));
+		_mm_store_ps(s.normal_y.data() + i, _mm_and_ps(valid, _mm_mul_ps(_mm_div_ps(cy, len), sign)));
+		_mm_store_ps(s.normal_z.data() + i, _mm_and_ps(valid, _mm_mul_ps(_mm_div_ps(cz, len), sign)));
+	}
+}
+
+#endif // defined(SPARKI_MESH_STREAMS_SSE)
+
+} // namespace
+
+
+namespace sparki {
+namespace core {
+
+// ----- mesh_streams -----
+
+mesh_streams::mesh_streams(size_t vertex_count)
+	: vertex_count(vertex_count)
+{
+	const size_t count = padded_count();
+	position_x.resize(count);
+	position_y.resize(count);
+	position_z.resize(count);
+	normal_x.resize(count);
+	normal_y.resize(count);
+	normal_z.resize(count);
+	uv_u.resize(count);
+	uv_v.resize(count);
+	tangent_h.resize(count);
+}
+
+// ----- funcs -----
+
+mesh_streams make_mesh_streams(span<const vertex<vertex_attribs::p_n_uv_ts>> vertices)
+{
+	mesh_streams s(vertices.size());
+
+	parallel_for(vertices.size(), c_parallel_vertex_count, [&s, vertices](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			const vertex_t& v = vertices[i];
+			s.position_x[i] = v.position.x;
+			s.position_y[i] = v.position.y;
+			s.position_z[i] = v.position.z;
+			s.normal_x[i] = v.normal.x;
+			s.normal_y[i] = v.normal.y;
+			s.normal_z[i] = v.normal.z;
+			s.uv_u[i] = v.uv.x;
+			s.uv_v[i] = v.uv.y;
+			s.tangent_h[i] = v.tangent_h;
+		}
+	});
+
+	pad_mesh_streams(s);
+	return s;
+}
+
+void store_mesh_streams(const mesh_streams& streams, span<vertex<vertex_attribs::p_n_uv_ts>> out_vertices)
+{
+	assert(out_vertices.size() == streams.vertex_count);
+
+	parallel_for(streams.vertex_count, c_parallel_vertex_count, [&streams, out_vertices](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			vertex_t& v = out_vertices[i];
+			v.position = math::float3(streams.position_x[i], streams.position_y[i], streams.position_z[i]);
+			v.normal = math::float3(streams.normal_x[i], streams.normal_y[i], streams.normal_z[i]);
+			v.uv = math::float2(streams.uv_u[i], streams.uv_v[i]);
+			v.tangent_h = streams.tangent_h[i];
+		}
+	});
+}
+
+simd_level max_simd_level() noexcept
+{
+#if defined(SPARKI_MESH_STREAMS_SSE)
+	return (g_cpu_supports_avx) ? simd_level::avx : simd_level::sse;
+#else
+	return simd_level::scalar;
+#endif
+}
+
+void transform_mesh_streams(mesh_streams& streams, const math::float4x4& m)
+{
+	transform_mesh_streams(streams, m, max_simd_level());
+}
+
+void transform_mesh_streams(mesh_streams& streams, const math::float4x4& m, simd_level level)
+{
+	ENFORCE(level <= max_simd_level(), "The cpu does not support the simd level ", int(level), ".");
+
+	const transform_desc d = make_transform_desc(m);
+	const size_t block_count = streams.padded_count() / mesh_streams::c_lane_count;
+
+	parallel_for(block_count, c_parallel_vertex_count / mesh_streams::c_lane_count,
+		[&streams, &d, level](size_t begin, size_t end) {
+			begin *= mesh_streams::c_lane_count;
+			end *= mesh_streams::c_lane_count;
+
+			switch (level) {
+#if defined(SPARKI_MESH_STREAMS_SSE)
+				case simd_level::avx:	transform_positions_normals_avx(streams, d, begin, end); break;
+				case simd_level::sse:	transform_positions_normals_sse(streams, d, begin, end); break;
+#endif
+				default:				transform_positions_normals_scalar(streams, d, begin, end); break;
+			}
+
+			transform_tangents(streams, d, begin, end);
+		});
+}
+
+} // namespace core
+} // namespace sparki
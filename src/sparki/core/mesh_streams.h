@@ -0,0 +1,85 @@
+#pragma once
+
+#include "sparki/core/asset_geometry.h"
+#include "sparki/core/memory.h"
+#include "sparki/core/utility.h"
+#include "math/math.h"
+
+
+namespace sparki {
+namespace core {
+
+// mesh_streams is the structure of arrays form of vertex<vertex_attribs::p_n_uv_ts>.
+// Each attribute component has its own stream, so that the kernels (see transform_mesh_streams)
+// load & process c_lane_count vertices per instruction.
+// The streams are 64-byte aligned (aligned_buffer) and hold padded_count() items,
+// the padding repeats the last vertex, kernels do not have to handle a tail.
+struct mesh_streams final {
+
+	// The number of vertices which are processed at once (AVX).
+	static constexpr size_t c_lane_count = 8;
+
+
+	mesh_streams() noexcept = default;
+
+	// Allocates uninitialized streams for vertex_count vertices.
+	explicit mesh_streams(size_t vertex_count);
+
+	mesh_streams(mesh_streams&&) noexcept = default;
+	mesh_streams& operator=(mesh_streams&&) noexcept = default;
+
+
+	bool empty() const noexcept
+	{
+		return (vertex_count == 0);
+	}
+
+	// The size of each stream: vertex_count rounded up to c_lane_count.
+	size_t padded_count() const noexcept
+	{
+		return (vertex_count + c_lane_count - 1) / c_lane_count * c_lane_count;
+	}
+
+
+	size_t					vertex_count = 0;
+	aligned_buffer<float>	position_x;
+	aligned_buffer<float>	position_y;
+	aligned_buffer<float>	position_z;
+	aligned_buffer<float>	normal_x;
+	aligned_buffer<float>	normal_y;
+	aligned_buffer<float>	normal_z;
+	aligned_buffer<float>	uv_u;
+	aligned_buffer<float>	uv_v;
+	// The packed tangent space, see vertex<vertex_attribs::p_n_uv_ts>::tangent_h.
+	aligned_buffer<uint32_t> tangent_h;
+};
+
+// Converts the vertices into streams (AoS -> SoA). Large meshes are converted on the task system's worker threads.
+mesh_streams make_mesh_streams(span<const vertex<vertex_attribs::p_n_uv_ts>> vertices);
+
+// Converts the streams back into vertices (SoA -> AoS). out_vertices must hold streams.vertex_count items.
+void store_mesh_streams(const mesh_streams& streams, span<vertex<vertex_attribs::p_n_uv_ts>> out_vertices);
+
+// The instruction sets of the mesh_streams kernels, each next level is wider than the previous one.
+enum class simd_level : unsigned char {
+	scalar,
+	sse,
+	avx
+};
+
+// Returns the widest instruction set which the cpu supports, scalar on platforms other than x86/x64.
+simd_level max_simd_level() noexcept;
+
+// Transforms the vertices by the matrix in place:
+// positions are transformed as points, normals by the cofactor matrix, tangents by the upper 3x3 part.
+// Mirroring matrices flip the normals & the bitangent's sign.
+// Positions & normals are processed 8-wide using max_simd_level() instructions.
+void transform_mesh_streams(mesh_streams& streams, const math::float4x4& m);
+
+// Same as above, uses the specified instruction set which must not exceed max_simd_level().
+// All the levels produce bitwise identical results (checked by sparki_assetc --self-check),
+// mesh_streams.cpp is compiled without fp contraction for that. Normals which become zero stay zero.
+void transform_mesh_streams(mesh_streams& streams, const math::float4x4& m, simd_level level);
+
+} // namespace core
+} // namespace sparki
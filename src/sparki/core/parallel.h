@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include "ts/task_system.h"
+
+
+namespace sparki {
+namespace core {
+
+// The max number of tasks parallel_for puts into the task system's queue at once.
+constexpr size_t c_parallel_for_max_task_count = 32;
+
+// Splits the range [0, count) into contiguous chunks (each one is at least grain_size items)
+// and processes the chunks on the task system's worker threads.
+// func(begin, end) is invoked once per chunk and must not throw.
+// Blocks until all the chunks have been processed.
+template<typename Func>
+void parallel_for(size_t count, size_t grain_size, const Func& func)
+{
+	assert(grain_size > 0);
+	if (count == 0) return;
+
+	const size_t task_count = std::min(c_parallel_for_max_task_count, (count + grain_size - 1) / grain_size);
+	if (task_count == 1) {
+		func(size_t(0), count);
+		return;
+	}
+
+	// one wait counter per task, ts::run does not accumulate several tasks in a counter.
+	std::unique_ptr<std::atomic_size_t[]> wait_counters(new std::atomic_size_t[task_count]);
+	const size_t chunk_size = (count + task_count - 1) / task_count;
+
+	for (size_t t = 0; t < task_count; ++t) {
+		const size_t begin = t * chunk_size;
+		const size_t end = std::min(count, begin + chunk_size);
+		wait_counters[t] = 0;
+		ts::run([&func, begin, end] { if (begin < end) func(begin, end); }, wait_counters[t]);
+	}
+
+	for (size_t t = 0; t < task_count; ++t)
+		ts::wait_for(wait_counters[t]);
+}
+
+} // namespace core
+} // namespace sparki
@@ -0,0 +1,310 @@
+#include "sparki/core/platform_file.h"
+
+#include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <algorithm>
+#include <utility>
+#include "sparki/core/utility.h"
+
+#if defined(_WIN32)
+	#include <windows.h>
+#else
+	#include <dirent.h>
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+
+namespace {
+
+using namespace sparki::core;
+
+#if defined(_WIN32)
+
+void list_files_recursive(const std::string& dirname, const std::string& prefix, std::vector<std::string>& names)
+{
+	WIN32_FIND_DATAA fd;
+	const std::string pattern = dirname + "\\*";
+	HANDLE h = FindFirstFileA(pattern.c_str(), &fd);
+	ENFORCE(h != INVALID_HANDLE_VALUE, "Failed to read directory ", dirname);
+
+	try {
+		do {
+			const std::string name = fd.cFileName;
+			if (name == "." || name == "..") continue;
+
+			if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				list_files_recursive(dirname + '\\' + name, prefix + name + '/', names);
+			else
+				names.push_back(prefix + name);
+		} while (FindNextFileA(h, &fd));
+	}
+	catch (...) {
+		FindClose(h);
+		throw;
+	}
+
+	FindClose(h);
+}
+
+#else
+
+void list_files_recursive(const std::string& dirname, const std::string& prefix, std::vector<std::string>& names)
+{
+	DIR* p_dir = opendir(dirname.c_str());
+	ENFORCE(p_dir, "Failed to read directory ", dirname);
+
+	try {
+		while (const dirent* p_entry = readdir(p_dir)) {
+			const std::string name = p_entry->d_name;
+			if (name == "." || name == "..") continue;
+
+			const std::string path = dirname + '/' + name;
+			struct stat st;
+			if (stat(path.c_str(), &st) != 0) continue;
+
+			if (S_ISDIR(st.st_mode))
+				list_files_recursive(path, prefix + name + '/', names);
+			else if (S_ISREG(st.st_mode))
+				names.push_back(prefix + name);
+		}
+	}
+	catch (...) {
+		closedir(p_dir);
+		throw;
+	}
+
+	closedir(p_dir);
+}
+
+#endif // defined(_WIN32)
+
+} // namespace
+
+
+namespace sparki {
+namespace core {
+
+// ----- mapped_file -----
+
+#if defined(_WIN32)
+
+mapped_file::mapped_file(const char* p_filename)
+{
+	assert(p_filename);
+
+	try {
+		HANDLE p_file = CreateFileA(p_filename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		ENFORCE(p_file != INVALID_HANDLE_VALUE, "Failed to open file ", p_filename);
+		p_file_ = p_file;
+
+		LARGE_INTEGER file_size;
+		const BOOL res = GetFileSizeEx(p_file, &file_size);
+		ENFORCE(res && file_size.QuadPart > 0, "Failed to map an empty file ", p_filename);
+
+		p_mapping_ = CreateFileMappingA(p_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		ENFORCE(p_mapping_, "Failed to create file mapping. Error: ", GetLastError());
+
+		p_data_ = static_cast<const uint8_t*>(MapViewOfFile(p_mapping_, FILE_MAP_READ, 0, 0, 0));
+		ENFORCE(p_data_, "Failed to map view of file. Error: ", GetLastError());
+		size_ = size_t(file_size.QuadPart);
+	}
+	catch (...) {
+		dispose();
+		const std::string exc_msg = EXCEPTION_MSG("Map file error. File: ", p_filename);
+		std::throw_with_nested(std::runtime_error(exc_msg));
+	}
+}
+
+void mapped_file::dispose() noexcept
+{
+	if (p_data_) UnmapViewOfFile(p_data_);
+	if (p_mapping_) CloseHandle(p_mapping_);
+	if (p_file_) CloseHandle(p_file_);
+
+	p_data_ = nullptr;
+	size_ = 0;
+	p_file_ = nullptr;
+	p_mapping_ = nullptr;
+}
+
+void mapped_file::prefetch() const noexcept
+{
+	if (!p_data_) return;
+
+	WIN32_MEMORY_RANGE_ENTRY range = { const_cast<uint8_t*>(p_data_), size_ };
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+#else
+
+mapped_file::mapped_file(const char* p_filename)
+{
+	assert(p_filename);
+
+	const int fd = open(p_filename, O_RDONLY);
+	ENFORCE(fd != -1, "Failed to open file ", p_filename);
+
+	struct stat st;
+	const bool stat_res = (fstat(fd, &st) == 0) && (st.st_size > 0);
+	if (!stat_res) {
+		close(fd);
+		throw std::runtime_error(EXCEPTION_MSG("Failed to map an empty file ", p_filename));
+	}
+
+	void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // the mapping keeps its own reference to the file.
+	ENFORCE(p != MAP_FAILED, "Failed to map file ", p_filename);
+
+	p_data_ = static_cast<const uint8_t*>(p);
+	size_ = size_t(st.st_size);
+}
+
+void mapped_file::dispose() noexcept
+{
+	if (p_data_) munmap(const_cast<uint8_t*>(p_data_), size_);
+
+	p_data_ = nullptr;
+	size_ = 0;
+}
+
+void mapped_file::prefetch() const noexcept
+{
+	if (!p_data_) return;
+
+	madvise(const_cast<uint8_t*>(p_data_), size_, MADV_WILLNEED);
+}
+
+#endif // defined(_WIN32)
+
+mapped_file::mapped_file(mapped_file&& f) noexcept
+{
+	*this = std::move(f);
+}
+
+mapped_file& mapped_file::operator=(mapped_file&& f) noexcept
+{
+	if (this == &f) return *this;
+
+	dispose();
+	std::swap(p_data_, f.p_data_);
+	std::swap(size_, f.size_);
+#if defined(_WIN32)
+	std::swap(p_file_, f.p_file_);
+	std::swap(p_mapping_, f.p_mapping_);
+#endif
+	return *this;
+}
+
+mapped_file::~mapped_file() noexcept
+{
+	dispose();
+}
+
+// ----- funcs -----
+
+#if defined(_WIN32)
+
+file_info get_file_info(const char* p_filename)
+{
+	assert(p_filename);
+
+	file_info fi;
+
+	char path[MAX_PATH];
+	const DWORD len = GetFullPathNameA(p_filename, MAX_PATH, path, nullptr);
+	ENFORCE(0 < len && len < MAX_PATH, "Failed to get the full path of file ", p_filename);
+	fi.canonical_path.assign(path, len);
+	for (char& c : fi.canonical_path) {
+		c = (c == '/') ? '\\' : char(std::tolower(static_cast<unsigned char>(c)));
+	}
+
+	WIN32_FILE_ATTRIBUTE_DATA attribs;
+	const BOOL res = GetFileAttributesExA(p_filename, GetFileExInfoStandard, &attribs);
+	ENFORCE(res && !(attribs.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY), "Failed to get attributes of file ", p_filename);
+	fi.last_write_time = (uint64_t(attribs.ftLastWriteTime.dwHighDateTime) << 32) | attribs.ftLastWriteTime.dwLowDateTime;
+	fi.byte_count = (size_t(attribs.nFileSizeHigh) << 32) | attribs.nFileSizeLow;
+
+	return fi;
+}
+
+bool file_exists(const char* p_filename) noexcept
+{
+	assert(p_filename);
+
+	const DWORD attribs = GetFileAttributesA(p_filename);
+	return (attribs != INVALID_FILE_ATTRIBUTES) && !(attribs & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+void create_directory(const char* p_dirname)
+{
+	assert(p_dirname);
+
+	const BOOL res = CreateDirectoryA(p_dirname, nullptr);
+	ENFORCE(res || GetLastError() == ERROR_ALREADY_EXISTS, "Failed to create directory ", p_dirname,
+		". Error: ", GetLastError());
+}
+
+#else
+
+file_info get_file_info(const char* p_filename)
+{
+	assert(p_filename);
+
+	file_info fi;
+
+	char path[PATH_MAX];
+	ENFORCE(realpath(p_filename, path), "Failed to get the full path of file ", p_filename);
+	fi.canonical_path = path;
+
+	struct stat st;
+	ENFORCE(stat(path, &st) == 0 && S_ISREG(st.st_mode), "Failed to get attributes of file ", p_filename);
+#if defined(__APPLE__)
+	fi.last_write_time = uint64_t(st.st_mtimespec.tv_sec) * 1'000'000'000 + uint64_t(st.st_mtimespec.tv_nsec);
+#else
+	fi.last_write_time = uint64_t(st.st_mtim.tv_sec) * 1'000'000'000 + uint64_t(st.st_mtim.tv_nsec);
+#endif
+	fi.byte_count = size_t(st.st_size);
+
+	return fi;
+}
+
+bool file_exists(const char* p_filename) noexcept
+{
+	assert(p_filename);
+
+	struct stat st;
+	return (stat(p_filename, &st) == 0) && S_ISREG(st.st_mode);
+}
+
+void create_directory(const char* p_dirname)
+{
+	assert(p_dirname);
+
+	struct stat st;
+	if (stat(p_dirname, &st) == 0 && S_ISDIR(st.st_mode)) return;
+
+	ENFORCE(mkdir(p_dirname, 0755) == 0 || errno == EEXIST, "Failed to create directory ", p_dirname,
+		". Error: ", errno);
+}
+
+#endif // defined(_WIN32)
+
+std::vector<std::string> list_files(const char* p_dirname)
+{
+	assert(p_dirname);
+
+	std::vector<std::string> names;
+	list_files_recursive(std::string(p_dirname), std::string(), names);
+	std::sort(names.begin(), names.end());
+	return names;
+}
+
+} // namespace core
+} // namespace sparki
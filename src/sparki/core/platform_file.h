@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace sparki {
+namespace core {
+
+struct file_info final {
+	// Absolute path without '.' & '..' components (symbolic links are resolved on posix systems).
+	// On Windows the path is lower case and uses backslash separators, so it identifies the file uniquely.
+	std::string		canonical_path;
+	// The time of the last modification. The units are platform specific, use the value for comparison only.
+	uint64_t		last_write_time = 0;
+	size_t			byte_count = 0;
+};
+
+// mapped_file maps the whole contents of a file into the process's address space (read-only access).
+// The mapped memory is backed by the OS page cache, no data is copied by the object itself.
+// Pointers obtained via data() stay valid until the object is disposed/destroyed.
+class mapped_file final {
+public:
+
+	mapped_file() noexcept = default;
+
+	explicit mapped_file(const char* p_filename);
+
+	mapped_file(mapped_file&& f) noexcept;
+	mapped_file& operator=(mapped_file&& f) noexcept;
+
+	~mapped_file() noexcept;
+
+
+	const uint8_t* data() const noexcept
+	{
+		return p_data_;
+	}
+
+	size_t size() const noexcept
+	{
+		return size_;
+	}
+
+	bool empty() const noexcept
+	{
+		return (p_data_ == nullptr);
+	}
+
+
+	// Unmaps the file if such has been mapped.
+	void dispose() noexcept;
+
+	// Hints the os to read the whole mapping into the page cache asynchronously,
+	// so that the first access does not stall on page faults. Does nothing if the hint is not supported.
+	void prefetch() const noexcept;
+
+private:
+
+	const uint8_t*	p_data_ = nullptr;
+	size_t			size_ = 0;
+#if defined(_WIN32)
+	void*			p_file_ = nullptr;
+	void*			p_mapping_ = nullptr;
+#endif
+};
+
+
+// Returns the canonical path, the last write time and the size of the specified file.
+// Throws if the file does not exist.
+file_info get_file_info(const char* p_filename);
+
+// Returns true if the specified regular file exists.
+bool file_exists(const char* p_filename) noexcept;
+
+// Creates the specified directory if it does not exist. The parent directory must exist.
+void create_directory(const char* p_dirname);
+
+// Returns the names of all the regular files in the specified directory and its subdirectories.
+// The names are relative to p_dirname, use '/' separators and are sorted lexicographically.
+// Throws if the directory cannot be read.
+std::vector<std::string> list_files(const char* p_dirname);
+
+} // namespace core
+} // namespace sparki
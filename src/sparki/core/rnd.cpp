@@ -84,10 +84,10 @@ void render_system::init_passes_and_tools()
 	p_envmap_builder_		= std::make_unique<envmap_texture_builder>(p_device_, p_ctx_, 
 		p_debug_, p_gbuffer_->p_sampler_linear);
 	p_material_editor_tool_ = std::make_unique<core::material_editor_tool>(p_device_, p_ctx_, 
-		p_debug_, p_gbuffer_->p_sampler_point);
+		p_debug_, p_gbuffer_->p_sampler_point, asset_manager_);
 	// rnd passes
 	p_skybox_pass_		= std::make_unique<skybox_pass>(p_device_, p_ctx_, p_debug_);
-	p_light_pass_		= std::make_unique<shading_pass>(p_device_, p_ctx_, p_debug_);
+	p_light_pass_		= std::make_unique<shading_pass>(p_device_, p_ctx_, p_debug_, asset_manager_);
 	p_postproc_pass_	= std::make_unique<postproc_pass>(p_device_, p_ctx_, p_debug_);
 	p_imgui_pass_		= std::make_unique<imgui_pass>(p_device_, p_ctx_, p_debug_);
 }
@@ -104,7 +104,7 @@ void render_system::draw_frame(frame& frame)
 	p_ctx_->ClearRenderTargetView(p_gbuffer_->p_tex_color_rtv, &float4::zero.x);
 	p_ctx_->ClearDepthStencilView(p_gbuffer_->p_tex_depth_dsv, D3D11_CLEAR_DEPTH, 1.0f, 0);
 
-	p_light_pass_->perform(*p_gbuffer_, pv_matrix, frame.material, frame.camera_position);
+	p_light_pass_->perform(*p_gbuffer_, pv_matrix, frame.projection_matrix, frame.material, frame.camera_position);
 	p_skybox_pass_->perform(*p_gbuffer_, pv_matrix, frame.camera_position);
 
 	// reset rtv bindings
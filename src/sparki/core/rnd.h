@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include "sparki/core/asset_manager.h"
 #include "sparki/core/rnd_base.h"
 #include "sparki/core/rnd_imgui.h"
 #include "sparki/core/rnd_pass.h"
@@ -30,6 +31,11 @@ public:
 	~render_system() noexcept;
 
 
+	core::asset_manager& asset_manager() noexcept
+	{
+		return asset_manager_;
+	}
+
 	material_editor_tool& material_editor_tool() noexcept
 	{
 		return *p_material_editor_tool_;
@@ -48,6 +54,8 @@ private:
 	void init_passes_and_tools();
 
 
+	// assets ---
+	core::asset_manager				asset_manager_;
 	// device stuff ---
 	com_ptr<ID3D11Device>			p_device_;
 	com_ptr<ID3D11DeviceContext>	p_ctx_;
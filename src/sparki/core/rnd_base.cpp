@@ -4,6 +4,75 @@
 #include <algorithm>
 
 
+namespace {
+
+using namespace sparki::core;
+
+D3D11_TEXTURE2D_DESC make_texture_2d_desc(const uint3& size, uint32_t mipmap_count, uint32_t array_size,
+	pixel_format fmt, D3D11_USAGE usage, UINT bind_flags, UINT misc_flags) noexcept
+{
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = size.x;
+	desc.Height = size.y;
+	desc.MipLevels = mipmap_count;
+	desc.ArraySize = array_size;
+	desc.Format = make_dxgi_format(fmt);
+	desc.SampleDesc.Count = 1;
+	desc.SampleDesc.Quality = 0;
+	desc.Usage = usage;
+	desc.BindFlags = bind_flags;
+	desc.MiscFlags = misc_flags;
+	return desc;
+}
+
+inline D3D11_SUBRESOURCE_DATA make_subresource_data(const uint8_t* ptr, const uint3& size,
+	uint32_t mipmap_index, pixel_format fmt) noexcept
+{
+	const UINT w = std::max(1u, size.x >> mipmap_index);
+
+	D3D11_SUBRESOURCE_DATA data;
+	data.pSysMem = ptr;
+	data.SysMemPitch = UINT(row_byte_count(w, fmt));
+	data.SysMemSlicePitch = 0;
+	return data;
+}
+
+// Returns subresource descriptions (slice-major order) which point into td.buffer.
+std::vector<D3D11_SUBRESOURCE_DATA> make_subresource_data_list(const texture_data& td)
+{
+	std::vector<D3D11_SUBRESOURCE_DATA> data_list;
+	data_list.reserve(td.array_size * td.mipmap_count);
+
+	const uint8_t* ptr = td.buffer.data();
+	for (uint32_t a = 0; a < td.array_size; ++a) {
+		for (uint32_t m = 0; m < td.mipmap_count; ++m) {
+			data_list.push_back(make_subresource_data(ptr, td.size, m, td.format));
+			ptr += byte_count(td.size, m, td.format);
+		}
+	}
+
+	return data_list;
+}
+
+// Returns subresource descriptions (slice-major order) which point into the view's mapped file.
+std::vector<D3D11_SUBRESOURCE_DATA> make_subresource_data_list(const texture_view& tv)
+{
+	std::vector<D3D11_SUBRESOURCE_DATA> data_list;
+	data_list.reserve(tv.array_size() * tv.mipmap_count());
+
+	for (uint32_t a = 0; a < tv.array_size(); ++a) {
+		for (uint32_t m = 0; m < tv.mipmap_count(); ++m) {
+			const uint8_t* ptr = tv.subresource(a, m).data();
+			data_list.push_back(make_subresource_data(ptr, tv.size(), m, tv.format()));
+		}
+	}
+
+	return data_list;
+}
+
+} // namespace
+
+
 namespace sparki {
 namespace core {
 
@@ -349,6 +418,11 @@ com_ptr<ID3D11Buffer> make_structured_buffer(ID3D11Device* p_device, UINT item_b
 	return buffer;
 }
 
+DXGI_FORMAT make_dxgi_format(index_format fmt) noexcept
+{
+	return (fmt == index_format::uint16) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+}
+
 DXGI_FORMAT make_dxgi_format(sparki::core::pixel_format fmt) noexcept
 {
 	assert(fmt != pixel_format::rgb_8);
@@ -364,6 +438,9 @@ DXGI_FORMAT make_dxgi_format(sparki::core::pixel_format fmt) noexcept
 		case pixel_format::red_8:		return DXGI_FORMAT_R8_UNORM;
 		case pixel_format::rg_8:		return DXGI_FORMAT_R8G8_UNORM;
 		case pixel_format::rgba_8:		return DXGI_FORMAT_R8G8B8A8_UNORM;
+		case pixel_format::bc5:			return DXGI_FORMAT_BC5_UNORM;
+		case pixel_format::bc6h_uf16:	return DXGI_FORMAT_BC6H_UF16;
+		case pixel_format::bc7:			return DXGI_FORMAT_BC7_UNORM;
 	}
 }
 
@@ -380,6 +457,9 @@ pixel_format make_pixel_format(DXGI_FORMAT fmt) noexcept
 		case DXGI_FORMAT_R8_UNORM:				return pixel_format::red_8;
 		case DXGI_FORMAT_R8G8_UNORM:			return pixel_format::rg_8;
 		case DXGI_FORMAT_R8G8B8A8_UNORM:		return pixel_format::rgba_8;
+		case DXGI_FORMAT_BC5_UNORM:				return pixel_format::bc5;
+		case DXGI_FORMAT_BC6H_UF16:				return pixel_format::bc6h_uf16;
+		case DXGI_FORMAT_BC7_UNORM:				return pixel_format::bc7;
 	}
 }
 
@@ -390,33 +470,25 @@ com_ptr<ID3D11Texture2D> make_texture_2d(ID3D11Device* p_device, const texture_d
 	assert(td.type == texture_type::texture_2d);
 	assert(is_valid_texture_data(td));
 
-	D3D11_TEXTURE2D_DESC desc = {};
-	desc.Width = td.size.x;
-	desc.Height = td.size.y;
-	desc.MipLevels = td.mipmap_count;
-	desc.ArraySize = td.array_size;
-	desc.Format = make_dxgi_format(td.format);
-	desc.SampleDesc.Count = 1;
-	desc.SampleDesc.Quality = 0;
-	desc.Usage = usage;
-	desc.BindFlags = bind_flags;
+	const D3D11_TEXTURE2D_DESC desc = make_texture_2d_desc(td.size, td.mipmap_count,
+		td.array_size, td.format, usage, bind_flags, 0);
+	const std::vector<D3D11_SUBRESOURCE_DATA> data_list = make_subresource_data_list(td);
 
-	const size_t fmt_byte_count = byte_count(td.format);
-	const uint8_t* ptr = td.buffer.data();
-	std::vector<D3D11_SUBRESOURCE_DATA> data_list(desc.ArraySize * desc.MipLevels);
+	com_ptr<ID3D11Texture2D> p_tex;
+	HRESULT hr = p_device->CreateTexture2D(&desc, data_list.data(), &p_tex.ptr);
+	assert(hr == S_OK);
+	return p_tex;
+}
 
-	for (UINT a = 0; a < desc.ArraySize; ++a) {
-		for (UINT m = 0; m < desc.MipLevels; ++m) {
-			const UINT w = desc.Width >> m;
-			const UINT h = desc.Height >> m;
-			const UINT index = a * desc.MipLevels + m;
-
-			data_list[index].pSysMem = ptr;
-			data_list[index].SysMemPitch = UINT(w * fmt_byte_count);
-			data_list[index].SysMemSlicePitch = 0;
-			ptr += w * h * fmt_byte_count;
-		}
-	}
+com_ptr<ID3D11Texture2D> make_texture_2d(ID3D11Device* p_device, const texture_view& tv,
+	D3D11_USAGE usage, UINT bind_flags)
+{
+	assert(p_device);
+	assert(tv.type() == texture_type::texture_2d);
+
+	const D3D11_TEXTURE2D_DESC desc = make_texture_2d_desc(tv.size(), tv.mipmap_count(),
+		tv.array_size(), tv.format(), usage, bind_flags, 0);
+	const std::vector<D3D11_SUBRESOURCE_DATA> data_list = make_subresource_data_list(tv);
 
 	com_ptr<ID3D11Texture2D> p_tex;
 	HRESULT hr = p_device->CreateTexture2D(&desc, data_list.data(), &p_tex.ptr);
@@ -432,36 +504,26 @@ com_ptr<ID3D11Texture2D> make_texture_cube(ID3D11Device* p_device, const texture
 	assert(td.array_size == 6);
 	assert(is_valid_texture_data(td));
 
-	D3D11_TEXTURE2D_DESC desc = {};
-	desc.Width = td.size.x;
-	desc.Height = td.size.y;
-	desc.MipLevels = td.mipmap_count;
-	desc.ArraySize = td.array_size;
-	desc.Format = make_dxgi_format(td.format);
-	desc.SampleDesc.Count = 1;
-	desc.SampleDesc.Quality = 0;
-	desc.Usage = usage;
-	desc.BindFlags = bind_flags;
-	desc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
-	if (misc_flags != 0)
-		desc.MiscFlags |= misc_flags;
+	const D3D11_TEXTURE2D_DESC desc = make_texture_2d_desc(td.size, td.mipmap_count,
+		td.array_size, td.format, usage, bind_flags, D3D11_RESOURCE_MISC_TEXTURECUBE | misc_flags);
+	const std::vector<D3D11_SUBRESOURCE_DATA> data_list = make_subresource_data_list(td);
 
-	const size_t fmt_byte_count = byte_count(td.format);
-	const uint8_t* ptr = td.buffer.data();
-	std::vector<D3D11_SUBRESOURCE_DATA> data_list(desc.ArraySize * desc.MipLevels);
+	com_ptr<ID3D11Texture2D> p_tex;
+	HRESULT hr = p_device->CreateTexture2D(&desc, data_list.data(), &p_tex.ptr);
+	assert(hr == S_OK);
+	return p_tex;
+}
 
-	for (UINT a = 0; a < desc.ArraySize; ++a) {
-		for (UINT m = 0; m < desc.MipLevels; ++m) {
-			const UINT w = desc.Width >> m;
-			const UINT h = desc.Height >> m;
-			const UINT index = a * desc.MipLevels + m;
-
-			data_list[index].pSysMem = ptr;
-			data_list[index].SysMemPitch = UINT(w * fmt_byte_count);
-			data_list[index].SysMemSlicePitch = 0;
-			ptr += w * h * fmt_byte_count;
-		}
-	}
+com_ptr<ID3D11Texture2D> make_texture_cube(ID3D11Device* p_device, const texture_view& tv,
+	D3D11_USAGE usage, UINT bind_flags, UINT misc_flags)
+{
+	assert(p_device);
+	assert(tv.type() == texture_type::texture_cube);
+	assert(tv.array_size() == 6);
+
+	const D3D11_TEXTURE2D_DESC desc = make_texture_2d_desc(tv.size(), tv.mipmap_count(),
+		tv.array_size(), tv.format(), usage, bind_flags, D3D11_RESOURCE_MISC_TEXTURECUBE | misc_flags);
+	const std::vector<D3D11_SUBRESOURCE_DATA> data_list = make_subresource_data_list(tv);
 
 	com_ptr<ID3D11Texture2D> p_tex;
 	HRESULT hr = p_device->CreateTexture2D(&desc, data_list.data(), &p_tex.ptr);
@@ -526,7 +588,6 @@ texture_data make_texture_data(ID3D11Device* p_device, ID3D11DeviceContext* p_ct
 	texture_data td(type, uint3(desc.Width, desc.Height, 1), 
 		desc.MipLevels, desc.ArraySize, make_pixel_format(desc.Format));
 	
-	const size_t fmt_byte_count = byte_count(td.format);
 	uint8_t* ptr = td.buffer.data();
 
 	// for each array slice 
@@ -540,9 +601,11 @@ texture_data make_texture_data(ID3D11Device* p_device, ID3D11DeviceContext* p_ct
 			hr = p_ctx->Map(p_tex_staging, index, D3D11_MAP_READ, 0, &map);
 			assert(hr == S_OK);
 
-			const UINT w = desc.Width >> m;
-			const UINT h = desc.Height >> m;
-			const size_t mip_bc = w * h * fmt_byte_count;
+			const UINT w = std::max(1u, desc.Width >> m);
+			const UINT h = std::max(1u, desc.Height >> m);
+			const size_t row_bc = row_byte_count(w, td.format);
+			const UINT rows = row_count(h, td.format);
+			const size_t mip_bc = row_bc * rows;
 			assert(mip_bc > 0);
 			assert(mip_bc <= map.DepthPitch);
 
@@ -552,11 +615,10 @@ texture_data make_texture_data(ID3D11Device* p_device, ID3D11DeviceContext* p_ct
 			}
 			else {
 				uint8_t* p_src = reinterpret_cast<uint8_t*>(map.pData);
-				const size_t row_bc = w * fmt_byte_count;
 				// Note(MSDN): The runtime might assign values to RowPitch and DepthPitch 
 				// that are larger than anticipated because there might be padding between rows and depth.
 				// https://msdn.microsoft.com/en-us/library/windows/desktop/ff476182(v=vs.85).aspx
-				for (size_t row = 0; row < h; ++row) {
+				for (size_t row = 0; row < rows; ++row) {
 					std::memcpy(ptr, p_src, row_bc);
 					p_src += map.RowPitch;
 					ptr += row_bc;
@@ -259,6 +259,8 @@ com_ptr<ID3D11Buffer> make_constant_buffer(ID3D11Device* p_device, UINT byte_cou
 com_ptr<ID3D11Buffer> make_structured_buffer(ID3D11Device* p_device, UINT item_byte_count, UINT item_count,
 	D3D11_USAGE usage, UINT bing_flags);
 
+DXGI_FORMAT make_dxgi_format(index_format fmt) noexcept;
+
 DXGI_FORMAT make_dxgi_format(pixel_format fmt) noexcept;
 
 pixel_format make_pixel_format(DXGI_FORMAT fmt) noexcept;
@@ -266,9 +268,15 @@ pixel_format make_pixel_format(DXGI_FORMAT fmt) noexcept;
 com_ptr<ID3D11Texture2D> make_texture_2d(ID3D11Device* p_device, const texture_data& td,
 	D3D11_USAGE usage, UINT bind_flags);
 
+com_ptr<ID3D11Texture2D> make_texture_2d(ID3D11Device* p_device, const texture_view& tv,
+	D3D11_USAGE usage, UINT bind_flags);
+
 com_ptr<ID3D11Texture2D> make_texture_cube(ID3D11Device* p_device, const texture_data& td,
 	D3D11_USAGE usage, UINT bind_flags, UINT misc_flags = 0);
 
+com_ptr<ID3D11Texture2D> make_texture_cube(ID3D11Device* p_device, const texture_view& tv,
+	D3D11_USAGE usage, UINT bind_flags, UINT misc_flags = 0);
+
 com_ptr<ID3D11Texture2D> make_texture_cube(ID3D11Device* p_device, UINT side_size, UINT mipmap_count,
 	DXGI_FORMAT format, D3D11_USAGE usage, UINT bing_flags, UINT misc_flags = 0);
 
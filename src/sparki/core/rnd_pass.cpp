@@ -1,13 +1,16 @@
 #include "sparki/core/rnd_pass.h"
 
+#include <algorithm>
+
 
 namespace sparki {
 namespace core {
 
 // ----- shading_pass -----
 
-shading_pass::shading_pass(ID3D11Device* p_device, ID3D11DeviceContext* p_ctx, ID3D11Debug* p_debug)
-	: p_device_(p_device), p_ctx_(p_ctx), p_debug_(p_debug)
+shading_pass::shading_pass(ID3D11Device* p_device, ID3D11DeviceContext* p_ctx, ID3D11Debug* p_debug,
+	asset_manager& asset_manager)
+	: p_device_(p_device), p_ctx_(p_ctx), p_debug_(p_debug), asset_manager_(asset_manager)
 {
 	assert(p_device);
 	assert(p_ctx);
@@ -40,27 +43,44 @@ void shading_pass::init_geometry()
 		&p_input_layout_.ptr);
 	assert(hr == S_OK);
 
-	//geometry_t geometry = read_geo("../../data/geometry/plane.geo");
-	geometry_t geometry = read_from_geo_file("../../data/geometry/sphere.geo");
-	//geometry_t geometry = read_geo("../../data/geometry/suzanne.geo");
+	asset_manager_.load_mesh(c_geometry_filename, asset_priority::high, [this](const mesh_handle& h) {
+		ENFORCE(h.ready(), h.error_message());
+		init_geometry_buffers(h.get().vertices(), h.get().index_data(), h.get().index_fmt(), h.get().meshlets(),
+			h.get().lods(), h.get().bounds());
+	});
+}
+
+void shading_pass::init_geometry_buffers(span<const vertex<vertex_attribs::p_n_uv_ts>> vertices,
+	span<const uint8_t> index_data, index_format index_fmt, span<const meshlet> meshlets,
+	span<const mesh_lod> lods, const mesh_bounds& bounds)
+{
+	using fmt_t = mesh_geometry<vertex_attribs::p_n_uv_ts>::format;
+
 	D3D11_BUFFER_DESC vb_desc = {};
-	vb_desc.ByteWidth = UINT(byte_count(geometry.vertices));
+	vb_desc.ByteWidth = UINT(byte_count(vertices));
 	vb_desc.Usage = D3D11_USAGE_IMMUTABLE;
 	vb_desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	const D3D11_SUBRESOURCE_DATA vb_data = { geometry.vertices.data(), 0, 0 };
-	hr = p_device_->CreateBuffer(&vb_desc, &vb_data, &p_vertex_buffer_.ptr);
+	const D3D11_SUBRESOURCE_DATA vb_data = { vertices.data(), 0, 0 };
+	HRESULT hr = p_device_->CreateBuffer(&vb_desc, &vb_data, &p_vertex_buffer_.ptr);
 	assert(hr == S_OK);
 
 	D3D11_BUFFER_DESC ib_desc = {};
-	ib_desc.ByteWidth = UINT(byte_count(geometry.indices));
+	ib_desc.ByteWidth = UINT(byte_count(index_data));
 	ib_desc.Usage = D3D11_USAGE_IMMUTABLE;
 	ib_desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	const D3D11_SUBRESOURCE_DATA ib_data = { geometry.indices.data(), 0, 0 };
+	const D3D11_SUBRESOURCE_DATA ib_data = { index_data.data(), 0, 0 };
 	hr = p_device_->CreateBuffer(&ib_desc, &ib_data, &p_index_buffer_.ptr);
 	assert(hr == S_OK);
 
 	vertex_stride_ = UINT(fmt_t::vertex_byte_count);
-	index_count_ = UINT(geometry.indices.size());
+	index_dxgi_format_ = make_dxgi_format(index_fmt);
+	bounds_ = bounds;
+	meshlets_.assign(meshlets.begin(), meshlets.end());
+	lods_.assign(lods.begin(), lods.end());
+	if (lods_.empty()) {
+		const uint32_t index_count = uint32_t(index_data.size() / byte_count(index_fmt));
+		lods_.push_back({ 0, index_count, 0, uint32_t(meshlets_.size()), 0.0f });
+	}
 }
 
 void shading_pass::init_pipeline_state()
@@ -75,26 +95,38 @@ void shading_pass::init_pipeline_state()
 
 void shading_pass::init_textures()
 {
-	texture_data td_diffuse_envmap = load_from_tex_file("../../data/pisa_diffuse_envmap.tex");
-	texture_data td_specular_envmap = load_from_tex_file("../../data/pisa_specular_envmap.tex");
-	texture_data td_specular_brdf = load_from_tex_file("../../data/specular_brdf.tex");
-
-	p_tex_diffuse_envmap_ = make_texture_cube(p_device_, td_diffuse_envmap, D3D11_USAGE_IMMUTABLE, D3D11_BIND_SHADER_RESOURCE);
-	HRESULT hr = p_device_->CreateShaderResourceView(p_tex_diffuse_envmap_, nullptr, &p_tex_diffuse_envmap_srv_.ptr);
-	assert(hr == S_OK);
-
-	p_tex_specular_envmap_ = make_texture_cube(p_device_, td_specular_envmap, D3D11_USAGE_IMMUTABLE, D3D11_BIND_SHADER_RESOURCE);
-	hr = p_device_->CreateShaderResourceView(p_tex_specular_envmap_, nullptr, &p_tex_specular_envmap_srv_.ptr);
-	assert(hr == S_OK);
-
-	p_tex_specular_brdf_ = make_texture_2d(p_device_, td_specular_brdf, D3D11_USAGE_IMMUTABLE, D3D11_BIND_SHADER_RESOURCE);
-	hr = p_device_->CreateShaderResourceView(p_tex_specular_brdf_, nullptr, &p_tex_specular_brdf_srv_.ptr);
-	assert(hr == S_OK);
+	asset_manager_.load_texture(texture_request("../../data/pisa_diffuse_envmap.tex", 4), asset_priority::high,
+		[this](const texture_handle& h) {
+			ENFORCE(h.ready(), h.error_message());
+			p_tex_diffuse_envmap_ = make_texture_cube(p_device_, h.get(), D3D11_USAGE_IMMUTABLE, D3D11_BIND_SHADER_RESOURCE);
+			HRESULT hr = p_device_->CreateShaderResourceView(p_tex_diffuse_envmap_, nullptr, &p_tex_diffuse_envmap_srv_.ptr);
+			assert(hr == S_OK);
+		});
+
+	asset_manager_.load_texture(texture_request("../../data/pisa_specular_envmap.tex", 4), asset_priority::high,
+		[this](const texture_handle& h) {
+			ENFORCE(h.ready(), h.error_message());
+			p_tex_specular_envmap_ = make_texture_cube(p_device_, h.get(), D3D11_USAGE_IMMUTABLE, D3D11_BIND_SHADER_RESOURCE);
+			HRESULT hr = p_device_->CreateShaderResourceView(p_tex_specular_envmap_, nullptr, &p_tex_specular_envmap_srv_.ptr);
+			assert(hr == S_OK);
+		});
+
+	asset_manager_.load_texture(texture_request("../../data/specular_brdf.tex", 2), asset_priority::high,
+		[this](const texture_handle& h) {
+			ENFORCE(h.ready(), h.error_message());
+			p_tex_specular_brdf_ = make_texture_2d(p_device_, h.get(), D3D11_USAGE_IMMUTABLE, D3D11_BIND_SHADER_RESOURCE);
+			HRESULT hr = p_device_->CreateShaderResourceView(p_tex_specular_brdf_, nullptr, &p_tex_specular_brdf_srv_.ptr);
+			assert(hr == S_OK);
+		});
 }
 
-void shading_pass::perform(const gbuffer& gbuffer, const float4x4& pv_matrix,
+void shading_pass::perform(const gbuffer& gbuffer, const float4x4& pv_matrix, const float4x4& projection_matrix,
 	const material& material, const float3& camera_position)
 {
+	// the geometry & textures are still being loaded.
+	if (!p_vertex_buffer_ || !p_tex_diffuse_envmap_srv_ 
+		|| !p_tex_specular_envmap_srv_ || !p_tex_specular_brdf_srv_) return;
+
 	const float4x4 model_matrix = float4x4::identity;
 	const float4x4 normal_matrix = float4x4::identity;
 	const float4x4 pvm_matrix = pv_matrix * model_matrix;
@@ -115,7 +147,7 @@ void shading_pass::perform(const gbuffer& gbuffer, const float4x4& pv_matrix,
 	p_ctx_->IASetInputLayout(p_input_layout_);
 	p_ctx_->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	p_ctx_->IASetVertexBuffers(0, 1, &p_vertex_buffer_.ptr, &vertex_stride_, &offset);
-	p_ctx_->IASetIndexBuffer(p_index_buffer_, DXGI_FORMAT_R32_UINT, 0);
+	p_ctx_->IASetIndexBuffer(p_index_buffer_, index_dxgi_format_, 0);
 	// rasterizer & output merger
 	p_ctx_->RSSetState(gbuffer.p_rasterizer_state);
 	p_ctx_->OMSetDepthStencilState(p_depth_stencil_state_, 0);
@@ -141,7 +173,38 @@ void shading_pass::perform(const gbuffer& gbuffer, const float4x4& pv_matrix,
 	assert(hr == S_OK);
 #endif
 
-	p_ctx_->DrawIndexed(index_count_, 0, 0);
+	// the whole mesh is outside the frustum.
+	const frustum f = make_frustum(pvm_matrix);
+	if (cull_bounds(bounds_, f)) return;
+
+	// the distance to the mesh's bounding sphere, lod errors are measured in model space.
+	const float3 camera_ms = xyz(camera_position_ms);
+	const float distance = std::max(0.0f, len(camera_ms - bounds_.center) - bounds_.radius);
+	const size_t lod_index = select_lod(span<const mesh_lod>(lods_.data(), lods_.size()),
+		projection_matrix, distance, gbuffer.rnd_viewport.Height);
+	const mesh_lod& lod = lods_[lod_index];
+
+	if (lod.meshlet_count == 0) {
+		p_ctx_->DrawIndexed(lod.index_count, lod.first_index, 0);
+		return;
+	}
+
+	// skip the meshlets which are outside the frustum or face away from the camera,
+	// the adjacent visible meshlets are drawn by one call.
+	UINT first_index = 0;
+	UINT index_count = 0;
+	for (uint32_t i = lod.first_meshlet; i < lod.first_meshlet + lod.meshlet_count; ++i) {
+		const meshlet& m = meshlets_[i];
+		if (cull_meshlet(m, f, camera_ms)) continue;
+
+		if (first_index + index_count != m.first_index) {
+			if (index_count > 0) p_ctx_->DrawIndexed(index_count, first_index, 0);
+			first_index = m.first_index;
+			index_count = 0;
+		}
+		index_count += m.index_count;
+	}
+	if (index_count > 0) p_ctx_->DrawIndexed(index_count, first_index, 0);
 }
 
 // ----- skybox_pass -----
@@ -180,8 +243,8 @@ void skybox_pass::init_pipeline_state()
 
 void skybox_pass::init_skybox_texture()
 {
-	const texture_data td = load_from_tex_file("../../data/pisa_skybox.tex");
-	p_tex_skybox_ = make_texture_cube(p_device_, td, D3D11_USAGE_IMMUTABLE, D3D11_BIND_SHADER_RESOURCE);
+	const texture_view tv("../../data/pisa_skybox.tex");
+	p_tex_skybox_ = make_texture_cube(p_device_, tv, D3D11_USAGE_IMMUTABLE, D3D11_BIND_SHADER_RESOURCE);
 	HRESULT hr = p_device_->CreateShaderResourceView(p_tex_skybox_, nullptr, &p_tex_skybox_srv_.ptr);
 	assert(hr == S_OK);
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "sparki/core/asset_manager.h"
 #include "sparki/core/rnd_base.h"
 
 
@@ -9,13 +10,19 @@ namespace core {
 class shading_pass final {
 public:
 
-	shading_pass(ID3D11Device* p_device, ID3D11DeviceContext* p_ctx, ID3D11Debug* p_debug);
+	// The mesh which is drawn by the pass. Other files: plane.geo, suzanne.geo.
+	static constexpr const char* c_geometry_filename = "../../data/geometry/sphere.geo";
+
+	// Geometry & textures are requested from asset_manager, the pass is not drawn until they have been loaded.
+	shading_pass(ID3D11Device* p_device, ID3D11DeviceContext* p_ctx, ID3D11Debug* p_debug,
+		asset_manager& asset_manager);
 
 	shading_pass(shading_pass&&) = delete;
 	shading_pass& operator=(shading_pass&&) = delete;
 
 
-	void perform(const gbuffer& gbuffer, const float4x4& pv_matrix,
+	// projection_matrix is used to select the lod of the mesh.
+	void perform(const gbuffer& gbuffer, const float4x4& pv_matrix, const float4x4& projection_matrix,
 		const material& material, const float3& camera_position);
 
 private:
@@ -25,6 +32,12 @@ private:
 
 	void init_geometry();
 
+	// The buffers are initialized directly from the spans (usually mapped .geo file pages).
+	// index_data contains indices of the specified format. meshlets & lods may be empty.
+	void init_geometry_buffers(span<const vertex<vertex_attribs::p_n_uv_ts>> vertices,
+		span<const uint8_t> index_data, index_format index_fmt, span<const meshlet> meshlets,
+		span<const mesh_lod> lods, const mesh_bounds& bounds);
+
 	void init_pipeline_state();
 
 	void init_textures();
@@ -33,6 +46,7 @@ private:
 	ID3D11Device*						p_device_;
 	ID3D11DeviceContext*				p_ctx_;
 	ID3D11Debug*						p_debug_;
+	asset_manager&						asset_manager_;
 	hlsl_shader							shader_;
 	com_ptr<ID3D11DepthStencilState>	p_depth_stencil_state_;
 	com_ptr<ID3D11Buffer>				p_cb_vertex_shader_;
@@ -43,8 +57,14 @@ private:
 	com_ptr<ID3D11Texture2D>			p_tex_specular_brdf_;
 	com_ptr<ID3D11ShaderResourceView>	p_tex_specular_brdf_srv_;
 	// temporary
-	UINT								vertex_stride_;
-	UINT								index_count_;
+	UINT								vertex_stride_ = 0;
+	DXGI_FORMAT							index_dxgi_format_ = DXGI_FORMAT_R32_UINT;
+	// Culls the whole mesh & measures the distance for the lod selection.
+	mesh_bounds							bounds_ = {};
+	// Culled on the cpu each frame, the whole lod is drawn if it has no meshlets.
+	std::vector<meshlet>				meshlets_;
+	// Selected each frame by the projected error, a mesh without lods gets one which covers everything.
+	std::vector<mesh_lod>				lods_;
 	com_ptr<ID3D11InputLayout>			p_input_layout_;
 	com_ptr<ID3D11Buffer>				p_vertex_buffer_;
 	com_ptr<ID3D11Buffer>				p_index_buffer_;
@@ -1,9 +1,45 @@
 #include "sparki/core/rnd_tool.h"
 
 #include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include "sparki/core/asset_texture_tool.h"
+#include "sparki/core/utility.h"
 #include "ts/task_system.h"
 
 
+namespace {
+
+using namespace sparki::core;
+
+// Material textures are loaded with 4 channels. Image files are flipped vertically,
+// .tex files are expected to be flipped during the conversion.
+inline texture_request make_material_texture_request(const char* p_filename)
+{
+	assert(p_filename);
+	return texture_request(p_filename, 4, true);
+}
+
+// Creates an immutable texture & its srv. The previous objects (if any) are released.
+void make_material_texture(ID3D11Device* p_device, const texture_data& td,
+	com_ptr<ID3D11Texture2D>& p_tex, com_ptr<ID3D11ShaderResourceView>& p_tex_srv)
+{
+	assert(p_device);
+
+	com_ptr<ID3D11Texture2D> p_tex_new = make_texture_2d(p_device, td,
+		D3D11_USAGE_IMMUTABLE, D3D11_BIND_SHADER_RESOURCE);
+	com_ptr<ID3D11ShaderResourceView> p_tex_srv_new;
+	HRESULT hr = p_device->CreateShaderResourceView(p_tex_new, nullptr, &p_tex_srv_new.ptr);
+	assert(hr == S_OK);
+
+	p_tex = std::move(p_tex_new);
+	p_tex_srv = std::move(p_tex_srv_new);
+}
+
+} // namespace
+
+
 namespace sparki {
 namespace core {
 
@@ -91,19 +127,18 @@ envmap_texture_builder::envmap_texture_builder(ID3D11Device* p_device, ID3D11Dev
 com_ptr<ID3D11Texture2D> envmap_texture_builder::make_skybox(const char* p_hdr_filename)
 {
 	// equirect texture
-	const texture_data td = load_from_image_file(p_hdr_filename, 4);
+	const texture_data td = load_from_image_file(p_hdr_filename, 4, false, true);
 	com_ptr<ID3D11Texture2D> p_tex_equirect = make_texture_2d(p_device_, td, D3D11_USAGE_IMMUTABLE, D3D11_BIND_SHADER_RESOURCE);
 	com_ptr<ID3D11ShaderResourceView> p_tex_equirect_srv;
 	HRESULT hr = p_device_->CreateShaderResourceView(p_tex_equirect, nullptr, &p_tex_equirect_srv.ptr);
 	assert(hr == S_OK);
 
-	// skybox texture & uav
+	// skybox texture (mipmap #0 only) & uav
 	com_ptr<ID3D11Texture2D> p_tex_skybox = make_texture_cube(p_device_,
-		c_skybox_side_size, c_skybox_mipmap_count,
+		c_skybox_side_size, 1,
 		DXGI_FORMAT_R16G16B16A16_FLOAT,
 		D3D11_USAGE_DEFAULT, 
-		D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET | D3D11_BIND_UNORDERED_ACCESS,
-		D3D11_RESOURCE_MISC_GENERATE_MIPS);
+		D3D11_BIND_UNORDERED_ACCESS);
 	
 	D3D11_UNORDERED_ACCESS_VIEW_DESC uav_desc = {};
 	uav_desc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2DARRAY;
@@ -241,22 +276,34 @@ void envmap_texture_builder::perform(const char* p_hdr_filename, const char* p_s
 	assert(p_diffuse_envmap_filename);
 	assert(p_specular_envmap_filename);
 
-	// make skybox texture & save it to a file
-	com_ptr<ID3D11Texture2D> p_tex_skybox = make_skybox(p_hdr_filename);
-	save_skybox_to_file(p_skybox_filename, p_tex_skybox);
+	// make skybox texture, generate its mipmaps on the cpu & save it to a file.
+	// Cube faces are filtered across their edges which removes seams from the blurry mipmaps 
+	// that are sampled by the envmap convolution shaders.
+	com_ptr<ID3D11Texture2D> p_tex_skybox;
+	{
+		com_ptr<ID3D11Texture2D> p_tex_skybox_mip0 = make_skybox(p_hdr_filename);
+		const texture_data td_mip0 = make_texture_data(p_device_, p_ctx_, 
+			texture_type::texture_cube, p_tex_skybox_mip0);
+
+		mipmap_desc mip_desc;
+		mip_desc.filter = mipmap_filter::kaiser;
+		mip_desc.mipmap_count = c_skybox_mipmap_count;
+		const texture_data td = generate_mipmaps(td_mip0, mip_desc);
+
+		p_tex_skybox = make_texture_cube(p_device_, td, D3D11_USAGE_IMMUTABLE, D3D11_BIND_SHADER_RESOURCE);
+		save_to_tex_file(p_skybox_filename, compress_texture(td, pixel_format::bc6h_uf16));
+	}
 
-	// generate skybox mipmaps
 	com_ptr<ID3D11ShaderResourceView> p_tex_skybox_srv;
 	HRESULT hr = p_device_->CreateShaderResourceView(p_tex_skybox, nullptr, &p_tex_skybox_srv.ptr);
 	assert(hr == S_OK);
-	p_ctx_->GenerateMips(p_tex_skybox_srv);
 
 	// make diffuse envmap and save it to a file
 	{
 		com_ptr<ID3D11Texture2D> p_tex_diffuse_envmap = make_diffuse_envmap(p_tex_skybox_srv);
 		const texture_data td = make_texture_data(p_device_, p_ctx_,
 			texture_type::texture_cube, p_tex_diffuse_envmap);
-		save_to_tex_file(p_diffuse_envmap_filename, td);
+		save_to_tex_file(p_diffuse_envmap_filename, compress_texture(td, pixel_format::bc6h_uf16));
 	}
 	
 	// make specular envmap and save it to a file
@@ -264,35 +311,8 @@ void envmap_texture_builder::perform(const char* p_hdr_filename, const char* p_s
 		com_ptr<ID3D11Texture2D> p_tex_specular_envmap = make_specular_envmap(p_tex_skybox, p_tex_skybox_srv);
 		const texture_data td = make_texture_data(p_device_, p_ctx_, 
 			texture_type::texture_cube, p_tex_specular_envmap);
-		save_to_tex_file(p_specular_envmap_filename, td);
-	}
-}
-
-void envmap_texture_builder::save_skybox_to_file(const char* p_filename, ID3D11Texture2D* p_tex_skybox)
-{
-	assert(p_filename);
-	assert(p_tex_skybox);
-
-	// create skybox texture (single mip level) and 
-	D3D11_TEXTURE2D_DESC tmp_desc;
-	p_tex_skybox->GetDesc(&tmp_desc);
-	tmp_desc.MipLevels = 1;
-	tmp_desc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
-	com_ptr<ID3D11Texture2D> p_tex_skybox_tmp;
-	HRESULT hr = p_device_->CreateTexture2D(&tmp_desc, nullptr, &p_tex_skybox_tmp.ptr);
-	assert(hr == S_OK);
-
-	// copy mip #0 from &p_tex_skybox to p_tex_skybox_tmp
-	const D3D11_BOX box = { 0, 0, 0, tmp_desc.Width, tmp_desc.Height, 1 };
-	for (UINT a = 0; a < tmp_desc.ArraySize; ++a) {
-		const UINT index = D3D11CalcSubresource(0, a, c_skybox_mipmap_count);
-		p_ctx_->CopySubresourceRegion(p_tex_skybox_tmp, a, 0, 0, 0, p_tex_skybox, index, &box);
+		save_to_tex_file(p_specular_envmap_filename, compress_texture(td, pixel_format::bc6h_uf16));
 	}
-
-	// save p_tex_skybox_tmp to a file
-	const texture_data td = make_texture_data(p_device_, p_ctx_, 
-		texture_type::texture_cube, p_tex_skybox_tmp);
-	save_to_tex_file(p_filename, td);
 }
 
 // ----- material_properties_composer -----
@@ -465,8 +485,8 @@ void unique_color_miner::perform(ID3D11ShaderResourceView* p_tex_image_srv, cons
 const ubyte4 material_editor_tool::c_default_color	= ubyte4(0x7f, 0x7f, 0x7f, 0xff);
 
 material_editor_tool::material_editor_tool(ID3D11Device* p_device, ID3D11DeviceContext* p_ctx, 
-	ID3D11Debug* p_debug, ID3D11SamplerState* p_sampler_point)
-	: p_device_(p_device), p_ctx_(p_ctx), p_debug_(p_debug), 
+	ID3D11Debug* p_debug, ID3D11SamplerState* p_sampler_point, asset_manager& asset_manager)
+	: p_device_(p_device), p_ctx_(p_ctx), p_debug_(p_debug), asset_manager_(asset_manager),
 	color_miner_(p_device, p_ctx, p_debug),
 	properties_composer_(p_device, p_ctx, p_debug, p_sampler_point)
 {
@@ -581,65 +601,82 @@ void material_editor_tool::init_property_mask_textures()
 
 void material_editor_tool::reload_base_color_texture(const char* p_filename)
 {
-	assert(p_filename);
-
-	p_tex_base_color_texture_srv_.dispose();
-	p_tex_base_color_texture_.dispose();
-
-	const texture_data td = load_from_image_file(p_filename, 4, true);
-	p_tex_base_color_texture_ = make_texture_2d(p_device_, td, 
-		D3D11_USAGE_IMMUTABLE, D3D11_BIND_SHADER_RESOURCE);
-	HRESULT hr = p_device_->CreateShaderResourceView(p_tex_base_color_texture_, nullptr, 
-		&p_tex_base_color_texture_srv_.ptr);
-	assert(hr == S_OK);
+	// the current texture is used until the new one has been loaded.
+	base_color_texture_request_ = asset_manager_.load_texture(make_material_texture_request(p_filename),
+		asset_priority::high, [this](const texture_handle& h) {
+			if (h != base_color_texture_request_) return; // there is a more recent request.
+			base_color_texture_request_ = texture_handle();
+			ENFORCE(h.ready(), h.error_message());
+
+			make_material_texture(p_device_, h.get(), p_tex_base_color_texture_, p_tex_base_color_texture_srv_);
+		});
 }
 
 void material_editor_tool::reload_reflect_color_texture(const char* p_filename)
 {
-	assert(p_filename);
-
-	p_tex_reflect_color_texture_srv_.dispose();
-	p_tex_reflect_color_texture_.dispose();
-
-	const texture_data td = load_from_image_file(p_filename, 4, true);
-	p_tex_reflect_color_texture_ = make_texture_2d(p_device_, td,
-		D3D11_USAGE_IMMUTABLE, D3D11_BIND_SHADER_RESOURCE);
-	HRESULT hr = p_device_->CreateShaderResourceView(p_tex_reflect_color_texture_, nullptr,
-		&p_tex_reflect_color_texture_srv_.ptr);
-	assert(hr == S_OK);
+	// the current texture is used until the new one has been loaded.
+	reflect_color_texture_request_ = asset_manager_.load_texture(make_material_texture_request(p_filename),
+		asset_priority::high, [this](const texture_handle& h) {
+			if (h != reflect_color_texture_request_) return; // there is a more recent request.
+			reflect_color_texture_request_ = texture_handle();
+			ENFORCE(h.ready(), h.error_message());
+
+			make_material_texture(p_device_, h.get(), p_tex_reflect_color_texture_, p_tex_reflect_color_texture_srv_);
+		});
 }
 
 void material_editor_tool::reload_normal_map_texture(const char* p_filename)
 {
-	assert(p_filename);
-
-	p_tex_normal_map_srv_.dispose();
-	p_tex_normal_map_.dispose();
-
-	const texture_data td = load_from_image_file(p_filename, 4, true);
-	p_tex_normal_map_ = make_texture_2d(p_device_, td,
-		D3D11_USAGE_IMMUTABLE, D3D11_BIND_SHADER_RESOURCE);
-	HRESULT hr = p_device_->CreateShaderResourceView(p_tex_normal_map_, nullptr, &p_tex_normal_map_srv_.ptr);
-	assert(hr == S_OK);
-
-	material_.p_tex_normal_map_srv = p_tex_normal_map_srv_;
+	// the current texture is used until the new one has been loaded.
+	normal_map_request_ = asset_manager_.load_texture(make_material_texture_request(p_filename),
+		asset_priority::high, [this](const texture_handle& h) {
+			if (h != normal_map_request_) return; // there is a more recent request or the normal map has been reset.
+			normal_map_request_ = texture_handle();
+			ENFORCE(h.ready(), h.error_message());
+
+			make_material_texture(p_device_, h.get(), p_tex_normal_map_, p_tex_normal_map_srv_);
+			material_.p_tex_normal_map_srv = p_tex_normal_map_srv_;
+		});
 }
 
 void material_editor_tool::reload_property_mask_texture(const char* p_filename)
 {
-	assert(p_filename);
+	// the current textures are used until the new mask has been loaded.
+	property_mask_request_ = asset_manager_.load_texture(make_material_texture_request(p_filename),
+		asset_priority::high, [this](const texture_handle& h) {
+			if (h != property_mask_request_) return; // there is a more recent request or the mask has been reset.
+			property_mask_request_ = texture_handle();
+			ENFORCE(h.ready(), h.error_message());
+			on_property_mask_loaded(h.get());
+		});
+}
 
-	p_tex_property_mask_srv_.dispose();
-	p_tex_property_mask_.dispose();
+void material_editor_tool::on_property_mask_loaded(const texture_data& td)
+{
+	ENFORCE(!is_block_compressed(td.format), "Property mask texture must not be block compressed.");
+
+	p_tex_properties_texture_uav_.dispose();
 	p_tex_properties_texture_srv_.dispose();
 	p_tex_properties_texture_.dispose();
-
-	const texture_data td = load_from_image_file(p_filename, 4, true);
-	p_tex_property_mask_ = make_texture_2d(p_device_, td, D3D11_USAGE_IMMUTABLE, D3D11_BIND_SHADER_RESOURCE);
-	HRESULT hr = p_device_->CreateShaderResourceView(p_tex_property_mask_, nullptr, &p_tex_property_mask_srv_.ptr);
-	assert(hr == S_OK);
+	make_material_texture(p_device_, td, p_tex_property_mask_, p_tex_property_mask_srv_);
 
 	color_miner_.perform(p_tex_property_mask_srv_, xy(td.size), property_colors_);
+	selected_property_index_ = c_no_property;
+
+	// the top mipmap is the first one in the buffer.
+	property_mask_texels_.clear();
+	property_mask_size_ = uint2::zero;
+	if (td.format == pixel_format::rgba_8) {
+		const size_t texel_count = size_t(td.size.x) * td.size.y;
+		const uint8_t* p_texel = td.buffer.data();
+		property_mask_texels_.resize(texel_count);
+		for (size_t i = 0; i < texel_count; ++i, p_texel += 4) {
+			property_mask_texels_[i] = (uint32_t(p_texel[0]) << 24) | (uint32_t(p_texel[1]) << 16)
+				| (uint32_t(p_texel[2]) << 8) | 0xff;
+		}
+
+		property_mask_size_ = xy(td.size);
+	}
 
 	D3D11_TEXTURE2D_DESC tex_desc = {};
 	tex_desc.Width				= UINT(td.size.x);
@@ -651,16 +688,20 @@ void material_editor_tool::reload_property_mask_texture(const char* p_filename)
 	tex_desc.SampleDesc.Quality = 0;
 	tex_desc.Usage				= D3D11_USAGE_DEFAULT;
 	tex_desc.BindFlags			= D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
-	hr = p_device_->CreateTexture2D(&tex_desc, nullptr, &p_tex_properties_texture_.ptr);
+	HRESULT hr = p_device_->CreateTexture2D(&tex_desc, nullptr, &p_tex_properties_texture_.ptr);
 	assert(hr == S_OK);
 	hr = p_device_->CreateShaderResourceView(p_tex_properties_texture_, nullptr, &p_tex_properties_texture_srv_.ptr);
 	assert(hr == S_OK);
 	hr = p_device_->CreateUnorderedAccessView(p_tex_properties_texture_, nullptr, &p_tex_properties_texture_uav_.ptr);
 	assert(hr == S_OK);
+
+	activate_properties_texture();
+	update_properties_texture();
 }
 
 void material_editor_tool::reset_normal_map_texture()
 {
+	normal_map_request_ = texture_handle();
 	p_tex_normal_map_srv_.dispose();
 	p_tex_normal_map_.dispose();
 
@@ -690,9 +731,13 @@ void material_editor_tool::reset_normal_map_texture()
 
 void material_editor_tool::reset_property_mask_texture()
 {
+	property_mask_request_ = texture_handle();
 	p_tex_property_mask_srv_.dispose();
 	p_tex_property_mask_.dispose();
 	property_colors_.clear();
+	property_mask_texels_.clear();
+	property_mask_size_ = uint2::zero;
+	selected_property_index_ = c_no_property;
 
 	D3D11_TEXTURE2D_DESC tex_desc = {};
 	tex_desc.Width				= 1;
@@ -715,6 +760,37 @@ void material_editor_tool::reset_property_mask_texture()
 	assert(hr == S_OK);
 }
 
+bool material_editor_tool::select_property(const float2& uv)
+{
+	selected_property_index_ = c_no_property;
+	if (property_mask_texels_.empty() || property_colors_.empty()) return false;
+
+	// point sampling with wrap addressing, like the shaders do.
+	const float u = uv.x - std::floor(uv.x);
+	const float v = uv.y - std::floor(uv.y);
+	const uint32_t x = std::min(property_mask_size_.x - 1, uint32_t(u * property_mask_size_.x));
+	const uint32_t y = std::min(property_mask_size_.y - 1, uint32_t(v * property_mask_size_.y));
+	const uint32_t texel = property_mask_texels_[size_t(y) * property_mask_size_.x + x];
+
+	// the miner converts unorm values back into bytes on the gpu, a channel may differ by 1.
+	uint32_t best_diff = 2;
+	for (size_t i = 0; i < property_colors_.size(); ++i) {
+		uint32_t diff = 0;
+		for (uint32_t shift = 8; shift <= 24; shift += 8) {
+			const int c0 = int((texel >> shift) & 0xff);
+			const int c1 = int((property_colors_[i] >> shift) & 0xff);
+			diff = std::max(diff, uint32_t(std::abs(c0 - c1)));
+		}
+
+		if (diff < best_diff) {
+			best_diff = diff;
+			selected_property_index_ = i;
+		}
+	}
+
+	return selected_property_index_ != c_no_property;
+}
+
 void material_editor_tool::update_base_color_color(const ubyte4& rgba)
 {
 	p_ctx_->UpdateSubresource(p_tex_base_color_color_, 0, nullptr,
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <limits>
+#include "sparki/core/asset_manager.h"
 #include "sparki/core/rnd_base.h"
 
 
@@ -71,8 +73,6 @@ private:
 	com_ptr<ID3D11Texture2D> make_specular_envmap(ID3D11Texture2D* p_tex_skybox, 
 		ID3D11ShaderResourceView* p_tex_skybox_srv);
 
-	void save_skybox_to_file(const char* p_filename, ID3D11Texture2D* p_tex_skybox);
-
 
 	ID3D11Device*				p_device_;
 	ID3D11DeviceContext*		p_ctx_;
@@ -156,10 +156,12 @@ public:
 
 	// default base or reflect color value
 	static const ubyte4		c_default_color;
+	// selected_property_index() if no property is selected.
+	static constexpr size_t	c_no_property = std::numeric_limits<size_t>::max();
 
 
 	material_editor_tool(ID3D11Device* p_device, ID3D11DeviceContext* p_ctx, 
-		ID3D11Debug* p_debug, ID3D11SamplerState* p_sampler_point);
+		ID3D11Debug* p_debug, ID3D11SamplerState* p_sampler_point, asset_manager& asset_manager);
 
 	material_editor_tool(material_editor_tool&&) = delete;
 	material_editor_tool& operator=(material_editor_tool&&) = delete;
@@ -185,6 +187,12 @@ public:
 		return property_values_;
 	}
 
+	// The index of the property which has been picked by select_property, c_no_property if none.
+	size_t selected_property_index() const noexcept
+	{
+		return selected_property_index_;
+	}
+
 	ID3D11ShaderResourceView* p_tex_base_color_color_srv() noexcept
 	{
 		return p_tex_base_color_color_srv_;
@@ -246,18 +254,26 @@ public:
 		material_.p_tex_properties_srv = p_tex_properties_texture_srv_;
 	}
 
+	// The reload_* methods request the texture from the asset manager and return immediately.
+	// The current texture stays in use until the new one has been loaded.
 	void reload_base_color_texture(const char* p_filename);
 
 	void reload_reflect_color_texture(const char* p_filename);
 
 	void reload_normal_map_texture(const char* p_filename);
 
+	// Also mines the mask's colors, activates & updates the properties texture once the mask has been loaded.
 	void reload_property_mask_texture(const char* p_filename);
 
 	void reset_normal_map_texture();
 
 	void reset_property_mask_texture();
 
+	// Selects the property whose color the property mask has at the specified texture coordinates
+	// (point sampling, wrap addressing). Returns false and clears the selection
+	// if the mask has not been loaded or the texel's color is not one of property_colors().
+	bool select_property(const float2& uv);
+
 	void update_base_color_color(const ubyte4& rgba);
 
 	void update_reflect_color_color(const ubyte4& rgba);
@@ -279,10 +295,13 @@ private:
 
 	void init_property_mask_textures();
 
+	void on_property_mask_loaded(const texture_data& td);
+
 
 	ID3D11Device*					p_device_;
 	ID3D11DeviceContext*			p_ctx_;
 	ID3D11Debug*					p_debug_;
+	asset_manager&					asset_manager_;
 	unique_color_miner				color_miner_;
 	material_properties_composer	properties_composer_;
 	// current material stuff ---
@@ -310,6 +329,15 @@ private:
 	com_ptr<ID3D11UnorderedAccessView>	p_tex_properties_texture_uav_;
 	std::vector<uint32_t>				property_colors_;
 	std::vector<float2>					property_values_;
+	// A copy of the mask's top mipmap for the cpu picking, texels are packed like property_colors_.
+	std::vector<uint32_t>				property_mask_texels_;
+	uint2								property_mask_size_;
+	size_t								selected_property_index_ = c_no_property;
+	// pending texture requests ---
+	texture_handle						base_color_texture_request_;
+	texture_handle						reflect_color_texture_request_;
+	texture_handle						normal_map_request_;
+	texture_handle						property_mask_request_;
 };
 
 } // namespace core
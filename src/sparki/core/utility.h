@@ -11,6 +11,8 @@
 	#define SPARKI_RELEASE 1
 #endif // !defined(NDEBUG)
 
+#include <cassert>
+
 #define EXCEPTION_MSG(...) sparki::core::concat(__FILE__, '(', __LINE__, "): ", __VA_ARGS__)
 
 #define ENFORCE(expression, ...)								\
@@ -36,6 +38,64 @@ void concat_impl(std::ostringstream& string_stream, const T& obj, const Args&...
 } // namespace intrinsic
 
 
+// span is a non-owning view over a contiguous sequence of objects.
+template<typename T>
+class span final {
+public:
+
+	using value_type = T;
+
+
+	span() noexcept = default;
+
+	span(T* p_data, size_t size) noexcept
+		: p_data_(p_data), size_(size)
+	{}
+
+	template<typename U>
+	span(const span<U>& s) noexcept
+		: p_data_(s.data()), size_(s.size())
+	{}
+
+
+	T& operator[](size_t index) const noexcept
+	{
+		assert(index < size_);
+		return p_data_[index];
+	}
+
+	T* begin() const noexcept
+	{
+		return p_data_;
+	}
+
+	T* end() const noexcept
+	{
+		return p_data_ + size_;
+	}
+
+	T* data() const noexcept
+	{
+		return p_data_;
+	}
+
+	bool empty() const noexcept
+	{
+		return (size_ == 0);
+	}
+
+	size_t size() const noexcept
+	{
+		return size_;
+	}
+
+private:
+
+	T*		p_data_ = nullptr;
+	size_t	size_ = 0;
+};
+
+
 // Returns the number of bytes occupied by elements of container.
 // Take into account that container by itself may occupy more space.
 template<typename Container>
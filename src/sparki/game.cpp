@@ -1,6 +1,7 @@
 #include "sparki/game.h"
 
 #include <cassert>
+#include <algorithm>
 
 
 namespace sparki {
@@ -11,10 +12,17 @@ game_system::game_system(HWND p_hwnd, const uint2& viewport_size, const core::in
 	:input_state_(input_state),
 	render_system_(p_hwnd, viewport_size),
 	viewport_is_visible_(true),
-	camera_(float3::unit_z, float3::zero)
+	camera_(float3::unit_z, float3::zero),
+	viewport_size_(viewport_size)
 {
 	p_material_editor_view_ = std::make_unique<material_editor_view>(p_hwnd, render_system_.material_editor_tool());
 
+	render_system_.asset_manager().load_mesh(core::shading_pass::c_geometry_filename, core::asset_priority::normal,
+		[this](const core::mesh_handle& h) {
+			ENFORCE(h.ready(), h.error_message());
+			init_picking(h);
+		});
+
 	frame_.projection_matrix = math::perspective_matrix_directx(
 		game_system::projection_fov, aspect_ratio(viewport_size),
 		game_system::projection_near, game_system::projection_far);
@@ -25,6 +33,9 @@ void game_system::draw_frame(float interpolation_factor)
 	assert(0.0f <= interpolation_factor && interpolation_factor <= 1.0f);
 	if (!viewport_is_visible_) return;
 
+	// loaded assets replace the current resources before anyone takes a reference to them.
+	render_system_.asset_manager().dispatch_completed();
+
 	ImGui::NewFrame();
 	p_material_editor_view_->show();
 
@@ -73,6 +84,27 @@ void game_system::update()
 	camera_.roll_angles = float2::zero;
 }
 
+void game_system::init_picking(const core::mesh_handle& h)
+{
+	const core::mapped_geo_file& file = h.get();
+	const size_t first_index = file.lods().empty() ? 0 : file.lods()[0].first_index;
+	const size_t index_count = file.lods().empty() ? file.index_count() : file.lods()[0].index_count;
+
+	pick_indices_.resize(index_count);
+	if (file.index_fmt() == core::index_format::uint16) {
+		const uint16_t* p_indices = reinterpret_cast<const uint16_t*>(file.index_data().data()) + first_index;
+		std::copy(p_indices, p_indices + index_count, pick_indices_.begin());
+	}
+	else {
+		const uint32_t* p_indices = reinterpret_cast<const uint32_t*>(file.index_data().data()) + first_index;
+		std::copy(p_indices, p_indices + index_count, pick_indices_.begin());
+	}
+
+	const core::span<const uint32_t> indices(pick_indices_.data(), pick_indices_.size());
+	pick_bvh_ = core::mesh_bvh(file.vertices(), indices);
+	pick_mesh_ = h;
+}
+
 void game_system::on_keypress(core::key, core::key_state)
 {
 
@@ -80,6 +112,30 @@ void game_system::on_keypress(core::key, core::key_state)
 
 void game_system::on_mouse_click()
 {
+	if (!is_mouse_left_down(input_state_) || input_state_.mouse_is_out) return;
+	if (ImGui::GetIO().WantCaptureMouse) return; // the click belongs to the ui.
+	if (pick_bvh_.empty()) return;
+
+	// the mouse position is relative to the bottom-left corner, ndc's y goes up as well.
+	const float2 ndc(
+		2.0f * (float(input_state_.mouse_position.x) + 0.5f) / float(viewport_size_.x) - 1.0f,
+		2.0f * (float(input_state_.mouse_position.y) + 0.5f) / float(viewport_size_.y) - 1.0f);
+
+	// the mesh is drawn with the identity model matrix, so the ray is in the model space.
+	// It spans the frustum from the near to the far plane when t goes from 0 to 1.
+	const float4x4 view_matrix = math::view_matrix(camera_.position, camera_.target, camera_.up);
+	const core::ray r = core::make_picking_ray(ndc, inverse(frame_.projection_matrix * view_matrix));
+
+	core::ray_hit hit;
+	if (!pick_bvh_.raycast(r, 1.0f, hit)) return;
+
+	const core::span<const core::mapped_geo_file::vertex_t> vertices = pick_mesh_.get().vertices();
+	const uint32_t* p_triangle = pick_indices_.data() + 3 * size_t(hit.triangle_index);
+	const float2 uv = (1.0f - hit.u - hit.v) * vertices[p_triangle[0]].uv
+		+ hit.u * vertices[p_triangle[1]].uv
+		+ hit.v * vertices[p_triangle[2]].uv;
+
+	render_system_.material_editor_tool().select_property(uv);
 }
 
 void game_system::on_mouse_move()
@@ -111,6 +167,7 @@ void game_system::on_resize_viewport(const uint2& size)
 	ImGui::GetIO().DisplaySize = ImVec2(float(size.x), float(size.y));
 
 	viewport_is_visible_ = true;
+	viewport_size_ = size;
 	frame_.projection_matrix = math::perspective_matrix_directx(game_system::projection_fov, 
 		aspect_ratio(size), game_system::projection_near, game_system::projection_far);
 	render_system_.resize_viewport(size);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+#include "sparki/core/mesh_bvh.h"
 #include "sparki/core/platform_input.h"
 #include "sparki/core/rnd.h"
 #include "sparki/core/rnd_imgui.h"
@@ -63,6 +65,10 @@ private:
 	static constexpr float projection_far = 1000.0f;
 
 
+	// Builds the bvh of the mesh which is drawn by the shading pass, clicks pick its triangles.
+	void init_picking(const core::mesh_handle& h);
+
+
 	// __game context__
 	const core::input_state&	input_state_;
 	core::render_system			render_system_;
@@ -72,6 +78,13 @@ private:
 	// __game state__
 	camera						camera_;
 	core::frame					frame_;
+	uint2						viewport_size_;
+	// __picking__
+	// The mesh keeps the vertices mapped, their uvs are interpolated at the picked point.
+	core::mesh_handle			pick_mesh_;
+	// lod 0 indices of pick_mesh_, ray_hit::triangle_index refers to them.
+	std::vector<uint32_t>		pick_indices_;
+	core::mesh_bvh				pick_bvh_;
 };
 
 } // namespace sparki
@@ -46,8 +46,6 @@ int main()
 	};
 
 	try {
-		//sparki::convert_fbx_to_geo("../../data/geometry/sphere.fbx", "../../data/geometry/sphere.geo");
-
 		auto report = ts::launch_task_system(ts_desc, sparki_main);
 
 		std::cout << "----- Task System Report ----- " << std::endl
@@ -64,7 +64,7 @@ bool show_open_file_dialog(HWND p_hwnd, std::string& filename)
 	ofn.lStructSize = sizeof(OPENFILENAME);
 	ofn.hwndOwner = p_hwnd;
 	ofn.hInstance = GetModuleHandle(nullptr);
-	ofn.lpstrFilter = "Image Files\0*.jpg;*.png;*.tga;\0\0";
+	ofn.lpstrFilter = "Image Files\0*.jpg;*.png;*.tga;*.tex;\0\0";
 	ofn.lpstrCustomFilter = nullptr;
 	ofn.nMaxCustFilter = 0;
 	ofn.nFilterIndex = 1;
@@ -228,13 +228,9 @@ void material_editor_view::show_normal_map_ui()
 
 void material_editor_view::show_material_properties_ui()
 {
-	bool update_properties_texture = false;
 	if (ImGui::ImageButton(met_.p_tex_property_mask_srv(), ImVec2(64, 64), ImVec2(0, 0), ImVec2(1, 1), 0)) {
-		if (show_open_file_dialog(p_hwnd_, property_mask_texture_filename_)) {
+		if (show_open_file_dialog(p_hwnd_, property_mask_texture_filename_))
 			met_.reload_property_mask_texture(property_mask_texture_filename_.c_str());
-			met_.activate_properties_texture();
-			update_properties_texture = true;
-		}
 	}
 
 	ImGui::SameLine();
@@ -258,11 +254,15 @@ void material_editor_view::show_material_properties_ui()
 		}
 	} 
 	else {
-		bool upd = update_properties_texture;
+		bool upd = false;
 		for (size_t i = 0; i < met_.property_count(); ++i) {
 			const ImVec4 c = make_color_imvec4(met_.property_colors()[i]);
 			float2& props = met_.property_values()[i];
 
+			// the property which has been picked on the model.
+			const bool selected = (i == met_.selected_property_index());
+			if (selected) ImGui::PushStyleColor(ImGuiCol_FrameBg, ImVec4(0.2f, 0.85f, 0.2f, 0.5f));
+
 			ImGui::ColorButton("", c, ImGuiColorEditFlags_NoInputs | ImGuiColorEditFlags_NoLabel);
 			ImGui::SameLine();
 			bool check = props.x;
@@ -272,6 +272,8 @@ void material_editor_view::show_material_properties_ui()
 			}
 			ImGui::SameLine();
 			upd |= ImGui::SliderFloat(property_mapping_widget_names[i * 2 + 1], &props.y, 0.0f, 1.0f);
+
+			if (selected) ImGui::PopStyleColor();
 		}
 
 		if (upd)
@@ -0,0 +1,497 @@
+#include "sparki_assetc/asset_compiler.h"
+
+#include <cassert>
+#include <cctype>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include "sparki/core/asset_geometry_import.h"
+#include "sparki/core/asset_geometry_tool.h"
+#include "sparki/core/asset_texture_tool.h"
+#include "sparki/core/hash.h"
+#include "sparki/core/parallel.h"
+#include "sparki/core/platform_file.h"
+#include "sparki/core/utility.h"
+
+#pragma warning(disable:4996) // C4996 'fopen': This function or variable may be unsafe.
+
+
+namespace {
+
+using namespace sparki::assetc;
+using namespace sparki::core;
+
+enum class job_status : unsigned char {
+	pending,
+	skipped,
+	built,
+	failed
+};
+
+struct job_state final {
+	job_status	status = job_status::pending;
+	uint64_t	input_hash = 0;
+	uint64_t	settings_hash = 0;
+	std::string	note;
+	std::string	error_message;
+};
+
+// Bump the version to rebuild all the outputs after a change of the converters.
+constexpr const char* c_assetc_version = "assetc 8";
+
+// Side size & sample count of specular_brdf.tex, see brdf_integrator.
+constexpr uint32_t c_specular_brdf_side_size = 512;
+constexpr uint32_t c_specular_brdf_sample_count = 1024;
+
+// Vertices are welded only if their attributes are bitwise equal.
+constexpr float c_weld_epsilon = 0.0f;
+
+// .geo files are stored raw, so that mapped_geo_file reads the vertices & indices in place.
+// Compression is opted in per asset: sources whose names contain the tag are stored compressed
+// (mapped_geo_file decodes them on load).
+constexpr const char* c_compressed_geo_tag = "_compressed";
+
+// Equirectangular .hdr images whose names end with the suffix are baked into envmaps
+// (see make_skybox_job & make_envmaps_job).
+constexpr const char* c_envmap_suffix = "_envmap.hdr";
+
+// The fbx sdk is not guaranteed to be thread-safe, fbx files are converted one by one.
+std::mutex g_fbx_mutex;
+
+
+bool ends_with(const std::string& str, const char* p_suffix)
+{
+	const size_t len = std::strlen(p_suffix);
+	return (str.size() >= len) && (str.compare(str.size() - len, len, p_suffix) == 0);
+}
+
+std::string to_lower(std::string str)
+{
+	for (char& c : str) c = char(std::tolower(static_cast<unsigned char>(c)));
+	return str;
+}
+
+std::string replace_extension(const std::string& filename, const char* p_extension)
+{
+	const size_t pos = filename.find_last_of('.');
+	return filename.substr(0, pos) + p_extension;
+}
+
+uint64_t hash_string(const std::string& str) noexcept
+{
+	return hash_bytes(str.data(), str.size());
+}
+
+geo_encoding get_geo_encoding(const std::string& filename)
+{
+	return (to_lower(filename).find(c_compressed_geo_tag) != std::string::npos)
+		? geo_encoding::compressed
+		: geo_encoding::raw;
+}
+
+asset_job make_image_job(const std::string& filename)
+{
+	// material textures follow the naming of the material editor:
+	// normal maps keep two channels, the property mask is an exact color palette (no filtering, no compression).
+	pixel_format fmt = pixel_format::bc7;
+	mipmap_desc desc = { mipmap_filter::kaiser, 0, true };
+
+	const std::string name = to_lower(filename);
+	if (name.find("normal_map") != std::string::npos) {
+		fmt = pixel_format::bc5;
+		desc = { mipmap_filter::box, 0, false };
+	}
+	else if (name.find("property_mask") != std::string::npos) {
+		fmt = pixel_format::rgba_8;
+		desc = { mipmap_filter::box, 1, false };
+	}
+
+	asset_job job;
+	job.output_filename = replace_extension(filename, ".tex");
+	job.input_filenames.push_back(filename);
+	job.settings = concat("image_to_tex format:", int(fmt), " filter:", int(desc.filter),
+		" mipmap_count:", desc.mipmap_count, " srgb:", desc.srgb, " flip:1");
+	job.build = [fmt, desc](const std::string& output_path, const std::vector<std::string>& input_paths) {
+		convert_image_to_tex(input_paths[0].c_str(), output_path.c_str(), fmt, desc, true);
+		return std::string();
+	};
+
+	return job;
+}
+
+asset_job make_hdr_job(const std::string& filename)
+{
+	const mipmap_desc desc = { mipmap_filter::box, 0, false };
+
+	asset_job job;
+	job.output_filename = replace_extension(filename, ".tex");
+	job.input_filenames.push_back(filename);
+	job.settings = concat("image_to_tex format:", int(pixel_format::bc6h_uf16), " filter:", int(desc.filter),
+		" mipmap_count:", desc.mipmap_count, " flip:0");
+	job.build = [desc](const std::string& output_path, const std::vector<std::string>& input_paths) {
+		convert_image_to_tex(input_paths[0].c_str(), output_path.c_str(), pixel_format::bc6h_uf16, desc, false);
+		return std::string();
+	};
+
+	return job;
+}
+
+std::string envmap_name(const std::string& filename)
+{
+	return filename.substr(0, filename.size() - std::strlen(c_envmap_suffix));
+}
+
+// The rgba_16f skybox which the envmaps are baked from, an intermediate file of the build directory.
+std::string skybox_source_filename(const std::string& filename)
+{
+	return concat(asset_compiler::c_build_dirname, '/', envmap_name(filename), "_skybox.tex");
+}
+
+// The skybox is baked on the cpu (see convert_hdr_to_skybox).
+asset_job make_skybox_job(const std::string& filename)
+{
+	const envmap_desc desc;
+
+	asset_job job;
+	job.output_filename = envmap_name(filename) + "_skybox.tex";
+	job.extra_output_filenames.push_back(skybox_source_filename(filename));
+	job.input_filenames.push_back(filename);
+	job.settings = concat("hdr_to_skybox format:", int(pixel_format::bc6h_uf16),
+		" skybox:", desc.skybox_side_size, ",", desc.skybox_mipmap_count);
+	job.build = [desc, output_filename = job.output_filename, source_filename = job.extra_output_filenames[0]]
+		(const std::string& output_path, const std::vector<std::string>& input_paths) {
+		// output_path is the data directory + output_filename.
+		const std::string dirname = output_path.substr(0, output_path.size() - output_filename.size());
+		convert_hdr_to_skybox(input_paths[0].c_str(), output_path.c_str(), (dirname + source_filename).c_str(), desc);
+		return std::string();
+	};
+
+	return job;
+}
+
+// The diffuse & specular envmaps are baked on the cpu from the output of the skybox job
+// (see convert_skybox_to_envmaps), the job is skipped if the rebuilt skybox has not changed.
+asset_job make_envmaps_job(const std::string& filename, size_t skybox_job_index)
+{
+	const envmap_desc desc;
+	const std::string name = envmap_name(filename);
+
+	asset_job job;
+	job.output_filename = name + "_diffuse_envmap.tex";
+	job.extra_output_filenames.push_back(name + "_specular_envmap.tex");
+	job.input_filenames.push_back(skybox_source_filename(filename));
+	job.dependencies.push_back(skybox_job_index);
+	job.settings = concat("skybox_to_envmaps format:", int(pixel_format::bc6h_uf16),
+		" diffuse:", desc.diffuse_envmap_side_size,
+		" specular:", desc.specular_envmap_side_size, ",", desc.specular_envmap_mipmap_count);
+	job.build = [desc, output_filename = job.output_filename, extra_filename = job.extra_output_filenames[0]]
+		(const std::string& output_path, const std::vector<std::string>& input_paths) {
+		// output_path is the data directory + output_filename, the specular envmap is next to it.
+		const std::string dirname = output_path.substr(0, output_path.size() - output_filename.size());
+		convert_skybox_to_envmaps(input_paths[0].c_str(), output_path.c_str(), (dirname + extra_filename).c_str(), desc);
+		return std::string();
+	};
+
+	return job;
+}
+
+asset_job make_fbx_job(const std::string& filename)
+{
+	const lod_chain_desc lod_desc;
+	const geo_encoding encoding = get_geo_encoding(filename);
+	std::string lod_ratios;
+	for (float r : lod_desc.ratios) lod_ratios += concat(r, ',');
+
+	asset_job job;
+	job.output_filename = replace_extension(filename, ".geo");
+	job.input_filenames.push_back(filename);
+	job.settings = concat("fbx_to_geo weld_epsilon:", c_weld_epsilon, " optimize:1 meshlets:1",
+		" encoding:", int(encoding),
+		" lod_ratios:", lod_ratios, " lod_max_error:", lod_desc.max_error);
+	job.build = [lod_desc, encoding](const std::string& output_path, const std::vector<std::string>& input_paths) {
+		std::lock_guard<std::mutex> lock(g_fbx_mutex);
+		const mesh_optimization_report r = convert_fbx_to_geo(input_paths[0].c_str(), output_path.c_str(),
+			{ c_weld_epsilon }, lod_desc, encoding);
+
+		return concat("acmr ", r.before.acmr, " -> ", r.after.acmr, ", atvr ", r.before.atvr, " -> ", r.after.atvr);
+	};
+
+	return job;
+}
+
+// load_scene is load_scene_from_obj_file or load_scene_from_gltf_file, both are thread-safe.
+// input_filenames[0] is the scene file, the others (gltf buffers) are hashed only.
+asset_job make_scene_job(const std::string& filename, std::vector<std::string> dependency_filenames,
+	const char* p_settings_name, scene_geometry (*load_scene)(const char*))
+{
+	const lod_chain_desc lod_desc;
+	const geo_encoding encoding = get_geo_encoding(filename);
+	std::string lod_ratios;
+	for (float r : lod_desc.ratios) lod_ratios += concat(r, ',');
+
+	asset_job job;
+	job.output_filename = replace_extension(filename, ".geo");
+	job.input_filenames.push_back(filename);
+	job.input_filenames.insert(job.input_filenames.end(), dependency_filenames.begin(), dependency_filenames.end());
+	job.settings = concat(p_settings_name, " weld_epsilon:", c_weld_epsilon, " optimize:1 meshlets:1",
+		" encoding:", int(encoding),
+		" lod_ratios:", lod_ratios, " lod_max_error:", lod_desc.max_error);
+	job.build = [lod_desc, encoding, load_scene]
+		(const std::string& output_path, const std::vector<std::string>& input_paths) {
+		const mesh_optimization_report r = convert_scene_to_geo(load_scene(input_paths[0].c_str()),
+			output_path.c_str(), { c_weld_epsilon }, lod_desc, encoding);
+
+		return concat("acmr ", r.before.acmr, " -> ", r.after.acmr, ", atvr ", r.before.atvr, " -> ", r.after.atvr);
+	};
+
+	return job;
+}
+
+// The bake goes into the build directory, data/specular_brdf.tex is the checked-in gpu result
+// which the renderer loads.
+asset_job make_specular_brdf_job()
+{
+	asset_job job;
+	job.output_filename = concat(asset_compiler::c_build_dirname, "/specular_brdf.tex");
+	job.settings = concat("specular_brdf side_size:", c_specular_brdf_side_size,
+		" sample_count:", c_specular_brdf_sample_count);
+	job.build = [](const std::string& output_path, const std::vector<std::string>&) {
+		const texture_data td = bake_specular_brdf(c_specular_brdf_side_size, c_specular_brdf_sample_count);
+		save_to_tex_file(output_path.c_str(), td);
+		return std::string();
+	};
+
+	return job;
+}
+
+} // namespace
+
+
+namespace sparki {
+namespace assetc {
+
+// ----- asset_compiler -----
+
+asset_compiler::asset_compiler(std::string data_dirname)
+	: data_dirname_(std::move(data_dirname))
+{
+	assert(!data_dirname_.empty());
+	load_manifest();
+}
+
+size_t asset_compiler::add_job(asset_job job)
+{
+	assert(!job.output_filename.empty());
+	assert(job.build);
+	assert(std::all_of(job.dependencies.cbegin(), job.dependencies.cend(),
+		[this](size_t d) { return d < jobs_.size(); }));
+
+	jobs_.push_back(std::move(job));
+	return jobs_.size() - 1;
+}
+
+void asset_compiler::add_data_directory_jobs()
+{
+	const std::vector<std::string> filenames = list_files(data_dirname_.c_str());
+	const std::string build_prefix = concat(c_build_dirname, '/');
+
+	for (const std::string& filename : filenames) {
+		if (filename.compare(0, build_prefix.size(), build_prefix) == 0) continue;
+
+		const std::string name = to_lower(filename);
+
+		if (ends_with(name, ".png") || ends_with(name, ".jpg") || ends_with(name, ".tga"))
+			add_job(make_image_job(filename));
+		else if (ends_with(name, c_envmap_suffix)) {
+			const size_t skybox_job_index = add_job(make_skybox_job(filename));
+			add_job(make_envmaps_job(filename, skybox_job_index));
+		}
+		else if (ends_with(name, ".hdr"))
+			add_job(make_hdr_job(filename));
+		else if (ends_with(name, ".fbx"))
+			add_job(make_fbx_job(filename));
+		else if (ends_with(name, ".obj"))
+			add_job(make_scene_job(filename, {}, "obj_to_geo", load_scene_from_obj_file));
+		else if (ends_with(name, ".gltf") || ends_with(name, ".glb"))
+			add_job(make_scene_job(filename, list_gltf_buffers(filename), "gltf_to_geo", load_scene_from_gltf_file));
+	}
+
+	add_job(make_specular_brdf_job());
+}
+
+compile_report asset_compiler::run(bool force)
+{
+	create_directory(path(c_build_dirname).c_str());
+
+	// group jobs by depth, jobs of the same depth do not depend on each other.
+	std::vector<size_t> depths(jobs_.size(), 0);
+	size_t max_depth = 0;
+	for (size_t i = 0; i < jobs_.size(); ++i) {
+		for (size_t d : jobs_[i].dependencies)
+			depths[i] = std::max(depths[i], depths[d] + 1);
+
+		max_depth = std::max(max_depth, depths[i]);
+	}
+
+	std::vector<std::vector<size_t>> levels(max_depth + 1);
+	for (size_t i = 0; i < jobs_.size(); ++i)
+		levels[depths[i]].push_back(i);
+
+	// Each state is written by its own job only, dependents read it on the next level.
+	std::vector<job_state> states(jobs_.size());
+
+	for (const std::vector<size_t>& level : levels) {
+		parallel_for(level.size(), 1, [&](size_t begin, size_t end) {
+			for (size_t l = begin; l < end; ++l) {
+				const size_t index = level[l];
+				const asset_job& job = jobs_[index];
+				job_state& state = states[index];
+
+				try {
+					for (size_t d : job.dependencies) {
+						ENFORCE(states[d].status != job_status::failed,
+							"Dependency ", jobs_[d].output_filename, " has failed.");
+					}
+
+					std::vector<std::string> input_paths;
+					input_paths.reserve(job.input_filenames.size());
+					uint64_t input_hash = hash_string(c_assetc_version);
+					for (const std::string& fn : job.input_filenames) {
+						input_paths.push_back(path(fn));
+						input_hash = hash_combine(input_hash, hash_file(input_paths.back().c_str()));
+					}
+					for (size_t d : job.dependencies)
+						input_hash = hash_combine(input_hash, hash_file(path(jobs_[d].output_filename).c_str()));
+
+					state.input_hash = input_hash;
+					state.settings_hash = hash_string(job.settings);
+
+					const std::string output_path = path(job.output_filename);
+					auto it = manifest_.find(job.output_filename);
+					const bool up_to_date = !force
+						&& (it != manifest_.cend())
+						&& (it->second.input_hash == state.input_hash)
+						&& (it->second.settings_hash == state.settings_hash)
+						&& file_exists(output_path.c_str())
+						&& std::all_of(job.extra_output_filenames.cbegin(), job.extra_output_filenames.cend(),
+							[this](const std::string& fn) { return file_exists(path(fn).c_str()); });
+
+					if (up_to_date) {
+						state.status = job_status::skipped;
+						continue;
+					}
+
+					state.note = job.build(output_path, input_paths);
+					state.status = job_status::built;
+				}
+				catch (const std::exception& e) {
+					state.status = job_status::failed;
+					state.error_message = concat(job.output_filename, ":\n", make_exception_message(e));
+				}
+			}
+		});
+	}
+
+	// update the manifest & make the report
+	compile_report report;
+	for (size_t i = 0; i < jobs_.size(); ++i) {
+		const job_state& state = states[i];
+
+		switch (state.status) {
+			default: assert(false); break;
+
+			case job_status::skipped: {
+				++report.skipped_count;
+				break;
+			}
+
+			case job_status::built: {
+				++report.built_count;
+				if (!state.note.empty()) report.notes.push_back(concat(jobs_[i].output_filename, ": ", state.note));
+				manifest_[jobs_[i].output_filename] = { state.input_hash, state.settings_hash };
+				break;
+			}
+
+			case job_status::failed: {
+				++report.failed_count;
+				report.error_messages.push_back(state.error_message);
+				manifest_.erase(jobs_[i].output_filename);
+				break;
+			}
+		}
+	}
+
+	save_manifest();
+	return report;
+}
+
+void asset_compiler::load_manifest()
+{
+	manifest_.clear();
+
+	const std::string filename = path(c_manifest_filename);
+	std::unique_ptr<FILE, decltype(&std::fclose)> file(std::fopen(filename.c_str(), "rt"), &std::fclose);
+	if (!file) return; // the first run.
+
+	// each line: <input hash> <settings hash> <output filename>
+	char name[1024];
+	manifest_entry e;
+	while (std::fscanf(file.get(), "%" SCNx64 " %" SCNx64 " %1023[^\n]", &e.input_hash, &e.settings_hash, name) == 3)
+		manifest_[name] = e;
+}
+
+void asset_compiler::save_manifest() const
+{
+	const std::string filename = path(c_manifest_filename);
+
+	try {
+		std::unique_ptr<FILE, decltype(&std::fclose)> file(std::fopen(filename.c_str(), "wt"), &std::fclose);
+		ENFORCE(file, "Failed to open the manifest file.");
+
+		// sorted, so that the file does not change if the set of outputs is the same.
+		std::vector<std::pair<std::string, manifest_entry>> entries(manifest_.cbegin(), manifest_.cend());
+		std::sort(entries.begin(), entries.end(),
+			[](const auto& l, const auto& r) { return l.first < r.first; });
+
+		for (const auto& pair : entries) {
+			const int res = std::fprintf(file.get(), "%016" PRIx64 " %016" PRIx64 " %s\n",
+				pair.second.input_hash, pair.second.settings_hash, pair.first.c_str());
+			ENFORCE(res > 0, "Failed to write the manifest file.");
+		}
+	}
+	catch (...) {
+		const std::string exc_msg = EXCEPTION_MSG("Save manifest error. File: ", filename);
+		std::throw_with_nested(std::runtime_error(exc_msg));
+	}
+}
+
+std::string asset_compiler::path(const std::string& filename) const
+{
+	return data_dirname_ + '/' + filename;
+}
+
+std::vector<std::string> asset_compiler::list_gltf_buffers(const std::string& filename) const
+{
+	std::vector<std::string> uris;
+	try {
+		uris = list_gltf_dependencies(path(filename).c_str());
+	}
+	catch (...) {
+		// the job's build reports the error.
+		return {};
+	}
+
+	const size_t sep = filename.find_last_of("/\\");
+	const std::string dirname = (sep == std::string::npos) ? std::string() : filename.substr(0, sep + 1);
+	for (std::string& uri : uris)
+		uri = dirname + uri;
+
+	return uris;
+}
+
+} // namespace assetc
+} // namespace sparki
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace sparki {
+namespace assetc {
+
+// Produces the output file. Paths are prefixed with the data directory.
+// Returns a note which is put into the report (e.g. optimization stats), the note may be empty.
+using build_func_t = std::function<std::string(const std::string& output_path,
+	const std::vector<std::string>& input_paths)>;
+
+// asset_job describes one output file of the data directory and the way it is produced.
+struct asset_job final {
+	// The output filename relative to the data directory.
+	std::string					output_filename;
+	// Other files which build writes next to the output (e.g. several textures baked from one source),
+	// relative to the data directory. The job is rebuilt if any of them is missing.
+	std::vector<std::string>	extra_output_filenames;
+	// Source filenames relative to the data directory. Their contents are hashed before each build.
+	// Outputs of the dependencies may be listed too, they are hashed after the dependencies have been built.
+	std::vector<std::string>	input_filenames;
+	// Indices of the jobs which have to be completed before this one.
+	// Outputs of the dependencies are hashed along with input_filenames.
+	std::vector<size_t>			dependencies;
+	// Textual description of the conversion parameters. A change of the settings forces a rebuild.
+	std::string					settings;
+	build_func_t				build;
+};
+
+struct compile_report final {
+	size_t						built_count = 0;
+	size_t						skipped_count = 0;
+	size_t						failed_count = 0;
+	std::vector<std::string>	notes;
+	std::vector<std::string>	error_messages;
+};
+
+// asset_compiler keeps a graph of asset jobs and executes it on the task system's worker threads.
+// A job whose input hash & settings hash match the values recorded in the manifest is skipped
+// (unless its output is missing). The manifest is stored in the data directory.
+class asset_compiler final {
+public:
+
+	static constexpr const char* c_manifest_filename = ".assetc_manifest";
+
+	// The subdirectory of the data directory for the outputs which must not replace checked-in files
+	// & the intermediate files. It is created by run(), add_data_directory_jobs does not look into it.
+	static constexpr const char* c_build_dirname = ".assetc";
+
+
+	explicit asset_compiler(std::string data_dirname);
+
+	asset_compiler(asset_compiler&&) = delete;
+	asset_compiler& operator=(asset_compiler&&) = delete;
+
+
+	const std::vector<asset_job>& jobs() const noexcept
+	{
+		return jobs_;
+	}
+
+
+	// Adds the job into the graph and returns its index. Dependencies must have been added earlier.
+	size_t add_job(asset_job job);
+
+	// Walks the data directory and adds a job for each recognized source file:
+	// images (.png, .jpg, .tga) -> .tex, .hdr -> bc6h .tex, .fbx, .obj, .gltf & .glb -> .geo,
+	// <name>_envmap.hdr (equirectangular) -> <name>_skybox.tex, then the skybox -> <name>_diffuse_envmap.tex
+	// & <name>_specular_envmap.tex (the envmaps job depends on the skybox job).
+	// The external buffers of .gltf files are inputs of their jobs.
+	// .geo files are written raw, except for the sources whose names contain "_compressed" (geo_encoding::compressed).
+	// Also adds the specular brdf lookup texture bake (<c_build_dirname>/specular_brdf.tex),
+	// the checked-in specular_brdf.tex (made by brdf_integrator) is not replaced.
+	void add_data_directory_jobs();
+
+	// Executes the graph. Jobs of the same depth are built in parallel.
+	// A failed job fails all its dependents. force == true ignores the manifest.
+	compile_report run(bool force);
+
+private:
+
+	struct manifest_entry final {
+		uint64_t	input_hash = 0;
+		uint64_t	settings_hash = 0;
+	};
+
+	void load_manifest();
+
+	void save_manifest() const;
+
+	std::string path(const std::string& filename) const;
+
+	// Returns the buffer files of the .gltf file relative to the data directory, none if the file can't be read.
+	std::vector<std::string> list_gltf_buffers(const std::string& filename) const;
+
+
+	std::string										data_dirname_;
+	std::vector<asset_job>							jobs_;
+	std::unordered_map<std::string, manifest_entry>	manifest_;
+};
+
+} // namespace assetc
+} // namespace sparki
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "sparki/core/utility.h"
+#include "sparki_assetc/asset_compiler.h"
+#include "sparki_assetc/self_check.h"
+#include "ts/task_system.h"
+
+
+namespace {
+
+// Command line: sparki_assetc [data directory] [--force] [--self-check]
+std::string g_data_dirname = "../../data";
+bool g_force = false;
+bool g_self_check = false;
+bool g_failed = false;
+
+
+void assetc_main()
+{
+	using namespace sparki::assetc;
+
+	const auto start = std::chrono::steady_clock::now();
+
+	asset_compiler compiler(g_data_dirname);
+	compiler.add_data_directory_jobs();
+	const compile_report report = compiler.run(g_force);
+
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+	const auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+
+	for (const std::string& note : report.notes)
+		std::cout << note << std::endl;
+
+	for (const std::string& msg : report.error_messages)
+		std::cout << "----- Error -----" << std::endl << msg << std::endl;
+
+	std::cout << "----- Asset Compiler Report -----" << std::endl
+		<< "data directory: " << g_data_dirname << std::endl
+		<< "jobs: " << compiler.jobs().size() << std::endl
+		<< "built: " << report.built_count << std::endl
+		<< "up to date: " << report.skipped_count << std::endl
+		<< "failed: " << report.failed_count << std::endl
+		<< "time: " << elapsed_ms << " ms" << std::endl;
+
+	g_failed = (report.failed_count > 0);
+}
+
+void self_check_main()
+{
+	using namespace sparki::assetc;
+
+	const self_check_report report = run_self_checks(g_data_dirname);
+
+	for (const std::string& note : report.notes)
+		std::cout << note << std::endl;
+
+	for (const std::string& msg : report.error_messages)
+		std::cout << "----- Error -----" << std::endl << msg << std::endl;
+
+	std::cout << "----- Self Check Report -----" << std::endl
+		<< "passed: " << report.passed_count << std::endl
+		<< "failed: " << report.failed_count << std::endl;
+
+	g_failed = (report.failed_count > 0);
+}
+
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+	for (int i = 1; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--force") == 0) g_force = true;
+		else if (std::strcmp(argv[i], "--self-check") == 0) g_self_check = true;
+		else g_data_dirname = argv[i];
+	}
+
+	// jobs run nested parallel loops (mipmaps, bc encoding), the queue has to hold
+	// c_parallel_for_max_task_count tasks of each job which is being built.
+	const size_t thread_count = std::max(2u, std::thread::hardware_concurrency());
+	const ts::task_system_desc ts_desc = {
+		/* thread_count */				thread_count,
+		/* fiber_count */				128,
+		/* fiber_stack_byte_count */	128,
+		/* queue_size */				2048,
+		/* queue_immediate_size */		8
+	};
+
+	try {
+		ts::launch_task_system(ts_desc, (g_self_check) ? self_check_main : assetc_main);
+	}
+	catch (const std::exception& e) {
+		const std::string msg = sparki::core::make_exception_message(e);
+		std::cout << "----- Exception -----" << std::endl << msg << std::endl;
+		return 1;
+	}
+
+	return g_failed ? 1 : 0;
+}
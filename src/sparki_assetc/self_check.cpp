@@ -0,0 +1,1203 @@
+#include "sparki_assetc/self_check.h"
+
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <memory>
+#include "math/math.h"
+#include "sparki/core/asset_geometry.h"
+#include "sparki/core/asset_geometry_tool.h"
+#include "sparki/core/asset_texture.h"
+#include "sparki/core/asset_texture_tool.h"
+#include "sparki/core/half_float.h"
+#include "sparki/core/mesh_bvh.h"
+#include "sparki/core/mesh_streams.h"
+#include "sparki/core/platform_file.h"
+#include "sparki/core/utility.h"
+#include "sparki_assetc/asset_compiler.h"
+
+
+namespace {
+
+using namespace sparki::assetc;
+using namespace sparki::core;
+using math::float3;
+using math::float4;
+using math::float4x4;
+
+// A check throws if it fails, the returned note is put into the report.
+using check_func_t = std::function<std::string()>;
+
+// ----- frustum & meshlet culling -----
+
+// Points which are closer than the margin to a frustum plane (in ndc units) are not classified.
+constexpr float c_ndc_margin = 1e-3f;
+
+enum class clip_class : unsigned char {
+	inside,
+	outside,
+	boundary
+};
+
+// The reference classification: a clip space point is inside if -w <= x <= w, -w <= y <= w, 0 <= z <= w.
+clip_class classify_point(const float4x4& pvm_matrix, const float3& p)
+{
+	const float4 c = math::mul(pvm_matrix, float4(p, 1.0f));
+	if (c.w <= 0.0f) return clip_class::outside;
+
+	const float x = c.x / c.w;
+	const float y = c.y / c.w;
+	const float z = c.z / c.w;
+	const float dist = std::min({ 1.0f - std::abs(x), 1.0f - std::abs(y), z, 1.0f - z });
+	if (std::abs(dist) < c_ndc_margin) return clip_class::boundary;
+
+	return (dist > 0.0f) ? clip_class::inside : clip_class::outside;
+}
+
+mesh_bounds make_sphere_bounds(const float3& center, float radius)
+{
+	mesh_bounds b;
+	b.min = center - float3(radius);
+	b.max = center + float3(radius);
+	b.center = center;
+	b.radius = radius;
+	return b;
+}
+
+// Compares make_frustum & cull_bounds with the clip space test of points which are sampled
+// in ndc space of a perspective frustum. Ndc z covers [-1, 0) which is inside the frustum
+// only if the depth range is mistaken for [-1, 1] (opengl).
+std::string check_frustum_culling()
+{
+	// known frusta: the planes of box shaped (orthographic) frusta.
+	{
+		float4x4 m = float4x4::identity;
+		m.m00 = 2.0f;
+		m.m11 = 4.0f;
+		m.m22 = 0.5f;
+		// x in [-0.5, 0.5], y in [-0.25, 0.25], z in [0, 2]
+		const frustum f = make_frustum(m);
+		const float4 expected[6] = {
+			float4(1.0f, 0.0f, 0.0f, 0.5f), float4(-1.0f, 0.0f, 0.0f, 0.5f),
+			float4(0.0f, 1.0f, 0.0f, 0.25f), float4(0.0f, -1.0f, 0.0f, 0.25f),
+			float4(0.0f, 0.0f, 1.0f, 0.0f), float4(0.0f, 0.0f, -1.0f, 2.0f)
+		};
+		for (size_t i = 0; i < 6; ++i) {
+			ENFORCE(math::approx_equal(math::xyz(f.planes[i]), math::xyz(expected[i]))
+				&& math::approx_equal(f.planes[i].w, expected[i].w),
+				"Box frustum plane ", i, " is wrong.");
+		}
+
+		ENFORCE(!cull_bounds(make_sphere_bounds(float3(0.0f, 0.0f, 0.05f), 0.0f), f),
+			"A point at the near side of the box frustum is culled.");
+		ENFORCE(cull_bounds(make_sphere_bounds(float3(0.0f, 0.0f, -0.05f), 0.0f), f),
+			"A point in front of the near plane of the box frustum is not culled, is the depth range [0, 1]?");
+		ENFORCE(cull_bounds(make_sphere_bounds(float3(0.0f, 0.0f, 2.05f), 0.0f), f),
+			"A point behind the far plane of the box frustum is not culled.");
+	}
+
+	// a perspective frustum of the same kind the renderer uses.
+	const float near_z = 0.5f;
+	const float far_z = 20.0f;
+	const float3 camera_position(1.0f, 2.0f, 3.0f);
+	const float3 camera_target(4.0f, 1.0f, -6.0f);
+	const float3 model_offset(0.5f, -0.25f, 1.0f);
+	const float4x4 pvm_matrix = math::perspective_matrix_directx(math::pi_3, 1.5f, near_z, far_z)
+		* math::view_matrix(camera_position, camera_target, float3::unit_y)
+		* math::translation_matrix(model_offset);
+	const frustum f = make_frustum(pvm_matrix);
+
+	// points on the view axis right in front of & behind the near & far planes (model space).
+	const float3 forward = math::normalize(camera_target - camera_position);
+	auto on_axis = [&](float depth) { return camera_position + forward * depth - model_offset; };
+	ENFORCE(cull_bounds(make_sphere_bounds(on_axis(near_z * 0.98f), 0.0f), f),
+		"A point on the view axis in front of the near plane is not culled.");
+	ENFORCE(!cull_bounds(make_sphere_bounds(on_axis(near_z * 1.02f), 0.0f), f),
+		"A point on the view axis behind the near plane is culled.");
+	ENFORCE(!cull_bounds(make_sphere_bounds(on_axis(far_z * 0.98f), 0.0f), f),
+		"A point on the view axis in front of the far plane is culled.");
+	ENFORCE(cull_bounds(make_sphere_bounds(on_axis(far_z * 1.02f), 0.0f), f),
+		"A point on the view axis behind the far plane is not culled.");
+
+	// sampled points & spheres, the spheres which are culled must not have a point inside the frustum.
+	const float4x4 inv_pvm_matrix = math::inverse(pvm_matrix);
+	const float sphere_radius = 0.25f;
+	const float sphere_dir_scale = sphere_radius * 0.999f / std::sqrt(3.0f);
+	const int step_count = 24;
+	size_t point_count = 0;
+	size_t near_range_count = 0;
+	size_t culled_sphere_count = 0;
+
+	for (int zi = 0; zi <= step_count; ++zi) {
+		for (int yi = 0; yi <= step_count; ++yi) {
+			for (int xi = 0; xi <= step_count; ++xi) {
+				const float x = -1.5f + 3.0f * float(xi) / step_count;
+				const float y = -1.5f + 3.0f * float(yi) / step_count;
+				const float z = -1.0f + 2.5f * float(zi) / step_count;
+				const float4 h = math::mul(inv_pvm_matrix, float4(x, y, z, 1.0f));
+				if (std::abs(h.w) < 1e-6f) continue;
+
+				const float3 p = math::xyz(h) / h.w;
+				const clip_class cls = classify_point(pvm_matrix, p);
+				if (cls == clip_class::boundary) continue;
+
+				const bool inside = (cls == clip_class::inside);
+				ENFORCE(cull_bounds(make_sphere_bounds(p, 0.0f), f) != inside,
+					"The point (", p.x, ", ", p.y, ", ", p.z, ") is ", (inside ? "culled" : "not culled"), ".");
+				++point_count;
+				if (z < 0.0f && std::abs(x) < 1.0f && std::abs(y) < 1.0f) ++near_range_count;
+
+				const bool culled = cull_bounds(make_sphere_bounds(p, sphere_radius), f);
+				ENFORCE(!(inside && culled), "The sphere around an inside point is culled.");
+				if (!culled) continue;
+
+				++culled_sphere_count;
+				for (int d = 0; d < 27; ++d) {
+					const float3 dir(float(d % 3 - 1), float(d / 3 % 3 - 1), float(d / 9 - 1));
+					ENFORCE(classify_point(pvm_matrix, p + dir * sphere_dir_scale) != clip_class::inside,
+						"A sphere which intersects the frustum is culled.");
+				}
+			}
+		}
+	}
+
+	ENFORCE(near_range_count > 0, "No point samples ndc z in [-1, 0).");
+	ENFORCE(culled_sphere_count > 0, "No sphere is culled.");
+
+	return concat("frustum culling: ", point_count, " points (", near_range_count,
+		" in ndc z [-1, 0)), ", culled_sphere_count, " culled spheres");
+}
+
+using vertex_t = vertex<vertex_attribs::p_n_uv_ts>;
+
+// Appends the triangle so that it faces away from the centre (counter-clockwise front faces).
+// Degenerate triangles are skipped.
+void add_outward_triangle(mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh, std::vector<uint32_t>& indices,
+	const float3& center, uint32_t i0, uint32_t i1, uint32_t i2)
+{
+	const float3& p0 = mesh.vertices[i0].position;
+	const float3 n = math::cross(mesh.vertices[i1].position - p0, mesh.vertices[i2].position - p0);
+	if (math::len(n) < 1e-6f) return;
+
+	const bool flip = math::dot(n, p0 - center) < 0.0f;
+	indices.insert(indices.end(), { i0, flip ? i2 : i1, flip ? i1 : i2 });
+}
+
+void set_indices(mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh, const std::vector<uint32_t>& indices)
+{
+	mesh.indices.resize(indices.size());
+	std::copy(indices.begin(), indices.end(), mesh.indices.data());
+}
+
+// A grid of side_count * side_count quads in the xy plane which faces +z.
+mesh_geometry<vertex_attribs::p_n_uv_ts> make_plane_mesh(uint32_t side_count)
+{
+	const uint32_t row = side_count + 1;
+	mesh_geometry<vertex_attribs::p_n_uv_ts> mesh;
+	mesh.vertices.resize(row * row);
+	for (uint32_t y = 0; y < row; ++y) {
+		for (uint32_t x = 0; x < row; ++x)
+			mesh.vertices[y * row + x] = vertex_t(float3(float(x), float(y), 0.0f), float3::unit_z, math::float2(), 0);
+	}
+
+	std::vector<uint32_t> indices;
+	for (uint32_t y = 0; y < side_count; ++y) {
+		for (uint32_t x = 0; x < side_count; ++x) {
+			const uint32_t i = y * row + x;
+			add_outward_triangle(mesh, indices, float3(float(x), float(y), -1.0f), i, i + 1, i + row + 1);
+			add_outward_triangle(mesh, indices, float3(float(x), float(y), -1.0f), i, i + row + 1, i + row);
+		}
+	}
+
+	set_indices(mesh, indices);
+	return mesh;
+}
+
+// A unit uv sphere centred at the origin whose triangles face outwards.
+mesh_geometry<vertex_attribs::p_n_uv_ts> make_sphere_mesh(uint32_t ring_count, uint32_t segment_count)
+{
+	const uint32_t row = segment_count + 1;
+	mesh_geometry<vertex_attribs::p_n_uv_ts> mesh;
+	mesh.vertices.resize((ring_count + 1) * row);
+	for (uint32_t r = 0; r <= ring_count; ++r) {
+		const float theta = math::pi * float(r) / ring_count;
+		for (uint32_t s = 0; s <= segment_count; ++s) {
+			const float phi = 2.0f * math::pi * float(s) / segment_count;
+			const float3 p(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+			mesh.vertices[r * row + s] = vertex_t(p, p, math::float2(), 0);
+		}
+	}
+
+	std::vector<uint32_t> indices;
+	for (uint32_t r = 0; r < ring_count; ++r) {
+		for (uint32_t s = 0; s < segment_count; ++s) {
+			const uint32_t i = r * row + s;
+			add_outward_triangle(mesh, indices, float3::zero, i, i + 1, i + row + 1);
+			add_outward_triangle(mesh, indices, float3::zero, i, i + row + 1, i + row);
+		}
+	}
+
+	set_indices(mesh, indices);
+	return mesh;
+}
+
+// Returns the number of culled meshlets. Every triangle of a culled meshlet must face away from the camera.
+size_t check_backface_culling(const mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh, const frustum& f,
+	const float3& camera_position)
+{
+	size_t culled_count = 0;
+	for (const meshlet& m : mesh.meshlets) {
+		if (!cull_meshlet(m, f, camera_position)) continue;
+
+		++culled_count;
+		for (uint32_t i = m.first_index; i < m.first_index + m.index_count; i += 3) {
+			const float3& p0 = mesh.vertices[mesh.indices[i]].position;
+			const float3& p1 = mesh.vertices[mesh.indices[i + 1]].position;
+			const float3& p2 = mesh.vertices[mesh.indices[i + 2]].position;
+			const float3 n = math::cross(p1 - p0, p2 - p0);
+			ENFORCE(math::dot(n, camera_position - p0) <= 1e-5f * math::len(n),
+				"A meshlet which has a front facing triangle is culled, camera (",
+				camera_position.x, ", ", camera_position.y, ", ", camera_position.z, ").");
+		}
+	}
+
+	return culled_count;
+}
+
+// Checks the normal cones of build_meshlets with cull_meshlet: flat meshlets are culled exactly
+// from behind and never from the front or the side, meshlets of a sphere are culled only if
+// all their triangles are back facing.
+std::string check_meshlet_culling()
+{
+	// a frustum which contains every mesh of the check: x, y, z in [-500, 500].
+	float4x4 box_matrix = float4x4::identity;
+	box_matrix.m00 = box_matrix.m11 = 0.002f;
+	box_matrix.m22 = 0.001f;
+	box_matrix.m23 = 0.5f;
+	const frustum f = make_frustum(box_matrix);
+
+	mesh_geometry<vertex_attribs::p_n_uv_ts> plane = make_plane_mesh(32);
+	build_meshlets(plane);
+	ENFORCE(plane.meshlets.size() > 1, "The plane has ", plane.meshlets.size(), " meshlets.");
+
+	const float3 plane_center(16.0f, 16.0f, 0.0f);
+	for (const meshlet& m : plane.meshlets) {
+		ENFORCE(math::approx_equal(m.cone_axis, float3::unit_z, 1e-4f), "The plane's cone axis is not +z.");
+		ENFORCE(!cull_meshlet(m, f, plane_center + float3(0.0f, 0.0f, 10.0f)),
+			"A meshlet of the plane is culled from the front.");
+		ENFORCE(!cull_meshlet(m, f, plane_center + float3(100.0f, 0.0f, 0.0f)),
+			"A meshlet of the plane is culled from its plane.");
+		ENFORCE(cull_meshlet(m, f, plane_center + float3(0.0f, 0.0f, -100.0f)),
+			"A meshlet of the plane is not culled from behind.");
+	}
+
+	mesh_geometry<vertex_attribs::p_n_uv_ts> sphere = make_sphere_mesh(48, 96);
+	build_meshlets(sphere);
+
+	size_t camera_count = 0;
+	size_t culled_count = 0;
+	const uint32_t dir_count = 64;
+	for (float distance : { 1.2f, 3.0f, 10.0f, 100.0f }) {
+		for (uint32_t i = 0; i < dir_count; ++i) {
+			// fibonacci sphere directions
+			const float y = 1.0f - 2.0f * (float(i) + 0.5f) / dir_count;
+			const float r = std::sqrt(1.0f - y * y);
+			const float phi = float(i) * 2.39996323f;
+			const float3 camera_position = float3(r * std::cos(phi), y, r * std::sin(phi)) * distance;
+
+			culled_count += check_backface_culling(sphere, f, camera_position);
+			++camera_count;
+		}
+	}
+
+	ENFORCE(culled_count > 0, "No meshlet of the sphere is culled.");
+
+	return concat("meshlet culling: ", plane.meshlets.size(), " plane meshlets, ", sphere.meshlets.size(),
+		" sphere meshlets, ", culled_count, " culled out of ", sphere.meshlets.size() * camera_count);
+}
+
+// ----- mesh streams -----
+
+// Returns a float in [-1, 1), the sequence is the same on every run.
+float next_signed_unit(uint32_t& state) noexcept
+{
+	state = state * 1664525u + 1013904223u;
+	return float(state >> 8) / float(1u << 23) - 1.0f;
+}
+
+bool equal_streams(const mesh_streams& a, const mesh_streams& b)
+{
+	const size_t n = a.vertex_count;
+	return (std::memcmp(a.position_x.data(), b.position_x.data(), n * sizeof(float)) == 0)
+		&& (std::memcmp(a.position_y.data(), b.position_y.data(), n * sizeof(float)) == 0)
+		&& (std::memcmp(a.position_z.data(), b.position_z.data(), n * sizeof(float)) == 0)
+		&& (std::memcmp(a.normal_x.data(), b.normal_x.data(), n * sizeof(float)) == 0)
+		&& (std::memcmp(a.normal_y.data(), b.normal_y.data(), n * sizeof(float)) == 0)
+		&& (std::memcmp(a.normal_z.data(), b.normal_z.data(), n * sizeof(float)) == 0)
+		&& (std::memcmp(a.tangent_h.data(), b.tangent_h.data(), n * sizeof(uint32_t)) == 0);
+}
+
+// Transforms random vertices by rigid, scaling & mirroring matrices with every simd level
+// which the cpu supports. The results must be bitwise equal to the scalar ones
+// and match the positions which are transformed by math::mul.
+std::string check_mesh_streams_transform()
+{
+	// not a multiple of c_lane_count, the padding is transformed too.
+	const size_t vertex_count = 10001;
+	std::vector<vertex_t> vertices(vertex_count);
+	uint32_t state = 1;
+	for (vertex_t& v : vertices) {
+		const float3 p(next_signed_unit(state), next_signed_unit(state), next_signed_unit(state));
+		const float3 n(next_signed_unit(state), next_signed_unit(state), next_signed_unit(state));
+		const float3 t(next_signed_unit(state), next_signed_unit(state), next_signed_unit(state));
+		const float w = (next_signed_unit(state) < 0.0f) ? -1.0f : 1.0f;
+		v = vertex_t(p * 100.0f, math::normalize(n + float3(0.01f)), math::float2(),
+			math::pack_unorm_10_10_10_2(math::float4(math::normalize(t + float3(0.01f)), w) * 0.5f + 0.5f));
+	}
+
+	float4x4 rigid = float4x4::identity;
+	rigid.m00 = 0.8f;	rigid.m01 = -0.6f;	rigid.m03 = 12.5f;
+	rigid.m10 = 0.6f;	rigid.m11 = 0.8f;	rigid.m13 = -3.0f;
+	rigid.m23 = 0.25f;
+	float4x4 scaling = rigid;
+	scaling.m00 *= 3.0f;
+	scaling.m10 *= 3.0f;
+	scaling.m22 = 0.125f;
+	float4x4 mirroring = scaling;
+	mirroring.m01 = -mirroring.m01;
+	mirroring.m11 = -mirroring.m11;
+
+	const simd_level max_level = max_simd_level();
+	for (const float4x4& m : { rigid, scaling, mirroring }) {
+		mesh_streams reference = make_mesh_streams(span<const vertex_t>(vertices.data(), vertices.size()));
+		transform_mesh_streams(reference, m, simd_level::scalar);
+
+		for (size_t i = 0; i < vertex_count; ++i) {
+			const float3 expected = math::xyz(math::mul(m, float4(vertices[i].position, 1.0f)));
+			const float3 actual(reference.position_x[i], reference.position_y[i], reference.position_z[i]);
+			ENFORCE(math::approx_equal(expected, actual, 1e-3f), "The vertex ", i, " is transformed incorrectly.");
+		}
+
+		for (simd_level level : { simd_level::sse, simd_level::avx }) {
+			if (level > max_level) continue;
+
+			mesh_streams streams = make_mesh_streams(span<const vertex_t>(vertices.data(), vertices.size()));
+			transform_mesh_streams(streams, m, level);
+			ENFORCE(equal_streams(streams, reference), "The results of simd level ", int(level),
+				" differ from the scalar ones.");
+		}
+	}
+
+	static constexpr const char* c_level_names[] = { "scalar", "sse", "avx" };
+	return concat("mesh streams transform: ", vertex_count, " vertices, levels up to ",
+		c_level_names[size_t(max_level)], " are bitwise equal");
+}
+
+// ----- envmaps -----
+
+// The envmaps which have been baked on the gpu by envmap_texture_builder, they are the references of the cpu bakes.
+constexpr const char* c_reference_diffuse_envmap_filename = "pisa_diffuse_envmap.tex";
+constexpr const char* c_reference_specular_envmap_filename = "pisa_specular_envmap.tex";
+
+// Tolerances of the relative rgb error, |cpu - gpu| / max(c_min_reference_value, |gpu|).
+// The gpu integrates in a different order & rounds intermediate values to half floats,
+// the measured errors are: diffuse mean 0.0003, max 0.0012; specular mean <= 0.015, <= 1.6% over 0.05.
+constexpr double c_min_reference_value = 0.01;
+constexpr double c_max_diffuse_mean_error = 0.002;
+constexpr double c_max_diffuse_error = 0.01;
+constexpr double c_max_specular_mean_error = 0.025;
+constexpr double c_specular_outlier_error = 0.05;
+constexpr double c_max_specular_outlier_fraction = 0.03;
+
+struct envmap_error final {
+	double	mean = 0.0;
+	double	max = 0.0;
+	// The fraction of the values whose error exceeds c_specular_outlier_error.
+	double	outlier_fraction = 0.0;
+};
+
+// Compares the rgb values of the mipmap level of the cube texture with the reference one (both rgba_16f).
+envmap_error compare_envmap_level(const texture_data& td, const texture_view& reference, uint32_t mipmap_index)
+{
+	ENFORCE(td.format == pixel_format::rgba_16f && reference.format() == pixel_format::rgba_16f,
+		"Envmaps must be rgba_16f.");
+	ENFORCE(td.size.x == reference.size().x && td.array_size == 6 && reference.array_size() == 6,
+		"The envmap does not match the reference one.");
+
+	const size_t level_bc = byte_count(td.size, mipmap_index, td.format);
+	const size_t value_count = level_bc / sizeof(uint16_t);
+	std::vector<float> values(value_count);
+	std::vector<float> reference_values(value_count);
+	double error_sum = 0.0;
+	size_t outlier_count = 0;
+	envmap_error e;
+
+	for (uint32_t face = 0; face < 6; ++face) {
+		size_t offset = 0;
+		for (uint32_t i = 0; i < face * td.mipmap_count + mipmap_index; ++i)
+			offset += byte_count(td.size, i % td.mipmap_count, td.format);
+
+		const span<const uint8_t> ref = reference.subresource(face, mipmap_index);
+		ENFORCE(ref.size() == level_bc, "The envmap does not match the reference one.");
+		half_to_float(reinterpret_cast<const uint16_t*>(td.buffer.data() + offset), values.data(), value_count);
+		half_to_float(reinterpret_cast<const uint16_t*>(ref.data()), reference_values.data(), value_count);
+
+		for (size_t i = 0; i < value_count; ++i) {
+			if (i % 4 == 3) continue; // alpha
+
+			const double r = double(reference_values[i]);
+			const double error = std::abs(double(values[i]) - r) / std::max(c_min_reference_value, std::abs(r));
+			error_sum += error;
+			e.max = std::max(e.max, error);
+			if (error > c_specular_outlier_error) ++outlier_count;
+		}
+	}
+
+	const double rgb_count = double(value_count / 4 * 3 * 6);
+	e.mean = error_sum / rgb_count;
+	e.outlier_fraction = double(outlier_count) / rgb_count;
+	return e;
+}
+
+// Bakes the diffuse & specular envmaps of the pisa skybox on the cpu and compares them
+// with the checked-in gpu bakes. The skybox is mipmap #0 of the specular envmap.
+std::string check_envmaps(const std::string& data_dirname)
+{
+	const envmap_desc desc;
+	const texture_view reference_diffuse(concat(data_dirname, "/", c_reference_diffuse_envmap_filename).c_str());
+	const texture_view reference_specular(concat(data_dirname, "/", c_reference_specular_envmap_filename).c_str());
+	ENFORCE(reference_diffuse.size().x == desc.diffuse_envmap_side_size
+		&& reference_specular.size().x == desc.specular_envmap_side_size
+		&& reference_specular.mipmap_count() == desc.specular_envmap_mipmap_count,
+		"The reference envmaps do not match envmap_desc's sizes.");
+
+	texture_data skybox_level(texture_type::texture_cube, reference_specular.size(), 1, 6, pixel_format::rgba_16f);
+	const size_t face_bc = byte_count(skybox_level.size, 0, skybox_level.format);
+	for (uint32_t face = 0; face < 6; ++face) {
+		const span<const uint8_t> src = reference_specular.subresource(face, 0);
+		ENFORCE(src.size() == face_bc, "Invalid reference specular envmap.");
+		std::memcpy(skybox_level.buffer.data() + face * face_bc, src.data(), face_bc);
+	}
+
+	mipmap_desc md;
+	md.filter = mipmap_filter::kaiser;
+	const texture_data skybox = generate_mipmaps(skybox_level, md);
+
+	const texture_data diffuse = bake_diffuse_envmap(skybox, desc.diffuse_envmap_side_size);
+	const envmap_error diffuse_error = compare_envmap_level(diffuse, reference_diffuse, 0);
+	ENFORCE(diffuse_error.mean <= c_max_diffuse_mean_error && diffuse_error.max <= c_max_diffuse_error,
+		"The diffuse envmap differs from the reference one, mean error ", diffuse_error.mean,
+		", max error ", diffuse_error.max);
+
+	std::string note = concat("envmaps: diffuse mean error ", diffuse_error.mean, ", specular mean errors");
+	const texture_data specular = bake_specular_envmap(skybox, desc.specular_envmap_side_size,
+		desc.specular_envmap_mipmap_count);
+	for (uint32_t m = 0; m < specular.mipmap_count; ++m) {
+		const envmap_error e = compare_envmap_level(specular, reference_specular, m);
+		ENFORCE(e.mean <= c_max_specular_mean_error && e.outlier_fraction <= c_max_specular_outlier_fraction,
+			"The specular envmap's mipmap ", m, " differs from the reference one, mean error ", e.mean,
+			", outliers ", e.outlier_fraction);
+		note = concat(note, " ", e.mean);
+	}
+
+	return note;
+}
+
+// ----- files -----
+
+// A file in the build directory of the data directory, removed when the check ends.
+struct scratch_file final {
+
+	scratch_file(const std::string& data_dirname, const char* p_name)
+	{
+		const std::string dirname = concat(data_dirname, '/', asset_compiler::c_build_dirname);
+		create_directory(dirname.c_str());
+		filename = concat(dirname, "/self_check_", p_name);
+	}
+
+	scratch_file(scratch_file&&) = delete;
+	scratch_file& operator=(scratch_file&&) = delete;
+
+	~scratch_file() noexcept
+	{
+		std::remove(filename.c_str());
+	}
+
+
+	std::string filename;
+};
+
+template<typename Container_a, typename Container_b>
+bool equal_bytes(const Container_a& a, const Container_b& b)
+{
+	return (byte_count(a) == byte_count(b))
+		&& ((byte_count(a) == 0) || (std::memcmp(a.data(), b.data(), byte_count(a)) == 0));
+}
+
+// Writes the first byte_count bytes of the source file into the destination file.
+void write_truncated_copy(const std::string& src_filename, const std::string& dst_filename, size_t byte_count)
+{
+	const mapped_file src(src_filename.c_str());
+	ENFORCE(byte_count <= src.size(), "The file ", src_filename, " is too short.");
+
+	std::unique_ptr<FILE, decltype(&std::fclose)> file(std::fopen(dst_filename.c_str(), "wb"), &std::fclose);
+	ENFORCE(file, "Failed to create the file ", dst_filename);
+	ENFORCE(std::fwrite(src.data(), byte_count, 1, file.get()) == 1, "Failed to write the file ", dst_filename);
+}
+
+// ----- .geo round trip -----
+
+// Octahedral snorm16 normals are restored within ~3e-5 of the source ones.
+constexpr float c_max_geo_normal_error = 1e-4f;
+// Float rounding of the dequantization (offset + q * scale) relative to the value.
+constexpr float c_geo_rounding_error = 1e-6f;
+
+// An offset & scaled sphere whose vertices have distinct uvs & arbitrary tangent space bits, with meshlets.
+mesh_geometry<vertex_attribs::p_n_uv_ts> make_geo_check_mesh()
+{
+	mesh_geometry<vertex_attribs::p_n_uv_ts> mesh = make_sphere_mesh(24, 48);
+	uint32_t state = 7;
+	for (vertex_t& v : mesh.vertices) {
+		v.position = v.position * 25.0f + float3(100.5f, -20.0f, 3.25f);
+		v.uv = math::float2(next_signed_unit(state) * 2.0f, next_signed_unit(state));
+		v.tangent_h = state;
+	}
+
+	build_meshlets(mesh);
+	return mesh;
+}
+
+// Returns true if opening the file throws.
+bool is_rejected_geo_file(const std::string& filename)
+{
+	try {
+		const mapped_geo_file file(filename.c_str());
+		return false;
+	}
+	catch (const std::exception&) {
+		return true;
+	}
+}
+
+// Writes the mesh into raw & compressed .geo files and reads them back: raw files restore the mesh exactly,
+// compressed ones restore the indices, the tangent spaces & the meshlet ranges exactly, positions & uvs
+// within half a quantization step and normals within c_max_geo_normal_error.
+// Truncated files are rejected.
+std::string check_geo_round_trip(const std::string& data_dirname)
+{
+	const scratch_file raw_file(data_dirname, "raw.geo");
+	const scratch_file compressed_file(data_dirname, "compressed.geo");
+	const scratch_file truncated_file(data_dirname, "truncated.geo");
+
+	mesh_geometry<vertex_attribs::p_n_uv_ts> mesh = make_geo_check_mesh();
+	save_to_geo_file(raw_file.filename.c_str(), mesh, geo_encoding::raw);
+	{
+		const mesh_geometry<vertex_attribs::p_n_uv_ts> m = read_from_geo_file(raw_file.filename.c_str());
+		ENFORCE(equal_bytes(m.vertices, mesh.vertices) && equal_bytes(m.indices, mesh.indices)
+			&& equal_bytes(m.meshlets, mesh.meshlets), "The raw .geo file does not restore the mesh.");
+	}
+
+	mesh.index_fmt = index_format::uint16;
+	save_to_geo_file(compressed_file.filename.c_str(), mesh, geo_encoding::compressed);
+	const mapped_geo_file file(compressed_file.filename.c_str());
+	ENFORCE(file.encoding() == geo_encoding::compressed && file.index_fmt() == index_format::uint16
+		&& file.vertices().size() == mesh.vertices.size() && file.index_count() == mesh.indices.size()
+		&& file.meshlets().size() == mesh.meshlets.size(), "The compressed .geo file's header is wrong.");
+
+	const uint16_t* p_indices = reinterpret_cast<const uint16_t*>(file.index_data().data());
+	ENFORCE(std::equal(mesh.indices.begin(), mesh.indices.end(), p_indices),
+		"The compressed .geo file does not restore the indices.");
+
+	// the quantization step of each position & uv component.
+	float min_v[5], max_v[5];
+	std::fill(std::begin(min_v), std::end(min_v), std::numeric_limits<float>::max());
+	std::fill(std::begin(max_v), std::end(max_v), std::numeric_limits<float>::lowest());
+	for (const vertex_t& v : mesh.vertices) {
+		const float a[5] = { v.position.x, v.position.y, v.position.z, v.uv.x, v.uv.y };
+		for (size_t c = 0; c < 5; ++c) {
+			min_v[c] = std::min(min_v[c], a[c]);
+			max_v[c] = std::max(max_v[c], a[c]);
+		}
+	}
+
+	float max_step_error = 0.0f;
+	float max_normal_error = 0.0f;
+	for (size_t i = 0; i < mesh.vertices.size(); ++i) {
+		const vertex_t& src = mesh.vertices[i];
+		const vertex_t& dst = file.vertices()[i];
+		ENFORCE(dst.tangent_h == src.tangent_h, "The tangent space of the vertex ", i, " differs.");
+
+		const float a[5] = { src.position.x, src.position.y, src.position.z, src.uv.x, src.uv.y };
+		const float b[5] = { dst.position.x, dst.position.y, dst.position.z, dst.uv.x, dst.uv.y };
+		for (size_t c = 0; c < 5; ++c) {
+			const float step = (max_v[c] - min_v[c]) / 65535.0f;
+			const float error = std::abs(b[c] - a[c]);
+			ENFORCE(error <= step * 0.5f + std::abs(a[c]) * c_geo_rounding_error,
+				"The component ", c, " of the vertex ", i, " is restored with the error ", error, ", the step is ", step);
+			max_step_error = std::max(max_step_error, error / step);
+		}
+
+		const float normal_error = math::len(dst.normal - src.normal);
+		ENFORCE(normal_error <= c_max_geo_normal_error, "The normal of the vertex ", i, " is restored with the error ",
+			normal_error);
+		max_normal_error = std::max(max_normal_error, normal_error);
+	}
+
+	// the meshlet spheres enclose the restored positions.
+	for (size_t i = 0; i < mesh.meshlets.size(); ++i) {
+		const meshlet& m = file.meshlets()[i];
+		ENFORCE(m.first_index == mesh.meshlets[i].first_index && m.index_count == mesh.meshlets[i].index_count,
+			"The index range of the meshlet ", i, " differs.");
+
+		for (uint32_t k = m.first_index; k < m.first_index + m.index_count; ++k) {
+			const float3& p = file.vertices()[p_indices[k]].position;
+			ENFORCE(math::len(p - m.center) <= m.radius * (1.0f + c_geo_rounding_error),
+				"The meshlet ", i, " does not enclose its restored vertices.");
+		}
+	}
+
+	for (const std::string* p_filename : { &raw_file.filename, &compressed_file.filename }) {
+		const size_t size = get_file_info(p_filename->c_str()).byte_count;
+		for (size_t truncated_size : { size_t(16), size / 2, size - 1 }) {
+			write_truncated_copy(*p_filename, truncated_file.filename, truncated_size);
+			ENFORCE(is_rejected_geo_file(truncated_file.filename), "The file ", *p_filename, " truncated to ",
+				truncated_size, " bytes is not rejected.");
+		}
+	}
+
+	return concat("geo round trip: ", mesh.vertices.size(), " vertices, ", mesh.meshlets.size(),
+		" meshlets, max errors: positions & uvs ", max_step_error, " steps, normals ", max_normal_error);
+}
+
+// ----- textures -----
+
+// Checks byte_count with known layouts and writes a texture_2d array into a .tex file & reads it back
+// (load_from_tex_file with & without the top mipmap, texture_view).
+std::string check_texture_layout(const std::string& data_dirname)
+{
+	struct layout final {
+		texture_type	type;
+		math::uint3		size;
+		uint32_t		mipmap_count;
+		uint32_t		array_size;
+		pixel_format	format;
+		size_t			expected_byte_count;
+	};
+
+	// each array slice has the whole mipmap chain.
+	const layout layouts[] = {
+		// (8 * 4 + 4 * 2 + 2 * 1) * 4 bytes * 3 slices
+		{ texture_type::texture_2d, math::uint3(8, 4, 1), 3, 3, pixel_format::rgba_8, 504 },
+		// (4 * 4 + 2 * 2 + 1 * 1) * 8 bytes * 6 faces
+		{ texture_type::texture_cube, math::uint3(4, 4, 1), 3, 6, pixel_format::rgba_16f, 1008 },
+		// (4 + 1 + 1 + 1) blocks * 16 bytes * 2 slices
+		{ texture_type::texture_2d, math::uint3(8, 8, 1), 4, 2, pixel_format::bc7, 224 },
+		{ texture_type::texture_2d, math::uint3(5, 3, 1), 1, 1, pixel_format::rg_8, 30 }
+	};
+
+	for (const layout& l : layouts) {
+		const size_t bc = byte_count(l.type, l.size, l.mipmap_count, l.array_size, l.format);
+		ENFORCE(bc == l.expected_byte_count, "byte_count of a ", l.size.x, "x", l.size.y, " texture of ", l.array_size,
+			" slices is ", bc, ", expected ", l.expected_byte_count);
+	}
+
+	// 6x4, 3x2, 1x1
+	texture_data td(texture_type::texture_2d, math::uint3(6, 4, 1), 3, 3, pixel_format::rgba_8);
+	for (size_t i = 0; i < td.buffer.size(); ++i)
+		td.buffer[i] = uint8_t(i * 7 + 3);
+
+	const scratch_file tex_file(data_dirname, "array.tex");
+	save_to_tex_file(tex_file.filename.c_str(), td);
+
+	const texture_data loaded = load_from_tex_file(tex_file.filename.c_str());
+	ENFORCE(loaded.type == td.type && loaded.size.x == td.size.x && loaded.size.y == td.size.y
+		&& loaded.mipmap_count == td.mipmap_count && loaded.array_size == td.array_size
+		&& loaded.format == td.format && equal_bytes(loaded.buffer, td.buffer),
+		"The .tex file does not restore the texture array.");
+
+	const texture_view view(tex_file.filename.c_str());
+	const texture_data tail = load_from_tex_file(tex_file.filename.c_str(), 1);
+	ENFORCE(tail.size.x == 3 && tail.size.y == 2 && tail.mipmap_count == 2 && tail.array_size == td.array_size,
+		"The .tex file without the top mipmap has a wrong layout.");
+
+	size_t offset = 0;
+	size_t tail_offset = 0;
+	for (uint32_t a = 0; a < td.array_size; ++a) {
+		for (uint32_t m = 0; m < td.mipmap_count; ++m) {
+			const size_t bc = byte_count(td.size, m, td.format);
+			const span<const uint8_t> s = view.subresource(a, m);
+			ENFORCE(s.size() == bc && std::memcmp(s.data(), td.buffer.data() + offset, bc) == 0,
+				"The subresource (", a, ", ", m, ") of the texture_view differs.");
+
+			if (m > 0) {
+				ENFORCE(std::memcmp(tail.buffer.data() + tail_offset, td.buffer.data() + offset, bc) == 0,
+					"The subresource (", a, ", ", m, ") of the texture without the top mipmap differs.");
+				tail_offset += bc;
+			}
+
+			offset += bc;
+		}
+	}
+
+	ENFORCE(offset == td.buffer.size() && tail_offset == tail.buffer.size(), "The texture layout has gaps.");
+	return concat("texture layout: ", std::size(layouts), " byte counts, ", td.array_size, " slices x ",
+		td.mipmap_count, " mipmaps round trip");
+}
+
+// ----- block compression -----
+
+// The reference decoders below follow the bc format specs, independently of the encoders (asset_texture_tool.cpp).
+// They decode the block modes which compress_texture writes: bc4/bc5, bc6h mode 11 & bc7 mode 6.
+
+// Measured errors of the encoders on the check's images: bc5 max 5.1, bc6h mean 2.1%, max 8.5%
+// (16 weights across a 4.8x range of a block), bc7 rms 1.1, max 4.
+constexpr float c_max_bc5_error = 8.0f;
+constexpr double c_max_bc6h_mean_error = 0.04;
+constexpr double c_max_bc6h_error = 0.15;
+constexpr double c_max_bc7_rms_error = 2.0;
+constexpr float c_max_bc7_error = 8.0f;
+
+constexpr uint32_t c_bc_weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Reads the bits of a 16-byte block from the lowest one.
+class block_reader final {
+public:
+
+	explicit block_reader(const uint8_t* p_block) noexcept
+		: p_block_(p_block)
+	{}
+
+
+	uint32_t read(uint32_t bit_count) noexcept
+	{
+		uint32_t value = 0;
+		for (uint32_t i = 0; i < bit_count; ++i, ++offset_)
+			value |= uint32_t((p_block_[offset_ >> 3] >> (offset_ & 7)) & 1) << i;
+
+		return value;
+	}
+
+private:
+
+	const uint8_t*	p_block_;
+	uint32_t		offset_ = 0;
+};
+
+// Decodes a bc4 unorm block (8 bytes) into values of [0, 255].
+void decode_bc4_block(const uint8_t* p_block, float (&out)[16])
+{
+	const float r0 = p_block[0];
+	const float r1 = p_block[1];
+	float palette[8] = { r0, r1 };
+	if (r0 > r1) {
+		for (uint32_t i = 1; i < 7; ++i) palette[i + 1] = ((7 - i) * r0 + i * r1) / 7.0f;
+	}
+	else {
+		for (uint32_t i = 1; i < 5; ++i) palette[i + 1] = ((5 - i) * r0 + i * r1) / 5.0f;
+		palette[6] = 0.0f;
+		palette[7] = 255.0f;
+	}
+
+	block_reader reader(p_block + 2);
+	for (float& v : out) v = palette[reader.read(3)];
+}
+
+// Decodes a bc6h_uf16 mode 11 block into half float bit patterns (rgb).
+void decode_bc6h_block(const uint8_t* p_block, uint16_t (&out)[16][3])
+{
+	block_reader reader(p_block);
+	ENFORCE(reader.read(5) == 0x03, "Unexpected bc6h block mode.");
+
+	uint32_t endpoints[2][3];
+	for (auto& e : endpoints) {
+		for (uint32_t& c : e) {
+			const uint32_t q = reader.read(10);
+			// unquantize 10-bit unsigned endpoints
+			c = (q == 0) ? 0 : ((q == 1023) ? 0xffff : (((q << 16) + 0x8000) >> 10));
+		}
+	}
+
+	for (uint32_t i = 0; i < 16; ++i) {
+		const uint32_t w = c_bc_weights[reader.read((i == 0) ? 3 : 4)];
+		for (uint32_t c = 0; c < 3; ++c)
+			out[i][c] = uint16_t(((((64 - w) * endpoints[0][c] + w * endpoints[1][c] + 32) >> 6) * 31) >> 6);
+	}
+}
+
+// Decodes a bc7 mode 6 block into rgba values.
+void decode_bc7_block(const uint8_t* p_block, uint8_t (&out)[16][4])
+{
+	block_reader reader(p_block);
+	ENFORCE(reader.read(7) == 0x40, "Unexpected bc7 block mode.");
+
+	uint32_t endpoints[2][4];
+	for (uint32_t c = 0; c < 4; ++c) {
+		endpoints[0][c] = reader.read(7) << 1;
+		endpoints[1][c] = reader.read(7) << 1;
+	}
+	for (auto& e : endpoints) {
+		const uint32_t p_bit = reader.read(1);
+		for (uint32_t& c : e) c |= p_bit;
+	}
+
+	for (uint32_t i = 0; i < 16; ++i) {
+		const uint32_t w = c_bc_weights[reader.read((i == 0) ? 3 : 4)];
+		for (uint32_t c = 0; c < 4; ++c)
+			out[i][c] = uint8_t(((64 - w) * endpoints[0][c] + w * endpoints[1][c] + 32) >> 6);
+	}
+}
+
+// Calls func(slice, p_block, block_x, block_y) for each 16-byte block of the compressed texture (1 mipmap).
+template<typename Func>
+void for_each_block(const texture_data& compressed, Func func)
+{
+	const uint32_t width = compressed.size.x;
+	const uint32_t height = compressed.size.y;
+	const uint32_t block_count_x = (width + 3) / 4;
+	const uint32_t block_count_y = (height + 3) / 4;
+	const size_t slice_bc = byte_count(compressed.size, 0, compressed.format);
+
+	for (uint32_t a = 0; a < compressed.array_size; ++a) {
+		for (uint32_t by = 0; by < block_count_y; ++by) {
+			for (uint32_t bx = 0; bx < block_count_x; ++bx) {
+				const uint8_t* p_block = compressed.buffer.data() + a * slice_bc + (by * block_count_x + bx) * 16;
+				func(a, p_block, bx, by);
+			}
+		}
+	}
+}
+
+// Compresses fixed images (sizes which are not multiples of 4, two array slices) with compress_texture
+// and decodes the blocks: errors must be within the measured bounds, constant blocks must be exact.
+std::string check_block_compression()
+{
+	const math::uint3 size(14, 10, 1);
+	const size_t pixel_count = size_t(size.x) * size.y;
+	uint32_t state = 3;
+	auto noise = [&state](float amplitude) { return next_signed_unit(state) * amplitude; };
+	auto to_unorm8 = [](float v) { return uint8_t(std::min(255.0f, std::max(0.0f, v + 0.5f))); };
+
+	// the top left block of slice 1 is constant: (77, 200) & (11, 201, 39, 255) are encoded exactly.
+	auto is_constant_block = [](uint32_t a, uint32_t x, uint32_t y) { return (a == 1) && (x < 4) && (y < 4); };
+
+	// bc5
+	texture_data rg(texture_type::texture_2d, size, 1, 2, pixel_format::rg_8);
+	for (uint32_t a = 0; a < 2; ++a) {
+		for (uint32_t y = 0; y < size.y; ++y) {
+			for (uint32_t x = 0; x < size.x; ++x) {
+				uint8_t* p = rg.buffer.data() + (a * pixel_count + y * size.x + x) * 2;
+				const bool constant = is_constant_block(a, x, y);
+				p[0] = constant ? 77 : to_unorm8(x * 16.0f + y * 3.0f + noise(6.0f));
+				p[1] = constant ? 200 : to_unorm8(255.0f - y * 20.0f - x * 2.0f + noise(6.0f));
+			}
+		}
+	}
+
+	const texture_data bc5 = compress_texture(rg, pixel_format::bc5);
+	ENFORCE(bc5.format == pixel_format::bc5 && bc5.array_size == 2 && bc5.buffer.size() == byte_count(bc5.type,
+		bc5.size, bc5.mipmap_count, bc5.array_size, bc5.format), "The bc5 texture has a wrong layout.");
+
+	float bc5_max_error = 0.0f;
+	for_each_block(bc5, [&](uint32_t a, const uint8_t* p_block, uint32_t bx, uint32_t by) {
+		float r[16], g[16];
+		decode_bc4_block(p_block, r);
+		decode_bc4_block(p_block + 8, g);
+		for (uint32_t i = 0; i < 16; ++i) {
+			const uint32_t x = bx * 4 + i % 4, y = by * 4 + i / 4;
+			if (x >= size.x || y >= size.y) continue;
+
+			const uint8_t* p = rg.buffer.data() + (a * pixel_count + y * size.x + x) * 2;
+			const float error = std::max(std::abs(r[i] - p[0]), std::abs(g[i] - p[1]));
+			ENFORCE(!is_constant_block(a, x, y) || error == 0.0f, "The constant bc5 block is not exact.");
+			bc5_max_error = std::max(bc5_max_error, error);
+		}
+	});
+	ENFORCE(bc5_max_error <= c_max_bc5_error, "The bc5 max error is ", bc5_max_error);
+
+	// bc6h: values in [0.05, 16] on a log scale.
+	texture_data hdr(texture_type::texture_2d, size, 1, 2, pixel_format::rgba_16f);
+	for (uint32_t a = 0; a < 2; ++a) {
+		for (uint32_t y = 0; y < size.y; ++y) {
+			for (uint32_t x = 0; x < size.x; ++x) {
+				uint16_t* p = reinterpret_cast<uint16_t*>(hdr.buffer.data()) + (a * pixel_count + y * size.x + x) * 4;
+				const float t = float(x + y) / float(size.x + size.y - 2);
+				const float base = 0.05f * std::pow(320.0f, t);
+				p[0] = float_to_half(base * (1.0f + noise(0.01f)));
+				p[1] = float_to_half(base * 0.5f * (1.0f + noise(0.01f)));
+				p[2] = float_to_half(base * (0.25f + 0.5f * float(a)) * (1.0f + noise(0.01f)));
+				p[3] = float_to_half(1.0f);
+			}
+		}
+	}
+
+	const texture_data bc6h = compress_texture(hdr, pixel_format::bc6h_uf16);
+	double bc6h_error_sum = 0.0;
+	double bc6h_max_error = 0.0;
+	size_t bc6h_value_count = 0;
+	for_each_block(bc6h, [&](uint32_t a, const uint8_t* p_block, uint32_t bx, uint32_t by) {
+		uint16_t values[16][3];
+		decode_bc6h_block(p_block, values);
+		for (uint32_t i = 0; i < 16; ++i) {
+			const uint32_t x = bx * 4 + i % 4, y = by * 4 + i / 4;
+			if (x >= size.x || y >= size.y) continue;
+
+			const uint16_t* p = reinterpret_cast<const uint16_t*>(hdr.buffer.data()) + (a * pixel_count + y * size.x + x) * 4;
+			for (uint32_t c = 0; c < 3; ++c) {
+				const double src = half_to_float(p[c]);
+				const double error = std::abs(double(half_to_float(values[i][c])) - src) / src;
+				bc6h_error_sum += error;
+				bc6h_max_error = std::max(bc6h_max_error, error);
+				++bc6h_value_count;
+			}
+		}
+	});
+	const double bc6h_mean_error = bc6h_error_sum / double(bc6h_value_count);
+	ENFORCE(bc6h_mean_error <= c_max_bc6h_mean_error && bc6h_max_error <= c_max_bc6h_error,
+		"The bc6h relative errors are: mean ", bc6h_mean_error, ", max ", bc6h_max_error);
+
+	// bc7
+	texture_data rgba(texture_type::texture_2d, size, 1, 2, pixel_format::rgba_8);
+	for (uint32_t a = 0; a < 2; ++a) {
+		for (uint32_t y = 0; y < size.y; ++y) {
+			for (uint32_t x = 0; x < size.x; ++x) {
+				uint8_t* p = rgba.buffer.data() + (a * pixel_count + y * size.x + x) * 4;
+				const uint8_t constant[4] = { 11, 201, 39, 255 };
+				const float t = float(x + y);
+				const float v[4] = { t * 11.0f + noise(2.0f), 40.0f + t * 7.0f + noise(2.0f),
+					230.0f - t * 9.0f + noise(2.0f), 255.0f - t * 3.0f };
+				for (uint32_t c = 0; c < 4; ++c)
+					p[c] = is_constant_block(a, x, y) ? constant[c] : to_unorm8(v[c]);
+			}
+		}
+	}
+
+	const texture_data bc7 = compress_texture(rgba, pixel_format::bc7);
+	double bc7_error_sum = 0.0;
+	float bc7_max_error = 0.0f;
+	size_t bc7_value_count = 0;
+	for_each_block(bc7, [&](uint32_t a, const uint8_t* p_block, uint32_t bx, uint32_t by) {
+		uint8_t values[16][4];
+		decode_bc7_block(p_block, values);
+		for (uint32_t i = 0; i < 16; ++i) {
+			const uint32_t x = bx * 4 + i % 4, y = by * 4 + i / 4;
+			if (x >= size.x || y >= size.y) continue;
+
+			const uint8_t* p = rgba.buffer.data() + (a * pixel_count + y * size.x + x) * 4;
+			for (uint32_t c = 0; c < 4; ++c) {
+				const float error = std::abs(float(values[i][c]) - float(p[c]));
+				ENFORCE(!is_constant_block(a, x, y) || error == 0.0f, "The constant bc7 block is not exact.");
+				bc7_error_sum += double(error) * error;
+				bc7_max_error = std::max(bc7_max_error, error);
+				++bc7_value_count;
+			}
+		}
+	});
+	const double bc7_rms_error = std::sqrt(bc7_error_sum / double(bc7_value_count));
+	ENFORCE(bc7_rms_error <= c_max_bc7_rms_error && bc7_max_error <= c_max_bc7_error,
+		"The bc7 errors are: rms ", bc7_rms_error, ", max ", bc7_max_error);
+
+	return concat("block compression: bc5 max error ", bc5_max_error, ", bc6h mean & max relative errors ",
+		bc6h_mean_error, " ", bc6h_max_error, ", bc7 rms & max errors ", bc7_rms_error, " ", bc7_max_error);
+}
+
+// ----- welding -----
+
+using position_bits = std::array<uint32_t, 3>;
+
+position_bits get_position_bits(const float3& p) noexcept
+{
+	position_bits bits;
+	std::memcpy(bits.data(), &p.x, sizeof(float));
+	std::memcpy(bits.data() + 1, &p.y, sizeof(float));
+	std::memcpy(bits.data() + 2, &p.z, sizeof(float));
+	return bits;
+}
+
+// Each triangle is the sorted bits of its positions, the triangles are sorted too.
+std::vector<std::array<position_bits, 3>> get_triangle_set(const mesh_geometry<vertex_attribs::p_n_uv_ts>& mesh)
+{
+	std::vector<std::array<position_bits, 3>> triangles;
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+		std::array<position_bits, 3> t = { get_position_bits(mesh.vertices[mesh.indices[i]].position),
+			get_position_bits(mesh.vertices[mesh.indices[i + 1]].position),
+			get_position_bits(mesh.vertices[mesh.indices[i + 2]].position) };
+		std::sort(t.begin(), t.end());
+		triangles.push_back(t);
+	}
+
+	std::sort(triangles.begin(), triangles.end());
+	return triangles;
+}
+
+float make_nan(uint32_t bits) noexcept
+{
+	assert(((bits & 0x7f800000) == 0x7f800000) && (bits & 0x007fffff));
+
+	float v;
+	std::memcpy(&v, &bits, sizeof(v));
+	return v;
+}
+
+// NaNs (whatever their payloads & signs) weld with each other, -0.0 welds with 0.0 (exact & quantized keys).
+// build_meshlets keeps all the triangles of a mesh with NaN positions.
+std::string check_nan_welding()
+{
+	const float nans[3] = { std::numeric_limits<float>::quiet_NaN(), make_nan(0x7fc01234), make_nan(0xffc00000) };
+	const float3 positions[9] = {
+		float3(nans[0], 1.0f, 2.0f), float3(nans[1], 1.0f, 2.0f), float3(nans[2], 1.0f, 2.0f),
+		float3(-0.0f, 0.0f, 5.0f), float3(0.0f, 0.0f, 5.0f), float3(0.0f, -0.0f, 5.0f),
+		float3(1.0f, 2.0f, 3.0f), float3(1.0f, 2.0f, 3.0f), float3(3.0f, 2.0f, 1.0f)
+	};
+	// the vertices are ordered by their first reference.
+	const uint32_t expected_indices[9] = { 0, 0, 0, 1, 1, 1, 2, 2, 3 };
+
+	mesh_geometry<vertex_attribs::p_n_uv_ts> mesh(9, 9);
+	for (uint32_t i = 0; i < 9; ++i) {
+		mesh.vertices[i] = vertex_t(positions[i], float3::unit_z, math::float2(), 0);
+		mesh.indices[i] = i;
+	}
+
+	for (float epsilon : { 0.0f, 1e-3f }) {
+		const mesh_geometry<vertex_attribs::p_n_uv_ts> welded = weld_vertices(mesh, { epsilon });
+		ENFORCE(welded.vertices.size() == 4 && welded.indices.size() == 9
+			&& std::equal(welded.indices.begin(), welded.indices.end(), expected_indices),
+			"Welding with epsilon ", epsilon, " gives ", welded.vertices.size(), " vertices, expected 4.");
+	}
+
+	// every 5th vertex of the plane gets a distinct NaN.
+	mesh_geometry<vertex_attribs::p_n_uv_ts> plane = make_plane_mesh(8);
+	for (uint32_t i = 0; i < plane.vertices.size(); i += 5)
+		plane.vertices[i].position.x = make_nan(0x7fc00000 | (i + 1));
+
+	const std::vector<std::array<position_bits, 3>> triangles = get_triangle_set(plane);
+	build_meshlets(plane);
+
+	uint32_t next_index = 0;
+	for (const meshlet& m : plane.meshlets) {
+		ENFORCE(m.first_index == next_index, "The meshlets do not cover the index buffer.");
+		next_index += m.index_count;
+	}
+	ENFORCE(next_index == plane.indices.size() && get_triangle_set(plane) == triangles,
+		"build_meshlets has changed the triangles of a mesh with NaN positions.");
+
+	return concat("nan welding: ", std::size(positions), " vertices weld into 4, ", plane.meshlets.size(),
+		" meshlets of a plane with NaN positions");
+}
+
+// ----- bvh -----
+
+// Möller-Trumbore, both sides of the triangle. Returns the distance in units of the ray direction or -1.
+float intersect_triangle(const ray& r, const float3& p0, const float3& p1, const float3& p2) noexcept
+{
+	const float3 e1 = p1 - p0;
+	const float3 e2 = p2 - p0;
+	const float3 pv = math::cross(r.direction, e2);
+	const float det = math::dot(e1, pv);
+	if (std::abs(det) < 1e-12f) return -1.0f;
+
+	const float inv_det = 1.0f / det;
+	const float3 tv = r.origin - p0;
+	const float u = math::dot(tv, pv) * inv_det;
+	if (u < 0.0f || u > 1.0f) return -1.0f;
+
+	const float3 qv = math::cross(tv, e1);
+	const float v = math::dot(r.direction, qv) * inv_det;
+	if (v < 0.0f || u + v > 1.0f) return -1.0f;
+
+	return math::dot(e2, qv) * inv_det;
+}
+
+// Casts rays at points inside the triangles of a sphere from outside & rays which point away from it:
+// mesh_bvh::raycast must find the closest hit of the brute force search, intersects must agree.
+std::string check_bvh()
+{
+	const mesh_geometry<vertex_attribs::p_n_uv_ts> sphere = make_sphere_mesh(32, 64);
+	const mesh_bvh bvh(span<const vertex_t>(sphere.vertices.data(), sphere.vertices.size()),
+		span<const uint32_t>(sphere.indices.data(), sphere.indices.size()));
+	const size_t triangle_count = sphere.indices.size() / 3;
+	ENFORCE(bvh.triangle_count() == triangle_count, "The bvh has ", bvh.triangle_count(), " triangles.");
+
+	const uint32_t ray_count = 256;
+	uint32_t state = 5;
+	float max_error = 0.0f;
+	for (uint32_t i = 0; i < ray_count; ++i) {
+		const float3 dir = math::normalize(float3(next_signed_unit(state), next_signed_unit(state),
+			next_signed_unit(state)) + float3(0.01f));
+		const size_t t = size_t((next_signed_unit(state) * 0.5f + 0.5f) * float(triangle_count - 1));
+		const float u = 0.1f + 0.35f * (next_signed_unit(state) * 0.5f + 0.5f);
+		const float v = 0.1f + 0.35f * (next_signed_unit(state) * 0.5f + 0.5f);
+		const float3& p0 = sphere.vertices[sphere.indices[t * 3]].position;
+		const float3& p1 = sphere.vertices[sphere.indices[t * 3 + 1]].position;
+		const float3& p2 = sphere.vertices[sphere.indices[t * 3 + 2]].position;
+		const float3 target = p0 * (1.0f - u - v) + p1 * u + p2 * v;
+
+		// the origin is outside the sphere, the target is at the distance 1.
+		const float3 origin = target * 3.0f + dir * 0.5f;
+		const ray r = { origin, target - origin };
+		float expected = std::numeric_limits<float>::max();
+		for (size_t k = 0; k < triangle_count; ++k) {
+			const float d = intersect_triangle(r, sphere.vertices[sphere.indices[k * 3]].position,
+				sphere.vertices[sphere.indices[k * 3 + 1]].position, sphere.vertices[sphere.indices[k * 3 + 2]].position);
+			if (d >= 0.0f) expected = std::min(expected, d);
+		}
+		ENFORCE(expected <= 1.0f + 1e-4f, "The brute force search misses the ray ", i);
+
+		ray_hit hit;
+		ENFORCE(bvh.raycast(r, 2.0f, hit), "The ray ", i, " misses the sphere.");
+		ENFORCE(bvh.intersects(r, 2.0f), "intersects disagrees with raycast, ray ", i);
+		const float error = std::abs(hit.distance - expected);
+		ENFORCE(error <= 1e-4f, "The ray ", i, " hits at ", hit.distance, ", expected ", expected);
+		max_error = std::max(max_error, error);
+
+		ray_hit no_hit;
+		ENFORCE(!bvh.raycast(r, expected * 0.5f, no_hit) && !bvh.intersects(r, expected * 0.5f),
+			"The ray ", i, " hits within the half of the distance to the closest triangle.");
+
+		const ray away = { origin, origin - target };
+		ENFORCE(!bvh.raycast(away, 100.0f, no_hit) && !bvh.intersects(away, 100.0f),
+			"The ray ", i, " which points away from the sphere hits it.");
+	}
+
+	return concat("bvh: ", triangle_count, " triangles, ", bvh.node_count(), " nodes, ", ray_count,
+		" rays, max distance error ", max_error);
+}
+
+void run_check(self_check_report& report, const char* p_name, const check_func_t& func)
+{
+	try {
+		report.notes.push_back(func());
+		++report.passed_count;
+	}
+	catch (const std::exception& e) {
+		report.error_messages.push_back(concat(p_name, ":\n", make_exception_message(e)));
+		++report.failed_count;
+	}
+}
+
+} // namespace
+
+
+namespace sparki {
+namespace assetc {
+
+self_check_report run_self_checks(const std::string& data_dirname)
+{
+	self_check_report report;
+	run_check(report, "frustum culling", check_frustum_culling);
+	run_check(report, "meshlet culling", check_meshlet_culling);
+	run_check(report, "mesh streams transform", check_mesh_streams_transform);
+	run_check(report, "envmaps", [&data_dirname] { return check_envmaps(data_dirname); });
+	run_check(report, "geo round trip", [&data_dirname] { return check_geo_round_trip(data_dirname); });
+	run_check(report, "texture layout", [&data_dirname] { return check_texture_layout(data_dirname); });
+	run_check(report, "block compression", check_block_compression);
+	run_check(report, "nan welding", check_nan_welding);
+	run_check(report, "bvh", check_bvh);
+	return report;
+}
+
+} // namespace assetc
+} // namespace sparki
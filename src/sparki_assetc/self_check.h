@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+namespace sparki {
+namespace assetc {
+
+struct self_check_report final {
+	size_t						passed_count = 0;
+	size_t						failed_count = 0;
+	std::vector<std::string>	notes;
+	std::vector<std::string>	error_messages;
+};
+
+// Runs the checks of the numerical code which the asset pipeline & the renderer rely on
+// (culling, vertex stream kernels, envmap baking) against reference results, and round trips fixed inputs through
+// the .geo & .tex formats, the block compression encoders, vertex welding & mesh_bvh with exact or bounded errors.
+// The checks which need data files read them from the data directory,
+// the temporary files are written into its build subdirectory (asset_compiler::c_build_dirname).
+// Command line: sparki_assetc [data directory] --self-check
+self_check_report run_self_checks(const std::string& data_dirname);
+
+} // namespace assetc
+} // namespace sparki